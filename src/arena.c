@@ -0,0 +1,47 @@
+#include <stdlib.h>
+#include "arena.h"
+#include "matrix.h"
+#include "user_io.h"
+
+size_t arena_size (size_t bytes)
+{
+    return (bytes + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+}
+
+bool arena_reset (struct arena *a, size_t bytes)
+{
+    a->used = 0;
+    if (bytes <= a->size)
+        return true;
+
+    /* Nothing in it is kept, so there's no need to copy it over. Growing
+     * at least twofold keeps slowly growing work from reallocating often. */
+    size_t size = a->size * 2 > bytes ? a->size * 2 : bytes;
+    free(a->base);
+    a->size = 0;
+    if (posix_memalign((void **) &a->base, MATRIX_ALIGN, size) != 0) {
+        a->base = NULL;
+        report_error("Could not allocate %zu bytes of arena", size);
+        return false;
+    }
+    a->size = size;
+    return true;
+}
+
+void *arena_alloc (struct arena *a, size_t bytes)
+{
+    bytes = arena_size(bytes);
+    if (bytes > a->size - a->used)
+        return NULL;
+    void *p = a->base + a->used;
+    a->used += bytes;
+    return p;
+}
+
+void arena_free (struct arena *a)
+{
+    free(a->base);
+    a->base = NULL;
+    a->size = 0;
+    a->used = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A block of memory handed out in pieces and taken back all at once.
+ *
+ * Everything a piece of work needs is reserved up front, then allocated
+ * from the arena, and the whole arena is reset for the next piece of work.
+ * The block only grows when some piece of work needs more than any before
+ * it, so work of a steady size never calls malloc.
+ */
+struct arena {
+    char *base;  // the block, MATRIX_ALIGN aligned
+    size_t size; // its length in bytes
+    size_t used; // bytes handed out since the last reset
+};
+
+/* Take back everything handed out, and make sure the arena has room for
+ * bytes more, counting the padding arena_alloc adds.
+ *
+ * pre:  a is zeroed or was used before, and nothing from it is in use
+ * post: returns true with the arena empty and at least bytes long, false
+ *       after reporting an error
+ */
+bool arena_reset (struct arena *a, size_t bytes);
+
+/* Hand out a piece of the arena, aligned to MATRIX_ALIGN.
+ *
+ * pre:  a was reset with room for this piece and those before it
+ * post: returns the piece, or NULL if the arena doesn't have room
+ */
+void *arena_alloc (struct arena *a, size_t bytes);
+
+/* Round a size up to what arena_alloc takes for it, for arena_reset */
+size_t arena_size (size_t bytes);
+
+/* Free an arena's block.
+ *
+ * pre:  a is zeroed or was used before
+ * post: a is zeroed again, and may be used again
+ */
+void arena_free (struct arena *a);
+
+#endif
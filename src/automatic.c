@@ -1,84 +1,323 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include "user_io.h"
 #include "matrix_proc.h"
+#include "automatic.h"
+#include "blocked.h"
+#include "pool.h"
+#include "small.h"
+#include "stats.h"
 
-bool auto_echelon (int nrows, int ncols, double matrix[nrows][ncols]) {
+int lead_after_add (const struct matrix *matrix, int row, int lead, int col,
+        double scalar, bool finite, int to) {
+    if (!finite || !isfinite(scalar)) {
+        /* 0 * inf is NaN, so the row may have changed anywhere */
+        return leading_between(row, 0, to, matrix);
+    } else if (lead == col) {
+        return leading_between(row, col, to, matrix);
+    }
+    /* Left of col the pivot row is all zeroes, and if the row leads right
+     * of col then scalar is 0, so either way its leading entry stays put */
+    return lead;
+}
+
+/* A row operation shared out among the threads of the pool: add a multiple
+ * of the pivot row to each row in a range, to cancel out the pivot column */
+struct cancel_rows {
+    struct matrix *matrix;
+    int pivot_row;
+    int first_row; // item 0 of the loop
+    int lead;
+    bool divide;   // divide by the pivot, which isn't necessarily 1
+    int *leads;    // leading columns to keep up to date, or NULL
+    bool finite;   // whether the pivot row is all finite
+    bool above;    // also the rows above the pivot, skipping over it
+};
+
+/* The row that item of a cancel_rows loop stands for */
+static inline int cancel_row (const struct cancel_rows *c, int item)
+{
+    int k = c->first_row + item;
+    return c->above && k >= c->pivot_row ? k + 1 : k;
+}
+
+static void cancel_task (void *arg, int begin, int end)
+{
+    struct cancel_rows *c = arg;
+    struct matrix *matrix = c->matrix;
+    double pivot = MAT(matrix, c->pivot_row, c->lead);
+    for (int item = begin; item < end; item++) {
+        int k = cancel_row(c, item);
+        /* Rows above a pivot are done with, so like the reduced echelon
+         * form they skip what wouldn't change them */
+        bool skip_zero = c->divide || k < c->pivot_row;
+        double temp = c->divide ? -1 * MAT(matrix, k, c->lead) / pivot
+                                : -1 * MAT(matrix, k, c->lead);
+        /* The pivot row is all zeroes left of its pivot, but 0 * inf is
+         * not 0 */
+        if ((temp != 0 || !skip_zero) && isfinite(temp))
+            add_scaled_from(k, c->pivot_row, temp, c->lead, matrix);
+        else if (temp != 0 || !skip_zero)
+            add_scaled(k, c->pivot_row, temp, matrix);
+        if (c->leads != NULL && (k > c->pivot_row || c->divide))
+            c->leads[k] = lead_after_add(matrix, k, c->leads[k], c->lead, temp,
+                                         c->finite, matrix->ncols);
+    }
+}
+
+int echelon_step (struct matrix *matrix, int *leads, int i, int last_leading,
+        bool above, enum trace_mode trace) {
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+
+    /* Make a best-effort attempt to get the leading value *just*
+     * one column right from the previous one. A row of zeroes has no
+     * leading value, so it counts as leading past the last column. */
+    int desired_leading = last_leading + 1;
+    int current_leading = leads[i];
+    int64_t start = stats_start();
+    if (current_leading != desired_leading) {
+        /* Search for another row that DOES have the desired leading value */
+        for (int k = i+1; k < nrows; k++) {
+            int k_leading = leads[k];
+            if (k_leading < current_leading) {
+                swap_rows(i, k, matrix);
+                leads[k] = current_leading;
+                leads[i] = k_leading;
+                trace_swap(trace, i, k, matrix);
+                current_leading = k_leading;
+                // stop if we get a perfect match early
+                if (k_leading == desired_leading)
+                    break;
+            }
+        }
+    }
+
+    stats_stop(PHASE_PIVOT_SEARCH, start);
+
+    /* If we tried and failed to swap, raise an error. 
+     * This shouldn't happen, because a column of all zeroes is redundant */
+    if (current_leading == ncols) {
+        return STEP_DONE; // only rows of zeroes are left
+    } else if (current_leading < last_leading) {
+        return STEP_FAIL;
+    }
+
+    /* Now, try to scale the row so that the leading value is 1 */
+    start = stats_start();
+    if (MAT(matrix, i, current_leading) != 1) {
+        double temp = MAT(matrix, i, current_leading);
+        scale_pivot(i, current_leading, matrix);
+        trace_scale(trace, i, temp, matrix);
+    }
+
+    /* Use the newly scaled problem to cancel out that position elsewhere */
+    struct cancel_rows c = { matrix, i, above ? 0 : i+1, current_leading, false,
+                             leads, row_finite(i, matrix), above };
+    int count = above ? nrows - 1 : nrows - (i+1);
+    if (trace == TRACE_FULL) {
+        for (int item = 0; item < count; item++) {
+            int k = cancel_row(&c, item);
+            double temp = -1 * MAT(matrix, k, current_leading);
+            cancel_task(&c, item, item + 1);
+            if (temp != 0 || k > i)
+                trace_add(trace, k, temp, i, matrix);
+        }
+    } else {
+        /* Without the matrix to show in between, the other rows can be
+         * done in any order, so report them first and share them out */
+        for (int item = 0; item < count && tracing(trace); item++) {
+            int k = cancel_row(&c, item);
+            double temp = -1 * MAT(matrix, k, current_leading);
+            if (temp != 0 || k > i)
+                trace_add(trace, k, temp, i, matrix);
+        }
+        pool_for(cancel_task, &c, count, matrix->ncols);
+    }
+    stats_stop(PHASE_ROW_UPDATES, start);
+    return current_leading;
+}
+
+bool workspace_reserve (struct workspace *ws, int nrows, bool panel) {
+    if (ws->rows < nrows) {
+        int *leads = realloc(ws->leads, nrows * sizeof(int));
+        if (leads == NULL) {
+            report_error("Could not allocate the leading column list.");
+            return false;
+        }
+        ws->leads = leads;
+        ws->rows = nrows;
+    }
+    if (panel && ws->panel_rows < nrows) {
+        /* Nothing in it is kept, so there's no need to copy it over */
+        free(ws->panel);
+        ws->panel = malloc((size_t) nrows * PANEL_COLS * sizeof(double));
+        ws->panel_rows = ws->panel != NULL ? nrows : 0;
+        if (ws->panel == NULL) {
+            report_error("Could not allocate the panel workspace.");
+            return false;
+        }
+    }
+    return true;
+}
+
+void workspace_free (struct workspace *ws) {
+    free(ws->leads);
+    free(ws->panel);
+    *ws = (struct workspace) { 0 };
+}
+
+void leading_columns (const struct matrix *matrix, int *leads) {
+    for (int i = 0; i < matrix->nrows; i++) {
+        leads[i] = leading_pos(i, matrix);
+        if (leads[i] == -1)
+            leads[i] = matrix->ncols;
+    }
+}
+
+/* Whether to hand a matrix to the routines written out for its size. They
+ * do the same operations, but don't trace, record or count them. */
+static bool small_worthwhile (const struct matrix *matrix, enum trace_mode trace) {
+    return small_fits(matrix) && !tracing(trace) && !stats_enabled;
+}
+
+bool auto_echelon (struct matrix *matrix, enum trace_mode trace) {
+    struct workspace ws = { 0 };
+    bool success = auto_echelon_with(matrix, trace, &ws);
+    workspace_free(&ws);
+    return success;
+}
+
+bool auto_echelon_with (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws) {
     bool success = false;
+    int nrows = matrix->nrows;
     int last_leading = -1; /* start off with an invalid leading pos */
 
+    /* Big matrices go through the blocked engine, which does the same
+     * operations in a cache friendly order, but can't show the matrix
+     * in between them */
+    if (trace != TRACE_FULL && blocked_worthwhile(matrix))
+        return blocked_echelon(matrix, trace, ws);
+    if (small_worthwhile(matrix, trace))
+        return small_solve(matrix, SMALL_ECHELON);
+
+    if (!workspace_reserve(ws, nrows, false))
+        return success;
+    int *leads = ws->leads;
+    leading_columns(matrix, leads);
+
     /* Go from a matrix to its echelon form */
     for (int i = 0; i < nrows; i++) {
-        /* Make a best-effort attempt to get the leading value *just*
-         * one column right from the previous one */
-        int desired_leading = last_leading + 1;
-        int current_leading = leading_pos(i, nrows, ncols, matrix);
-        if (current_leading != desired_leading) {
-            /* Search for another row that DOES have the desired leading value */
-            for (int k = i+1; k < nrows; k++) {
-                int k_leading = leading_pos(k, nrows, ncols, matrix);
-                if (k_leading < current_leading) {
-                    printf("swap R%d <--> R%d\n", i+1, k+1);
-                    swap_rows(i, k, nrows, ncols, matrix);
-                    print_matrix(nrows, ncols, matrix);
-                    current_leading = k_leading;
-                    // stop if we get a perfect match early
-                    if (k_leading == desired_leading)
-                        break;
-                }
-            }
-        }
-
-        /* If we tried and failed to swap, raise an error. 
-         * This shouldn't happen, because a column of all zeroes is redundant */
-        if (current_leading == -1) {
-            continue; // if no leading value, we better not try more stuff
-        } else if (current_leading < last_leading) {
-            fprintf(stderr, "Could not find a row to swap with.\n");
+        int lead = echelon_step(matrix, leads, i, last_leading, false, trace);
+        if (lead == STEP_DONE) {
+            break;
+        } else if (lead == STEP_FAIL) {
+            report_error("Could not find a row to swap with.");
             return success;
         }
+        last_leading = lead; // Update the most recent leading position
+    }
+    success = true;
+    return success;
+}
 
-        /* Now, try to scale the row so that the leading value is 1 */
-        if (matrix[i][current_leading] != 1) {
-            double temp = matrix[i][current_leading];
-            printf("scale (1/%.2lf) * R%d\n", temp, i+1);
-            scale_row(i, 1/temp, nrows, ncols, matrix);
-            print_matrix(nrows, ncols, matrix);
-        }
+bool auto_gauss_jordan (struct matrix *matrix, enum trace_mode trace) {
+    struct workspace ws = { 0 };
+    bool success = auto_gauss_jordan_with(matrix, trace, &ws);
+    workspace_free(&ws);
+    return success;
+}
 
-        /* Use the newly scaled problem to cancel out that position elsewhere */
-        for (int k = i+1; k < nrows; k++) {
-            double temp = -1 * matrix[k][current_leading];
-            printf("add R%d + (%.2lf * R%d)\n", k+1, temp, i+1);
-            add_scaled(k, i, temp, nrows, ncols, matrix);
-            print_matrix(nrows, ncols, matrix);
+bool auto_gauss_jordan_with (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws) {
+    bool success = false;
+    int nrows = matrix->nrows;
+    int last_leading = -1;
+
+    if (trace != TRACE_FULL && blocked_worthwhile(matrix))
+        return blocked_gauss_jordan(matrix, trace, ws);
+    if (small_worthwhile(matrix, trace))
+        return small_solve(matrix, SMALL_GAUSS_JORDAN);
+
+    if (!workspace_reserve(ws, nrows, false))
+        return success;
+    int *leads = ws->leads;
+    leading_columns(matrix, leads);
+
+    /* The same steps as auto_echelon, each one cancelling out its pivot
+     * column above as well as below */
+    for (int i = 0; i < nrows; i++) {
+        int lead = echelon_step(matrix, leads, i, last_leading, true, trace);
+        if (lead == STEP_DONE) {
+            break;
+        } else if (lead == STEP_FAIL) {
+            report_error("Could not find a row to swap with.");
+            return success;
         }
-        last_leading = current_leading; // Update the most recent leading position
+        last_leading = lead;
     }
     success = true;
     return success;
 }
 
-bool auto_reduced_echelon (int nrows, int ncols, double matrix[nrows][ncols]) {
+bool auto_reduced_echelon (struct matrix *matrix, enum trace_mode trace) {
+    struct workspace ws = { 0 };
+    bool success = auto_reduced_echelon_with(matrix, trace, &ws);
+    workspace_free(&ws);
+    return success;
+}
+
+bool auto_reduced_echelon_with (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws) {
     bool success = false;
-    /* Cancel out what you can in all the rows above */
+    int nrows = matrix->nrows;
+
+    if (trace != TRACE_FULL && blocked_reduce_worthwhile(matrix))
+        return blocked_reduced_echelon(matrix, trace, ws);
+    if (small_worthwhile(matrix, trace))
+        return small_solve(matrix, SMALL_REDUCED);
+
+    if (!workspace_reserve(ws, nrows, false))
+        return success;
+    int *leads = ws->leads;
+    int64_t start = stats_start();
+    leading_columns(matrix, leads);
+    stats_stop(PHASE_PIVOT_SEARCH, start);
+
+    /* Cancel out what you can in all the rows above. They lead left of
+     * row i, where it is all zeroes, so their leading columns stay put
+     * unless an infinite multiplier spreads NaNs there; whatever row i
+     * holds right of its pivot can't move them */
     for (int i = nrows-1; i >= 0; i--) {
-        /* Make sure the row has a leading value and find what it is */
-        /* TODO this is being calculated wront. why? */
-        int lead = leading_pos(i, nrows, ncols, matrix);
-        if (lead == -1)
+        int lead = leads[i];
+        if (lead == matrix->ncols)
             continue; // if there's no leading value there's no point to continue
-        
+
         /* Subtract from every previous row */
-        for (int k = i-1; k >= 0; k--) {
-            double temp = -1 * matrix[k][lead] / matrix[i][lead]; 
-            if (temp != 0) {
-                add_scaled(k, i, temp, nrows, ncols, matrix);
-                printf("add R%d + (%.2lf * R%d)\n", k+1, temp, i+1);
-                print_matrix(nrows, ncols, matrix);
+        start = stats_start();
+        if (trace == TRACE_FULL) {
+            for (int k = i-1; k >= 0; k--) {
+                double temp = -1 * MAT(matrix, k, lead) / MAT(matrix, i, lead); 
+                if (temp != 0) {
+                    add_scaled(k, i, temp, matrix);
+                    leads[k] = lead_after_add(matrix, k, leads[k], lead, temp,
+                                              true, matrix->ncols);
+                    trace_add(trace, k, temp, i, matrix);
+                }
+            }
+        } else {
+            for (int k = i-1; k >= 0 && tracing(trace); k--) {
+                double temp = -1 * MAT(matrix, k, lead) / MAT(matrix, i, lead);
+                if (temp != 0)
+                    trace_add(trace, k, temp, i, matrix);
             }
+            struct cancel_rows c = { matrix, i, 0, lead, true, leads, true };
+            pool_for(cancel_task, &c, i, matrix->ncols);
         }
+        stats_stop(PHASE_ROW_UPDATES, start);
     }
     success = true;
     return success;
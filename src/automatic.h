@@ -2,20 +2,125 @@
 #define __AUTOMATIC_H__
 
 #include <stdbool.h>
+#include "matrix.h"
+#include "user_io.h"
+
+/* Scratch space for the dense engines. A caller solving many matrices can
+ * keep one from each solve to the next, so that nothing is allocated once
+ * it has grown to the biggest matrix. Start it zeroed.
+ */
+struct workspace {
+    int rows;       // rows leads has room for
+    int *leads;     // leading column of each row
+    int panel_rows; // rows panel has room for
+    double *panel;  // PANEL_COLS multipliers per row, for the blocked engine
+};
+
+/* Make sure a workspace has room for a matrix.
+ *
+ * pre:  ws is zeroed or was used before, nrows > 0
+ * post: returns true if ws->leads has room for nrows entries and, if panel
+ *       is set, ws->panel for nrows rows; false after reporting an error
+ */
+bool workspace_reserve (struct workspace *ws, int nrows, bool panel);
+
+/* Free the buffers of a workspace.
+ *
+ * pre:  ws is zeroed or was used before
+ * post: ws is zeroed again, and may be used again
+ */
+void workspace_free (struct workspace *ws);
 
 /* Put a matrix into echelon form. Overwrites data.
  *
  * pre:  matrix is initialized 
+ *       trace says how much of each step to print
  * post: returns true if reached echelon form, false otherwise
  */
-bool auto_echelon (int nrows, int ncols, double matrix[nrows][ncols]);
+bool auto_echelon (struct matrix *matrix, enum trace_mode trace);
+
+/* Like auto_echelon, with scratch space kept by the caller.
+ *
+ * pre:  as for auto_echelon, ws is zeroed or was used before
+ * post: as for auto_echelon, ws may have grown
+ */
+bool auto_echelon_with (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws);
 
 /* Given a matrix in echelon form, reduce it by cancelling out 
  * values above where possible.
  *
  * pre:  matrix is initialized and already in echelon form
+ *       trace says how much of each step to print
  * post: returns true if reached reduced echelon form, false otherwise
  */
-bool auto_reduced_echelon (int nrows, int ncols, double matrix[nrows][ncols]);
+bool auto_reduced_echelon (struct matrix *matrix, enum trace_mode trace);
+
+/* Like auto_reduced_echelon, with scratch space kept by the caller.
+ *
+ * pre:  as for auto_reduced_echelon, ws is zeroed or was used before
+ * post: as for auto_reduced_echelon, ws may have grown
+ */
+bool auto_reduced_echelon_with (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws);
+
+/* Put a matrix straight into reduced echelon form, in one pass. Each
+ * pivot is scaled to 1 and its column is cancelled out above and below it
+ * in the same sweep, rather than going back up the rows afterwards. The
+ * pivots are the ones auto_echelon finds, and the result is the one
+ * auto_reduced_echelon gives, give or take rounding in the last place.
+ *
+ * pre:  matrix is initialized
+ *       trace says how much of each step to print
+ * post: returns true if reached reduced echelon form, false otherwise
+ */
+bool auto_gauss_jordan (struct matrix *matrix, enum trace_mode trace);
+
+/* Like auto_gauss_jordan, with scratch space kept by the caller.
+ *
+ * pre:  as for auto_gauss_jordan, ws is zeroed or was used before
+ * post: as for auto_gauss_jordan, ws may have grown
+ */
+bool auto_gauss_jordan_with (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws);
+
+/* What echelon_step returns when it doesn't find a pivot */
+#define STEP_DONE -1 // every row from this one down is all zeroes
+#define STEP_FAIL -2 // a leading entry was left of the previous pivot
+
+/* Do one step of auto_echelon: bring the row with the leftmost leading
+ * entry up to row i, scale it so that entry is 1, and cancel out the
+ * entries below it, and above it too if above is set.
+ *
+ * pre:  rows above i are in echelon form, the last pivot being in column
+ *       last_leading (-1 if there is none)
+ *       leads holds the leading column of rows i and below, as given by
+ *       leading_columns
+ * post: returns the column of the new pivot in row i, or STEP_DONE or
+ *       STEP_FAIL
+ *       leads is up to date for the rows below i
+ */
+int echelon_step (struct matrix *matrix, int *leads, int i, int last_leading,
+        bool above, enum trace_mode trace);
+
+/* Make a list of the leading column of every row, for echelon_step.
+ *
+ * pre:  matrix is initialized, leads has room for nrows entries
+ * post: leads holds the leading columns, ncols standing for a row of
+ *       zeroes
+ */
+void leading_columns (const struct matrix *matrix, int *leads);
+
+/* Work out where a row leads after adding scalar times a pivot row to it,
+ * without scanning it from the start.
+ *
+ * pre:  before the add, the row led in column lead (or at or past to if
+ *       nothing before to was nonzero)
+ *       the pivot row leads in column col < to
+ *       finite says whether the pivot row was all finite
+ * post: returns the new leading column, looking only before to, or to
+ */
+int lead_after_add (const struct matrix *matrix, int row, int lead, int col,
+        double scalar, bool finite, int to);
 
 #endif
@@ -0,0 +1,184 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "automatic.h"
+#include "batch.h"
+#include "lu.h"
+#include "matrix.h"
+#include "pool.h"
+#include "reader.h"
+#include "user_io.h"
+
+/* A place in the window for one matrix and its printed result, both kept
+ * from one window to the next */
+struct batch_slot {
+    struct matrix *matrix;
+    struct workspace ws; // the engines' scratch space, kept for the next window
+    struct lu_factors *factors; // the factors to solve with, or NULL
+    FILE *out;   // writes into text
+    char *text;  // the printed result, len bytes long once out is flushed
+    size_t len;
+    bool solved; // whether the matrix reached reduced echelon form
+};
+
+/* Read the size of the next matrix in the stream.
+ *
+ * pre:  in is open
+ * post: returns 1 and stores the size, 0 at the end of the stream, or -1
+ *       after reporting a bad size
+ */
+static int read_batch_size (struct reader *in, int *nrows, int *ncols)
+{
+    char *tok = reader_token(in);
+    if (tok == NULL)
+        return 0;
+    if (!parse_int(tok, nrows) || (tok = reader_token(in)) == NULL
+            || !parse_int(tok, ncols)) {
+        report_error("Failed to read the size of a matrix on line %ld. "
+                     "Make sure it was two integers.", in->line);
+        return -1;
+    }
+    if (*nrows <= 0 || *ncols <= 0) {
+        report_error("The matrix on line %ld must have at least one row "
+                     "and one column.", in->line);
+        return -1;
+    }
+    return 1;
+}
+
+/* Read the next matrix into a slot, reusing its storage if the size is
+ * the same.
+ *
+ * pre:  in is open, slot is zeroed or was filled before
+ * post: returns 1 once the matrix is in slot, 0 at the end of the stream,
+ *       or -1 after reporting an error
+ */
+static int read_slot (struct reader *in, struct batch_slot *slot)
+{
+    int nrows, ncols;
+    int status = read_batch_size(in, &nrows, &ncols);
+    if (status <= 0)
+        return status;
+
+    if (slot->matrix == NULL || slot->matrix->nrows != nrows
+            || slot->matrix->ncols != ncols) {
+        matrix_free(slot->matrix);
+        slot->matrix = matrix_create(nrows, ncols);
+        if (slot->matrix == NULL) {
+            report_error("Could not allocate a %d x %d matrix", nrows, ncols);
+            return -1;
+        }
+    }
+    if (slot->out == NULL) {
+        slot->out = open_memstream(&slot->text, &slot->len);
+        if (slot->out == NULL) {
+            report_error("open_memstream: %s", strerror(errno));
+            return -1;
+        }
+    }
+    return read_matrix(in, slot->matrix) ? 1 : -1;
+}
+
+/* Solve the matrices in a range of slots, shared out by pool_for */
+static void solve_task (void *arg, int begin, int end)
+{
+    struct batch_slot *slots = arg;
+    for (int k = begin; k < end; k++) {
+        struct batch_slot *slot = &slots[k];
+        // A singular A has no factors to solve with, so it is reduced
+        if (slot->factors != NULL && slot->factors->rank == slot->factors->n)
+            slot->solved = lu_solve(slot->factors, slot->matrix);
+        else
+            slot->solved = auto_echelon_with(slot->matrix, TRACE_QUIET, &slot->ws)
+                           && auto_reduced_echelon_with(slot->matrix, TRACE_QUIET,
+                                                        &slot->ws);
+        fseeko(slot->out, 0, SEEK_SET);
+        if (slot->solved)
+            fprint_matrix(slot->out, slot->matrix);
+        else // keep the place, so results still line up with the input
+            fprintf(slot->out, "No reduced echelon form found.\n\n");
+        fflush(slot->out);
+    }
+}
+
+bool batch_reduce (const char *path, struct lu_cache *cache)
+{
+    bool success = false;
+    struct reader in;
+    if (!reader_open(&in, path)) {
+        report_error("%s: %s", path, strerror(errno));
+        return success;
+    }
+    in.prompt = false; // nobody is there to answer
+    in.bulk = true;    // or reads the input after us
+
+    struct batch_slot *slots = calloc(BATCH_WINDOW, sizeof(struct batch_slot));
+    if (slots == NULL) {
+        report_error("Could not allocate the batch window.");
+        reader_close(&in);
+        return success;
+    }
+
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long total = 0;  // matrices read so far
+    long failed = 0; // of those, how many couldn't be reduced
+    int status = 1;
+    while (status > 0) {
+        /* Fill the window, noting the biggest matrix for pool_for */
+        int n = 0;
+        size_t cost = 1;
+        while (n < BATCH_WINDOW && (status = read_slot(&in, &slots[n])) > 0) {
+            struct matrix *m = slots[n++].matrix;
+            size_t work = (size_t) m->nrows * m->ncols * m->ncols;
+            if (work > cost)
+                cost = work;
+        }
+
+        /* The cache isn't shared between threads, so the factors are found
+         * beforehand. Any that can't be are reported, and those matrices
+         * eliminated instead. */
+        for (int k = 0; k < n && cache != NULL; k++) {
+            struct matrix *m = slots[k].matrix;
+            if (m->nrows <= m->ncols)
+                slots[k].factors = lu_cache_get(cache, m, m->nrows);
+        }
+
+        pool_for(solve_task, slots, n, cost);
+        for (int k = 0; k < n; k++) {
+            if (!slots[k].solved) {
+                report_error("Could not reduce matrix %ld.", total + k + 1);
+                failed++;
+            }
+            fwrite(slots[k].text, 1, slots[k].len, stdout);
+            lu_release(slots[k].factors);
+            slots[k].factors = NULL;
+        }
+        total += n;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    if (status == 0) {
+        double seconds = (stop.tv_sec - start.tv_sec)
+                         + (stop.tv_nsec - start.tv_nsec) / 1e9;
+        fprintf(stderr, "Reduced %ld matrices in %.3f s (%.0f matrices/s)\n",
+                total - failed, seconds, seconds > 0 ? total / seconds : 0.0);
+        if (cache != NULL)
+            fprintf(stderr, "Factored %ld coefficient matrices, reused %ld times\n",
+                    cache->misses, cache->hits);
+        success = failed == 0;
+    }
+
+    for (int k = 0; k < BATCH_WINDOW; k++) {
+        matrix_free(slots[k].matrix);
+        workspace_free(&slots[k].ws);
+        if (slots[k].out != NULL)
+            fclose(slots[k].out);
+        free(slots[k].text);
+    }
+    free(slots);
+    reader_close(&in);
+    return success;
+}
@@ -0,0 +1,41 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdbool.h>
+
+struct lu_cache; // see lu.h
+
+/* Reducing a stream of matrices without stopping to ask.
+ *
+ * The input is any number of matrices one after another, each written the
+ * usual way: its number of rows and columns, then its entries. They are
+ * read BATCH_WINDOW at a time and the matrices of each window are solved
+ * in parallel, spread across the worker pool, with each one's reduced
+ * echelon form written to a buffer of its own. The buffers are then
+ * printed in input order. They, the matrices and the engines' scratch
+ * space are all kept for the next window, so a stream of same-sized
+ * matrices allocates nothing after the first window.
+ *
+ * Given an lu_cache, each matrix [A | B] with A square is reduced with the
+ * factors of A instead, which are looked up or made one matrix at a time
+ * before the window is solved, so a stream of systems that share A only
+ * factors it once.
+ */
+
+/* Matrices read, solved and printed at a time */
+#define BATCH_WINDOW 1024
+
+/* Print the reduced echelon form of every matrix in a stream, then how
+ * many there were and how fast they went to stderr.
+ *
+ * pre:  path is a text file to read, or NULL for stdin; cache is the
+ *       factors to solve with, or NULL to eliminate; the pool and the
+ *       kernels may have been started
+ * post: returns true if every matrix was read and reduced. A matrix that
+ *       can't be reduced is reported and a note printed in its place, and
+ *       the rest go on; bad input is reported and stops the stream, after
+ *       printing the matrices before it.
+ */
+bool batch_reduce (const char *path, struct lu_cache *cache);
+
+#endif
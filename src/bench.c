@@ -0,0 +1,446 @@
+/* bench.c - Benchmarks for the elimination engines and row kernels
+ *
+ * Times auto_echelon, auto_reduced_echelon, auto_gauss_jordan, the sparse
+ * engine and the row operations in matrix_proc.c on reproducible random
+ * matrices, and prints one CSV line per benchmark so that runs can be
+ * compared by a script.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>     // getopt
+#include "automatic.h"
+#include "kernels.h"
+#include "matrix.h"
+#include "matrix_proc.h"
+#include "pool.h"
+#include "reader.h"
+#include "sparse.h"
+
+/* Sizes tried when none are given */
+static const int default_sizes[] = { 64, 128, 256, 512 };
+
+/* Most sizes that can be asked for at once */
+#define MAX_SIZES 32
+
+/* Row entries a kernel benchmark works through per repetition, split
+ * across however many calls that takes */
+#define KERNEL_ENTRIES (1 << 24)
+
+/* Fraction of entries that are nonzero in the sparse matrices */
+#define SPARSE_DENSITY 0.05
+
+/* The kinds of matrix to solve */
+enum kind {
+    KIND_DENSE,          // uniform entries in [-1, 1)
+    KIND_SPARSE,         // SPARSE_DENSITY of them nonzero, the rest zero
+    KIND_RANK_DEFICIENT, // small integers, the second half of the rows being
+                         // sums of rows from the first half
+    KIND_ILL_CONDITIONED, // the Hilbert matrix, 1 / (i + j + 1)
+    NKINDS,
+};
+
+static const char *kind_names[] = {
+    "dense", "sparse", "rank_deficient", "ill_conditioned",
+};
+
+/* Settings from the command line */
+struct options {
+    int sizes[MAX_SIZES];
+    int nsizes;
+    int reps;     // timed repetitions of every benchmark
+    int warmup;   // untimed repetitions before those
+    uint64_t seed;
+};
+
+/* One line of results. Operations are whole calls: one solve for the
+ * engines, one row operation for the kernels. */
+struct result {
+    const char *bench;
+    const char *kind;
+    int nrows, ncols;
+    double flops;  // nominal floating point operations per op
+    double bytes;  // nominal bytes read and written per op
+    double ns[64]; // nanoseconds per op, one per repetition
+    int reps;
+    bool ok;       // whether every repetition succeeded
+};
+
+/* ------------------------------------------------------------------------
+ * Reproducible random numbers
+ * --------------------------------------------------------------------- */
+
+/* SplitMix64, which is fast and good enough to fill test matrices */
+static uint64_t next_random (uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/* A double uniform in [0, 1) */
+static double next_uniform (uint64_t *state)
+{
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Fill a square matrix with one kind of entries.
+ *
+ * pre:  m is initialized and square, seed picks the sequence
+ * post: the same kind, size and seed always give the same matrix
+ */
+static void generate (struct matrix *m, enum kind kind, uint64_t seed)
+{
+    int n = m->nrows;
+    uint64_t state = seed ^ ((uint64_t) kind << 32) ^ (uint64_t) n;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            double x = 0;
+            switch (kind) {
+                case KIND_DENSE:
+                    x = 2 * next_uniform(&state) - 1;
+                    break;
+                case KIND_SPARSE:
+                    if (next_uniform(&state) < SPARSE_DENSITY)
+                        x = 2 * next_uniform(&state) - 1;
+                    break;
+                case KIND_RANK_DEFICIENT:
+                    if (i < (n + 1) / 2) {
+                        x = (double) (int) (next_random(&state) % 7) - 3;
+                    } else {
+                        int a = (int) (next_random(&state) % ((n + 1) / 2));
+                        x = MAT(m, a, j) + MAT(m, i - (n + 1) / 2, j);
+                    }
+                    break;
+                case KIND_ILL_CONDITIONED:
+                    x = 1.0 / (i + j + 1);
+                    break;
+                default:
+                    break;
+            }
+            MAT(m, i, j) = x;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------
+ * Timing
+ * --------------------------------------------------------------------- */
+
+static double now_ns (void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int compare_doubles (const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Print the header line of the CSV output */
+static void print_header (void)
+{
+    printf("bench,kind,rows,cols,kernels,threads,reps,status,"
+           "ns_per_op,min_ns_per_op,gflops,gbytes_per_s\n");
+}
+
+/* Print one result, using the median repetition for the rates.
+ *
+ * pre:  r->reps > 0
+ * post: r->ns is sorted
+ */
+static void print_result (struct result *r)
+{
+    qsort(r->ns, r->reps, sizeof(double), compare_doubles);
+    double median = r->reps % 2 ? r->ns[r->reps / 2]
+                                : (r->ns[r->reps / 2 - 1] + r->ns[r->reps / 2]) / 2;
+    printf("%s,%s,%d,%d,%s,%d,%d,%s,%.1f,%.1f,%.3f,%.3f\n",
+           r->bench, r->kind, r->nrows, r->ncols, kernels.name, pool_size(),
+           r->reps, r->ok ? "ok" : "failed", median, r->ns[0],
+           r->flops / median, r->bytes / median);
+    fflush(stdout);
+}
+
+/* ------------------------------------------------------------------------
+ * Engines
+ * --------------------------------------------------------------------- */
+
+/* Nominal cost of eliminating below and/or above every pivot of a full
+ * rank m x n matrix, one multiply-add per entry updated. Each one reads
+ * two doubles and writes one. */
+static void elimination_cost (int m, int n, bool below, bool above,
+        struct result *r)
+{
+    double updates = 0;
+    int p = m < n ? m : n;
+    for (int k = 0; k < p; k++)
+        updates += (double) ((below ? m - k - 1 : 0) + (above ? k : 0)) * (n - k);
+    r->flops = 2 * updates;
+    r->bytes = 24 * updates;
+}
+
+/* Which engine phase to time */
+enum phase {
+    PHASE_ECHELON,
+    PHASE_REDUCED,
+    PHASE_TWO_PASS,     // echelon then reduced, timed together
+    PHASE_GAUSS_JORDAN, // the same result in one pass
+    PHASE_SPARSE,
+};
+
+/* Time one phase on a copy of source, which is left alone.
+ *
+ * pre:  source and work are the same size
+ * post: r holds the times and whether every run succeeded
+ */
+static void time_phase (enum phase phase, const struct matrix *source,
+        struct matrix *work, const struct options *opt, struct result *r)
+{
+    size_t bytes = (size_t) source->nrows * source->stride * sizeof(double);
+    r->ok = true;
+    r->reps = 0;
+    for (int rep = -opt->warmup; rep < opt->reps; rep++) {
+        memcpy(work->data, source->data, bytes);
+        bool ok = true;
+        double start = 0, stop = 0;
+        if (phase == PHASE_ECHELON) {
+            start = now_ns();
+            ok = auto_echelon(work, TRACE_QUIET);
+            stop = now_ns();
+        } else if (phase == PHASE_REDUCED) {
+            /* Only the reduced pass is timed, from the echelon form */
+            ok = auto_echelon(work, TRACE_QUIET);
+            start = now_ns();
+            ok = ok && auto_reduced_echelon(work, TRACE_QUIET);
+            stop = now_ns();
+        } else if (phase == PHASE_TWO_PASS) {
+            start = now_ns();
+            ok = auto_echelon(work, TRACE_QUIET)
+                 && auto_reduced_echelon(work, TRACE_QUIET);
+            stop = now_ns();
+        } else if (phase == PHASE_GAUSS_JORDAN) {
+            start = now_ns();
+            ok = auto_gauss_jordan(work, TRACE_QUIET);
+            stop = now_ns();
+        } else {
+            start = now_ns();
+            struct sparse_matrix *sparse = sparse_from_dense(work);
+            ok = sparse != NULL && sparse_echelon(sparse, TRACE_QUIET);
+            sparse_free(sparse);
+            stop = now_ns();
+        }
+        if (rep >= 0) {
+            r->ns[r->reps++] = stop - start;
+            r->ok = r->ok && ok;
+        }
+    }
+}
+
+static bool bench_engines (const struct options *opt)
+{
+    for (int s = 0; s < opt->nsizes; s++) {
+        int n = opt->sizes[s];
+        struct matrix *source = matrix_create(n, n);
+        struct matrix *work = matrix_create(n, n);
+        if (source == NULL || work == NULL) {
+            fprintf(stderr, "Could not allocate a %d x %d matrix\n", n, n);
+            matrix_free(source);
+            matrix_free(work);
+            return false;
+        }
+        for (enum kind kind = 0; kind < NKINDS; kind++) {
+            generate(source, kind, opt->seed);
+            struct result r = { .kind = kind_names[kind], .nrows = n, .ncols = n };
+
+            r.bench = "echelon";
+            elimination_cost(n, n, true, false, &r);
+            time_phase(PHASE_ECHELON, source, work, opt, &r);
+            print_result(&r);
+
+            r.bench = "reduced";
+            elimination_cost(n, n, false, true, &r);
+            time_phase(PHASE_REDUCED, source, work, opt, &r);
+            print_result(&r);
+
+            /* Both ways to the reduced form do the same updates */
+            r.bench = "two_pass";
+            elimination_cost(n, n, true, true, &r);
+            time_phase(PHASE_TWO_PASS, source, work, opt, &r);
+            print_result(&r);
+
+            r.bench = "gauss_jordan";
+            time_phase(PHASE_GAUSS_JORDAN, source, work, opt, &r);
+            print_result(&r);
+
+            /* The sparse engine's work depends on fill-in, so there is no
+             * nominal count to give rates by */
+            if (kind == KIND_SPARSE) {
+                r.bench = "sparse_echelon";
+                r.flops = r.bytes = 0;
+                time_phase(PHASE_SPARSE, source, work, opt, &r);
+                print_result(&r);
+            }
+        }
+        matrix_free(source);
+        matrix_free(work);
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------
+ * Row kernels
+ * --------------------------------------------------------------------- */
+
+/* Which row operation to time */
+enum row_op {
+    OP_ADD_SCALED,
+    OP_SCALE,
+    OP_SWAP,
+};
+
+static bool bench_kernels (const struct options *opt)
+{
+    static const char *names[] = { "add_scaled", "scale_row", "swap_rows" };
+    static const double flops_per_entry[] = { 2, 1, 0 };
+    static const double bytes_per_entry[] = { 24, 16, 32 };
+
+    for (int s = 0; s < opt->nsizes; s++) {
+        int n = opt->sizes[s];
+        struct matrix *m = matrix_create(2, n);
+        if (m == NULL) {
+            fprintf(stderr, "Could not allocate a 2 x %d matrix\n", n);
+            return false;
+        }
+        for (int j = 0; j < n; j++) {
+            MAT(m, 0, j) = 1 + j % 7;
+            MAT(m, 1, j) = 1 - j % 5;
+        }
+
+        int calls = KERNEL_ENTRIES / n > 0 ? KERNEL_ENTRIES / n : 1;
+        for (enum row_op op = OP_ADD_SCALED; op <= OP_SWAP; op++) {
+            struct result r = { .bench = names[op], .kind = "row",
+                                .nrows = 1, .ncols = n, .ok = true };
+            r.flops = flops_per_entry[op] * n;
+            r.bytes = bytes_per_entry[op] * n;
+            for (int rep = -opt->warmup; rep < opt->reps; rep++) {
+                double start = now_ns();
+                for (int c = 0; c < calls; c++) {
+                    /* Scalars that undo each other, so the values stay put */
+                    if (op == OP_ADD_SCALED)
+                        add_scaled(0, 1, c % 2 ? -0.5 : 0.5, m);
+                    else if (op == OP_SCALE)
+                        scale_row(0, c % 2 ? 0.5 : 2.0, m);
+                    else
+                        swap_rows(0, 1, m);
+                }
+                double stop = now_ns();
+                if (rep >= 0)
+                    r.ns[r.reps++] = (stop - start) / calls;
+            }
+            print_result(&r);
+        }
+        matrix_free(m);
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------
+ * Command line
+ * --------------------------------------------------------------------- */
+
+/* Parse a list of sizes like 64,128,256.
+ *
+ * pre:  s is NUL terminated
+ * post: returns true after filling opt->sizes, false if s isn't a list
+ *       of positive sizes or has too many
+ */
+static bool parse_sizes (char *s, struct options *opt)
+{
+    opt->nsizes = 0;
+    for (char *tok = strtok(s, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        int n;
+        if (opt->nsizes == MAX_SIZES || !parse_int(tok, &n) || n <= 0)
+            return false;
+        opt->sizes[opt->nsizes++] = n;
+    }
+    return opt->nsizes > 0;
+}
+
+int main (int argc, char *argv[])
+{
+    struct options opt = { .reps = 5, .warmup = 1, .seed = 1 };
+    opt.nsizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    memcpy(opt.sizes, default_sizes, sizeof(default_sizes));
+    int threads = 1;
+    bool engines = true, row_kernels = true;
+
+    int opt_char;
+    while ((opt_char = getopt(argc, argv, "hn:r:w:j:s:EK")) != -1) {
+        int value;
+        switch (opt_char) {
+            case 'h':
+                printf("Usage: %s [FLAGS]\n\n"
+                       "Prints one CSV line per benchmark to stdout.\n\n"
+                       "FLAGS:\n"
+                       "  -n SIZES  Comma separated sizes to try (default 64,128,256,512)\n"
+                       "  -r N      Timed repetitions of each benchmark, up to 64 (default 5)\n"
+                       "  -w N      Untimed warmup repetitions first (default 1)\n"
+                       "  -j N      Threads to solve with, 0 for one per CPU (default 1)\n"
+                       "  -s SEED   Seed for the random matrices (default 1)\n"
+                       "  -E        Only the engines, not the row kernels\n"
+                       "  -K        Only the row kernels, not the engines\n"
+                       "\nECHELON_KERNELS picks the kernel version, as for echelon.\n",
+                       argv[0]);
+                return 0;
+            case 'n':
+                if (!parse_sizes(optarg, &opt)) {
+                    fprintf(stderr, "Bad size list: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r':
+            case 'w':
+            case 'j':
+            case 's':
+                if (!parse_int(optarg, &value) || value < 0
+                        || (opt_char == 'r' && (value < 1 || value > 64))) {
+                    fprintf(stderr, "Bad value for -%c: %s\n", opt_char, optarg);
+                    return EXIT_FAILURE;
+                }
+                if (opt_char == 'r')
+                    opt.reps = value;
+                else if (opt_char == 'w')
+                    opt.warmup = value;
+                else if (opt_char == 'j')
+                    threads = value;
+                else
+                    opt.seed = (uint64_t) value;
+                break;
+            case 'E':
+                row_kernels = false;
+                break;
+            case 'K':
+                engines = false;
+                break;
+            default:
+                fprintf(stderr, "Use %s -h for help.\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    kernels_init();
+    if (!pool_start(threads))
+        return EXIT_FAILURE;
+    print_header();
+    bool success = (!row_kernels || bench_kernels(&opt))
+                   && (!engines || bench_engines(&opt));
+    pool_stop();
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
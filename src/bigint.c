@@ -0,0 +1,846 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bigint.h"
+
+/* Scratch space bigint_cross keeps on the stack, in limbs */
+#define CROSS_STACK_LIMBS 512
+
+/* Products and carries of two limbs */
+typedef unsigned __int128 u128;
+typedef __int128 i128;
+
+/* The magnitude and sign of a bigint, whichever way it is stored. Small
+ * values are put in buf so both kinds look the same. */
+struct view {
+    bool negative;
+    int len;              // limbs in d, the top one nonzero, 0 for zero
+    const uint64_t *d;
+    uint64_t buf[1];
+};
+
+static void view_of (struct view *v, const struct bigint *x)
+{
+    if (x->len > 0) {
+        v->negative = x->negative;
+        v->len = x->len;
+        v->d = x->limbs;
+        return;
+    }
+    v->negative = x->small < 0;
+    v->buf[0] = x->small < 0 ? -(uint64_t) x->small : (uint64_t) x->small;
+    v->len = v->buf[0] != 0;
+    v->d = v->buf;
+}
+
+static uint64_t *limbs_alloc (int n)
+{
+    return malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+}
+
+/* Drop the leading zero limbs of a magnitude; returns its true length */
+static int trim (const uint64_t *d, int len)
+{
+    while (len > 0 && d[len - 1] == 0)
+        len--;
+    return len;
+}
+
+/* Take the value of x from the first len limbs of its own storage, moving
+ * it back to small if it fits.
+ *
+ * pre:  x->limbs holds len limbs
+ * post: x is normalized
+ */
+static void settle (struct bigint *x, int len, bool negative)
+{
+    len = trim(x->limbs, len);
+    x->len = 0;
+    if (len <= 1) {
+        uint64_t mag = len > 0 ? x->limbs[0] : 0;
+        if (mag <= INT64_MAX) {
+            x->small = negative ? -(int64_t) mag : (int64_t) mag;
+            return;
+        } else if (negative && mag == (uint64_t) 1 << 63) {
+            x->small = INT64_MIN;
+            return;
+        }
+    }
+    x->len = len;
+    x->negative = negative;
+}
+
+/* Make a freshly computed magnitude the value of x.
+ *
+ * pre:  d was allocated with room for cap limbs and holds len of them
+ * post: x owns d, and its old limbs are freed
+ */
+static void install (struct bigint *x, uint64_t *d, int cap, int len,
+        bool negative)
+{
+    free(x->limbs);
+    x->limbs = d;
+    x->cap = cap;
+    settle(x, len, negative);
+}
+
+/* Compare two magnitudes.
+ *
+ * pre:  neither has leading zero limbs
+ * post: returns -1, 0 or 1 as a < b, a == b or a > b
+ */
+static int mag_cmp (const uint64_t *a, int al, const uint64_t *b, int bl)
+{
+    if (al != bl)
+        return al < bl ? -1 : 1;
+    for (int i = al - 1; i >= 0; i--) {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* r = a + b, where r has room for max(al, bl) + 1 limbs; returns the
+ * length of r */
+static int mag_add (uint64_t *r, const uint64_t *a, int al, const uint64_t *b,
+        int bl)
+{
+    if (al < bl) {
+        const uint64_t *t = a; a = b; b = t;
+        int tl = al; al = bl; bl = tl;
+    }
+    u128 carry = 0;
+    for (int i = 0; i < al; i++) {
+        carry += (u128) a[i] + (i < bl ? b[i] : 0);
+        r[i] = (uint64_t) carry;
+        carry >>= 64;
+    }
+    r[al] = (uint64_t) carry;
+    return al + 1;
+}
+
+/* r = a - b, where a >= b and r has room for al limbs; returns the length
+ * of r */
+static int mag_sub (uint64_t *r, const uint64_t *a, int al, const uint64_t *b,
+        int bl)
+{
+    uint64_t borrow = 0;
+    for (int i = 0; i < al; i++) {
+        uint64_t x = a[i];
+        uint64_t y = (i < bl ? b[i] : 0);
+        r[i] = x - y - borrow;
+        borrow = x < y || (x == y && borrow);
+    }
+    return al;
+}
+
+/* r = a * b, where r has room for al + bl limbs and is neither a nor b;
+ * returns the length of r */
+static int mag_mul (uint64_t *r, const uint64_t *a, int al, const uint64_t *b,
+        int bl)
+{
+    memset(r, 0, (al + bl) * sizeof(uint64_t));
+    for (int i = 0; i < al; i++) {
+        u128 carry = 0;
+        for (int j = 0; j < bl; j++) {
+            carry += (u128) a[i] * b[j] + r[i + j];
+            r[i + j] = (uint64_t) carry;
+            carry >>= 64;
+        }
+        r[i + bl] = (uint64_t) carry;
+    }
+    return al + bl;
+}
+
+/* Divide a magnitude by one limb in place.
+ *
+ * pre:  v != 0
+ * post: a holds the quotient, and the remainder is returned
+ */
+static uint64_t mag_div_limb (uint64_t *a, int al, uint64_t v)
+{
+    /* A divisor under 2^32 can go half a limb at a time, with the
+     * machine's own 64-bit division instead of a 128-bit one */
+    if (v >> 32 == 0) {
+        uint64_t rem = 0;
+        for (int i = al - 1; i >= 0; i--) {
+            uint64_t hi = rem << 32 | a[i] >> 32;
+            rem = hi % v;
+            uint64_t lo = rem << 32 | (a[i] & 0xffffffff);
+            rem = lo % v;
+            a[i] = (hi / v) << 32 | lo / v;
+        }
+        return rem;
+    }
+
+    u128 rem = 0;
+    for (int i = al - 1; i >= 0; i--) {
+        u128 cur = rem << 64 | a[i];
+        a[i] = (uint64_t) (cur / v);
+        rem = cur % v;
+    }
+    return (uint64_t) rem;
+}
+
+/* Long division of magnitudes, Knuth's algorithm D.
+ *
+ * pre:  al >= bl >= 2, the top limb of b is nonzero, q has room for
+ *       al - bl + 1 limbs and r for bl, neither overlapping a or b
+ * post: q = a / b and r = a % b; returns false if memory ran out
+ */
+static bool mag_divmod (uint64_t *q, uint64_t *r, const uint64_t *a, int al,
+        const uint64_t *b, int bl)
+{
+    const u128 base = (u128) 1 << 64;
+    uint64_t *un = limbs_alloc(al + 1);
+    uint64_t *vn = limbs_alloc(bl);
+    if (un == NULL || vn == NULL) {
+        free(un);
+        free(vn);
+        return false;
+    }
+
+    /* Shift so the top limb of the divisor has its high bit set, which
+     * keeps each estimated quotient limb within 2 of the truth */
+    int s = __builtin_clzll(b[bl - 1]);
+    for (int i = bl - 1; i > 0; i--)
+        vn[i] = (b[i] << s) | (uint64_t) ((u128) b[i - 1] >> (64 - s));
+    vn[0] = b[0] << s;
+    un[al] = (uint64_t) ((u128) a[al - 1] >> (64 - s));
+    for (int i = al - 1; i > 0; i--)
+        un[i] = (a[i] << s) | (uint64_t) ((u128) a[i - 1] >> (64 - s));
+    un[0] = a[0] << s;
+
+    for (int j = al - bl; j >= 0; j--) {
+        u128 top = (u128) un[j + bl] << 64 | un[j + bl - 1];
+        u128 qhat = top / vn[bl - 1];
+        u128 rhat = top % vn[bl - 1];
+        while (qhat >= base
+               || qhat * vn[bl - 2] > (rhat << 64 | un[j + bl - 2])) {
+            qhat--;
+            rhat += vn[bl - 1];
+            if (rhat >= base)
+                break;
+        }
+
+        /* Subtract qhat times the divisor */
+        i128 borrow = 0;
+        i128 t;
+        for (int i = 0; i < bl; i++) {
+            u128 p = qhat * vn[i];
+            t = (i128) un[i + j] - borrow - (i128) (uint64_t) p;
+            un[i + j] = (uint64_t) t;
+            borrow = (i128) (p >> 64) - (t >> 64);
+        }
+        t = (i128) un[j + bl] - borrow;
+        un[j + bl] = (uint64_t) t;
+
+        /* The estimate was one too big, add the divisor back */
+        q[j] = (uint64_t) qhat;
+        if (t < 0) {
+            q[j]--;
+            u128 carry = 0;
+            for (int i = 0; i < bl; i++) {
+                carry += (u128) un[i + j] + vn[i];
+                un[i + j] = (uint64_t) carry;
+                carry >>= 64;
+            }
+            un[j + bl] += (uint64_t) carry;
+        }
+    }
+
+    for (int i = 0; i < bl - 1; i++)
+        r[i] = (un[i] >> s) | (uint64_t) ((u128) un[i + 1] << (64 - s));
+    r[bl - 1] = un[bl - 1] >> s;
+    free(un);
+    free(vn);
+    return true;
+}
+
+/* Copy a magnitude shifted right by some bits, which must only drop
+ * zeroes; returns the length of the copy, which has room for len limbs and
+ * may be a itself */
+static int mag_shift_right (uint64_t *r, const uint64_t *a, int len, int bits)
+{
+    int limbs = bits / 64;
+    bits %= 64;
+    int rlen = len - limbs;
+    for (int i = 0; i < rlen; i++) {
+        u128 pair = a[i + limbs];
+        if (i + limbs + 1 < len)
+            pair |= (u128) a[i + limbs + 1] << 64;
+        r[i] = (uint64_t) (pair >> bits);
+    }
+    return trim(r, rlen);
+}
+
+/* Count the zero bits at the bottom of a nonzero magnitude */
+static int mag_trailing_zeroes (const uint64_t *a)
+{
+    int zeroes = 0;
+    while (a[zeroes / 64] == 0)
+        zeroes += 64;
+    return zeroes + __builtin_ctzll(a[zeroes / 64]);
+}
+
+/* r = a << bits, where r has room for len + bits / 64 + 1 limbs and is
+ * not a; returns the length of r */
+static int mag_shift_left (uint64_t *r, const uint64_t *a, int len, int bits)
+{
+    int limbs = bits / 64;
+    bits %= 64;
+    memset(r, 0, limbs * sizeof(uint64_t));
+    uint64_t carry = 0;
+    for (int i = 0; i < len; i++) {
+        u128 shifted = (u128) a[i] << bits;
+        r[i + limbs] = (uint64_t) shifted | carry;
+        carry = (uint64_t) (shifted >> 64);
+    }
+    r[len + limbs] = carry;
+    return trim(r, len + limbs + 1);
+}
+
+/* Divide magnitudes known to divide exactly, working up from the low limbs
+ * (Jebelean's method). Each quotient limb is found with one multiplication
+ * by the inverse of the divisor's low limb, and only the limbs that still
+ * matter to the quotient are updated, so this is a good deal cheaper than
+ * long division.
+ *
+ * pre:  b divides a, both nonzero, q has room for al limbs and work for
+ *       al + bl, neither overlapping a or b
+ * post: q = a / b; returns its length
+ */
+static int mag_divexact (uint64_t *q, const uint64_t *a, int al,
+        const uint64_t *b, int bl, uint64_t *work)
+{
+    /* Both share the divisor's factors of two, take them out so the
+     * divisor is odd and has an inverse mod 2^64 */
+    int zeroes = mag_trailing_zeroes(b);
+    uint64_t *bn = work + al;
+    al = mag_shift_right(work, a, al, zeroes);
+    bl = mag_shift_right(bn, b, bl, zeroes);
+    if (al < bl)
+        return 0;
+
+    /* Newton's iteration doubles the correct low bits of the inverse each
+     * time, and an odd number is its own inverse to 3 bits */
+    uint64_t inv = bn[0];
+    for (int i = 0; i < 5; i++)
+        inv *= 2 - bn[0] * inv;
+
+    int qlen = al - bl + 1;
+    for (int i = 0; i < qlen; i++) {
+        uint64_t qi = work[i] * inv;
+        q[i] = qi;
+
+        /* work -= qi * b << i, as far as limb qlen */
+        int top = bl < qlen - i ? bl : qlen - i;
+        uint64_t borrow = 0;
+        for (int j = 0; j < top; j++) {
+            u128 p = (u128) qi * bn[j] + borrow;
+            uint64_t lo = (uint64_t) p;
+            borrow = (uint64_t) (p >> 64) + (work[i + j] < lo);
+            work[i + j] -= lo;
+        }
+        for (int j = i + top; borrow != 0 && j < qlen; j++) {
+            uint64_t w = work[j];
+            work[j] = w - borrow;
+            borrow = w < borrow;
+        }
+    }
+    return qlen;
+}
+
+void bigint_init (struct bigint *x)
+{
+    x->small = 0;
+    x->negative = false;
+    x->len = 0;
+    x->cap = 0;
+    x->limbs = NULL;
+}
+
+void bigint_clear (struct bigint *x)
+{
+    free(x->limbs);
+    bigint_init(x);
+}
+
+void bigint_set_int (struct bigint *x, int64_t value)
+{
+    x->small = value;
+    x->len = 0;
+}
+
+bool bigint_set (struct bigint *x, const struct bigint *y)
+{
+    if (x == y)
+        return true;
+    if (y->len == 0) {
+        bigint_set_int(x, y->small);
+        return true;
+    }
+    if (x->cap < y->len) {
+        uint64_t *d = limbs_alloc(y->len);
+        if (d == NULL)
+            return false;
+        free(x->limbs);
+        x->limbs = d;
+        x->cap = y->len;
+    }
+    memcpy(x->limbs, y->limbs, y->len * sizeof(uint64_t));
+    x->len = y->len;
+    x->negative = y->negative;
+    return true;
+}
+
+void bigint_swap (struct bigint *x, struct bigint *y)
+{
+    struct bigint t = *x;
+    *x = *y;
+    *y = t;
+}
+
+int bigint_sign (const struct bigint *x)
+{
+    if (x->len > 0)
+        return x->negative ? -1 : 1;
+    return (x->small > 0) - (x->small < 0);
+}
+
+int bigint_cmp (const struct bigint *x, const struct bigint *y)
+{
+    if (x->len == 0 && y->len == 0)
+        return (x->small > y->small) - (x->small < y->small);
+
+    int xs = bigint_sign(x);
+    int ys = bigint_sign(y);
+    if (xs != ys)
+        return xs < ys ? -1 : 1;
+    struct view a, b;
+    view_of(&a, x);
+    view_of(&b, y);
+    int c = mag_cmp(a.d, a.len, b.d, b.len);
+    return xs < 0 ? -c : c;
+}
+
+bool bigint_neg (struct bigint *x)
+{
+    if (x->len > 0) {
+        x->negative = !x->negative;
+        return true;
+    } else if (x->small != INT64_MIN) {
+        x->small = -x->small;
+        return true;
+    }
+
+    /* 2^63 only fits as a big value */
+    uint64_t *d = limbs_alloc(1);
+    if (d == NULL)
+        return false;
+    d[0] = (uint64_t) 1 << 63;
+    install(x, d, 1, 1, false);
+    return true;
+}
+
+/* r = a + b on views, so a subtraction is an addition with one view's sign
+ * flipped */
+static bool add_views (struct bigint *r, const struct view *a,
+        const struct view *b)
+{
+    int cap = (a->len > b->len ? a->len : b->len) + 1;
+    uint64_t *d = limbs_alloc(cap);
+    if (d == NULL)
+        return false;
+
+    int len;
+    bool negative;
+    if (a->negative == b->negative) {
+        len = mag_add(d, a->d, a->len, b->d, b->len);
+        negative = a->negative;
+    } else if (mag_cmp(a->d, a->len, b->d, b->len) >= 0) {
+        len = mag_sub(d, a->d, a->len, b->d, b->len);
+        negative = a->negative;
+    } else {
+        len = mag_sub(d, b->d, b->len, a->d, a->len);
+        negative = b->negative;
+    }
+    install(r, d, cap, len, negative);
+    return true;
+}
+
+bool bigint_add (struct bigint *r, const struct bigint *a, const struct bigint *b)
+{
+    int64_t sum;
+    if (a->len == 0 && b->len == 0
+            && !__builtin_add_overflow(a->small, b->small, &sum)) {
+        bigint_set_int(r, sum);
+        return true;
+    }
+
+    struct view va, vb;
+    view_of(&va, a);
+    view_of(&vb, b);
+    return add_views(r, &va, &vb);
+}
+
+bool bigint_mul (struct bigint *r, const struct bigint *a, const struct bigint *b)
+{
+    int64_t product;
+    if (a->len == 0 && b->len == 0
+            && !__builtin_mul_overflow(a->small, b->small, &product)) {
+        bigint_set_int(r, product);
+        return true;
+    }
+
+    struct view va, vb;
+    view_of(&va, a);
+    view_of(&vb, b);
+    if (va.len == 0 || vb.len == 0) {
+        bigint_set_int(r, 0);
+        return true;
+    }
+    int cap = va.len + vb.len;
+    uint64_t *d = limbs_alloc(cap);
+    if (d == NULL)
+        return false;
+    int len = mag_mul(d, va.d, va.len, vb.d, vb.len);
+    install(r, d, cap, len, va.negative != vb.negative);
+    return true;
+}
+
+bool bigint_cross (struct bigint *r, const struct bigint *a, const struct bigint *b,
+        const struct bigint *c, const struct bigint *e, const struct bigint *d)
+{
+    /* With 64-bit operands each product is under 2^126 in size, so their
+     * difference always fits in 128 bits */
+    if (a->len == 0 && b->len == 0 && c->len == 0 && e->len == 0
+            && d->len == 0) {
+        i128 diff = (i128) a->small * b->small - (i128) c->small * e->small;
+        if (diff >= INT64_MIN && diff <= INT64_MAX && d->small != -1) {
+            bigint_set_int(r, (int64_t) diff / d->small);
+            return true;
+        }
+        i128 quot = diff / d->small;
+        if (quot >= INT64_MIN && quot <= INT64_MAX) {
+            bigint_set_int(r, (int64_t) quot);
+            return true;
+        }
+    }
+
+    /* Otherwise everything happens in one scratch buffer, on the stack
+     * unless the numbers are huge, and the quotient goes straight into r's
+     * storage when there is room. In elimination r is usually an entry
+     * being updated in place, so once it has grown this never allocates. */
+    struct view va, vb, vc, ve, vd;
+    view_of(&va, a);
+    view_of(&vb, b);
+    view_of(&vc, c);
+    view_of(&ve, e);
+    view_of(&vd, d);
+    int abl = va.len + vb.len;
+    int cel = vc.len + ve.len;
+    int dl = (abl > cel ? abl : cel) + 1;
+    int need = abl + cel + dl + dl + vd.len;
+    uint64_t stack[CROSS_STACK_LIMBS];
+    uint64_t *buf = need <= CROSS_STACK_LIMBS ? stack : limbs_alloc(need);
+    if (buf == NULL)
+        return false;
+    uint64_t *ab = buf;
+    uint64_t *ce = ab + abl;
+    uint64_t *diff = ce + cel;
+    uint64_t *work = diff + dl;
+
+    abl = trim(ab, mag_mul(ab, va.d, va.len, vb.d, vb.len));
+    cel = trim(ce, mag_mul(ce, vc.d, vc.len, ve.d, ve.len));
+    bool abneg = va.negative != vb.negative;
+    bool ceneg = vc.negative != ve.negative;
+    int len;
+    bool negative;
+    if (abneg != ceneg) {
+        len = mag_add(diff, ab, abl, ce, cel);
+        negative = abneg;
+    } else if (mag_cmp(ab, abl, ce, cel) >= 0) {
+        len = mag_sub(diff, ab, abl, ce, cel);
+        negative = abneg;
+    } else {
+        len = mag_sub(diff, ce, cel, ab, abl);
+        negative = !abneg;
+    }
+    len = trim(diff, len);
+
+    bool success = true;
+    if (len == 0) {
+        bigint_set_int(r, 0);
+    } else if (r->cap >= len && r->limbs != vd.d) {
+        len = mag_divexact(r->limbs, diff, len, vd.d, vd.len, work);
+        settle(r, len, negative != vd.negative);
+    } else {
+        uint64_t *q = limbs_alloc(len);
+        if (q == NULL) {
+            success = false;
+        } else {
+            int qlen = mag_divexact(q, diff, len, vd.d, vd.len, work);
+            install(r, q, len, qlen, negative != vd.negative);
+        }
+    }
+    if (buf != stack)
+        free(buf);
+    return success;
+}
+
+bool bigint_divmod (struct bigint *q, struct bigint *r, const struct bigint *a,
+        const struct bigint *b)
+{
+    if (a->len == 0 && b->len == 0
+            && !(a->small == INT64_MIN && b->small == -1)) {
+        int64_t quot = a->small / b->small;
+        int64_t rem = a->small % b->small;
+        if (q != NULL)
+            bigint_set_int(q, quot);
+        if (r != NULL)
+            bigint_set_int(r, rem);
+        return true;
+    }
+
+    struct view va, vb;
+    view_of(&va, a);
+    view_of(&vb, b);
+    bool qneg = va.negative != vb.negative;
+    bool rneg = va.negative;
+
+    /* |a| < |b|: nothing goes in, and all of a is left over */
+    if (mag_cmp(va.d, va.len, vb.d, vb.len) < 0) {
+        if (r != NULL && !bigint_set(r, a))
+            return false;
+        if (q != NULL)
+            bigint_set_int(q, 0);
+        return true;
+    }
+
+    int qcap = va.len - vb.len + 1;
+    int rcap = vb.len;
+    uint64_t *qd = limbs_alloc(qcap);
+    uint64_t *rd = limbs_alloc(rcap);
+    if (qd == NULL || rd == NULL) {
+        free(qd);
+        free(rd);
+        return false;
+    }
+    if (vb.len == 1) {
+        memcpy(qd, va.d, va.len * sizeof(uint64_t));
+        rd[0] = mag_div_limb(qd, va.len, vb.d[0]);
+    } else if (!mag_divmod(qd, rd, va.d, va.len, vb.d, vb.len)) {
+        free(qd);
+        free(rd);
+        return false;
+    }
+
+    /* Both are computed before either is stored, since they may share
+     * storage with a or b */
+    if (q != NULL)
+        install(q, qd, qcap, qcap, qneg);
+    else
+        free(qd);
+    if (r != NULL)
+        install(r, rd, rcap, rcap, rneg);
+    else
+        free(rd);
+    return true;
+}
+
+bool bigint_divexact (struct bigint *q, const struct bigint *a,
+        const struct bigint *b)
+{
+    if (a->len == 0 && b->len == 0)
+        return bigint_divmod(q, NULL, a, b);
+
+    struct view va, vb;
+    view_of(&va, a);
+    view_of(&vb, b);
+    if (va.len == 0) {
+        bigint_set_int(q, 0);
+        return true;
+    }
+    uint64_t *d = limbs_alloc(va.len);
+    uint64_t *work = limbs_alloc(va.len + vb.len);
+    if (d == NULL || work == NULL) {
+        free(d);
+        free(work);
+        return false;
+    }
+    int len = mag_divexact(d, va.d, va.len, vb.d, vb.len, work);
+    free(work);
+    install(q, d, va.len, len, va.negative != vb.negative);
+    return true;
+}
+
+bool bigint_gcd (struct bigint *r, const struct bigint *a, const struct bigint *b)
+{
+    /* Plain Euclid when the values fit in 64 bits */
+    if (a->len == 0 && b->len == 0) {
+        uint64_t x = a->small < 0 ? -(uint64_t) a->small : (uint64_t) a->small;
+        uint64_t y = b->small < 0 ? -(uint64_t) b->small : (uint64_t) b->small;
+        while (y != 0) {
+            uint64_t t = x % y;
+            x = y;
+            y = t;
+        }
+        if (x <= INT64_MAX) {
+            bigint_set_int(r, (int64_t) x);
+            return true;
+        }
+    }
+
+    struct view va, vb;
+    view_of(&va, a);
+    view_of(&vb, b);
+    if (va.len == 0 || vb.len == 0) {
+        if (!bigint_set(r, va.len == 0 ? b : a))
+            return false;
+        return bigint_sign(r) >= 0 || bigint_neg(r);
+    }
+
+    /* Binary gcd on copies of the magnitudes, which only ever subtracts
+     * and shifts in place. The answer is at most as long as the shorter
+     * one, plus a limb for the shared factors of two. */
+    uint64_t *u = limbs_alloc(va.len + vb.len + 1);
+    if (u == NULL)
+        return false;
+    uint64_t *v = u + va.len;
+    int ul = va.len;
+    int vl = vb.len;
+    memcpy(u, va.d, ul * sizeof(uint64_t));
+    memcpy(v, vb.d, vl * sizeof(uint64_t));
+    int twos_u = mag_trailing_zeroes(u);
+    int twos_v = mag_trailing_zeroes(v);
+    int twos = twos_u < twos_v ? twos_u : twos_v;
+    ul = mag_shift_right(u, u, ul, twos_u);
+    vl = mag_shift_right(v, v, vl, twos_v);
+    for (;;) {
+        /* Both are odd here, so their difference is even */
+        if (ul == 1 && vl == 1) {
+            uint64_t x = u[0];
+            uint64_t y = v[0];
+            while (y != 0) {
+                uint64_t t = x % y;
+                x = y;
+                y = t;
+            }
+            u[0] = x;
+            break;
+        }
+        int c = mag_cmp(u, ul, v, vl);
+        if (c == 0) {
+            break;
+        } else if (c < 0) {
+            uint64_t *t = u; u = v; v = t;
+            int tl = ul; ul = vl; vl = tl;
+        }
+        ul = trim(u, mag_sub(u, u, ul, v, vl));
+        ul = mag_shift_right(u, u, ul, mag_trailing_zeroes(u));
+    }
+
+    /* Put the shared factors of two back */
+    uint64_t *d = limbs_alloc(ul + twos / 64 + 1);
+    if (d == NULL) {
+        free(u < v ? u : v);
+        return false;
+    }
+    int len = mag_shift_left(d, u, ul, twos);
+    free(u < v ? u : v);
+    install(r, d, ul + twos / 64 + 1, len, false);
+    return true;
+}
+
+bool bigint_parse (struct bigint *x, const char *s, int len)
+{
+    bool negative = false;
+    if (len > 0 && (*s == '+' || *s == '-')) {
+        negative = *s == '-';
+        s++;
+        len--;
+    }
+    if (len == 0)
+        return false;
+    for (int i = 0; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9')
+            return false;
+    }
+
+    /* Up to 18 digits always fit in 64 bits */
+    if (len <= 18) {
+        int64_t value = 0;
+        for (int i = 0; i < len; i++)
+            value = value * 10 + (s[i] - '0');
+        bigint_set_int(x, negative ? -value : value);
+        return true;
+    }
+
+    /* Otherwise take in 18 digits at a time: d = d * 10^k + chunk. Each
+     * limb holds more than 19 digits, so len / 18 + 1 limbs are plenty. */
+    int cap = len / 18 + 1;
+    uint64_t *d = limbs_alloc(cap);
+    if (d == NULL)
+        return false;
+    int dlen = 0;
+    for (int i = 0; i < len; ) {
+        uint64_t chunk = 0;
+        uint64_t scale = 1;
+        for (int k = 0; k < 18 && i < len; k++, i++) {
+            chunk = chunk * 10 + (s[i] - '0');
+            scale *= 10;
+        }
+        u128 carry = chunk;
+        for (int j = 0; j < dlen; j++) {
+            carry += (u128) d[j] * scale;
+            d[j] = (uint64_t) carry;
+            carry >>= 64;
+        }
+        if (carry != 0)
+            d[dlen++] = (uint64_t) carry;
+    }
+    install(x, d, cap, dlen, negative);
+    return true;
+}
+
+char *bigint_to_string (const struct bigint *x)
+{
+    if (x->len == 0) {
+        char *s = malloc(21);
+        if (s != NULL)
+            snprintf(s, 21, "%" PRId64, x->small);
+        return s;
+    }
+
+    /* Peel off 9 digits at a time from a copy of the magnitude. Each limb
+     * makes under 20 digits. */
+    int len = x->len;
+    uint64_t *d = limbs_alloc(len);
+    int nchunks = len * 20 / 9 + 1;
+    uint64_t *chunks = malloc(nchunks * sizeof(uint64_t));
+    char *s = malloc(len * 20 + 2);
+    if (d == NULL || chunks == NULL || s == NULL) {
+        free(d);
+        free(chunks);
+        free(s);
+        return NULL;
+    }
+    memcpy(d, x->limbs, len * sizeof(uint64_t));
+    int n = 0;
+    do {
+        chunks[n++] = mag_div_limb(d, len, 1000000000);
+        len = trim(d, len);
+    } while (len > 0);
+
+    char *p = s;
+    if (x->negative)
+        *p++ = '-';
+    p += sprintf(p, "%" PRIu64, chunks[n - 1]);
+    for (int i = n - 2; i >= 0; i--)
+        p += sprintf(p, "%09" PRIu64, chunks[i]);
+    free(d);
+    free(chunks);
+    return s;
+}
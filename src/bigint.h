@@ -0,0 +1,109 @@
+#ifndef __BIGINT_H__
+#define __BIGINT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Integers of any size.
+ *
+ * Values that fit in an int64_t are kept in small and handled with plain
+ * 64-bit arithmetic. Only when a result overflows does it move to limbs,
+ * base 2^64 digits of its magnitude, least significant first, and it moves
+ * back as soon as it fits again. Results may share storage with operands.
+ *
+ * Every bigint has to be set up with bigint_init and released with
+ * bigint_clear. Functions that can allocate return false if memory ran
+ * out, leaving the result unspecified but still safe to clear.
+ */
+struct bigint {
+    int64_t small;    // the value, when len is 0
+    bool negative;    // sign of a big value
+    int len;          // limbs in use by a big value, the top one nonzero
+    int cap;          // limbs allocated, kept for reuse while small
+    uint64_t *limbs;  // magnitude of a big value
+};
+
+/* pre:  x is uninitialized
+ * post: x is 0 */
+void bigint_init (struct bigint *x);
+
+/* pre:  x was initialized
+ * post: x owns no memory, and may be initialized again */
+void bigint_clear (struct bigint *x);
+
+/* pre:  x was initialized
+ * post: x = value */
+void bigint_set_int (struct bigint *x, int64_t value);
+
+/* pre:  x and y were initialized
+ * post: returns true after x = y */
+bool bigint_set (struct bigint *x, const struct bigint *y);
+
+/* pre:  x and y were initialized
+ * post: their values are exchanged without copying */
+void bigint_swap (struct bigint *x, struct bigint *y);
+
+/* pre:  x was initialized
+ * post: returns -1, 0 or 1 as x is negative, zero or positive */
+int bigint_sign (const struct bigint *x);
+
+/* pre:  x and y were initialized
+ * post: returns -1, 0 or 1 as x < y, x == y or x > y */
+int bigint_cmp (const struct bigint *x, const struct bigint *y);
+
+/* pre:  x was initialized
+ * post: returns true after x = -x */
+bool bigint_neg (struct bigint *x);
+
+/* pre:  all were initialized
+ * post: returns true after r = a + b */
+bool bigint_add (struct bigint *r, const struct bigint *a, const struct bigint *b);
+
+/* pre:  all were initialized
+ * post: returns true after r = a * b */
+bool bigint_mul (struct bigint *r, const struct bigint *a, const struct bigint *b);
+
+/* The step at the heart of fraction-free elimination.
+ *
+ * pre:  all were initialized, d != 0, and d divides a*b - c*e exactly
+ * post: returns true after r = (a*b - c*e) / d
+ */
+bool bigint_cross (struct bigint *r, const struct bigint *a, const struct bigint *b,
+        const struct bigint *c, const struct bigint *e, const struct bigint *d);
+
+/* Division rounding toward zero, like C's / and %.
+ *
+ * pre:  all were initialized, b != 0, q and r are different
+ * post: returns true after q = a / b and r = a % b (either may be NULL)
+ */
+bool bigint_divmod (struct bigint *q, struct bigint *r, const struct bigint *a,
+        const struct bigint *b);
+
+/* Division that is known to leave no remainder, which is much faster than
+ * bigint_divmod when the numbers are big.
+ *
+ * pre:  all were initialized, b != 0, and b divides a exactly
+ * post: returns true after q = a / b
+ */
+bool bigint_divexact (struct bigint *q, const struct bigint *a,
+        const struct bigint *b);
+
+/* pre:  all were initialized
+ * post: returns true after r = gcd(|a|, |b|), which is 0 only if both are */
+bool bigint_gcd (struct bigint *r, const struct bigint *a, const struct bigint *b);
+
+/* Read a string of decimal digits, with an optional leading sign.
+ *
+ * pre:  x was initialized, s points at len characters
+ * post: returns true after setting x, false if s isn't an integer
+ */
+bool bigint_parse (struct bigint *x, const char *s, int len);
+
+/* Write x in decimal.
+ *
+ * pre:  x was initialized
+ * post: returns a string to free, or NULL if memory ran out
+ */
+char *bigint_to_string (const struct bigint *x);
+
+#endif
@@ -0,0 +1,490 @@
+#include "automatic.h"
+#include "blocked.h"
+#include "kernels.h"
+#include "matrix_proc.h"
+#include "pool.h"
+#include "stats.h"
+
+bool blocked_worthwhile (const struct matrix *matrix)
+{
+    return matrix->nrows >= 2 * PANEL_COLS && matrix->ncols >= 2 * PANEL_COLS;
+}
+
+bool blocked_reduce_worthwhile (const struct matrix *matrix)
+{
+    if (!blocked_worthwhile(matrix))
+        return false;
+
+    /* Working out multipliers ahead of time relies on every row below a
+     * pivot having a zero in its column, which rounding can spoil */
+    int last_leading = -1;
+    for (int i = 0; i < matrix->nrows; i++) {
+        int lead = leading_pos(i, matrix);
+        if (lead == -1) {
+            last_leading = matrix->ncols;
+        } else if (lead <= last_leading) {
+            return false;
+        } else {
+            last_leading = lead;
+        }
+    }
+    return true;
+}
+
+/* Swap two rows of the multiplier workspace.
+ *
+ * pre:  a and b are rows of at least n doubles
+ * post: their first n entries are exchanged
+ */
+static void swap_multipliers (double *a, double *b, int n)
+{
+    for (int p = 0; p < n; p++) {
+        double temp = a[p];
+        a[p] = b[p];
+        b[p] = temp;
+    }
+}
+
+/* kernels.update, shared out among the threads of the pool by rows of c */
+struct shared_update {
+    double *c;
+    size_t ldc;
+    const double *l;
+    size_t ldl;
+    const double *const *u;
+    int n;
+    int k;
+};
+
+static void update_task (void *arg, int begin, int end)
+{
+    struct shared_update *a = arg;
+    kernels.update(a->c + (size_t) begin * a->ldc, a->ldc,
+                   a->l + (size_t) begin * a->ldl, a->ldl,
+                   a->u, end - begin, a->n, a->k);
+}
+
+/* Run kernels.update with its rows split among the threads of the pool.
+ *
+ * pre:  as for row_kernels.update
+ * post: c has been updated
+ */
+static void shared_update (double *c, size_t ldc, const double *l, size_t ldl,
+        const double *const *u, int m, int n, int k)
+{
+    struct shared_update a = { c, ldc, l, ldl, u, n, k };
+    stats_count(STAT_FLOPS, 2 * (int64_t) m * n * k);
+    pool_for(update_task, &a, m, (size_t) n * k);
+}
+
+/* Cancelling out a pivot column within a panel, shared out by rows */
+struct panel_cancel {
+    struct matrix *matrix;
+    double *l;     // multiplier workspace, its row 0 being matrix row base
+    int base;
+    int pivot_row; // item 0 of the loop is the row right below it
+    int lead;
+    int c_end;
+    int npiv;      // which multiplier column to fill in
+    int *leads;    // leading columns, only looking left of c_end
+    bool finite;   // whether the pivot row is all finite
+};
+
+static void panel_cancel_task (void *arg, int begin, int end)
+{
+    struct panel_cancel *a = arg;
+    const double *row = matrix_row(a->matrix, a->pivot_row) + a->lead;
+    for (int k = a->pivot_row + 1 + begin; k < a->pivot_row + 1 + end; k++) {
+        double temp = -1 * MAT(a->matrix, k, a->lead);
+        a->l[(size_t) (k - a->base) * PANEL_COLS + a->npiv] = temp;
+        stats_count(STAT_ADDS, 1);
+        stats_count(STAT_FLOPS, 2 * (int64_t) (a->c_end - a->lead));
+        kernels.axpy(matrix_row(a->matrix, k) + a->lead, row, temp,
+                     a->c_end - a->lead);
+        a->leads[k] = lead_after_add(a->matrix, k, a->leads[k], a->lead, temp,
+                                     a->finite, a->c_end);
+    }
+}
+
+/* Cancelling out a finished panel's pivot columns above its pivots, in the
+ * panel's columns only */
+struct panel_above {
+    struct matrix *matrix;
+    double *l;        // multiplier workspace, its row 0 being matrix row 0
+    const int *leads; // leading column of each row, the pivot rows included
+    int r0;           // the panel's first pivot row
+    int npiv;
+    int c_end;
+};
+
+/* Cancel out the panel's pivot columns in one row above them, one pivot
+ * after another, and remember the multipliers. Rows above the panel take
+ * every pivot, and a pivot row only the ones after it. Zero multipliers
+ * are skipped, as echelon_step skips them.
+ *
+ * pre:  the pivot rows after row k have not been cancelled out yet
+ * post: row k is up to date left of c_end, and its multipliers are in l
+ */
+static void panel_above_row (const struct panel_above *a, int k)
+{
+    double *row = matrix_row(a->matrix, k);
+    double *lk = a->l + (size_t) k * PANEL_COLS;
+    for (int p = k < a->r0 ? 0 : k - a->r0 + 1; p < a->npiv; p++) {
+        int lead = a->leads[a->r0 + p];
+        double temp = -1 * row[lead];
+        lk[p] = temp;
+        if (temp != 0) {
+            stats_count(STAT_ADDS, 1);
+            stats_count(STAT_FLOPS, 2 * (int64_t) (a->c_end - lead));
+            kernels.axpy(row + lead, matrix_row(a->matrix, a->r0 + p) + lead,
+                         temp, a->c_end - lead);
+        }
+    }
+}
+
+static void panel_above_task (void *arg, int begin, int end)
+{
+    for (int k = begin; k < end; k++)
+        panel_above_row(arg, k);
+}
+
+/* Cancel out a finished panel's pivot columns above its pivots, once the
+ * rows below have had their update. The rows above the panel's first pivot
+ * row r0 take every pivot, and the pivot rows themselves the ones after
+ * them, having caught up with the ones before on becoming pivot rows.
+ * Going from the top down, every row reads the pivot rows below it before
+ * they change.
+ *
+ * pre:  rows r0 .. r0+npiv-1 are the panel's pivot rows, u points into
+ *       them at c_end, l holds the multipliers of the rows from r0 down
+ *       finite says whether every pivot row is all finite
+ * post: rows 0 .. r0+npiv-2 are up to date, and their additions reported
+ */
+static void reduce_above (struct matrix *matrix, double *l, const int *leads,
+        const double *const *u, int r0, int npiv, int c_end, bool finite,
+        enum trace_mode trace)
+{
+    /* The panel's columns, where the multipliers come from. The rows
+     * above the panel only read the pivot rows, so they can be shared
+     * out. */
+    struct panel_above a = { matrix, l, leads, r0, npiv, c_end };
+    pool_for(panel_above_task, &a, r0, (size_t) npiv * PANEL_COLS / 2);
+    for (int k = r0; k < r0 + npiv - 1; k++)
+        panel_above_row(&a, k);
+
+    /* Report the additions pivot by pivot. Once a pivot row is scaled,
+     * nothing changes it before its additions to the rows above it here,
+     * so replaying them in this order gives the same result. */
+    for (int p = 0; p < npiv && tracing(trace); p++) {
+        for (int k = 0; k < r0 + p; k++) {
+            double temp = l[(size_t) k * PANEL_COLS + p];
+            if (temp != 0)
+                trace_add(trace, k, temp, r0 + p, matrix);
+        }
+    }
+
+    /* Then the rest of the rows, right of the panel */
+    int n = matrix->ncols - c_end;
+    if (n == 0)
+        return;
+    if (finite && r0 > 0)
+        shared_update(matrix_row(matrix, 0) + c_end, matrix->stride, l, PANEL_COLS,
+                      u, r0, n, npiv);
+    for (int k = finite ? r0 : 0; k < r0 + npiv - 1; k++) {
+        int first = k < r0 ? 0 : k - r0 + 1;
+        const double *lk = l + (size_t) k * PANEL_COLS;
+        if (finite) {
+            stats_count(STAT_FLOPS, 2 * (int64_t) n * (npiv - first));
+            kernels.update(matrix_row(matrix, k) + c_end, 0, lk + first, 0,
+                           u + first, 1, n, npiv - first);
+            continue;
+        }
+        /* 0 * inf is not 0, so leave out the zero multipliers that
+         * echelon_step would have skipped */
+        for (int p = first; p < npiv; p++) {
+            if (lk[p] != 0) {
+                stats_count(STAT_FLOPS, 2 * (int64_t) n);
+                kernels.axpy(matrix_row(matrix, k) + c_end, u[p], lk[p], n);
+            }
+        }
+    }
+}
+
+/* Put a matrix into echelon form a panel at a time, as blocked_echelon
+ * describes, or into reduced echelon form if above is set.
+ *
+ * pre:  as for blocked_echelon
+ * post: returns true if reached that form, false otherwise
+ */
+static bool blocked_eliminate (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws, bool above)
+{
+    bool success = false;
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+    if (!workspace_reserve(ws, nrows, true))
+        return success;
+
+    /* Multipliers of each row for the pivots of the current panel, and the
+     * part of each pivot row right of the panel. Only the rows from the
+     * panel down need multipliers, unless the rows above are reduced too. */
+    double *l = ws->panel;
+    const double *u[PANEL_COLS];
+
+    /* Leading column of each row. Within a panel, rows that lead right of
+     * it may show c_end instead until the panel is applied to them. */
+    int *leads = ws->leads;
+    leading_columns(matrix, leads);
+
+    int i = 0;
+    int last_leading = -1;
+    while (i < nrows) {
+        /* The panel covers the next PANEL_COLS columns. Everything left of
+         * c_end is up to date in every row, everything right of it is
+         * missing the updates from the panel's pivots. */
+        int r0 = i;
+        int base = above ? 0 : r0; // matrix row of the first multipliers
+        int c_end = last_leading + 1 + PANEL_COLS;
+        if (c_end > ncols)
+            c_end = ncols;
+        int npiv = 0;
+        bool full_step = false;
+        bool failed = false;
+        bool finite = true; // whether every pivot row so far is all finite
+
+        while (i < nrows && npiv < PANEL_COLS && last_leading + 1 < c_end) {
+            int desired_leading = last_leading + 1;
+            int current_leading = leads[i];
+
+            /* Which rows lead before this row is only known when it leads
+             * inside the panel. Otherwise finish the panel and take one
+             * step with the whole matrix up to date. */
+            if (current_leading >= c_end) {
+                full_step = true;
+                break;
+            }
+
+            /* The same search as echelon_step. Rows that lead right of
+             * the panel never win it, since this row leads inside it. */
+            if (current_leading != desired_leading) {
+                for (int k = i+1; k < nrows; k++) {
+                    int k_leading = leads[k];
+                    if (k_leading < current_leading) {
+                        swap_rows(i, k, matrix);
+                        leads[k] = current_leading;
+                        leads[i] = k_leading;
+                        swap_multipliers(l + (size_t) (i - base) * PANEL_COLS,
+                                         l + (size_t) (k - base) * PANEL_COLS, npiv);
+                        trace_swap(trace, i, k, matrix);
+                        current_leading = k_leading;
+                        if (k_leading == desired_leading)
+                            break;
+                    }
+                }
+            }
+            if (current_leading < last_leading) {
+                failed = true;
+                break;
+            }
+
+            /* Catch the rest of the pivot row up with the pivots above it,
+             * then scale all of it */
+            double *row = matrix_row(matrix, i);
+            if (npiv > 0 && c_end < ncols) {
+                stats_count(STAT_FLOPS, 2 * (int64_t) (ncols - c_end) * npiv);
+                kernels.update(row + c_end, 0, l + (size_t) (i - base) * PANEL_COLS,
+                               0, u, 1, ncols - c_end, npiv);
+            }
+            if (row[current_leading] != 1) {
+                double temp = row[current_leading];
+                scale_pivot(i, current_leading, matrix);
+                trace_scale(trace, i, temp, matrix);
+            }
+            bool row_ok = row_finite(i, matrix);
+            finite = finite && row_ok;
+
+            /* Cancel out the pivot column below, in the panel only, and
+             * remember the multipliers for the rest. The rows above wait
+             * for the end of the panel. */
+            struct panel_cancel c = { matrix, l, base, i, current_leading, c_end,
+                                      npiv, leads, row_ok };
+            pool_for(panel_cancel_task, &c, nrows - (i+1), c_end - current_leading);
+            for (int k = i+1; k < nrows && tracing(trace); k++)
+                trace_add(trace, k, l[(size_t) (k - base) * PANEL_COLS + npiv], i, matrix);
+
+            u[npiv++] = row + c_end;
+            last_leading = current_leading;
+            i++;
+        }
+
+        /* Past the last column there is no panel to speak of, so let
+         * echelon_step sort out what's left */
+        if (npiv == 0 && !full_step)
+            full_step = true;
+
+        /* Apply the whole panel to the rest of the rows below it, even on
+         * the way out after a failure, so they're left as auto_echelon
+         * would leave them */
+        if (npiv > 0 && c_end < ncols && i < nrows)
+            shared_update(matrix_row(matrix, i) + c_end, matrix->stride,
+                          l + (size_t) (i - base) * PANEL_COLS, PANEL_COLS,
+                          u, nrows - i, ncols - c_end, npiv);
+        if (above && npiv > 0)
+            reduce_above(matrix, l, leads, u, r0, npiv, c_end, finite, trace);
+
+        /* Rows that lead right of the panel still do, unless an infinity
+         * got spread around. Only the ones marked c_end need a look. */
+        for (int k = i; k < nrows && npiv > 0; k++) {
+            if (!finite)
+                leads[k] = leading_between(k, 0, ncols, matrix);
+            else if (leads[k] == c_end)
+                leads[k] = leading_between(k, c_end, ncols, matrix);
+        }
+
+        int lead = 0;
+        if (full_step && !failed) {
+            lead = echelon_step(matrix, leads, i, last_leading, above, trace);
+            if (lead == STEP_DONE)
+                break;
+            failed = lead == STEP_FAIL;
+        }
+        if (failed) {
+            report_error("Could not find a row to swap with.");
+            return success;
+        }
+        if (full_step) {
+            last_leading = lead;
+            i++;
+        }
+    }
+
+    success = true;
+    return success;
+}
+
+bool blocked_echelon (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws)
+{
+    return blocked_eliminate(matrix, trace, ws, false);
+}
+
+bool blocked_gauss_jordan (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws)
+{
+    return blocked_eliminate(matrix, trace, ws, true);
+}
+
+/* Working out the multipliers of the rows above a block, shared out by rows */
+struct block_multipliers {
+    const struct matrix *matrix;
+    double *l;
+    const int *lead;
+    const int *rows; // the block's pivot rows, from the bottom up
+    int npiv;
+};
+
+static void multipliers_task (void *arg, int begin, int end)
+{
+    struct block_multipliers *a = arg;
+    for (int k = begin; k < end; k++) {
+        for (int p = 0; p < a->npiv; p++) {
+            int i = a->rows[p];
+            a->l[(size_t) k * PANEL_COLS + p] =
+                -1 * MAT(a->matrix, k, a->lead[i]) / MAT(a->matrix, i, a->lead[i]);
+        }
+    }
+}
+
+bool blocked_reduced_echelon (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws)
+{
+    bool success = false;
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+
+    /* Rows below a pivot only have zeroes in its column, so cancelling
+     * them out never changes the entries the multipliers come from. That
+     * lets every multiplier for a block be worked out before the block's
+     * rows are added to the rows above it. */
+    if (!workspace_reserve(ws, nrows, true))
+        return success;
+    int *lead = ws->leads;
+    double *l = ws->panel;
+    const double *u[PANEL_COLS];
+    for (int i = 0; i < nrows; i++)
+        lead[i] = leading_pos(i, matrix);
+
+    int bottom = nrows - 1;
+    while (bottom >= 0) {
+        /* Gather up to PANEL_COLS pivot rows, from the bottom up. Rows
+         * top+1 .. bottom make up the block. */
+        int rows[PANEL_COLS];
+        int npiv = 0;
+        int top = bottom;
+        for (; top >= 0 && npiv < PANEL_COLS; top--) {
+            if (lead[top] != -1)
+                rows[npiv++] = top;
+        }
+        if (npiv == 0)
+            break;
+
+        /* Multipliers for the rows above the block */
+        struct block_multipliers b = { matrix, l, lead, rows, npiv };
+        pool_for(multipliers_task, &b, top + 1, npiv);
+
+        /* Reduce within the block, reporting operations in the same order
+         * auto_reduced_echelon would */
+        for (int p = 0; p < npiv; p++) {
+            int i = rows[p];
+            const double *pivot_row = matrix_row(matrix, i) + lead[i];
+            for (int k = i-1; k > top; k--) {
+                double temp = -1 * MAT(matrix, k, lead[i]) / MAT(matrix, i, lead[i]);
+                if (temp != 0) {
+                    stats_count(STAT_ADDS, 1);
+                    stats_count(STAT_FLOPS, 2 * (int64_t) (ncols - lead[i]));
+                    kernels.axpy(matrix_row(matrix, k) + lead[i], pivot_row,
+                                 temp, ncols - lead[i]);
+                    trace_add(trace, k, temp, i, matrix);
+                }
+            }
+            for (int k = top; k >= 0 && tracing(trace); k--) {
+                double temp = l[(size_t) k * PANEL_COLS + p];
+                if (temp != 0)
+                    trace_add(trace, k, temp, i, matrix);
+            }
+        }
+
+        /* Then add the whole block to the rows above it at once, from the
+         * leftmost pivot on. auto_reduced_echelon skips zero multipliers,
+         * which only makes a difference once a row has overflowed, since
+         * 0 * inf is not 0. Do the same in that case. */
+        if (top >= 0) {
+            int first_col = lead[rows[npiv - 1]];
+            bool finite = true;
+            for (int p = 0; p < npiv; p++) {
+                u[p] = matrix_row(matrix, rows[p]) + first_col;
+                finite = finite && row_finite(rows[p], matrix);
+            }
+            if (finite) {
+                shared_update(matrix_row(matrix, 0) + first_col, matrix->stride,
+                              l, PANEL_COLS, u, top + 1, ncols - first_col, npiv);
+            } else {
+                for (int p = 0; p < npiv; p++) {
+                    for (int k = top; k >= 0; k--) {
+                        double temp = l[(size_t) k * PANEL_COLS + p];
+                        if (temp != 0) {
+                            stats_count(STAT_ADDS, 1);
+                            stats_count(STAT_FLOPS, 2 * (int64_t) (ncols - first_col));
+                            kernels.axpy(matrix_row(matrix, k) + first_col, u[p],
+                                         temp, ncols - first_col);
+                        }
+                    }
+                }
+            }
+        }
+        bottom = top;
+    }
+
+    success = true;
+    return success;
+}
@@ -0,0 +1,75 @@
+#ifndef __BLOCKED_H__
+#define __BLOCKED_H__
+
+#include <stdbool.h>
+#include "matrix.h"
+#include "user_io.h"
+
+/* Columns in one panel of the blocked engine */
+#define PANEL_COLS 64
+
+/* Decide whether a matrix is big enough for the blocked engine to pay off.
+ *
+ * pre:  matrix is initialized
+ * post: returns true if the blocked engine should be used
+ */
+bool blocked_worthwhile (const struct matrix *matrix);
+
+/* Decide whether to reduce a matrix in echelon form with the blocked
+ * engine. Besides being big enough, each row has to lead strictly right of
+ * the one above it, with any rows of zeroes at the bottom.
+ *
+ * pre:  matrix is initialized
+ * post: returns true if blocked_reduced_echelon should be used
+ */
+bool blocked_reduce_worthwhile (const struct matrix *matrix);
+
+struct workspace; // see automatic.h
+
+/* Put a matrix into echelon form, like auto_echelon, a panel of columns at
+ * a time.
+ *
+ * Within a panel, pivots are found and eliminated exactly as auto_echelon
+ * does, but only the panel's columns are updated. The rest of each row is
+ * updated once at the end of the panel with every pivot in it, through
+ * kernels.update. The entries are computed with the same operations in the
+ * same order, so the result is the same bit for bit.
+ *
+ * pre:  matrix is initialized, trace is not TRACE_FULL, ws is zeroed or
+ *       was used before
+ * post: returns true if reached echelon form, false otherwise
+ */
+bool blocked_echelon (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws);
+
+/* Put a matrix straight into reduced echelon form, like auto_gauss_jordan,
+ * a panel of columns at a time.
+ *
+ * This is blocked_echelon with the rows above each pivot cancelled out as
+ * well. They are left alone while the panel's pivots are found, then at
+ * the end of the panel each one takes the pivots in turn within the
+ * panel's columns, and the rest of it is updated through kernels.update
+ * along with the rows below. Every row gets the same operations in the
+ * same order as in auto_gauss_jordan, so the result matches it bit for
+ * bit, up to the sign of zeroes. The additions to the rows above are
+ * reported at the end of each panel rather than with their pivots, in an
+ * order that replays to the same result.
+ *
+ * pre:  matrix is initialized, trace is not TRACE_FULL, ws is zeroed or
+ *       was used before
+ * post: returns true if reached reduced echelon form, false otherwise
+ */
+bool blocked_gauss_jordan (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws);
+
+/* Reduce a matrix in echelon form, like auto_reduced_echelon, a block of
+ * pivot rows at a time, giving the same result bit for bit.
+ *
+ * pre:  blocked_reduce_worthwhile(matrix), trace is not TRACE_FULL, ws is
+ *       zeroed or was used before
+ * post: returns true if reached reduced echelon form, false otherwise
+ */
+bool blocked_reduced_echelon (struct matrix *matrix, enum trace_mode trace,
+        struct workspace *ws);
+
+#endif
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include "automatic.h"
+#include "echelon.h"
+#include "kernels.h"
+#include "matrix_proc.h"
+#include "pool.h"
+#include "user_io.h"
+
+_Static_assert(ECHELON_SWAP == (int) JOURNAL_SWAP && ECHELON_SCALE == (int) JOURNAL_SCALE
+               && ECHELON_ADD == (int) JOURNAL_ADD,
+               "step operations must match the journal's");
+
+/* Longest error message kept, counting the NUL */
+#define ERROR_SIZE 128
+
+struct echelon_solver {
+    struct workspace ws;
+    echelon_step_fn step; // the caller's callback, or NULL
+    void *step_arg;
+    char error[ERROR_SIZE];
+};
+
+bool echelon_init (int nthreads)
+{
+    kernels_init();
+
+    /* There is no solver to keep the message in yet, so it is dropped */
+    char error[ERROR_SIZE];
+    struct report_sink sink = { NULL, NULL, error, sizeof(error) };
+    report_to(&sink);
+    bool success = pool_start(nthreads);
+    report_to(NULL);
+    return success;
+}
+
+void echelon_shutdown (void)
+{
+    pool_stop();
+}
+
+struct matrix *echelon_matrix_create (int nrows, int ncols)
+{
+    return matrix_create(nrows, ncols);
+}
+
+void echelon_matrix_free (struct matrix *matrix)
+{
+    matrix_free(matrix);
+}
+
+double *echelon_matrix_row (struct matrix *matrix, int row)
+{
+    return matrix_row(matrix, row);
+}
+
+struct echelon_solver *echelon_solver_create (void)
+{
+    return calloc(1, sizeof(struct echelon_solver));
+}
+
+void echelon_solver_free (struct echelon_solver *solver)
+{
+    if (solver == NULL)
+        return;
+    workspace_free(&solver->ws);
+    free(solver);
+}
+
+void echelon_on_step (struct echelon_solver *solver, echelon_step_fn fn,
+        void *arg)
+{
+    solver->step = fn;
+    solver->step_arg = arg;
+}
+
+/* Hand a row operation reported by the engines on to the caller */
+static void pass_step (void *arg, enum journal_op op, int row1, int row2,
+        double scalar)
+{
+    struct echelon_solver *solver = arg;
+    struct echelon_step step = { (enum echelon_op) op, row1, row2, scalar };
+    solver->step(solver->step_arg, &step);
+}
+
+bool echelon_solve (struct echelon_solver *solver, struct matrix *matrix,
+        bool reduced)
+{
+    struct report_sink sink = { solver->step != NULL ? pass_step : NULL, solver,
+                                solver->error, sizeof(solver->error) };
+    report_to(&sink);
+    bool success = auto_echelon_with(matrix, TRACE_QUIET, &solver->ws)
+                   && (!reduced || auto_reduced_echelon_with(matrix, TRACE_QUIET,
+                                                             &solver->ws));
+    report_to(NULL);
+    return success;
+}
+
+int echelon_rank (const struct matrix *matrix, int *pivots)
+{
+    if (pivots != NULL)
+        return pivot_columns(matrix, pivots);
+    int rank = 0;
+    for (int i = 0; i < matrix->nrows; i++) {
+        if (leading_pos(i, matrix) != -1)
+            rank++;
+    }
+    return rank;
+}
+
+const char *echelon_error (const struct echelon_solver *solver)
+{
+    return solver->error;
+}
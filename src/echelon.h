@@ -0,0 +1,125 @@
+#ifndef __ECHELON_H__
+#define __ECHELON_H__
+
+#include <stdbool.h>
+#include "matrix.h"
+
+/* libechelon: the dense engines of echelon, for use from other programs.
+ *
+ * Nothing here prints anything. Errors are kept in the solver for
+ * echelon_error, and the row operations of a solve can be passed to a
+ * callback instead of being traced. A solver holds the scratch space of
+ * the engines, so solving matrices no bigger than the ones before it
+ * allocates nothing.
+ *
+ * Separate threads may use separate solvers at once, as long as
+ * echelon_init was given one thread. With more, the worker pool is shared,
+ * and only one thread may be solving at a time.
+ */
+
+/* The row operations passed to a step callback */
+enum echelon_op {
+    ECHELON_SWAP = 1,  // rows row1 and row2 traded places
+    ECHELON_SCALE = 2, // row1 was multiplied by scalar
+    ECHELON_ADD = 3,   // scalar times row2 was added to row1
+};
+
+/* One row operation, with rows counted from 0 */
+struct echelon_step {
+    enum echelon_op op;
+    int row1;
+    int row2;      // -1 for ECHELON_SCALE
+    double scalar; // 0 for ECHELON_SWAP
+};
+
+/* Called after each row operation, with arg as given to echelon_on_step */
+typedef void (*echelon_step_fn) (void *arg, const struct echelon_step *step);
+
+struct echelon_solver;
+
+/* Pick the row kernels for this CPU and start the worker threads.
+ *
+ * pre:  not already initialized; nthreads >= 1, or 0 for one per CPU
+ * post: returns true if ready, false if the threads could not be started;
+ *       nothing is printed either way
+ */
+bool echelon_init (int nthreads);
+
+/* Stop the worker threads.
+ *
+ * pre:  no solve is in progress
+ * post: echelon_init may be called again
+ */
+void echelon_shutdown (void);
+
+/* Make a matrix of zeroes. Entries are reached through MAT in matrix.h or
+ * echelon_matrix_row.
+ *
+ * pre:  nrows > 0, ncols > 0
+ * post: returns the matrix, or NULL if it could not be allocated
+ */
+struct matrix *echelon_matrix_create (int nrows, int ncols);
+
+/* Free a matrix.
+ *
+ * pre:  matrix came from echelon_matrix_create, or is NULL
+ * post: its memory is released
+ */
+void echelon_matrix_free (struct matrix *matrix);
+
+/* Get a row of a matrix, to read or fill in.
+ *
+ * pre:  0 <= row < matrix->nrows
+ * post: returns a pointer to its ncols entries
+ */
+double *echelon_matrix_row (struct matrix *matrix, int row);
+
+/* Make a solver.
+ *
+ * pre:  none
+ * post: returns the solver, or NULL if it could not be allocated
+ */
+struct echelon_solver *echelon_solver_create (void);
+
+/* Free a solver and its scratch space.
+ *
+ * pre:  solver came from echelon_solver_create, or is NULL
+ * post: its memory is released
+ */
+void echelon_solver_free (struct echelon_solver *solver);
+
+/* Have every row operation of the solver's solves passed to a callback.
+ *
+ * pre:  solver is initialized, fn is NULL to stop
+ * post: fn is called with arg after each operation, on the thread that
+ *       called echelon_solve
+ */
+void echelon_on_step (struct echelon_solver *solver, echelon_step_fn fn,
+        void *arg);
+
+/* Put a matrix into echelon form, or reduced echelon form if reduced is
+ * set, with each leading entry 1.
+ *
+ * pre:  echelon_init was called, solver and matrix are initialized
+ * post: returns true if the matrix reached that form, false after leaving
+ *       a message for echelon_error
+ */
+bool echelon_solve (struct echelon_solver *solver, struct matrix *matrix,
+        bool reduced);
+
+/* Find the rank and pivot columns of a matrix in echelon form.
+ *
+ * pre:  matrix was solved, pivots has room for nrows entries or is NULL
+ * post: returns the rank, after storing the pivot column of each nonzero
+ *       row in pivots unless it is NULL
+ */
+int echelon_rank (const struct matrix *matrix, int *pivots);
+
+/* Describe what went wrong in the last solve that failed.
+ *
+ * pre:  solver is initialized
+ * post: returns the message, "" if no solve has failed
+ */
+const char *echelon_error (const struct echelon_solver *solver);
+
+#endif
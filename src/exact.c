@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "exact.h"
+#include "pool.h"
+
+/* Set r to 10^n.
+ *
+ * pre:  r was initialized, n >= 0
+ * post: returns true on success, false if memory ran out
+ */
+static bool power_of_ten (struct bigint *r, int n)
+{
+    struct bigint step;
+    bool success = true;
+    bigint_init(&step);
+    bigint_set_int(r, 1);
+    while (n > 0 && success) {
+        int k = n < 18 ? n : 18;
+        int64_t p = 1;
+        for (int i = 0; i < k; i++)
+            p *= 10;
+        bigint_set_int(&step, p);
+        success = bigint_mul(r, r, &step);
+        n -= k;
+    }
+    bigint_clear(&step);
+    return success;
+}
+
+/* Parse a decimal with an optional exponent, the same syntax parse_double
+ * takes, as the fraction num / den.
+ *
+ * pre:  s is NUL terminated, num and den were initialized
+ * post: returns true and sets end past the number on success, false if
+ *       there is no number at s or memory ran out
+ */
+static bool parse_decimal_exact (const char *s, const char **end,
+        struct bigint *num, struct bigint *den)
+{
+    const char *p = s;
+    bool negative = false;
+    if (*p == '+' || *p == '-')
+        negative = (*p++ == '-');
+
+    /* Gather the digits on both sides of the point */
+    const char *int_digits = p;
+    while (*p >= '0' && *p <= '9')
+        p++;
+    int int_len = p - int_digits;
+    const char *frac_digits = p;
+    int frac_len = 0;
+    if (*p == '.') {
+        frac_digits = ++p;
+        while (*p >= '0' && *p <= '9')
+            p++;
+        frac_len = p - frac_digits;
+    }
+    if (int_len + frac_len == 0)
+        return false;
+
+    long exponent = -frac_len;
+    if (*p == 'e' || *p == 'E') {
+        const char *q = p + 1;
+        bool exp_negative = false;
+        long exp = 0;
+        if (*q == '+' || *q == '-')
+            exp_negative = (*q++ == '-');
+        if (*q < '0' || *q > '9')
+            return false;
+        for (; *q >= '0' && *q <= '9'; q++) {
+            if (exp <= EXACT_MAX_EXPONENT)
+                exp = exp * 10 + (*q - '0');
+        }
+        if (exp > EXACT_MAX_EXPONENT)
+            return false;
+        exponent += exp_negative ? -exp : exp;
+        p = q;
+    }
+    *end = p;
+
+    /* The mantissa is the digits with the point taken out */
+    int len = int_len + frac_len;
+    char *digits = malloc(len + 1);
+    if (digits == NULL)
+        return false;
+    digits[0] = negative ? '-' : '+';
+    memcpy(digits + 1, int_digits, int_len);
+    memcpy(digits + 1 + int_len, frac_digits, frac_len);
+    bool success = bigint_parse(num, digits, len + 1);
+    free(digits);
+    if (!success)
+        return false;
+
+    if (exponent >= 0) {
+        struct bigint scale;
+        bigint_init(&scale);
+        success = power_of_ten(&scale, exponent) && bigint_mul(num, num, &scale);
+        bigint_clear(&scale);
+        bigint_set_int(den, 1);
+        return success;
+    }
+    return power_of_ten(den, -exponent);
+}
+
+/* Put a fraction in lowest terms with a positive denominator.
+ *
+ * pre:  den != 0
+ * post: returns true on success, false if memory ran out
+ */
+static bool reduce_fraction (struct bigint *num, struct bigint *den)
+{
+    if (bigint_sign(den) < 0 && !(bigint_neg(num) && bigint_neg(den)))
+        return false;
+
+    struct bigint g;
+    bigint_init(&g);
+    bool success = bigint_gcd(&g, num, den)
+                   && bigint_divexact(num, num, &g)
+                   && bigint_divexact(den, den, &g);
+    bigint_clear(&g);
+    return success;
+}
+
+bool parse_rational (const char *tok, struct bigint *num, struct bigint *den)
+{
+    bool success = false;
+    const char *p;
+    struct bigint num2, den2;
+    bigint_init(&num2);
+    bigint_init(&den2);
+
+    if (!parse_decimal_exact(tok, &p, num, den))
+        goto out;
+    if (*p == '/') {
+        /* (a/b) / (c/d) = (a*d) / (b*c) */
+        if (!parse_decimal_exact(p + 1, &p, &num2, &den2)
+                || bigint_sign(&num2) == 0
+                || !bigint_mul(num, num, &den2) || !bigint_mul(den, den, &num2))
+            goto out;
+    }
+    if (*p != '\0')
+        goto out;
+    success = reduce_fraction(num, den);
+out:
+    bigint_clear(&num2);
+    bigint_clear(&den2);
+    return success;
+}
+
+struct exact_matrix *exact_create (int nrows, int ncols)
+{
+    struct exact_matrix *matrix = malloc(sizeof(struct exact_matrix));
+    if (matrix == NULL)
+        return NULL;
+    matrix->nrows = nrows;
+    matrix->ncols = ncols;
+    matrix->entries = malloc((size_t) nrows * ncols * sizeof(struct bigint));
+    if (matrix->entries == NULL) {
+        free(matrix);
+        return NULL;
+    }
+    for (size_t i = 0; i < (size_t) nrows * ncols; i++)
+        bigint_init(&matrix->entries[i]);
+    return matrix;
+}
+
+void exact_free (struct exact_matrix *matrix)
+{
+    if (matrix == NULL)
+        return;
+    for (size_t i = 0; i < (size_t) matrix->nrows * matrix->ncols; i++)
+        bigint_clear(&matrix->entries[i]);
+    free(matrix->entries);
+    free(matrix);
+}
+
+bool exact_set_row (struct exact_matrix *matrix, int row,
+        const struct bigint *nums, const struct bigint *dens)
+{
+    bool success = false;
+    struct bigint lcm, g, t;
+    bigint_init(&lcm);
+    bigint_init(&g);
+    bigint_init(&t);
+
+    /* lcm(l, d) = l / gcd(l, d) * d */
+    bigint_set_int(&lcm, 1);
+    for (int j = 0; j < matrix->ncols; j++) {
+        if (bigint_sign(&nums[j]) == 0)
+            continue;
+        if (!bigint_gcd(&g, &lcm, &dens[j])
+                || !bigint_divexact(&t, &dens[j], &g)
+                || !bigint_mul(&lcm, &lcm, &t))
+            goto out;
+    }
+
+    for (int j = 0; j < matrix->ncols; j++) {
+        if (!bigint_divexact(&t, &lcm, &dens[j])
+                || !bigint_mul(&EXACT(matrix, row, j), &nums[j], &t))
+            goto out;
+    }
+    success = true;
+out:
+    bigint_clear(&lcm);
+    bigint_clear(&g);
+    bigint_clear(&t);
+    return success;
+}
+
+/* Find the first nonzero entry of a row at or after a column.
+ *
+ * pre:  0 <= from <= ncols
+ * post: returns its column, or ncols if there is none
+ */
+static int leading_from (const struct exact_matrix *matrix, int row, int from)
+{
+    while (from < matrix->ncols && bigint_sign(&EXACT(matrix, row, from)) == 0)
+        from++;
+    return from;
+}
+
+char *exact_entry_string (const struct exact_matrix *matrix, int row, int col)
+{
+    const struct bigint *entry = &EXACT(matrix, row, col);
+    if (bigint_sign(entry) == 0)
+        return strdup("0");
+
+    struct bigint num, den;
+    char *s = NULL;
+    bigint_init(&num);
+    bigint_init(&den);
+    if (!bigint_set(&num, entry)
+            || !bigint_set(&den, &EXACT(matrix, row, leading_from(matrix, row, 0)))
+            || !reduce_fraction(&num, &den))
+        goto out;
+
+    s = bigint_to_string(&num);
+    if (s != NULL && !(den.len == 0 && den.small == 1)) {
+        char *d = bigint_to_string(&den);
+        char *frac = d == NULL ? NULL : malloc(strlen(s) + strlen(d) + 2);
+        if (frac != NULL)
+            sprintf(frac, "%s/%s", s, d);
+        free(s);
+        free(d);
+        s = frac;
+    }
+out:
+    bigint_clear(&num);
+    bigint_clear(&den);
+    return s;
+}
+
+/* One Bareiss step applied to a range of rows, shared out by pool_for:
+ *
+ *     a[k][j] = (p * a[k][j] - a[k][col] * a[pivot_row][j]) / prev
+ *
+ * for every row k in the range, which leaves a[k][col] at zero and scales
+ * the rest of the row by p / prev. The row's entries before its leading
+ * column stay zero and are skipped.
+ */
+struct bareiss_step {
+    struct exact_matrix *matrix;
+    int pivot_row;             // row holding the pivot p
+    int col;                   // column of the pivot
+    const struct bigint *prev; // the previous pivot, which divides exactly
+    int first_row;             // row that item 0 stands for
+    int *leads;                // leading column of each row
+    bool failed;               // set if memory ran out
+};
+
+static void bareiss_task (void *arg, int begin, int end)
+{
+    struct bareiss_step *s = arg;
+    struct exact_matrix *matrix = s->matrix;
+    int ncols = matrix->ncols;
+    const struct bigint *p = &EXACT(matrix, s->pivot_row, s->col);
+
+    for (int k = s->first_row + begin; k < s->first_row + end; k++) {
+        int lead = s->leads[k];
+        if (lead == ncols)
+            continue; // a row of zeroes stays that way
+        struct bigint *a = &EXACT(matrix, k, 0);
+        const struct bigint *pivot = &EXACT(matrix, s->pivot_row, 0);
+        for (int j = lead; j < ncols; j++) {
+            if (j != s->col
+                    && !bigint_cross(&a[j], p, &a[j], &a[s->col], &pivot[j], s->prev)) {
+                __atomic_store_n(&s->failed, true, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+        bigint_set_int(&a[s->col], 0);
+        if (lead == s->col)
+            s->leads[k] = leading_from(matrix, k, s->col + 1);
+    }
+}
+
+/* Roughly how many double-sized entries one update with this pivot is
+ * worth, for pool_for: a cross product and an exact division, each taking
+ * time quadratic in the length of the numbers.
+ *
+ * pre:  p was initialized
+ * post: returns the estimate
+ */
+static size_t update_cost (const struct bigint *p)
+{
+    size_t limbs = p->len > 0 ? p->len : 1;
+    return 16 * limbs * limbs;
+}
+
+bool exact_echelon (struct exact_matrix *matrix)
+{
+    bool success = false;
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+
+    int *leads = malloc(nrows * sizeof(int));
+    if (leads == NULL)
+        return success;
+    for (int i = 0; i < nrows; i++)
+        leads[i] = leading_from(matrix, i, 0);
+
+    struct bigint one;
+    bigint_init(&one);
+    bigint_set_int(&one, 1);
+    const struct bigint *prev = &one;
+
+    int last_leading = -1;
+    for (int i = 0; i < nrows; i++) {
+        /* Bring up a row with the leftmost leading entry, making the same
+         * swaps echelon_step would */
+        int desired_leading = last_leading + 1;
+        int current_leading = leads[i];
+        for (int k = i+1; k < nrows && current_leading != desired_leading; k++) {
+            int k_leading = leads[k];
+            if (k_leading < current_leading) {
+                for (int j = 0; j < ncols; j++)
+                    bigint_swap(&EXACT(matrix, i, j), &EXACT(matrix, k, j));
+                leads[k] = current_leading;
+                leads[i] = k_leading;
+                current_leading = k_leading;
+            }
+        }
+        if (current_leading == ncols)
+            break; // only rows of zeroes are left
+
+        struct bareiss_step step = { matrix, i, current_leading, prev, i+1,
+                                     leads, false };
+        pool_for(bareiss_task, &step, nrows - (i+1),
+                 (ncols - current_leading)
+                 * update_cost(&EXACT(matrix, i, current_leading)));
+        if (step.failed) {
+            bigint_clear(&one);
+            free(leads);
+            return success;
+        }
+        prev = &EXACT(matrix, i, current_leading);
+        last_leading = current_leading;
+    }
+    bigint_clear(&one);
+    free(leads);
+    success = true;
+    return success;
+}
+
+bool exact_reduced_echelon (struct exact_matrix *matrix)
+{
+    bool success = false;
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+
+    int *leads = malloc(nrows * sizeof(int));
+    if (leads == NULL)
+        return success;
+    int rank = 0;
+    while (rank < nrows && (leads[rank] = leading_from(matrix, rank, 0)) < ncols)
+        rank++;
+
+    /* The rows above pivot k have to be brought up to date with the steps
+     * they missed, so they are done in the order exact_echelon made them.
+     * Each step divides by the previous pivot as it was then, which row
+     * k-1 still holds, since it is only changed by the steps after it. */
+    struct bigint prev;
+    bigint_init(&prev);
+    for (int k = 1; k < rank; k++) {
+        if (!bigint_set(&prev, &EXACT(matrix, k-1, leads[k-1])))
+            goto out;
+        struct bareiss_step step = { matrix, k, leads[k], &prev, 0, leads,
+                                     false };
+        pool_for(bareiss_task, &step, k,
+                 ncols * update_cost(&EXACT(matrix, k, leads[k])));
+        if (step.failed)
+            goto out;
+    }
+    success = true;
+out:
+    bigint_clear(&prev);
+    free(leads);
+    return success;
+}
@@ -0,0 +1,89 @@
+#ifndef __EXACT_H__
+#define __EXACT_H__
+
+#include <stdbool.h>
+#include "bigint.h"
+
+/* Matrices of rational numbers, solved without rounding.
+ *
+ * Every row is kept as integers: its entries are the row's true values
+ * times some nonzero factor that is common to the whole row. Elimination
+ * is fraction-free (Bareiss): each update is a 2x2 cross product divided
+ * exactly by the previous pivot, so entries stay as small as the minors
+ * of the matrix and no gcds are needed along the way. Only printing turns
+ * rows back into fractions, by dividing through by their leading entry.
+ */
+
+/* Exponents past this are refused rather than expanded into digits */
+#define EXACT_MAX_EXPONENT 1000
+
+struct exact_matrix {
+    int nrows;
+    int ncols;
+    struct bigint *entries; // nrows * ncols entries, row by row
+};
+
+/* Access the entry at (row, col) of an exact matrix. */
+#define EXACT(m, row, col) ((m)->entries[(size_t) (row) * (m)->ncols + (col)])
+
+/* Parse a token as a rational number: an integer, a decimal with an
+ * optional exponent, or a fraction of two of those like -1/3 or 0.5/7.
+ *
+ * pre:  tok is a NUL terminated token, num and den were initialized
+ * post: returns true and stores the value as num / den, in lowest terms
+ *       with den > 0, on success; false if tok is not a number, is a
+ *       fraction with a zero denominator, or memory ran out
+ */
+bool parse_rational (const char *tok, struct bigint *num, struct bigint *den);
+
+/* Make an exact matrix of zeroes.
+ *
+ * pre:  nrows > 0, ncols > 0
+ * post: returns the matrix, or NULL if it could not be allocated
+ */
+struct exact_matrix *exact_create (int nrows, int ncols);
+
+/* Free an exact matrix.
+ *
+ * pre:  matrix came from exact_create, or is NULL
+ * post: its memory is released
+ */
+void exact_free (struct exact_matrix *matrix);
+
+/* Set a row from fractions, clearing their denominators.
+ *
+ * pre:  nums and dens hold ncols fractions with positive denominators
+ * post: returns true after storing the row times the lcm of dens, false
+ *       if memory ran out
+ */
+bool exact_set_row (struct exact_matrix *matrix, int row,
+        const struct bigint *nums, const struct bigint *dens);
+
+/* Write an entry as a fraction in lowest terms, as the row is meant to be
+ * read: its true values, scaled so the leading entry is 1.
+ *
+ * pre:  matrix is initialized
+ * post: returns a string like "-7/2" or "3" to free, or NULL if memory
+ *       ran out
+ */
+char *exact_entry_string (const struct exact_matrix *matrix, int row, int col);
+
+/* Put an exact matrix into echelon form, choosing pivot rows the same way
+ * auto_echelon does so the (normalized) result is what it would give
+ * without rounding.
+ *
+ * pre:  matrix is initialized
+ * post: returns true if reached echelon form, false if memory ran out
+ */
+bool exact_echelon (struct exact_matrix *matrix);
+
+/* Given an exact matrix in echelon form, cancel out the entries above each
+ * pivot. Afterwards every pivot holds the same value.
+ *
+ * pre:  matrix was put in echelon form by exact_echelon
+ * post: returns true if reached reduced echelon form, false if memory ran
+ *       out
+ */
+bool exact_reduced_echelon (struct exact_matrix *matrix);
+
+#endif
@@ -0,0 +1,217 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "format.h"
+
+enum matrix_format matrix_format = FORMAT_PLAIN;
+
+/* Write the decimal digits of n.
+ *
+ * pre:  dst has room for 20 bytes
+ * post: returns how many were written
+ */
+static int format_uint (char *dst, uint64_t n)
+{
+    char digits[20];
+    int len = 0;
+    do {
+        digits[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    for (int k = 0; k < len; k++)
+        dst[k] = digits[len - 1 - k];
+    return len;
+}
+
+int format_fixed (char *dst, double value)
+{
+    double a = fabs(value);
+    if (!(a < 0x1p53))
+        return snprintf(dst, FORMAT_ENTRY_MAX, "%.4f", value);
+
+    /* Everything here is positive and below 2^53, so converting to an
+     * integer truncates exactly, without a call to trunc or floor */
+    uint64_t ipart = (uint64_t) a;
+    double frac = a - (double) ipart;
+    uint64_t fpart = 0;
+
+    /* Integers, like most entries of a reduced echelon form, have nothing
+     * to round. Otherwise the fraction times 10^4 is hi * 10^4 + lo * 10^4,
+     * where hi holds its top 26 bits, so both products are exact whenever
+     * the fraction is big enough for the rounding to be in doubt. Then
+     * whether it is more or less than halfway to the next integer is the
+     * sign of a single sum, which rounding can't change. */
+    if (frac != 0) {
+        double hi = (double) (uint64_t) (frac * 0x1p26) * 0x1p-26;
+        double lo = frac - hi;
+        double scaled = hi * 10000;
+        fpart = (uint64_t) scaled;
+        double past_half = (scaled - (double) fpart - 0.5) + lo * 10000;
+
+        if (past_half > 0 || (past_half == 0 && fpart % 2 == 1))
+            fpart++;
+        if (fpart == 10000) {
+            ipart++;
+            fpart = 0;
+        }
+    }
+
+    int len = 0;
+    if (value < 0)
+        dst[len++] = '-';
+    len += format_uint(dst + len, ipart);
+    dst[len++] = '.';
+    for (int k = 3; k >= 0; k--) {
+        dst[len + k] = '0' + fpart % 10;
+        fpart /= 10;
+    }
+    return len + 4;
+}
+
+int format_fraction (char *dst, double value)
+{
+    double a = fabs(value);
+    int len = 0;
+    if (a < 0x1p53 && a == trunc(a)) {
+        if (value < 0)
+            dst[len++] = '-';
+        return len + format_uint(dst + len, (uint64_t) a);
+    } else if (!(a < 0x1p40)) {
+        return format_fixed(dst, value);
+    }
+
+    /* Go through the convergents of its continued fraction, the closest
+     * fractions for the size of their denominators, until one is close
+     * enough or the denominators get too big */
+    double tolerance = 1e-9 * (a > 1 ? a : 1);
+    int64_t h0 = 0, h1 = 1; // numerators of the last two convergents
+    int64_t k0 = 1, k1 = 0; // and their denominators
+    double r = a;
+    for (;;) {
+        double term = floor(r);
+        if (k1 > 0 && term > FORMAT_MAX_DENOMINATOR)
+            break;
+        int64_t h = (int64_t) term * h1 + h0;
+        int64_t k = (int64_t) term * k1 + k0;
+        if (k > FORMAT_MAX_DENOMINATOR)
+            break;
+        if (fabs(a - (double) h / k) <= tolerance) {
+            if (value < 0)
+                dst[len++] = '-';
+            len += format_uint(dst + len, h);
+            if (k != 1) {
+                dst[len++] = '/';
+                len += format_uint(dst + len, k);
+            }
+            return len;
+        }
+        h0 = h1;
+        h1 = h;
+        k0 = k1;
+        k1 = k;
+        if (r == term)
+            break;
+        r = 1 / (r - term);
+    }
+    return format_fixed(dst, value);
+}
+
+/* Hand the text collected so far to the stream.
+ *
+ * pre:  f was started
+ * post: f's buffer is empty
+ */
+static void formatter_flush (struct formatter *f)
+{
+    fwrite(f->buf, 1, f->len, f->out);
+    f->len = 0;
+}
+
+void formatter_start (struct formatter *f, FILE *out, enum matrix_format format)
+{
+    f->out = out;
+    f->format = format;
+    f->width = format == FORMAT_PLAIN ? 5 : 0; // like "%5.4lf"
+    f->lowest = 0;
+    f->highest = 0;
+    f->len = 0;
+}
+
+void formatter_fit (struct formatter *f, double value)
+{
+    if (f->format == FORMAT_FRACTIONS) {
+        char text[FORMAT_ENTRY_MAX];
+        int len = format_fraction(text, value);
+        if (len > f->width)
+            f->width = len;
+    } else if (isfinite(value)) {
+        /* With four decimals, the text only gets longer further from 0,
+         * so the extremes are the widest. Infinities and NaNs are
+         * narrower than 0.0000. */
+        if (value < f->lowest)
+            f->lowest = value;
+        if (value > f->highest)
+            f->highest = value;
+    }
+}
+
+void formatter_banner (struct formatter *f, int ncols)
+{
+    if (f->format == FORMAT_CSV)
+        return;
+    if (f->format == FORMAT_ALIGNED) {
+        char text[FORMAT_ENTRY_MAX];
+        int low = format_fixed(text, f->lowest);
+        int high = format_fixed(text, f->highest);
+        f->width = low > high ? low : high;
+    }
+
+    size_t stars = 5 * ((size_t) ncols + 2);
+    while (stars > 0) {
+        if (f->len == FORMAT_BUFFER)
+            formatter_flush(f);
+        size_t n = FORMAT_BUFFER - f->len;
+        if (n > stars)
+            n = stars;
+        memset(f->buf + f->len, '*', n);
+        f->len += n;
+        stars -= n;
+    }
+    if (f->len == FORMAT_BUFFER)
+        formatter_flush(f);
+    f->buf[f->len++] = '\n';
+}
+
+void formatter_entry (struct formatter *f, double value, bool last)
+{
+    // Room for the widest entry, padded, with a space and a newline
+    if (FORMAT_BUFFER - f->len < (size_t) FORMAT_ENTRY_MAX + f->width + 2)
+        formatter_flush(f);
+
+    char *p = f->buf + f->len;
+    int len = f->format == FORMAT_FRACTIONS ? format_fraction(p, value)
+                                            : format_fixed(p, value);
+    if (len < f->width) {
+        int pad = f->width - len;
+        memmove(p + pad, p, len);
+        memset(p, ' ', pad);
+        len = f->width;
+    }
+
+    if (f->format == FORMAT_CSV) {
+        p[len++] = last ? '\n' : ',';
+    } else {
+        p[len++] = ' ';
+        if (last)
+            p[len++] = '\n';
+    }
+    f->len += len;
+}
+
+void formatter_finish (struct formatter *f)
+{
+    if (f->len == FORMAT_BUFFER)
+        formatter_flush(f);
+    f->buf[f->len++] = '\n';
+    formatter_flush(f);
+}
@@ -0,0 +1,122 @@
+#ifndef __FORMAT_H__
+#define __FORMAT_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Turning the entries of a matrix into text, without printf.
+ *
+ * printf takes the stream's lock and parses its format for every entry,
+ * and converts with arbitrary precision arithmetic whatever the value.
+ * Here an entry below 2^53 is converted with integer arithmetic, and
+ * rounded exactly like printf rounds it, from the exact binary value with
+ * ties to even. Bigger ones, infinities and NaNs still go to snprintf.
+ * The text collects in a buffer in the formatter, and goes to the stream
+ * in FORMAT_BUFFER sized pieces. Nothing is allocated, and nothing is
+ * written to the matrix.
+ */
+
+/* Bytes of text collected before writing them out */
+#define FORMAT_BUFFER 32768
+
+/* Longest text of one entry: the digits of the biggest double, with a
+ * sign, point and four decimals */
+#define FORMAT_ENTRY_MAX 320
+
+/* Biggest denominator format_fraction tries. Distinct fractions this
+ * small are at least a millionth apart, so only one can be close enough */
+#define FORMAT_MAX_DENOMINATOR 1000
+
+/* How to lay out the entries of a matrix */
+enum matrix_format {
+    FORMAT_PLAIN,     // four decimals and a space after each entry, under
+                      // a line of stars
+    FORMAT_ALIGNED,   // like plain, with every entry padded to the width
+                      // of the widest, so the columns line up
+    FORMAT_CSV,       // four decimals separated by commas, with no stars
+    FORMAT_FRACTIONS, // like aligned, with each entry the nearest fraction
+                      // with a small denominator if it is close enough
+};
+
+/* How print_matrix lays out matrices, FORMAT_PLAIN unless changed */
+extern enum matrix_format matrix_format;
+
+/* One matrix being printed */
+struct formatter {
+    FILE *out;
+    enum matrix_format format;
+    int width;                 // what entries are padded to, if aligned
+    double lowest;             // the lowest and highest entries seen by
+    double highest;            // formatter_fit, for the width
+    size_t len;                // bytes of text in buf
+    char buf[FORMAT_BUFFER];
+};
+
+/* Start printing a matrix.
+ *
+ * pre:  out is open for writing
+ * post: f is ready for formatter_fit, if formatter_aligned(f), or else for
+ *       formatter_banner
+ */
+void formatter_start (struct formatter *f, FILE *out, enum matrix_format format);
+
+/* Check whether the entries have to be passed to formatter_fit before any
+ * are printed.
+ *
+ * pre:  f was started
+ * post: returns true for the layouts that pad entries to a common width
+ */
+static inline bool formatter_aligned (const struct formatter *f)
+{
+    return f->format == FORMAT_ALIGNED || f->format == FORMAT_FRACTIONS;
+}
+
+/* Make room for an entry in the common width.
+ *
+ * pre:  f was started, and nothing has been printed with it yet
+ * post: entries are padded at least to the width of value
+ */
+void formatter_fit (struct formatter *f, double value);
+
+/* Print the line of stars above a matrix, if the layout has one, and
+ * settle the width of the entries.
+ *
+ * pre:  f was started, and every entry fitted if formatter_aligned(f)
+ * post: the banner is in f's buffer
+ */
+void formatter_banner (struct formatter *f, int ncols);
+
+/* Print one entry of a row.
+ *
+ * pre:  the banner was printed, last says whether this ends the row
+ * post: the entry and what follows it are in f's buffer, and the buffer
+ *       was written out if it filled up
+ */
+void formatter_entry (struct formatter *f, double value, bool last);
+
+/* Print the blank line after a matrix, and write out everything left.
+ *
+ * pre:  f was started
+ * post: all of the text was handed to f->out
+ */
+void formatter_finish (struct formatter *f);
+
+/* Write the text of an entry with four decimals, exactly as "%.4f" would,
+ * except that -0 is written as 0.0000.
+ *
+ * pre:  dst has room for FORMAT_ENTRY_MAX bytes
+ * post: returns the length of the text, which isn't NUL terminated
+ */
+int format_fixed (char *dst, double value);
+
+/* Write the text of an entry as a fraction like -1/3, or an integer, if
+ * one with a denominator of at most FORMAT_MAX_DENOMINATOR is within a
+ * billionth of it (relative to it, if it is bigger than 1), or else with
+ * four decimals like format_fixed.
+ *
+ * pre:  dst has room for FORMAT_ENTRY_MAX bytes
+ * post: returns the length of the text, which isn't NUL terminated
+ */
+int format_fraction (char *dst, double value);
+
+#endif
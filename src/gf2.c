@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gf2.h"
+#include "kernels.h"
+#include "pool.h"
+
+/* Number of words that fit in one aligned block */
+#define ALIGN_WORDS (MATRIX_ALIGN / sizeof(uint64_t))
+
+/* Pivots that share one table of sums, and the size of that table */
+#define TABLE_BITS 8
+#define TABLE_ROWS (1 << TABLE_BITS)
+
+/* Most pivots cleared at once, which is one table per TABLE_BITS of them */
+#define BLOCK_PIVOTS 64
+#define BLOCK_TABLES (BLOCK_PIVOTS / TABLE_BITS)
+
+struct gf2_matrix *gf2_create (int nrows, int ncols)
+{
+    if (nrows <= 0 || ncols <= 0)
+        return NULL;
+
+    /* Pad each row out to a whole number of aligned blocks */
+    size_t words = ((size_t) ncols + 63) / 64;
+    words = (words + ALIGN_WORDS - 1) / ALIGN_WORDS * ALIGN_WORDS;
+    if ((size_t) nrows > SIZE_MAX / sizeof(uint64_t) / words)
+        return NULL; // would overflow the size computation
+
+    struct gf2_matrix *m = malloc(sizeof(*m));
+    if (m == NULL)
+        return NULL;
+    m->rows = malloc(nrows * sizeof(uint64_t *));
+    size_t bytes = (size_t) nrows * words * sizeof(uint64_t);
+    if (m->rows == NULL || posix_memalign((void **) &m->data, MATRIX_ALIGN, bytes) != 0) {
+        free(m->rows);
+        free(m);
+        return NULL;
+    }
+    memset(m->data, 0, bytes);
+    for (int i = 0; i < nrows; i++)
+        m->rows[i] = m->data + (size_t) i * words;
+
+    m->nrows = nrows;
+    m->ncols = ncols;
+    m->words = (int) words;
+    return m;
+}
+
+struct gf2_matrix *gf2_from_dense (const struct matrix *dense)
+{
+    struct gf2_matrix *m = gf2_create(dense->nrows, dense->ncols);
+    if (m == NULL) {
+        fprintf(stderr, "Could not allocate a %d x %d matrix mod 2\n",
+                dense->nrows, dense->ncols);
+        return NULL;
+    }
+    for (int i = 0; i < dense->nrows; i++) {
+        for (int j = 0; j < dense->ncols; j++) {
+            double x = MAT(dense, i, j);
+            /* Out of the range of an int64_t, or with a fractional part */
+            if (!(x > -9.2e18 && x < 9.2e18) || (double) (int64_t) x != x) {
+                fprintf(stderr, "The value at row %d, column %d is not a "
+                                "whole number.\n", i+1, j+1);
+                gf2_free(m);
+                return NULL;
+            }
+            gf2_set(m, i, j, (int) ((int64_t) x & 1));
+        }
+    }
+    return m;
+}
+
+void gf2_free (struct gf2_matrix *matrix)
+{
+    if (matrix == NULL)
+        return;
+    free(matrix->data);
+    free(matrix->rows);
+    free(matrix);
+}
+
+void gf2_set (struct gf2_matrix *matrix, int row, int col, int bit)
+{
+    uint64_t mask = (uint64_t) 1 << (col % 64);
+    if (bit)
+        matrix->rows[row][col / 64] |= mask;
+    else
+        matrix->rows[row][col / 64] &= ~mask;
+}
+
+/* Words of a row that can hold entries, leaving out the padding */
+static int used_words (const struct gf2_matrix *matrix)
+{
+    return (matrix->ncols + 63) / 64;
+}
+
+/* Add row src to row dst, from the word holding column col on. The
+ * caller knows src is zero to the left of col.
+ *
+ * pre:  matrix is initialized, 0 <= col < ncols
+ * post: dst += src
+ */
+static void add_row_from (struct gf2_matrix *matrix, int dst, int src, int col)
+{
+    int w = col / 64;
+    kernels.xor_words(matrix->rows[dst] + w, matrix->rows[src] + w,
+                      used_words(matrix) - w);
+}
+
+/* Find the leading column of a row, knowing it is at least from.
+ *
+ * pre:  matrix is initialized, 0 <= from <= ncols
+ * post: returns the column of the first 1, ncols if none
+ */
+static int leading_from (const struct gf2_matrix *matrix, int row, int from)
+{
+    if (from >= matrix->ncols)
+        return matrix->ncols;
+    const uint64_t *r = matrix->rows[row];
+    int w = from / 64;
+    uint64_t word = r[w] & (~(uint64_t) 0 << (from % 64));
+    while (word == 0) {
+        if (++w == used_words(matrix))
+            return matrix->ncols;
+        word = r[w];
+    }
+    return w * 64 + __builtin_ctzll(word);
+}
+
+static void swap_rows (struct gf2_matrix *matrix, int row1, int row2)
+{
+    uint64_t *temp = matrix->rows[row1];
+    matrix->rows[row1] = matrix->rows[row2];
+    matrix->rows[row2] = temp;
+}
+
+/* ------------------------------------------------------------------------
+ * One pivot at a time, in the same order as auto_echelon
+ * --------------------------------------------------------------------- */
+
+/* Cancel the 1s under (or over) a leading 1 in a range of rows, shared out
+ * by pool_for */
+struct cancel_rows {
+    struct gf2_matrix *matrix;
+    int pivot_row; // row with the leading 1
+    int first_row; // row that task item 0 stands for
+    int lead;      // column of the leading 1
+    int *leads;    // leading columns to keep up to date, or NULL
+};
+
+static void cancel_task (void *arg, int begin, int end)
+{
+    struct cancel_rows *c = arg;
+    struct gf2_matrix *matrix = c->matrix;
+    for (int k = c->first_row + begin; k < c->first_row + end; k++) {
+        if (!GF2(matrix, k, c->lead))
+            continue;
+        add_row_from(matrix, k, c->pivot_row, c->lead);
+        if (c->leads != NULL)
+            c->leads[k] = leading_from(matrix, k, c->lead + 1);
+    }
+}
+
+/* Cancel the 1s in a range of rows, printing as much as trace asks.
+ *
+ * pre:  c describes the pivot, the rows are first_row <= k < end
+ * post: those rows are zero in the pivot's column
+ */
+static void cancel_all (struct cancel_rows *c, int end, enum trace_mode trace)
+{
+    struct gf2_matrix *matrix = c->matrix;
+    if (trace == TRACE_FULL) {
+        for (int k = c->first_row; k < end; k++) {
+            if (!GF2(matrix, k, c->lead))
+                continue;
+            cancel_task(c, k - c->first_row, k - c->first_row + 1);
+            trace_gf2(trace, matrix, "add R%d + (1 * R%d)", k+1, c->pivot_row+1);
+        }
+    } else {
+        /* Without the matrix to show in between, the rows can be done in
+         * any order, so report them first and share them out */
+        for (int k = c->first_row; k < end && trace != TRACE_QUIET; k++) {
+            if (GF2(matrix, k, c->lead))
+                trace_gf2(trace, matrix, "add R%d + (1 * R%d)", k+1, c->pivot_row+1);
+        }
+        pool_for(cancel_task, c, end - c->first_row,
+                 (size_t) (used_words(matrix) - c->lead / 64) * 64);
+    }
+}
+
+static bool stepwise_echelon (struct gf2_matrix *matrix, enum trace_mode trace)
+{
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+    int last_leading = -1;
+
+    int *leads = malloc(nrows * sizeof(int));
+    if (leads == NULL) {
+        fprintf(stderr, "Could not allocate the leading column list.\n");
+        return false;
+    }
+    for (int i = 0; i < nrows; i++)
+        leads[i] = leading_from(matrix, i, 0);
+
+    for (int i = 0; i < nrows; i++) {
+        /* Look for a row leading just right of the last pivot, taking any
+         * row that leads further left than the best so far, just like
+         * echelon_step */
+        int desired_leading = last_leading + 1;
+        int current_leading = leads[i];
+        for (int k = i+1; k < nrows && current_leading != desired_leading; k++) {
+            int k_leading = leads[k];
+            if (k_leading < current_leading) {
+                swap_rows(matrix, i, k);
+                leads[k] = current_leading;
+                leads[i] = k_leading;
+                trace_gf2(trace, matrix, "swap R%d <--> R%d", i+1, k+1);
+                current_leading = k_leading;
+            }
+        }
+        if (current_leading == ncols)
+            break; // only rows of zeroes are left
+
+        struct cancel_rows c = { matrix, i, i+1, current_leading, leads };
+        cancel_all(&c, nrows, trace);
+        last_leading = current_leading;
+    }
+    free(leads);
+    return true;
+}
+
+static void stepwise_reduced_echelon (struct gf2_matrix *matrix,
+        enum trace_mode trace)
+{
+    for (int i = matrix->nrows-1; i >= 0; i--) {
+        int lead = leading_from(matrix, i, 0);
+        if (lead == matrix->ncols)
+            continue;
+        struct cancel_rows c = { matrix, i, 0, lead, NULL };
+        cancel_all(&c, i, trace);
+    }
+}
+
+/* ------------------------------------------------------------------------
+ * Method of Four Russians, up to BLOCK_PIVOTS pivots at a time
+ * --------------------------------------------------------------------- */
+
+/* Tables of every sum of a block of pivot rows, TABLE_BITS pivots to a
+ * table, and the rows they clear, shared out by pool_for */
+struct block {
+    struct gf2_matrix *matrix;
+    int first_pivot;       // row of the first pivot, the rest follow it
+    int npivots;           // pivot rows in the block
+    int pivots[BLOCK_PIVOTS]; // their columns, in increasing order
+    int word;              // first word where any pivot row is nonzero
+    uint64_t *tables;      // TABLE_ROWS rows of stride words per table
+    size_t stride;
+    int first_row;         // row that task item 0 stands for
+};
+
+/* Make each pivot row of a block zero in the columns of the others.
+ *
+ * pre:  each pivot row is zero to the left of its own pivot column
+ * post: the pivot rows are reduced against each other
+ */
+static void reduce_block (struct block *b)
+{
+    for (int l = 1; l < b->npivots; l++) {
+        for (int a = 0; a < l; a++) {
+            if (GF2(b->matrix, b->first_pivot + a, b->pivots[l]))
+                add_row_from(b->matrix, b->first_pivot + a, b->first_pivot + l,
+                             b->pivots[l]);
+        }
+    }
+}
+
+/* Fill in the tables of a block, each entry from one smaller entry plus
+ * one pivot row.
+ *
+ * pre:  the pivot rows are reduced against each other
+ * post: entry i of table t is the sum of the pivot rows t * TABLE_BITS + p
+ *       for every bit p set in i
+ */
+static void build_tables (struct block *b)
+{
+    int width = used_words(b->matrix) - b->word;
+    for (int t = 0; t * TABLE_BITS < b->npivots; t++) {
+        uint64_t *table = b->tables + (size_t) t * TABLE_ROWS * b->stride;
+        int bits = b->npivots - t * TABLE_BITS;
+        if (bits > TABLE_BITS)
+            bits = TABLE_BITS;
+        memset(table, 0, width * sizeof(uint64_t));
+        for (int i = 1; i < (1 << bits); i++) {
+            uint64_t *entry = table + (size_t) i * b->stride;
+            const uint64_t *pivot = b->matrix->rows[b->first_pivot + t * TABLE_BITS
+                                                    + __builtin_ctz(i)] + b->word;
+            memcpy(entry, table + (size_t) (i & (i - 1)) * b->stride,
+                   width * sizeof(uint64_t));
+            kernels.xor_words(entry, pivot, width);
+        }
+    }
+}
+
+/* Clear the pivot columns of a range of rows, one table lookup per
+ * TABLE_BITS pivots */
+static void block_task (void *arg, int begin, int end)
+{
+    struct block *b = arg;
+    struct gf2_matrix *matrix = b->matrix;
+    int width = used_words(matrix) - b->word;
+    for (int k = b->first_row + begin; k < b->first_row + end; k++) {
+        /* Read every index first, since the pivot rows are zero in each
+         * other's columns and won't change them */
+        int index[BLOCK_TABLES] = { 0 };
+        for (int l = 0; l < b->npivots; l++)
+            index[l / TABLE_BITS] |= GF2(matrix, k, b->pivots[l]) << (l % TABLE_BITS);
+        for (int t = 0; t * TABLE_BITS < b->npivots; t++) {
+            if (index[t] != 0)
+                kernels.xor_words(matrix->rows[k] + b->word,
+                                  b->tables + ((size_t) t * TABLE_ROWS + index[t]) * b->stride,
+                                  width);
+        }
+    }
+}
+
+/* Clear the pivot columns of a block in rows first_row <= k < end.
+ *
+ * pre:  the pivot rows of b are zero left of their pivots
+ * post: the pivot rows are reduced against each other, and rows k are
+ *       zero in every pivot column
+ */
+static void clear_block (struct block *b, int first_row, int end)
+{
+    b->word = b->pivots[0] / 64;
+    reduce_block(b);
+    build_tables(b);
+    b->first_row = first_row;
+    pool_for(block_task, b, end - first_row,
+             (size_t) (used_words(b->matrix) - b->word) * 64);
+}
+
+/* Allocate the tables for a matrix's blocks.
+ *
+ * pre:  b->matrix is set
+ * post: returns true after setting b->tables and b->stride, false if
+ *       there wasn't room
+ */
+static bool alloc_tables (struct block *b)
+{
+    b->stride = (used_words(b->matrix) + ALIGN_WORDS - 1) / ALIGN_WORDS * ALIGN_WORDS;
+    size_t bytes = BLOCK_TABLES * TABLE_ROWS * b->stride * sizeof(uint64_t);
+    return posix_memalign((void **) &b->tables, MATRIX_ALIGN, bytes) == 0;
+}
+
+static bool blocked_echelon (struct gf2_matrix *matrix, struct block *b)
+{
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+
+    /* How many pivots of the current block each row has been brought up
+     * to date with, while looking for the next pivot */
+    unsigned char *done = malloc(nrows);
+    if (done == NULL)
+        return false;
+
+    int r = 0; // row of the next pivot
+    int c = 0; // first column not looked at yet
+    while (r < nrows && c < ncols) {
+        b->first_pivot = r;
+        b->npivots = 0;
+        memset(done + r, 0, nrows - r);
+
+        /* Look through up to BLOCK_PIVOTS columns for pivots, adding the
+         * ones found so far to each row before checking it, the way
+         * stepwise elimination would have */
+        int end = ncols - c < BLOCK_PIVOTS ? ncols : c + BLOCK_PIVOTS;
+        for (; c < end && r + b->npivots < nrows; c++) {
+            int k = b->npivots;
+            int found = -1;
+            for (int i = r + k; i < nrows && found < 0; i++) {
+                for (int l = done[i]; l < k; l++) {
+                    if (GF2(matrix, i, b->pivots[l]))
+                        add_row_from(matrix, i, r + l, b->pivots[l]);
+                }
+                done[i] = k;
+                if (GF2(matrix, i, c))
+                    found = i;
+            }
+            if (found < 0)
+                continue; // no pivot in this column
+            swap_rows(matrix, r + k, found);
+            done[found] = done[r + k];
+            b->pivots[b->npivots++] = c;
+        }
+        if (b->npivots == 0)
+            continue;
+
+        /* The rest of the rows are cleared in one pass */
+        clear_block(b, r + b->npivots, nrows);
+        r += b->npivots;
+    }
+    free(done);
+    return true;
+}
+
+static void blocked_reduced_echelon (struct gf2_matrix *matrix, struct block *b)
+{
+    int pivots[BLOCK_PIVOTS];
+    int rank = 0;
+    while (rank < matrix->nrows && leading_from(matrix, rank, 0) < matrix->ncols)
+        rank++;
+
+    /* From the bottom up, so each block's pivot rows have already been
+     * cleared by the blocks below them */
+    for (int end = rank; end > 0; end -= BLOCK_PIVOTS) {
+        int begin = end > BLOCK_PIVOTS ? end - BLOCK_PIVOTS : 0;
+        for (int i = begin; i < end; i++)
+            pivots[i - begin] = leading_from(matrix, i, 0);
+        b->first_pivot = begin;
+        b->npivots = end - begin;
+        memcpy(b->pivots, pivots, sizeof(pivots));
+        clear_block(b, 0, begin);
+    }
+}
+
+/* Whether to go through the Method of Four Russians */
+static bool blocked_worthwhile (const struct gf2_matrix *matrix,
+        enum trace_mode trace)
+{
+    return trace == TRACE_QUIET && matrix->nrows >= GF2_BLOCKED_MIN_ROWS;
+}
+
+bool gf2_echelon (struct gf2_matrix *matrix, enum trace_mode trace)
+{
+    /* Without room for the tables, go one pivot at a time after all */
+    struct block b = { matrix };
+    if (!blocked_worthwhile(matrix, trace) || !alloc_tables(&b))
+        return stepwise_echelon(matrix, trace);
+    bool success = blocked_echelon(matrix, &b);
+    free(b.tables);
+    return success || stepwise_echelon(matrix, trace);
+}
+
+void gf2_reduced_echelon (struct gf2_matrix *matrix, enum trace_mode trace)
+{
+    struct block b = { matrix };
+    if (!blocked_worthwhile(matrix, trace) || !alloc_tables(&b)) {
+        stepwise_reduced_echelon(matrix, trace);
+        return;
+    }
+    blocked_reduced_echelon(matrix, &b);
+    free(b.tables);
+}
+
+int gf2_pivot_columns (const struct gf2_matrix *matrix, int *pivots)
+{
+    int rank = 0;
+    for (int i = 0; i < matrix->nrows; i++) {
+        int lead = leading_from(matrix, i, 0);
+        if (lead == matrix->ncols)
+            break;
+        pivots[rank++] = lead;
+    }
+    return rank;
+}
@@ -0,0 +1,91 @@
+#ifndef __GF2_H__
+#define __GF2_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "matrix.h"
+#include "user_io.h"
+
+/* Matrices over the integers mod 2, packed 64 entries to a word.
+ *
+ * Adding one row to another is a XOR of their words, and rows are reached
+ * through pointers, so swapping two of them doesn't move any entries.
+ * Every row starts on an aligned block, padded with zero bits.
+ *
+ * Matrices with at least GF2_BLOCKED_MIN_ROWS rows, solved without
+ * printing the steps, go through the Method of Four Russians: up to 64
+ * pivots are found at a time, and every other row is cleared of all of
+ * them with eight lookups in tables of precomputed sums of the pivot
+ * rows, reading and writing each row once instead of once per pivot.
+ * This finds the same pivot columns, but can end up with a different
+ * echelon form than going one pivot at a time. The reduced echelon form,
+ * being unique, is the same.
+ */
+
+/* Rows it takes before the blocked elimination is worth building tables */
+#define GF2_BLOCKED_MIN_ROWS 256
+
+struct gf2_matrix {
+    int nrows;
+    int ncols;
+    int words;       // words per row, including padding
+    uint64_t **rows; // bit j % 64 of rows[i][j / 64] is the entry at (i, j)
+    uint64_t *data;  // the storage the rows point into
+};
+
+/* Read the entry at (row, col) of a matrix mod 2, as 0 or 1. */
+#define GF2(m, row, col) ((int) ((m)->rows[row][(col) / 64] >> ((col) % 64) & 1))
+
+/* Make a matrix of zeroes mod 2.
+ *
+ * pre:  nrows > 0, ncols > 0
+ * post: returns the matrix, or NULL if it could not be allocated
+ */
+struct gf2_matrix *gf2_create (int nrows, int ncols);
+
+/* Reduce a dense matrix of whole numbers mod 2.
+ *
+ * pre:  dense is initialized
+ * post: returns the matrix, or NULL after reporting an entry that isn't a
+ *       whole number or an allocation that failed
+ */
+struct gf2_matrix *gf2_from_dense (const struct matrix *dense);
+
+/* Free a matrix mod 2.
+ *
+ * pre:  matrix came from gf2_create, or is NULL
+ * post: its memory is released
+ */
+void gf2_free (struct gf2_matrix *matrix);
+
+/* Set the entry at (row, col) of a matrix mod 2.
+ *
+ * pre:  matrix is initialized, bit is 0 or 1
+ * post: the entry is bit
+ */
+void gf2_set (struct gf2_matrix *matrix, int row, int col, int bit);
+
+/* Put a matrix mod 2 into echelon form.
+ *
+ * pre:  matrix is initialized
+ * post: returns true if reached echelon form, false if memory ran out
+ */
+bool gf2_echelon (struct gf2_matrix *matrix, enum trace_mode trace);
+
+/* Given a matrix mod 2 in echelon form, cancel out the entries above each
+ * leading 1.
+ *
+ * pre:  matrix was put in echelon form by gf2_echelon
+ * post: matrix is in reduced echelon form
+ */
+void gf2_reduced_echelon (struct gf2_matrix *matrix, enum trace_mode trace);
+
+/* List the pivot columns of a matrix mod 2 in echelon form.
+ *
+ * pre:  matrix is in echelon form, pivots has room for nrows entries
+ * post: returns the rank, after storing the pivot column of each nonzero
+ *       row in pivots
+ */
+int gf2_pivot_columns (const struct gf2_matrix *matrix, int *pivots);
+
+#endif
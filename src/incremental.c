@@ -0,0 +1,192 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "incremental.h"
+#include "kernels.h"
+#include "matrix_proc.h"
+#include "pool.h"
+#include "stats.h"
+#include "user_io.h"
+
+/* Rows to make room for at first */
+#define INCREMENTAL_START_ROWS 16
+
+/* Make room for one more row than are kept, the one being added.
+ *
+ * pre:  inc is initialized
+ * post: returns true if inc->rows has a free row, false after reporting
+ *       an error
+ */
+static bool reserve_row (struct incremental *inc)
+{
+    int capacity = inc->rows != NULL ? inc->rows->nrows : 0;
+    if (inc->rank < capacity)
+        return true;
+
+    int wanted = capacity > 0 ? 2 * capacity : INCREMENTAL_START_ROWS;
+    struct matrix *rows = matrix_create(wanted, inc->ncols);
+    const double **u = realloc(inc->u, wanted * sizeof(*u));
+    if (u != NULL)
+        inc->u = u;
+    double *l = realloc(inc->l, wanted * sizeof(*l));
+    if (l != NULL)
+        inc->l = l;
+    if (rows == NULL || u == NULL || l == NULL) {
+        report_error("Could not allocate room for %d rows", wanted);
+        matrix_free(rows);
+        return false;
+    }
+    if (capacity > 0)
+        memcpy(rows->data, inc->rows->data,
+               (size_t) capacity * rows->stride * sizeof(double));
+    matrix_free(inc->rows);
+    inc->rows = rows;
+    return true;
+}
+
+struct incremental *incremental_create (int ncols, bool system)
+{
+    struct incremental *inc = calloc(1, sizeof(*inc));
+    if (inc == NULL) {
+        report_error("Could not allocate the incremental state");
+        return NULL;
+    }
+    inc->ncols = ncols;
+    inc->system = system;
+    inc->pivots = malloc(ncols * sizeof(int));
+    inc->row_of_col = malloc(ncols * sizeof(int));
+    if (inc->pivots == NULL || inc->row_of_col == NULL) {
+        report_error("Could not allocate the incremental state");
+        incremental_free(inc);
+        return NULL;
+    }
+    for (int j = 0; j < ncols; j++)
+        inc->row_of_col[j] = -1;
+    return inc;
+}
+
+void incremental_free (struct incremental *inc)
+{
+    if (inc == NULL)
+        return;
+    matrix_free(inc->rows);
+    free(inc->pivots);
+    free(inc->row_of_col);
+    free(inc->u);
+    free(inc->l);
+    free(inc);
+}
+
+/* Subtract from a row the multiple of every kept row that cancels its
+ * pivot column. No kept row has anything in another's pivot column, so
+ * the multipliers are just the row's own entries there, and it takes a
+ * single pass over the row.
+ *
+ * pre:  row has inc->ncols entries and isn't one of the kept rows
+ * post: row is zero in every pivot column of inc
+ */
+static void reduce_row (struct incremental *inc, double *row)
+{
+    int count = 0;
+    int from = inc->ncols;
+    bool finite = true;
+    for (int k = 0; k < inc->rank; k++) {
+        double temp = -1 * row[inc->pivots[k]];
+        if (temp == 0)
+            continue;
+        inc->l[count] = temp;
+        inc->u[count] = matrix_row(inc->rows, k);
+        count++;
+        if (inc->pivots[k] < from)
+            from = inc->pivots[k];
+        finite = finite && isfinite(temp);
+    }
+    if (count == 0)
+        return;
+
+    /* The kept rows are all zero left of the leftmost pivot, but 0 * inf
+     * is not 0 */
+    if (!finite)
+        from = 0;
+    for (int k = 0; k < count; k++)
+        inc->u[k] += from;
+    stats_count(STAT_ADDS, count);
+    stats_count(STAT_FLOPS, 2 * (int64_t) count * (inc->ncols - from));
+    kernels.update(row + from, 0, inc->l, 0, inc->u, 1, inc->ncols - from,
+                   count);
+}
+
+/* The kept rows, and the new pivot to cancel out of them */
+struct cancel_kept {
+    struct matrix *rows;
+    int pivot_row;
+    int lead;
+};
+
+static void cancel_kept_task (void *arg, int begin, int end)
+{
+    struct cancel_kept *c = arg;
+    for (int k = begin; k < end; k++) {
+        double temp = -1 * MAT(c->rows, k, c->lead);
+        // The new row is zero left of its pivot, like a pivot row is
+        if (temp != 0 && isfinite(temp))
+            add_scaled_from(k, c->pivot_row, temp, c->lead, c->rows);
+        else if (temp != 0)
+            add_scaled(k, c->pivot_row, temp, c->rows);
+    }
+}
+
+enum incremental_outcome incremental_add (struct incremental *inc,
+        const double *row, int *lead)
+{
+    /* Work on the row in the room after the kept ones, so it is already
+     * in place if it is kept */
+    if (!reserve_row(inc))
+        return INCREMENTAL_ERROR;
+    int i = inc->rank;
+    double *r = matrix_row(inc->rows, i);
+    memcpy(r, row, inc->ncols * sizeof(double));
+
+    int64_t start = stats_start();
+    reduce_row(inc, r);
+    stats_stop(PHASE_ROW_UPDATES, start);
+
+    start = stats_start();
+    int j = leading_pos(i, inc->rows);
+    stats_stop(PHASE_PIVOT_SEARCH, start);
+    if (j == -1)
+        return INCREMENTAL_DEPENDENT;
+    if (inc->system && j == inc->ncols - 1)
+        return INCREMENTAL_INCONSISTENT;
+
+    /* Make it a pivot row, then clear its pivot column in the others */
+    start = stats_start();
+    scale_pivot(i, j, inc->rows);
+    struct cancel_kept c = { inc->rows, i, j };
+    pool_for(cancel_kept_task, &c, inc->rank, inc->ncols - j);
+    stats_stop(PHASE_ROW_UPDATES, start);
+
+    inc->pivots[i] = j;
+    inc->row_of_col[j] = i;
+    inc->rank++;
+    *lead = j;
+    return INCREMENTAL_PIVOT;
+}
+
+struct matrix *incremental_form (const struct incremental *inc)
+{
+    struct matrix *form = matrix_create(inc->rank, inc->ncols);
+    if (form == NULL) {
+        report_error("Could not allocate a %d x %d matrix", inc->rank,
+                     inc->ncols);
+        return NULL;
+    }
+    int i = 0;
+    for (int j = 0; j < inc->ncols; j++) {
+        int k = inc->row_of_col[j];
+        if (k >= 0)
+            memcpy(matrix_row(form, i++), matrix_row(inc->rows, k),
+                   inc->ncols * sizeof(double));
+    }
+    return form;
+}
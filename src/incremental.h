@@ -0,0 +1,79 @@
+#ifndef __INCREMENTAL_H__
+#define __INCREMENTAL_H__
+
+#include <stdbool.h>
+#include "matrix.h"
+
+/* Keeping the reduced echelon form of a matrix up to date as rows are added
+ * to it, one at a time.
+ *
+ * Only the rows with pivots are kept, each scaled so its pivot is 1 and
+ * with zeroes in every other row's pivot column. Since no row has anything
+ * in another's pivot column, a new row is reduced against all of them at
+ * once, with one multiplier each, in O(rank * ncols). Whatever is left
+ * either is all zeroes, so the row depended on the ones before it, or
+ * leads to a new pivot, which is cancelled out of the rows kept in another
+ * O(rank * ncols). So each row costs the same however many came before,
+ * instead of a whole elimination of the matrix so far.
+ *
+ * For a system, whose last column is the right-hand side, a row whose
+ * only nonzero left over is in that column says 0 = c, and is reported as
+ * inconsistent instead of being kept, so the rows kept stay solvable.
+ *
+ * Like the other engines, an entry counts as zero only if it is exactly
+ * zero.
+ */
+
+/* What adding a row did */
+enum incremental_outcome {
+    INCREMENTAL_PIVOT,        // the row added a pivot, and was kept
+    INCREMENTAL_DEPENDENT,    // the row was a combination of those kept
+    INCREMENTAL_INCONSISTENT, // the row contradicted those kept
+    INCREMENTAL_ERROR,        // something went wrong, and was reported
+};
+
+/* The rows with pivots so far, in the order they were added */
+struct incremental {
+    int ncols;           // entries in a row
+    bool system;         // whether the last column is the right-hand side
+    int rank;            // rows kept
+    struct matrix *rows; // rank of them in use, then the row being added
+    int *pivots;         // pivot column of each row kept
+    int *row_of_col;     // row kept whose pivot is in each column, or -1
+    const double **u;    // row pointers for kernels.update
+    double *l;           // multipliers for kernels.update
+};
+
+/* Start with no rows.
+ *
+ * pre:  ncols > 0, and ncols > 1 if system is set
+ * post: returns the state, or NULL after reporting an error
+ */
+struct incremental *incremental_create (int ncols, bool system);
+
+/* Free the state.
+ *
+ * pre:  inc came from incremental_create, or is NULL
+ * post: its memory is released
+ */
+void incremental_free (struct incremental *inc);
+
+/* Add a row.
+ *
+ * pre:  row holds inc->ncols entries, the kernels may have been picked
+ *       and the pool started
+ * post: returns what the row did, with lead set to its pivot column for
+ *       INCREMENTAL_PIVOT; the row is kept only in that case
+ */
+enum incremental_outcome incremental_add (struct incremental *inc,
+        const double *row, int *lead);
+
+/* Get the reduced echelon form of the rows so far.
+ *
+ * pre:  inc->rank > 0
+ * post: returns a new inc->rank x inc->ncols matrix with its rows in the
+ *       order of their pivots, or NULL after reporting an error
+ */
+struct matrix *incremental_form (const struct incremental *inc);
+
+#endif
@@ -0,0 +1,435 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "journal.h"
+#include "matrix_proc.h"
+#include "reader.h"
+
+_Static_assert(sizeof(struct journal_header) == 24,
+               "journal header must stay 24 bytes");
+_Static_assert(sizeof(struct journal_entry) == 24,
+               "journal entries must stay 24 bytes");
+
+/* The journal being written, if any */
+static struct {
+    FILE *file;
+    const char *path;
+    bool binary;
+    bool failed; // whether a write has gone wrong
+} out;
+
+bool journal_open (const char *path, bool binary, int nrows, int ncols)
+{
+    out.file = fopen(path, binary ? "wb" : "w");
+    if (out.file == NULL) {
+        perror(path);
+        return false;
+    }
+    out.path = path;
+    out.binary = binary;
+    out.failed = false;
+
+    if (binary) {
+        struct journal_header h = { .version = JOURNAL_VERSION,
+                                    .byte_order = JOURNAL_BYTE_ORDER,
+                                    .nrows = nrows, .ncols = ncols };
+        memcpy(h.magic, JOURNAL_MAGIC, sizeof(h.magic));
+        out.failed = fwrite(&h, sizeof(h), 1, out.file) != 1;
+    } else {
+        out.failed = fprintf(out.file, "echelon-journal %d %d %d\n",
+                             JOURNAL_VERSION, nrows, ncols) < 0;
+    }
+    return true;
+}
+
+bool journal_active (void)
+{
+    return out.file != NULL;
+}
+
+void journal_record (enum journal_op op, int row1, int row2, double scalar)
+{
+    if (out.file == NULL || out.failed)
+        return;
+
+    int written = 1;
+    if (out.binary) {
+        struct journal_entry e = { op, row1, row2, 0, scalar };
+        written = fwrite(&e, sizeof(e), 1, out.file);
+    } else if (op == JOURNAL_SWAP) {
+        written = fprintf(out.file, "swap %d %d\n", row1+1, row2+1);
+    } else if (op == JOURNAL_SCALE) {
+        written = fprintf(out.file, "scale %d %.17g\n", row1+1, scalar);
+    } else {
+        written = fprintf(out.file, "add %d %.17g %d\n", row1+1, scalar, row2+1);
+    }
+    out.failed = written <= 0;
+}
+
+bool journal_close (void)
+{
+    bool success = !out.failed;
+    if (fclose(out.file) != 0)
+        success = false;
+    if (!success)
+        fprintf(stderr, "%s: could not write the whole journal\n", out.path);
+    out.file = NULL;
+    return success;
+}
+
+/* Append an entry to a journal being loaded, growing its storage.
+ *
+ * pre:  *capacity is how many entries journal->entries has room for
+ * post: returns true if the entry was added, false if memory ran out
+ */
+static bool append_entry (struct journal *journal, long *capacity,
+        const struct journal_entry *entry)
+{
+    if (journal->nentries == *capacity) {
+        long grown = *capacity > 0 ? 2 * *capacity : 1024;
+        struct journal_entry *entries =
+            realloc(journal->entries, grown * sizeof(*entries));
+        if (entries == NULL)
+            return false;
+        journal->entries = entries;
+        *capacity = grown;
+    }
+    journal->entries[journal->nentries++] = *entry;
+    return true;
+}
+
+/* Check that an entry makes sense for a matrix of the journal's size.
+ *
+ * pre:  none
+ * post: returns true if its operation and rows are valid
+ */
+static bool valid_entry (const struct journal *journal,
+        const struct journal_entry *e)
+{
+    bool row1_ok = e->row1 >= 0 && e->row1 < journal->nrows;
+    bool row2_ok = e->row2 >= 0 && e->row2 < journal->nrows;
+    switch (e->op) {
+        case JOURNAL_SWAP:
+        case JOURNAL_ADD:
+            return row1_ok && row2_ok;
+        case JOURNAL_SCALE:
+            return row1_ok;
+        default:
+            return false;
+    }
+}
+
+/* Read a scalar written with %.17g, which may be inf or nan.
+ *
+ * pre:  tok is NULL or a NUL terminated token
+ * post: returns true and stores it if all of tok is a number
+ */
+static bool parse_scalar (const char *tok, double *value)
+{
+    char *end;
+    if (tok == NULL)
+        return false;
+    *value = strtod(tok, &end);
+    return end != tok && *end == '\0';
+}
+
+/* Read the text form of a journal.
+ *
+ * pre:  path is a text journal
+ * post: returns true after filling in journal, false after reporting the
+ *       line of the problem
+ */
+static bool load_text (const char *path, struct journal *journal)
+{
+    bool success = false;
+    long capacity = 0;
+    struct reader in;
+    if (!reader_open(&in, path)) {
+        perror(path);
+        return success;
+    }
+
+    char *tok = reader_token(&in);
+    int version;
+    if (tok == NULL || strcmp(tok, "echelon-journal") != 0
+            || (tok = reader_token(&in)) == NULL || !parse_int(tok, &version)
+            || version != JOURNAL_VERSION
+            || (tok = reader_token(&in)) == NULL || !parse_int(tok, &journal->nrows)
+            || (tok = reader_token(&in)) == NULL || !parse_int(tok, &journal->ncols)
+            || journal->nrows <= 0 || journal->ncols <= 0) {
+        fprintf(stderr, "%s: not a version %d journal\n", path, JOURNAL_VERSION);
+        goto out;
+    }
+
+    while ((tok = reader_token(&in)) != NULL) {
+        struct journal_entry e = { .row2 = -1, .scalar = 0 };
+        bool ok;
+        if (strcmp(tok, "swap") == 0) {
+            e.op = JOURNAL_SWAP;
+            ok = (tok = reader_token(&in)) != NULL && parse_int(tok, &e.row1)
+                 && (tok = reader_token(&in)) != NULL && parse_int(tok, &e.row2);
+        } else if (strcmp(tok, "scale") == 0) {
+            e.op = JOURNAL_SCALE;
+            ok = (tok = reader_token(&in)) != NULL && parse_int(tok, &e.row1)
+                 && parse_scalar(reader_token(&in), &e.scalar);
+            e.row2 = 0; // unused, and -1 once counted from 0 below
+        } else if (strcmp(tok, "add") == 0) {
+            e.op = JOURNAL_ADD;
+            ok = (tok = reader_token(&in)) != NULL && parse_int(tok, &e.row1)
+                 && parse_scalar(reader_token(&in), &e.scalar)
+                 && (tok = reader_token(&in)) != NULL && parse_int(tok, &e.row2);
+        } else {
+            ok = false;
+        }
+        e.row1--;
+        e.row2--;
+        if (!ok || !valid_entry(journal, &e)) {
+            fprintf(stderr, "%s: bad operation on line %ld\n", path, in.line);
+            goto out;
+        }
+        if (!append_entry(journal, &capacity, &e)) {
+            fprintf(stderr, "%s: ran out of memory for the journal\n", path);
+            goto out;
+        }
+    }
+    success = true;
+out:
+    reader_close(&in);
+    return success;
+}
+
+/* Read the binary form of a journal, past its header.
+ *
+ * pre:  f is open just after a header h that has been checked
+ * post: returns true after filling in journal, false after reporting why
+ */
+static bool load_binary (const char *path, FILE *f, struct journal *journal)
+{
+    long capacity = 0;
+    struct journal_entry e;
+    while (fread(&e, sizeof(e), 1, f) == 1) {
+        if (!valid_entry(journal, &e)) {
+            fprintf(stderr, "%s: bad operation %ld\n", path, journal->nentries + 1);
+            return false;
+        } else if (!append_entry(journal, &capacity, &e)) {
+            fprintf(stderr, "%s: ran out of memory for the journal\n", path);
+            return false;
+        }
+    }
+    if (ferror(f)) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+struct journal *journal_load (const char *path)
+{
+    struct journal *journal = calloc(1, sizeof(*journal));
+    FILE *f = fopen(path, "rb");
+    if (journal == NULL || f == NULL) {
+        if (f == NULL)
+            perror(path);
+        free(journal);
+        if (f != NULL)
+            fclose(f);
+        return NULL;
+    }
+
+    bool success;
+    struct journal_header h;
+    if (fread(&h, sizeof(h), 1, f) == 1
+            && memcmp(h.magic, JOURNAL_MAGIC, sizeof(h.magic)) == 0) {
+        if (h.byte_order != JOURNAL_BYTE_ORDER) {
+            fprintf(stderr, "%s: written with a different byte order\n", path);
+            success = false;
+        } else if (h.version != JOURNAL_VERSION) {
+            fprintf(stderr, "%s: unsupported version %u\n", path, h.version);
+            success = false;
+        } else if (h.nrows == 0 || h.ncols == 0 || h.nrows > INT32_MAX
+                || h.ncols > INT32_MAX) {
+            fprintf(stderr, "%s: bad dimensions in header\n", path);
+            success = false;
+        } else {
+            journal->nrows = h.nrows;
+            journal->ncols = h.ncols;
+            success = load_binary(path, f, journal);
+        }
+        fclose(f);
+    } else {
+        fclose(f);
+        success = load_text(path, journal);
+    }
+
+    if (!success) {
+        journal_free(journal);
+        return NULL;
+    }
+    return journal;
+}
+
+void journal_free (struct journal *journal)
+{
+    if (journal == NULL)
+        return;
+    free(journal->entries);
+    free(journal);
+}
+
+void journal_describe (const struct journal_entry *e, char *buf, size_t size)
+{
+    if (e->op == JOURNAL_SWAP)
+        snprintf(buf, size, "swap R%d <--> R%d", e->row1+1, e->row2+1);
+    else if (e->op == JOURNAL_SCALE)
+        snprintf(buf, size, "scale (1/%.2lf) * R%d", 1 / e->scalar, e->row1+1);
+    else
+        snprintf(buf, size, "add R%d + (%.2lf * R%d)", e->row1+1, e->scalar,
+                 e->row2+1);
+}
+
+/* ------------------------------------------------------------------------
+ * Replay
+ * --------------------------------------------------------------------- */
+
+struct replay {
+    const struct journal *journal;
+    const struct matrix *initial;
+    struct matrix *current;       // the matrix after step operations
+    long step;
+    long interval;                // operations between checkpoints
+    long ncheckpoints;
+    struct matrix **checkpoints;  // checkpoints[c] is the matrix after
+                                  // c * interval operations, or NULL until
+                                  // a seek has gone past it; 0 is initial
+};
+
+/* pre:  dst and src are the same size
+ * post: dst holds the entries of src */
+static void copy_matrix (struct matrix *dst, const struct matrix *src)
+{
+    for (int i = 0; i < src->nrows; i++)
+        memcpy(matrix_row(dst, i), matrix_row(src, i), src->ncols * sizeof(double));
+}
+
+struct replay *replay_create (const struct journal *journal,
+        const struct matrix *initial)
+{
+    if (initial->nrows != journal->nrows || initial->ncols != journal->ncols) {
+        fprintf(stderr, "The journal is for a %d x %d matrix, not %d x %d.\n",
+                journal->nrows, journal->ncols, initial->nrows, initial->ncols);
+        return NULL;
+    }
+
+    struct replay *r = calloc(1, sizeof(*r));
+    if (r == NULL)
+        return NULL;
+    r->journal = journal;
+    r->initial = initial;
+
+    /* As many copies as the memory budget allows, spread evenly */
+    size_t bytes = (size_t) initial->nrows * initial->stride * sizeof(double);
+    long copies = REPLAY_CHECKPOINT_BYTES / (bytes > 0 ? bytes : 1);
+    if (copies > REPLAY_MAX_CHECKPOINTS)
+        copies = REPLAY_MAX_CHECKPOINTS;
+    if (copies < 1)
+        copies = 1;
+    r->interval = (journal->nentries + copies - 1) / copies;
+    if (r->interval < 1)
+        r->interval = 1;
+    r->ncheckpoints = journal->nentries / r->interval + 1;
+
+    r->current = matrix_create(initial->nrows, initial->ncols);
+    r->checkpoints = calloc(r->ncheckpoints, sizeof(struct matrix *));
+    if (r->current == NULL || r->checkpoints == NULL) {
+        fprintf(stderr, "Could not allocate the replay.\n");
+        replay_free(r);
+        return NULL;
+    }
+    copy_matrix(r->current, initial);
+    return r;
+}
+
+/* Redo a scale the way scale_pivot did it, given what it multiplied by.
+ * Everything left of the pivot was zero, so the pivot is the leading entry.
+ *
+ * pre:  row is a row of matrix
+ * post: row *= scalar, with its leading entry 1 unless scalar is 0
+ */
+static void scale_recorded (int row, double scalar, struct matrix *matrix)
+{
+    scale_row(row, scalar, matrix);
+    int lead = leading_pos(row, matrix);
+    if (scalar != 0 && lead != -1)
+        MAT(matrix, row, lead) = 1;
+}
+
+/* Redo an addition the way the engines did it. They only add a pivot row
+ * from its pivot on, since it is zero to the left, unless the scalar isn't
+ * finite and 0 * inf would say otherwise. Adding the zeroes in as well
+ * would turn a -0 there into 0.
+ *
+ * pre:  row1 and row2 are rows of matrix
+ * post: row1 += scalar * row2, with the zeroes left of row2's leading
+ *       entry as they were
+ */
+static void add_recorded (int row1, int row2, double scalar, struct matrix *matrix)
+{
+    int lead = leading_pos(row2, matrix);
+    if (isfinite(scalar) && lead != -1)
+        add_scaled_from(row1, row2, scalar, lead, matrix);
+    else
+        add_scaled(row1, row2, scalar, matrix);
+}
+
+/* Do one operation from a journal.
+ *
+ * pre:  e was checked by valid_entry for matrix's size
+ * post: matrix has changed just as it did when e was recorded
+ */
+static void apply_entry (const struct journal_entry *e, struct matrix *matrix)
+{
+    if (e->op == JOURNAL_SWAP)
+        swap_rows(e->row1, e->row2, matrix);
+    else if (e->op == JOURNAL_SCALE)
+        scale_recorded(e->row1, e->scalar, matrix);
+    else
+        add_recorded(e->row1, e->row2, e->scalar, matrix);
+}
+
+struct matrix *replay_seek (struct replay *r, long step)
+{
+    /* Start from the latest checkpoint at or before step, unless the
+     * current matrix is between the two */
+    long c = step / r->interval;
+    while (c > 0 && r->checkpoints[c] == NULL)
+        c--;
+    if (r->step > step || r->step < c * r->interval) {
+        copy_matrix(r->current, c > 0 ? r->checkpoints[c] : r->initial);
+        r->step = c * r->interval;
+    }
+
+    /* Go forward, keeping a copy at each checkpoint passed for the first
+     * time. A copy that can't be allocated only makes later seeks slower. */
+    while (r->step < step) {
+        apply_entry(&r->journal->entries[r->step++], r->current);
+        c = r->step / r->interval;
+        if (r->step % r->interval == 0 && r->checkpoints[c] == NULL) {
+            r->checkpoints[c] = matrix_create(r->current->nrows, r->current->ncols);
+            if (r->checkpoints[c] != NULL)
+                copy_matrix(r->checkpoints[c], r->current);
+        }
+    }
+    return r->current;
+}
+
+void replay_free (struct replay *r)
+{
+    if (r == NULL)
+        return;
+    for (long c = 0; r->checkpoints != NULL && c < r->ncheckpoints; c++)
+        matrix_free(r->checkpoints[c]);
+    free(r->checkpoints);
+    matrix_free(r->current);
+    free(r);
+}
@@ -0,0 +1,159 @@
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "matrix.h"
+
+/* A journal of the row operations automatic mode does, and replaying it.
+ *
+ * While a journal is open, every swap, scale and addition the dense
+ * engines report through trace_swap, trace_scale and trace_add is also
+ * written to it, whatever the trace mode, as one small record. Replaying
+ * the records on the original matrix with the same row operations gives
+ * back the matrix after any step, bit for bit, without anything having
+ * printed it.
+ *
+ * Text journals start with a line "echelon-journal 1 NROWS NCOLS", then
+ * have one operation per line, with rows counted from 1 as in the traces:
+ *
+ *     swap I J            rows I and J trade places
+ *     scale I S           row I is multiplied by S
+ *     add I S J           S times row J is added to row I
+ *
+ * The engines only scale a row to make its leading entry 1, so after a
+ * scale the leading entry is set to exactly 1, as scale_pivot does. They
+ * only add a row from its leading entry on, leaving the zeroes before it
+ * alone, unless S isn't finite.
+ *
+ * Scalars are written with 17 significant digits, which is enough to read
+ * back the same double. Binary journals are a struct journal_header and
+ * then one struct journal_entry per operation, with rows counted from 0,
+ * in the byte order of the machine that wrote them.
+ */
+
+#define JOURNAL_MAGIC "ECHJ"
+#define JOURNAL_VERSION 1
+#define JOURNAL_BYTE_ORDER 0x01020304u
+
+/* Replay keeps copies of the matrix at regular steps, so seeking costs at
+ * most one interval of operations, with at most this many copies... */
+#define REPLAY_MAX_CHECKPOINTS 64
+
+/* ...taking up no more than this many bytes between them */
+#define REPLAY_CHECKPOINT_BYTES ((size_t) 256 << 20)
+
+/* Operations a journal can hold */
+enum journal_op {
+    JOURNAL_SWAP = 1,
+    JOURNAL_SCALE = 2,
+    JOURNAL_ADD = 3,
+};
+
+struct journal_header {
+    char magic[4];       // JOURNAL_MAGIC, not NUL terminated
+    uint16_t version;    // JOURNAL_VERSION
+    uint16_t reserved;   // zero
+    uint32_t byte_order; // JOURNAL_BYTE_ORDER as the writer saw it
+    uint32_t nrows;      // size of the matrix the operations apply to
+    uint32_t ncols;
+    uint32_t reserved2;  // zero
+};
+
+struct journal_entry {
+    uint32_t op;     // an enum journal_op
+    int32_t row1;    // the row that changes, or the first row swapped
+    int32_t row2;    // the row added, or the second row swapped, or -1
+    uint32_t reserved; // zero
+    double scalar;   // what the row is scaled by or row2 is multiplied by
+};
+
+/* A whole journal, loaded for replay */
+struct journal {
+    int nrows;
+    int ncols;
+    long nentries;
+    struct journal_entry *entries;
+};
+
+/* Start writing a journal. Only one can be open at a time.
+ *
+ * pre:  no journal is open, nrows > 0, ncols > 0
+ * post: returns true if path is open for writing the operations on an
+ *       nrows x ncols matrix, false after reporting why not
+ */
+bool journal_open (const char *path, bool binary, int nrows, int ncols);
+
+/* Check whether a journal is being written.
+ *
+ * pre:  none
+ * post: returns true between journal_open and journal_close
+ */
+bool journal_active (void);
+
+/* Add an operation to the open journal, if there is one.
+ *
+ * pre:  the operation was just done, by the calling thread alone
+ * post: it is written, or the journal notes a failure for journal_close
+ */
+void journal_record (enum journal_op op, int row1, int row2, double scalar);
+
+/* Finish writing the open journal.
+ *
+ * pre:  journal_open succeeded
+ * post: returns true if every operation made it to the file, false after
+ *       reporting an error
+ */
+bool journal_close (void);
+
+/* Load a text or binary journal.
+ *
+ * pre:  path names a journal
+ * post: returns the journal, or NULL after reporting what was wrong
+ */
+struct journal *journal_load (const char *path);
+
+/* Free a loaded journal.
+ *
+ * pre:  journal came from journal_load, or is NULL
+ * post: its memory is released
+ */
+void journal_free (struct journal *journal);
+
+/* Describe one operation as a trace would, like "add R3 + (-2.00 * R1)".
+ *
+ * pre:  buf has room for size bytes
+ * post: buf holds the NUL terminated description
+ */
+void journal_describe (const struct journal_entry *entry, char *buf, size_t size);
+
+struct replay;
+
+/* Get ready to replay a journal.
+ *
+ * pre:  journal was loaded, initial is the matrix it started from
+ * post: returns the replay, or NULL after reporting an allocation that
+ *       failed or a matrix of the wrong size. Neither argument may be
+ *       freed before the replay.
+ */
+struct replay *replay_create (const struct journal *journal,
+        const struct matrix *initial);
+
+/* Reconstruct the matrix after some number of operations, going forward
+ * from the nearest checkpoint at or before that step.
+ *
+ * pre:  0 <= step <= journal->nentries
+ * post: returns the matrix after the first step operations, owned by the
+ *       replay and valid until the next call
+ */
+struct matrix *replay_seek (struct replay *replay, long step);
+
+/* Free a replay.
+ *
+ * pre:  replay came from replay_create, or is NULL
+ * post: its memory is released
+ */
+void replay_free (struct replay *replay);
+
+#endif
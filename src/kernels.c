@@ -0,0 +1,687 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* Primes below this leave room in 32-bit lanes for a product that is
+ * still between 0 and 2p, so the vector modular kernels can use them */
+#define MOD_VECTOR_LIMIT ((uint64_t) 1 << 31)
+
+/* Columns of c that update works through at a time, so the slice of each
+ * row of u that it needs stays in cache across all the rows of c */
+#define UPDATE_COLS 512
+
+/* The double kernels round s * src[j] before adding it, like the scalar
+ * loop, so every version gives the same results. AVX-512 has fused
+ * multiply-adds built in, so gcc has to be told not to fuse there. */
+#if defined(__GNUC__) && !defined(__clang__)
+#define NO_FUSE __attribute__((optimize("fp-contract=off")))
+#else
+#define NO_FUSE
+#endif
+
+/* Run update one axpy at a time, a slice of columns at a time.
+ *
+ * pre:  as for row_kernels.update, axpy is the matching row kernel
+ * post: c has been updated
+ */
+static inline void update_by_rows (void (*axpy) (double *, const double *, double, int),
+        double *c, size_t ldc, const double *l, size_t ldl,
+        const double *const *u, int m, int n, int k)
+{
+    for (int j0 = 0; j0 < n; j0 += UPDATE_COLS) {
+        int width = n - j0 < UPDATE_COLS ? n - j0 : UPDATE_COLS;
+        for (int i = 0; i < m; i++) {
+            for (int p = 0; p < k; p++)
+                axpy(c + i * ldc + j0, u[p] + j0, l[i * ldl + p], width);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------
+ * Scalar versions, which work everywhere
+ * --------------------------------------------------------------------- */
+
+static void axpy_scalar (double *dst, const double *src, double s, int n)
+{
+    for (int j = 0; j < n; j++)
+        dst[j] += s * src[j];
+}
+
+static void scale_scalar (double *row, double s, int n)
+{
+    for (int j = 0; j < n; j++)
+        row[j] = row[j] * s;
+}
+
+static void swap_scalar (double *a, double *b, int n)
+{
+    for (int j = 0; j < n; j++) {
+        double temp = a[j];
+        a[j] = b[j];
+        b[j] = temp;
+    }
+}
+
+static void update_scalar (double *c, size_t ldc, const double *l, size_t ldl,
+        const double *const *u, int m, int n, int k)
+{
+    update_by_rows(axpy_scalar, c, ldc, l, ldl, u, m, n, k);
+}
+
+/* Shoup's precomputed quotient for multiplying by s mod p: s * 2^64 / p,
+ * rounded down */
+static inline uint64_t shoup64 (uint64_t s, uint64_t p)
+{
+    return (uint64_t) (((unsigned __int128) s << 64) / p);
+}
+
+/* s * x mod p, given s_shoup = shoup64(s, p) and x < 2^64 */
+static inline uint64_t mulmod_shoup (uint64_t x, uint64_t s, uint64_t s_shoup,
+        uint64_t p)
+{
+    uint64_t q = (uint64_t) (((unsigned __int128) x * s_shoup) >> 64);
+    uint64_t r = x * s - q * p; // the quotient is at most one short
+    return r >= p ? r - p : r;
+}
+
+static void axpy_mod_scalar (uint64_t *dst, const uint64_t *src, uint64_t s,
+        uint64_t p, int n)
+{
+    uint64_t s_shoup = shoup64(s, p);
+    for (int j = 0; j < n; j++) {
+        uint64_t t = dst[j] + mulmod_shoup(src[j], s, s_shoup, p);
+        dst[j] = t >= p ? t - p : t;
+    }
+}
+
+static void scale_mod_scalar (uint64_t *row, uint64_t s, uint64_t p, int n)
+{
+    uint64_t s_shoup = shoup64(s, p);
+    for (int j = 0; j < n; j++)
+        row[j] = mulmod_shoup(row[j], s, s_shoup, p);
+}
+
+static void xor_words_scalar (uint64_t *dst, const uint64_t *src, int n)
+{
+    for (int j = 0; j < n; j++)
+        dst[j] ^= src[j];
+}
+
+#define REAL float
+#define NAME(f) f##_float_scalar
+#define TARGET
+#include "kernels_real.h"
+
+#ifdef HAVE_X86
+
+/* ------------------------------------------------------------------------
+ * SSE2, two doubles at a time. Part of every x86-64 CPU.
+ * --------------------------------------------------------------------- */
+
+__attribute__((target("sse2")))
+static void axpy_sse2 (double *dst, const double *src, double s, int n)
+{
+    __m128d vs = _mm_set1_pd(s);
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        __m128d a0 = _mm_loadu_pd(dst + j);
+        __m128d a1 = _mm_loadu_pd(dst + j + 2);
+        a0 = _mm_add_pd(a0, _mm_mul_pd(vs, _mm_loadu_pd(src + j)));
+        a1 = _mm_add_pd(a1, _mm_mul_pd(vs, _mm_loadu_pd(src + j + 2)));
+        _mm_storeu_pd(dst + j, a0);
+        _mm_storeu_pd(dst + j + 2, a1);
+    }
+    for (; j < n; j++)
+        dst[j] += s * src[j];
+}
+
+__attribute__((target("sse2")))
+static void scale_sse2 (double *row, double s, int n)
+{
+    __m128d vs = _mm_set1_pd(s);
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        _mm_storeu_pd(row + j, _mm_mul_pd(_mm_loadu_pd(row + j), vs));
+        _mm_storeu_pd(row + j + 2, _mm_mul_pd(_mm_loadu_pd(row + j + 2), vs));
+    }
+    for (; j < n; j++)
+        row[j] = row[j] * s;
+}
+
+__attribute__((target("sse2")))
+static void swap_sse2 (double *a, double *b, int n)
+{
+    int j = 0;
+    for (; j + 2 <= n; j += 2) {
+        __m128d va = _mm_loadu_pd(a + j);
+        __m128d vb = _mm_loadu_pd(b + j);
+        _mm_storeu_pd(a + j, vb);
+        _mm_storeu_pd(b + j, va);
+    }
+    swap_scalar(a + j, b + j, n - j);
+}
+
+__attribute__((target("sse2")))
+static void xor_words_sse2 (uint64_t *dst, const uint64_t *src, int n)
+{
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *) (dst + j));
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (dst + j + 2));
+        a0 = _mm_xor_si128(a0, _mm_loadu_si128((const __m128i *) (src + j)));
+        a1 = _mm_xor_si128(a1, _mm_loadu_si128((const __m128i *) (src + j + 2)));
+        _mm_storeu_si128((__m128i *) (dst + j), a0);
+        _mm_storeu_si128((__m128i *) (dst + j + 2), a1);
+    }
+    xor_words_scalar(dst + j, src + j, n - j);
+}
+
+#define REAL float
+#define NAME(f) f##_float_sse2
+#define TARGET __attribute__((target("sse2")))
+#define VEC_BYTES 16
+#include "kernels_real.h"
+
+__attribute__((target("sse2")))
+static void update_sse2 (double *c, size_t ldc, const double *l, size_t ldl,
+        const double *const *u, int m, int n, int k)
+{
+    update_by_rows(axpy_sse2, c, ldc, l, ldl, u, m, n, k);
+}
+
+/* ------------------------------------------------------------------------
+ * AVX2, four doubles at a time
+ * --------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static void axpy_avx2 (double *dst, const double *src, double s, int n)
+{
+    __m256d vs = _mm256_set1_pd(s);
+    int j = 0;
+    for (; j + 16 <= n; j += 16) {
+        __m256d a0 = _mm256_loadu_pd(dst + j);
+        __m256d a1 = _mm256_loadu_pd(dst + j + 4);
+        __m256d a2 = _mm256_loadu_pd(dst + j + 8);
+        __m256d a3 = _mm256_loadu_pd(dst + j + 12);
+        a0 = _mm256_add_pd(a0, _mm256_mul_pd(vs, _mm256_loadu_pd(src + j)));
+        a1 = _mm256_add_pd(a1, _mm256_mul_pd(vs, _mm256_loadu_pd(src + j + 4)));
+        a2 = _mm256_add_pd(a2, _mm256_mul_pd(vs, _mm256_loadu_pd(src + j + 8)));
+        a3 = _mm256_add_pd(a3, _mm256_mul_pd(vs, _mm256_loadu_pd(src + j + 12)));
+        _mm256_storeu_pd(dst + j, a0);
+        _mm256_storeu_pd(dst + j + 4, a1);
+        _mm256_storeu_pd(dst + j + 8, a2);
+        _mm256_storeu_pd(dst + j + 12, a3);
+    }
+    for (; j + 4 <= n; j += 4) {
+        __m256d a = _mm256_loadu_pd(dst + j);
+        _mm256_storeu_pd(dst + j, _mm256_add_pd(a, _mm256_mul_pd(vs, _mm256_loadu_pd(src + j))));
+    }
+    for (; j < n; j++)
+        dst[j] += s * src[j];
+}
+
+__attribute__((target("avx2")))
+static void scale_avx2 (double *row, double s, int n)
+{
+    __m256d vs = _mm256_set1_pd(s);
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        _mm256_storeu_pd(row + j, _mm256_mul_pd(_mm256_loadu_pd(row + j), vs));
+        _mm256_storeu_pd(row + j + 4, _mm256_mul_pd(_mm256_loadu_pd(row + j + 4), vs));
+    }
+    for (; j < n; j++)
+        row[j] = row[j] * s;
+}
+
+__attribute__((target("avx2")))
+static void swap_avx2 (double *a, double *b, int n)
+{
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        __m256d va = _mm256_loadu_pd(a + j);
+        __m256d vb = _mm256_loadu_pd(b + j);
+        _mm256_storeu_pd(a + j, vb);
+        _mm256_storeu_pd(b + j, va);
+    }
+    swap_scalar(a + j, b + j, n - j);
+}
+
+/* Finish the columns of one row of an update that don't fill a vector */
+__attribute__((target("avx2")))
+static inline void update_tail (double *c, const double *l,
+        const double *const *u, int j, int n, int k)
+{
+    for (; j < n; j++) {
+        double x = c[j];
+        for (int p = 0; p < k; p++)
+            x += l[p] * u[p][j];
+        c[j] = x;
+    }
+}
+
+/* Keeps a block of 4 rows by 8 columns of c in registers while it works
+ * through every p */
+__attribute__((target("avx2")))
+static void update_avx2 (double *c, size_t ldc, const double *l, size_t ldl,
+        const double *const *u, int m, int n, int k)
+{
+    for (int j0 = 0; j0 < n; j0 += UPDATE_COLS) {
+        int jn = n - j0 < UPDATE_COLS ? n : j0 + UPDATE_COLS;
+        int i = 0;
+        for (; i + 4 <= m; i += 4) {
+            double *c0 = c + i * ldc, *c1 = c0 + ldc, *c2 = c1 + ldc, *c3 = c2 + ldc;
+            const double *l0 = l + i * ldl, *l1 = l0 + ldl, *l2 = l1 + ldl, *l3 = l2 + ldl;
+            int j = j0;
+            for (; j + 8 <= jn; j += 8) {
+                __m256d a00 = _mm256_loadu_pd(c0 + j), a01 = _mm256_loadu_pd(c0 + j + 4);
+                __m256d a10 = _mm256_loadu_pd(c1 + j), a11 = _mm256_loadu_pd(c1 + j + 4);
+                __m256d a20 = _mm256_loadu_pd(c2 + j), a21 = _mm256_loadu_pd(c2 + j + 4);
+                __m256d a30 = _mm256_loadu_pd(c3 + j), a31 = _mm256_loadu_pd(c3 + j + 4);
+                for (int p = 0; p < k; p++) {
+                    __m256d u0 = _mm256_loadu_pd(u[p] + j);
+                    __m256d u1 = _mm256_loadu_pd(u[p] + j + 4);
+                    __m256d b = _mm256_broadcast_sd(l0 + p);
+                    a00 = _mm256_add_pd(a00, _mm256_mul_pd(b, u0));
+                    a01 = _mm256_add_pd(a01, _mm256_mul_pd(b, u1));
+                    b = _mm256_broadcast_sd(l1 + p);
+                    a10 = _mm256_add_pd(a10, _mm256_mul_pd(b, u0));
+                    a11 = _mm256_add_pd(a11, _mm256_mul_pd(b, u1));
+                    b = _mm256_broadcast_sd(l2 + p);
+                    a20 = _mm256_add_pd(a20, _mm256_mul_pd(b, u0));
+                    a21 = _mm256_add_pd(a21, _mm256_mul_pd(b, u1));
+                    b = _mm256_broadcast_sd(l3 + p);
+                    a30 = _mm256_add_pd(a30, _mm256_mul_pd(b, u0));
+                    a31 = _mm256_add_pd(a31, _mm256_mul_pd(b, u1));
+                }
+                _mm256_storeu_pd(c0 + j, a00); _mm256_storeu_pd(c0 + j + 4, a01);
+                _mm256_storeu_pd(c1 + j, a10); _mm256_storeu_pd(c1 + j + 4, a11);
+                _mm256_storeu_pd(c2 + j, a20); _mm256_storeu_pd(c2 + j + 4, a21);
+                _mm256_storeu_pd(c3 + j, a30); _mm256_storeu_pd(c3 + j + 4, a31);
+            }
+            update_tail(c0, l0, u, j, jn, k);
+            update_tail(c1, l1, u, j, jn, k);
+            update_tail(c2, l2, u, j, jn, k);
+            update_tail(c3, l3, u, j, jn, k);
+        }
+        for (; i < m; i++) {
+            double *c0 = c + i * ldc;
+            const double *l0 = l + i * ldl;
+            int j = j0;
+            for (; j + 8 <= jn; j += 8) {
+                __m256d a0 = _mm256_loadu_pd(c0 + j), a1 = _mm256_loadu_pd(c0 + j + 4);
+                for (int p = 0; p < k; p++) {
+                    __m256d b = _mm256_broadcast_sd(l0 + p);
+                    a0 = _mm256_add_pd(a0, _mm256_mul_pd(b, _mm256_loadu_pd(u[p] + j)));
+                    a1 = _mm256_add_pd(a1, _mm256_mul_pd(b, _mm256_loadu_pd(u[p] + j + 4)));
+                }
+                _mm256_storeu_pd(c0 + j, a0);
+                _mm256_storeu_pd(c0 + j + 4, a1);
+            }
+            update_tail(c0, l0, u, j, jn, k);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void xor_words_avx2 (uint64_t *dst, const uint64_t *src, int n)
+{
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *) (dst + j));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *) (dst + j + 4));
+        a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((const __m256i *) (src + j)));
+        a1 = _mm256_xor_si256(a1, _mm256_loadu_si256((const __m256i *) (src + j + 4)));
+        _mm256_storeu_si256((__m256i *) (dst + j), a0);
+        _mm256_storeu_si256((__m256i *) (dst + j + 4), a1);
+    }
+    xor_words_scalar(dst + j, src + j, n - j);
+}
+
+#define REAL float
+#define NAME(f) f##_float_avx2
+#define TARGET __attribute__((target("avx2,fma")))
+#define VEC_BYTES 32
+#include "kernels_real.h"
+
+/* s * x mod p in each 64-bit lane, for x < 2^32 and p < MOD_VECTOR_LIMIT.
+ * vs_shoup holds s * 2^32 / p, rounded down. Every result is below 2^32,
+ * so taking the smaller of r and r - p in 32-bit lanes subtracts p just
+ * when r >= p, with the upper halves left at zero. */
+__attribute__((target("avx2")))
+static inline __m256i mulmod_avx2 (__m256i x, __m256i vs, __m256i vs_shoup,
+        __m256i vp)
+{
+    __m256i q = _mm256_srli_epi64(_mm256_mul_epu32(x, vs_shoup), 32);
+    __m256i r = _mm256_sub_epi64(_mm256_mul_epu32(x, vs), _mm256_mul_epu32(q, vp));
+    return _mm256_min_epu32(r, _mm256_sub_epi32(r, vp));
+}
+
+/* (a + b) mod p in each lane, for a, b < p < MOD_VECTOR_LIMIT */
+__attribute__((target("avx2")))
+static inline __m256i addmod_avx2 (__m256i a, __m256i b, __m256i vp)
+{
+    __m256i t = _mm256_add_epi64(a, b);
+    return _mm256_min_epu32(t, _mm256_sub_epi32(t, vp));
+}
+
+__attribute__((target("avx2")))
+static void axpy_mod_avx2 (uint64_t *dst, const uint64_t *src, uint64_t s,
+        uint64_t p, int n)
+{
+    if (p >= MOD_VECTOR_LIMIT) {
+        axpy_mod_scalar(dst, src, s, p, n);
+        return;
+    }
+    __m256i vs = _mm256_set1_epi64x(s);
+    __m256i vs_shoup = _mm256_set1_epi64x((s << 32) / p);
+    __m256i vp = _mm256_set1_epi64x(p);
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *) (src + j));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *) (src + j + 4));
+        __m256i a0 = _mm256_loadu_si256((const __m256i *) (dst + j));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *) (dst + j + 4));
+        a0 = addmod_avx2(a0, mulmod_avx2(b0, vs, vs_shoup, vp), vp);
+        a1 = addmod_avx2(a1, mulmod_avx2(b1, vs, vs_shoup, vp), vp);
+        _mm256_storeu_si256((__m256i *) (dst + j), a0);
+        _mm256_storeu_si256((__m256i *) (dst + j + 4), a1);
+    }
+    axpy_mod_scalar(dst + j, src + j, s, p, n - j);
+}
+
+__attribute__((target("avx2")))
+static void scale_mod_avx2 (uint64_t *row, uint64_t s, uint64_t p, int n)
+{
+    if (p >= MOD_VECTOR_LIMIT) {
+        scale_mod_scalar(row, s, p, n);
+        return;
+    }
+    __m256i vs = _mm256_set1_epi64x(s);
+    __m256i vs_shoup = _mm256_set1_epi64x((s << 32) / p);
+    __m256i vp = _mm256_set1_epi64x(p);
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (row + j));
+        _mm256_storeu_si256((__m256i *) (row + j), mulmod_avx2(a, vs, vs_shoup, vp));
+    }
+    scale_mod_scalar(row + j, s, p, n - j);
+}
+
+/* ------------------------------------------------------------------------
+ * AVX-512, eight doubles at a time, with masks for the ends of rows
+ * --------------------------------------------------------------------- */
+
+__attribute__((target("avx512f"))) NO_FUSE
+static void axpy_avx512 (double *dst, const double *src, double s, int n)
+{
+    __m512d vs = _mm512_set1_pd(s);
+    int j = 0;
+    for (; j + 32 <= n; j += 32) {
+        __m512d a0 = _mm512_loadu_pd(dst + j);
+        __m512d a1 = _mm512_loadu_pd(dst + j + 8);
+        __m512d a2 = _mm512_loadu_pd(dst + j + 16);
+        __m512d a3 = _mm512_loadu_pd(dst + j + 24);
+        a0 = _mm512_add_pd(a0, _mm512_mul_pd(vs, _mm512_loadu_pd(src + j)));
+        a1 = _mm512_add_pd(a1, _mm512_mul_pd(vs, _mm512_loadu_pd(src + j + 8)));
+        a2 = _mm512_add_pd(a2, _mm512_mul_pd(vs, _mm512_loadu_pd(src + j + 16)));
+        a3 = _mm512_add_pd(a3, _mm512_mul_pd(vs, _mm512_loadu_pd(src + j + 24)));
+        _mm512_storeu_pd(dst + j, a0);
+        _mm512_storeu_pd(dst + j + 8, a1);
+        _mm512_storeu_pd(dst + j + 16, a2);
+        _mm512_storeu_pd(dst + j + 24, a3);
+    }
+    for (; j < n; j += 8) {
+        __mmask8 m = n - j >= 8 ? 0xff : (__mmask8) ((1u << (n - j)) - 1);
+        __m512d a = _mm512_maskz_loadu_pd(m, dst + j);
+        __m512d b = _mm512_maskz_loadu_pd(m, src + j);
+        _mm512_mask_storeu_pd(dst + j, m, _mm512_add_pd(a, _mm512_mul_pd(vs, b)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void scale_avx512 (double *row, double s, int n)
+{
+    __m512d vs = _mm512_set1_pd(s);
+    for (int j = 0; j < n; j += 8) {
+        __mmask8 m = n - j >= 8 ? 0xff : (__mmask8) ((1u << (n - j)) - 1);
+        __m512d a = _mm512_maskz_loadu_pd(m, row + j);
+        _mm512_mask_storeu_pd(row + j, m, _mm512_mul_pd(a, vs));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void swap_avx512 (double *a, double *b, int n)
+{
+    for (int j = 0; j < n; j += 8) {
+        __mmask8 m = n - j >= 8 ? 0xff : (__mmask8) ((1u << (n - j)) - 1);
+        __m512d va = _mm512_maskz_loadu_pd(m, a + j);
+        __m512d vb = _mm512_maskz_loadu_pd(m, b + j);
+        _mm512_mask_storeu_pd(a + j, m, vb);
+        _mm512_mask_storeu_pd(b + j, m, va);
+    }
+}
+
+/* Keeps a block of 4 rows by 16 columns of c in registers while it works
+ * through every p, with masks for the last columns */
+__attribute__((target("avx512f"))) NO_FUSE
+static void update_avx512 (double *c, size_t ldc, const double *l, size_t ldl,
+        const double *const *u, int m, int n, int k)
+{
+    for (int j0 = 0; j0 < n; j0 += UPDATE_COLS) {
+        int jn = n - j0 < UPDATE_COLS ? n : j0 + UPDATE_COLS;
+        int i = 0;
+        for (; i + 4 <= m; i += 4) {
+            double *c0 = c + i * ldc, *c1 = c0 + ldc, *c2 = c1 + ldc, *c3 = c2 + ldc;
+            const double *l0 = l + i * ldl, *l1 = l0 + ldl, *l2 = l1 + ldl, *l3 = l2 + ldl;
+            for (int j = j0; j < jn; j += 16) {
+                int left = jn - j;
+                __mmask8 m0 = left >= 8 ? 0xff : (__mmask8) ((1u << left) - 1);
+                __mmask8 m1 = left >= 16 ? 0xff : left <= 8 ? 0 : (__mmask8) ((1u << (left - 8)) - 1);
+                __m512d a00 = _mm512_maskz_loadu_pd(m0, c0 + j), a01 = _mm512_maskz_loadu_pd(m1, c0 + j + 8);
+                __m512d a10 = _mm512_maskz_loadu_pd(m0, c1 + j), a11 = _mm512_maskz_loadu_pd(m1, c1 + j + 8);
+                __m512d a20 = _mm512_maskz_loadu_pd(m0, c2 + j), a21 = _mm512_maskz_loadu_pd(m1, c2 + j + 8);
+                __m512d a30 = _mm512_maskz_loadu_pd(m0, c3 + j), a31 = _mm512_maskz_loadu_pd(m1, c3 + j + 8);
+                for (int p = 0; p < k; p++) {
+                    __m512d u0 = _mm512_maskz_loadu_pd(m0, u[p] + j);
+                    __m512d u1 = _mm512_maskz_loadu_pd(m1, u[p] + j + 8);
+                    __m512d b = _mm512_set1_pd(l0[p]);
+                    a00 = _mm512_add_pd(a00, _mm512_mul_pd(b, u0));
+                    a01 = _mm512_add_pd(a01, _mm512_mul_pd(b, u1));
+                    b = _mm512_set1_pd(l1[p]);
+                    a10 = _mm512_add_pd(a10, _mm512_mul_pd(b, u0));
+                    a11 = _mm512_add_pd(a11, _mm512_mul_pd(b, u1));
+                    b = _mm512_set1_pd(l2[p]);
+                    a20 = _mm512_add_pd(a20, _mm512_mul_pd(b, u0));
+                    a21 = _mm512_add_pd(a21, _mm512_mul_pd(b, u1));
+                    b = _mm512_set1_pd(l3[p]);
+                    a30 = _mm512_add_pd(a30, _mm512_mul_pd(b, u0));
+                    a31 = _mm512_add_pd(a31, _mm512_mul_pd(b, u1));
+                }
+                _mm512_mask_storeu_pd(c0 + j, m0, a00); _mm512_mask_storeu_pd(c0 + j + 8, m1, a01);
+                _mm512_mask_storeu_pd(c1 + j, m0, a10); _mm512_mask_storeu_pd(c1 + j + 8, m1, a11);
+                _mm512_mask_storeu_pd(c2 + j, m0, a20); _mm512_mask_storeu_pd(c2 + j + 8, m1, a21);
+                _mm512_mask_storeu_pd(c3 + j, m0, a30); _mm512_mask_storeu_pd(c3 + j + 8, m1, a31);
+            }
+        }
+        for (; i < m; i++) {
+            double *c0 = c + i * ldc;
+            const double *l0 = l + i * ldl;
+            for (int j = j0; j < jn; j += 8) {
+                __mmask8 m0 = jn - j >= 8 ? 0xff : (__mmask8) ((1u << (jn - j)) - 1);
+                __m512d a0 = _mm512_maskz_loadu_pd(m0, c0 + j);
+                for (int p = 0; p < k; p++)
+                    a0 = _mm512_add_pd(a0, _mm512_mul_pd(_mm512_set1_pd(l0[p]),
+                                         _mm512_maskz_loadu_pd(m0, u[p] + j)));
+                _mm512_mask_storeu_pd(c0 + j, m0, a0);
+            }
+        }
+    }
+}
+
+/* s * x mod p in each lane, like mulmod_avx2 */
+__attribute__((target("avx512f")))
+static inline __m512i mulmod_avx512 (__m512i x, __m512i vs, __m512i vs_shoup,
+        __m512i vp)
+{
+    __m512i q = _mm512_srli_epi64(_mm512_mul_epu32(x, vs_shoup), 32);
+    __m512i r = _mm512_sub_epi64(_mm512_mul_epu32(x, vs), _mm512_mul_epu32(q, vp));
+    return _mm512_min_epu64(r, _mm512_sub_epi64(r, vp));
+}
+
+__attribute__((target("avx512f")))
+static void axpy_mod_avx512 (uint64_t *dst, const uint64_t *src, uint64_t s,
+        uint64_t p, int n)
+{
+    if (p >= MOD_VECTOR_LIMIT) {
+        axpy_mod_scalar(dst, src, s, p, n);
+        return;
+    }
+    __m512i vs = _mm512_set1_epi64(s);
+    __m512i vs_shoup = _mm512_set1_epi64((s << 32) / p);
+    __m512i vp = _mm512_set1_epi64(p);
+    int j = 0;
+    for (; j + 16 <= n; j += 16) {
+        __m512i a0 = _mm512_loadu_si512(dst + j);
+        __m512i a1 = _mm512_loadu_si512(dst + j + 8);
+        a0 = _mm512_add_epi64(a0, mulmod_avx512(_mm512_loadu_si512(src + j), vs, vs_shoup, vp));
+        a1 = _mm512_add_epi64(a1, mulmod_avx512(_mm512_loadu_si512(src + j + 8), vs, vs_shoup, vp));
+        _mm512_storeu_si512(dst + j, _mm512_min_epu64(a0, _mm512_sub_epi64(a0, vp)));
+        _mm512_storeu_si512(dst + j + 8, _mm512_min_epu64(a1, _mm512_sub_epi64(a1, vp)));
+    }
+    for (; j < n; j += 8) {
+        __mmask8 m = n - j >= 8 ? 0xff : (__mmask8) ((1u << (n - j)) - 1);
+        __m512i a = _mm512_maskz_loadu_epi64(m, dst + j);
+        __m512i b = _mm512_maskz_loadu_epi64(m, src + j);
+        a = _mm512_add_epi64(a, mulmod_avx512(b, vs, vs_shoup, vp));
+        _mm512_mask_storeu_epi64(dst + j, m, _mm512_min_epu64(a, _mm512_sub_epi64(a, vp)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void scale_mod_avx512 (uint64_t *row, uint64_t s, uint64_t p, int n)
+{
+    if (p >= MOD_VECTOR_LIMIT) {
+        scale_mod_scalar(row, s, p, n);
+        return;
+    }
+    __m512i vs = _mm512_set1_epi64(s);
+    __m512i vs_shoup = _mm512_set1_epi64((s << 32) / p);
+    __m512i vp = _mm512_set1_epi64(p);
+    for (int j = 0; j < n; j += 8) {
+        __mmask8 m = n - j >= 8 ? 0xff : (__mmask8) ((1u << (n - j)) - 1);
+        __m512i a = _mm512_maskz_loadu_epi64(m, row + j);
+        _mm512_mask_storeu_epi64(row + j, m, mulmod_avx512(a, vs, vs_shoup, vp));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void xor_words_avx512 (uint64_t *dst, const uint64_t *src, int n)
+{
+    int j = 0;
+    for (; j + 16 <= n; j += 16) {
+        __m512i a0 = _mm512_loadu_si512(dst + j);
+        __m512i a1 = _mm512_loadu_si512(dst + j + 8);
+        a0 = _mm512_xor_si512(a0, _mm512_loadu_si512(src + j));
+        a1 = _mm512_xor_si512(a1, _mm512_loadu_si512(src + j + 8));
+        _mm512_storeu_si512(dst + j, a0);
+        _mm512_storeu_si512(dst + j + 8, a1);
+    }
+    for (; j < n; j += 8) {
+        __mmask8 m = n - j >= 8 ? 0xff : (__mmask8) ((1u << (n - j)) - 1);
+        __m512i a = _mm512_maskz_loadu_epi64(m, dst + j);
+        __m512i b = _mm512_maskz_loadu_epi64(m, src + j);
+        _mm512_mask_storeu_epi64(dst + j, m, _mm512_xor_si512(a, b));
+    }
+}
+
+#define REAL float
+#define NAME(f) f##_float_avx512
+#define TARGET __attribute__((target("avx512f")))
+#define VEC_BYTES 64
+#include "kernels_real.h"
+
+#endif /* HAVE_X86 */
+
+/* ------------------------------------------------------------------------
+ * Choosing a version
+ * --------------------------------------------------------------------- */
+
+/* Every version, from most to least preferred */
+static const struct row_kernels versions[] = {
+#ifdef HAVE_X86
+    { "avx512", axpy_avx512, scale_avx512, swap_avx512, update_avx512,
+      axpy_mod_avx512, scale_mod_avx512, xor_words_avx512,
+      axpy_float_avx512, scale_float_avx512, update_float_avx512 },
+    { "avx2", axpy_avx2, scale_avx2, swap_avx2, update_avx2,
+      axpy_mod_avx2, scale_mod_avx2, xor_words_avx2,
+      axpy_float_avx2, scale_float_avx2, update_float_avx2 },
+    { "sse2", axpy_sse2, scale_sse2, swap_sse2, update_sse2,
+      axpy_mod_scalar, scale_mod_scalar, xor_words_sse2,
+      axpy_float_sse2, scale_float_sse2, update_float_sse2 },
+#endif
+    { "scalar", axpy_scalar, scale_scalar, swap_scalar, update_scalar,
+      axpy_mod_scalar, scale_mod_scalar, xor_words_scalar,
+      axpy_float_scalar, scale_float_scalar, update_float_scalar },
+};
+
+#define NVERSIONS (sizeof(versions) / sizeof(versions[0]))
+
+/* Check whether this CPU can run a version.
+ *
+ * pre:  name is one of the names in versions
+ * post: returns true if every instruction the version uses is available
+ */
+static bool cpu_supports (const char *name)
+{
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f");
+    if (strcmp(name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (strcmp(name, "sse2") == 0)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+/* The kernels in use, with nothing in them until kernels_init */
+struct row_kernels kernels;
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+/* Pick the version, once for the whole program.
+ *
+ * pre:  none
+ * post: kernels holds the version ECHELON_KERNELS names if this CPU can
+ *       run it, the best one it can run otherwise
+ */
+static void choose_kernels (void)
+{
+    const char *wanted = getenv("ECHELON_KERNELS");
+    for (size_t i = 0; i < NVERSIONS; i++) {
+        const char *name = versions[i].name;
+        if (wanted != NULL && strcmp(wanted, name) != 0)
+            continue;
+        if (cpu_supports(name)) {
+            kernels = versions[i];
+            return;
+        }
+    }
+
+    /* Asked for something we don't have, so fall back to the safe choice */
+    kernels = versions[NVERSIONS - 1];
+}
+
+void kernels_init (void)
+{
+    pthread_once(&kernels_once, choose_kernels);
+}
@@ -0,0 +1,89 @@
+#ifndef __KERNELS_H__
+#define __KERNELS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Vectorized loops over the entries of a row.
+ *
+ * Every kernel comes in several versions, one per instruction set, and the
+ * best one the CPU supports is chosen the first time any kernel is called.
+ * Setting the ECHELON_KERNELS environment variable to the name of a version
+ * ("scalar", "sse2", "avx2" or "avx512") forces that version instead, as
+ * long as the CPU supports it.
+ *
+ * Every version gives bit-for-bit the same results. axpy and update round
+ * the product s * src[j] before adding it, even where fused multiply-adds
+ * are available: keeping the product's rounding error can leave a tiny
+ * residue where a row should have cancelled to exactly zero, and the
+ * engines would take that residue for a pivot.
+ *
+ * The modular kernels work on integers mod a prime p < 2^63 and are exact
+ * in every version. They multiply with Shoup's method: a quotient
+ * estimated from a precomputed s * 2^w / p, which leaves the product
+ * between 0 and 2p, then one conditional subtraction. The avx2 and avx512
+ * versions do this in 32-bit lanes, so they only speed up primes below
+ * 2^31 and run the scalar loop for bigger ones.
+ */
+struct row_kernels {
+    const char *name;
+
+    /* dst[j] += s * src[j] for 0 <= j < n. dst and src may be the same. */
+    void (*axpy) (double *dst, const double *src, double s, int n);
+
+    /* row[j] *= s for 0 <= j < n */
+    void (*scale) (double *row, double s, int n);
+
+    /* exchange a[j] and b[j] for 0 <= j < n */
+    void (*swap) (double *a, double *b, int n);
+
+    /* c[i][j] += l[i][p] * u[p][j] for 0 <= p < k, for every 0 <= i < m
+     * and 0 <= j < n. Rows of c and l are ldc and ldl doubles apart, and
+     * u holds a pointer to each of the k rows it uses. The terms for each
+     * entry are added in order of p, rounded just like axpy rounds them,
+     * so the result matches k rounds of axpy calls bit for bit while
+     * reading and writing c only once. */
+    void (*update) (double *c, size_t ldc, const double *l, size_t ldl,
+                    const double *const *u, int m, int n, int k);
+
+    /* dst[j] = (dst[j] + s * src[j]) mod p for 0 <= j < n, where s and
+     * every entry are already reduced mod p */
+    void (*axpy_mod) (uint64_t *dst, const uint64_t *src, uint64_t s,
+                      uint64_t p, int n);
+
+    /* row[j] = (s * row[j]) mod p for 0 <= j < n, entries reduced mod p */
+    void (*scale_mod) (uint64_t *row, uint64_t s, uint64_t p, int n);
+
+    /* dst[j] ^= src[j] for 0 <= j < n, which adds rows of bits mod 2 */
+    void (*xor_words) (uint64_t *dst, const uint64_t *src, int n);
+
+    /* The kernels below are written once in kernels_real.h for any
+     * element type, and generated for each one they are needed for. */
+
+    /* axpy on rows of floats, twice as many to a vector */
+    void (*axpy_float) (float *dst, const float *src, float s, int n);
+
+    /* scale on rows of floats */
+    void (*scale_float) (float *row, float s, int n);
+
+    /* update on rows of floats, added up in order of p like update but
+     * with no promise of matching axpy_float bit for bit */
+    void (*update_float) (float *c, size_t ldc, const float *l, size_t ldl,
+                          const float *const *u, int m, int n, int k);
+};
+
+/* The kernels in use. Empty until kernels_init, which has to come before
+ * any of them is called. */
+extern struct row_kernels kernels;
+
+/* Pick the kernels to use, if that hasn't happened yet. Safe to call from
+ * any number of threads at once, but the workers call the kernels, so a
+ * program calls it before pool_start.
+ *
+ * pre:  none
+ * post: kernels holds the best version for this CPU, or the one named by
+ *       ECHELON_KERNELS
+ */
+void kernels_init (void);
+
+#endif
@@ -0,0 +1,150 @@
+/* kernels_real.h - Row kernels written once for any floating point type
+ *
+ * kernels.c includes this once per element type and instruction set, with
+ * these defined:
+ *
+ *     REAL        the element type, float or double
+ *     NAME(f)     the name to give kernel f, like f##_float_avx2
+ *     TARGET      attributes picking the instruction set, or nothing
+ *     VEC_BYTES   the size of a vector register, left undefined for plain
+ *                 loops with no vectors
+ *
+ * and this undefines them again at the end. The loops are written with
+ * GCC's vector extensions, which become SSE2, AVX2 or AVX-512 code
+ * depending on TARGET, and hold twice as many floats as doubles.
+ */
+
+#ifdef VEC_BYTES
+#define LANES ((int) (VEC_BYTES / sizeof(REAL)))
+typedef REAL NAME(vec) __attribute__((vector_size(VEC_BYTES)));
+#endif
+
+/* dst[j] += s * src[j] for 0 <= j < n. dst and src may be the same. */
+TARGET __attribute__((unused))
+static void NAME(axpy) (REAL *dst, const REAL *src, REAL s, int n)
+{
+    int j = 0;
+#ifdef VEC_BYTES
+    for (; j + LANES <= n; j += LANES) {
+        NAME(vec) d, x;
+        memcpy(&d, dst + j, sizeof(d)); // unaligned loads and stores
+        memcpy(&x, src + j, sizeof(x));
+        d += s * x;
+        memcpy(dst + j, &d, sizeof(d));
+    }
+#endif
+    for (; j < n; j++)
+        dst[j] += s * src[j];
+}
+
+/* row[j] *= s for 0 <= j < n */
+TARGET __attribute__((unused))
+static void NAME(scale) (REAL *row, REAL s, int n)
+{
+    int j = 0;
+#ifdef VEC_BYTES
+    for (; j + LANES <= n; j += LANES) {
+        NAME(vec) r;
+        memcpy(&r, row + j, sizeof(r));
+        r *= s;
+        memcpy(row + j, &r, sizeof(r));
+    }
+#endif
+    for (; j < n; j++)
+        row[j] *= s;
+}
+
+/* c[i][j] += l[i][p] * u[p][j] for 0 <= p < k, for every 0 <= i < m and
+ * 0 <= j < n, like update. Four rows of c at a time are kept in registers,
+ * two vectors wide, or one row four vectors wide, while going through p.
+ * The terms are added in order of p, but not necessarily rounded like axpy
+ * rounds them. */
+TARGET __attribute__((unused))
+static void NAME(update) (REAL *c, size_t ldc, const REAL *l, size_t ldl,
+        const REAL *const *u, int m, int n, int k)
+{
+    for (int j0 = 0; j0 < n; j0 += UPDATE_COLS) {
+        int jn = n - j0 < UPDATE_COLS ? n : j0 + UPDATE_COLS;
+        int jv = j0; // where the vectors stop
+#ifdef VEC_BYTES
+        jv = j0 + (jn - j0) / LANES * LANES;
+        int i = 0;
+        for (; i + 4 <= m; i += 4) {
+            REAL *c0 = c + i * ldc, *c1 = c0 + ldc, *c2 = c1 + ldc, *c3 = c2 + ldc;
+            const REAL *l0 = l + i * ldl, *l1 = l0 + ldl, *l2 = l1 + ldl, *l3 = l2 + ldl;
+            for (int j = j0; j + 2 * LANES <= jv; j += 2 * LANES) {
+                /* Named one by one, since arrays of them end up in memory */
+                NAME(vec) a00, a01, a10, a11, a20, a21, a30, a31, x0, x1;
+                memcpy(&a00, c0 + j, sizeof(x0)); memcpy(&a01, c0 + j + LANES, sizeof(x0));
+                memcpy(&a10, c1 + j, sizeof(x0)); memcpy(&a11, c1 + j + LANES, sizeof(x0));
+                memcpy(&a20, c2 + j, sizeof(x0)); memcpy(&a21, c2 + j + LANES, sizeof(x0));
+                memcpy(&a30, c3 + j, sizeof(x0)); memcpy(&a31, c3 + j + LANES, sizeof(x0));
+                for (int p = 0; p < k; p++) {
+                    memcpy(&x0, u[p] + j, sizeof(x0));
+                    memcpy(&x1, u[p] + j + LANES, sizeof(x1));
+                    a00 += l0[p] * x0; a01 += l0[p] * x1;
+                    a10 += l1[p] * x0; a11 += l1[p] * x1;
+                    a20 += l2[p] * x0; a21 += l2[p] * x1;
+                    a30 += l3[p] * x0; a31 += l3[p] * x1;
+                }
+                memcpy(c0 + j, &a00, sizeof(x0)); memcpy(c0 + j + LANES, &a01, sizeof(x0));
+                memcpy(c1 + j, &a10, sizeof(x0)); memcpy(c1 + j + LANES, &a11, sizeof(x0));
+                memcpy(c2 + j, &a20, sizeof(x0)); memcpy(c2 + j + LANES, &a21, sizeof(x0));
+                memcpy(c3 + j, &a30, sizeof(x0)); memcpy(c3 + j + LANES, &a31, sizeof(x0));
+            }
+        }
+
+        /* The rows left over, a row at a time but still four vectors
+         * wide where they fit, and the last vector of the ones before */
+        for (int r = 0; r < m; r++) {
+            int j = r < i ? j0 + (jv - j0) / (2 * LANES) * (2 * LANES) : j0;
+            for (; j + 4 * LANES <= jv; j += 4 * LANES) {
+                NAME(vec) a0, a1, a2, a3, x0, x1, x2, x3;
+                REAL *cr = c + r * ldc + j;
+                memcpy(&a0, cr, sizeof(a0));
+                memcpy(&a1, cr + LANES, sizeof(a1));
+                memcpy(&a2, cr + 2 * LANES, sizeof(a2));
+                memcpy(&a3, cr + 3 * LANES, sizeof(a3));
+                for (int p = 0; p < k; p++) {
+                    REAL b = l[r * ldl + p];
+                    memcpy(&x0, u[p] + j, sizeof(x0));
+                    memcpy(&x1, u[p] + j + LANES, sizeof(x1));
+                    memcpy(&x2, u[p] + j + 2 * LANES, sizeof(x2));
+                    memcpy(&x3, u[p] + j + 3 * LANES, sizeof(x3));
+                    a0 += b * x0;
+                    a1 += b * x1;
+                    a2 += b * x2;
+                    a3 += b * x3;
+                }
+                memcpy(cr, &a0, sizeof(a0));
+                memcpy(cr + LANES, &a1, sizeof(a1));
+                memcpy(cr + 2 * LANES, &a2, sizeof(a2));
+                memcpy(cr + 3 * LANES, &a3, sizeof(a3));
+            }
+            for (; j < jv; j += LANES) {
+                NAME(vec) a, x;
+                memcpy(&a, c + r * ldc + j, sizeof(a));
+                for (int p = 0; p < k; p++) {
+                    memcpy(&x, u[p] + j, sizeof(x));
+                    a += l[r * ldl + p] * x;
+                }
+                memcpy(c + r * ldc + j, &a, sizeof(a));
+            }
+        }
+#endif
+        for (int r = 0; r < m; r++) {
+            for (int j = jv; j < jn; j++) {
+                REAL sum = c[r * ldc + j];
+                for (int p = 0; p < k; p++)
+                    sum += l[r * ldl + p] * u[p][j];
+                c[r * ldc + j] = sum;
+            }
+        }
+    }
+}
+
+#undef LANES
+#undef REAL
+#undef NAME
+#undef TARGET
+#undef VEC_BYTES
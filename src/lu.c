@@ -0,0 +1,455 @@
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "blocked.h"
+#include "kernels.h"
+#include "lu.h"
+#include "pool.h"
+#include "stats.h"
+#include "user_io.h"
+
+/* Rows that a solve takes together, as many as kernels.update keeps in
+ * registers at once */
+#define SOLVE_ROWS 4
+
+#define REAL double
+#define EPSILON DBL_EPSILON
+#define NAME(f) f##_double
+#define AXPY kernels.axpy
+#define SCALE kernels.scale
+#define UPDATE kernels.update
+#include "lu_real.h"
+#undef REAL
+#undef EPSILON
+#undef NAME
+#undef AXPY
+#undef SCALE
+#undef UPDATE
+
+#define LU_FILE_MAGIC "ECHL"
+#define LU_FILE_VERSION 2 // 1 had no pivot tolerance
+#define LU_FILE_BYTE_ORDER 0x01020304u
+
+/* The start of a factor file. After it come the n rows of the factors, n
+ * doubles each, then perm and pivots, rank int64_ts each. Everything is in
+ * the byte order of the machine that wrote it, like a matrix file. */
+struct lu_file_header {
+    char magic[4];        // LU_FILE_MAGIC, not NUL terminated
+    uint16_t version;     // LU_FILE_VERSION
+    uint16_t reserved0;   // zero
+    uint32_t byte_order;  // LU_FILE_BYTE_ORDER as the writer saw it
+    int32_t sign;         // 1 or -1
+    uint64_t key;         // lu_key of A
+    uint64_t n;           // rows and columns of A
+    uint64_t rank;        // number of pivots
+    uint8_t reserved[24]; // zero
+};
+
+_Static_assert(sizeof(struct lu_file_header) == 64,
+               "factor file header must stay 64 bytes");
+
+/* Multipliers of xxHash64, whose rounds lu_key borrows */
+#define HASH_PRIME1 0x9e3779b185ebca87ull
+#define HASH_PRIME2 0xc2b2ae3d27d4eb4full
+#define HASH_PRIME3 0x165667b19e3779f9ull
+
+static inline uint64_t hash_round (uint64_t acc, uint64_t word)
+{
+    acc += word * HASH_PRIME2;
+    acc = acc << 31 | acc >> 33;
+    return acc * HASH_PRIME1;
+}
+
+static inline uint64_t rotate (uint64_t x, int bits)
+{
+    return x << bits | x >> (64 - bits);
+}
+
+uint64_t lu_key (const struct matrix *matrix, int n)
+{
+    /* Four words at a time into four hashes, so the multiplies overlap */
+    uint64_t h0 = HASH_PRIME1 + n, h1 = HASH_PRIME2 + n, h2 = n, h3 = -HASH_PRIME1 + n;
+    for (int i = 0; i < n; i++) {
+        const double *row = matrix_row(matrix, i);
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            uint64_t w[4];
+            memcpy(w, row + j, sizeof(w));
+            h0 = hash_round(h0, w[0]);
+            h1 = hash_round(h1, w[1]);
+            h2 = hash_round(h2, w[2]);
+            h3 = hash_round(h3, w[3]);
+        }
+        for (; j < n; j++) {
+            uint64_t w;
+            memcpy(&w, row + j, sizeof(w));
+            h0 = hash_round(h0, w);
+        }
+    }
+
+    /* Then mixed together so that every bit counts towards every other */
+    uint64_t hash = rotate(h0, 1) + rotate(h1, 7) + rotate(h2, 12) + rotate(h3, 18);
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/* The factors as lu_real.h keeps them, in the rows of f->lu */
+static struct factors_double factors_of (const struct lu_factors *f)
+{
+    return (struct factors_double) { matrix_row(f->lu, 0), f->lu->stride, f->n,
+                                      f->rank, f->sign, f->perm, f->pivots };
+}
+
+struct lu_factors *lu_factor (const struct matrix *matrix, int n)
+{
+    struct lu_factors *f = calloc(1, sizeof(*f));
+    double *l = NULL; // multipliers of the block being factored
+    if (f == NULL) {
+        report_error("Could not allocate the factors.");
+        return NULL;
+    }
+    f->key = lu_key(matrix, n);
+    f->n = n;
+    f->sign = 1;
+    f->refs = 1;
+    f->perm = malloc(n * sizeof(int));
+    f->pivots = malloc(n * sizeof(int));
+    f->lu = matrix_create(n, n);
+    l = malloc((size_t) n * PANEL_COLS * sizeof(double));
+    if (f->perm == NULL || f->pivots == NULL || f->lu == NULL || l == NULL) {
+        report_error("Could not allocate the factors.");
+        goto fail;
+    }
+    for (int i = 0; i < n; i++) {
+        const double *row = matrix_row(matrix, i);
+        for (int j = 0; j < n; j++) {
+            if (!isfinite(row[j])) {
+                report_error("Only finite coefficients can be factored.");
+                goto fail;
+            }
+        }
+        memcpy(matrix_row(f->lu, i), row, n * sizeof(double));
+    }
+    stats_count(STAT_FACTORIZATIONS, 1);
+
+    /* A pivot has to stand out from the rounding errors of the entries
+     * cancelled into it, which grow to about n * eps times the biggest
+     * row sum of A, like the tolerance of MATLAB's rref. factor_double
+     * skips the columns with nothing bigger. */
+    double anorm = 0;
+    for (int i = 0; i < n; i++) {
+        double sum = 0;
+        for (int j = 0; j < n; j++)
+            sum += fabs(MAT(f->lu, i, j));
+        if (sum > anorm)
+            anorm = sum;
+    }
+
+    struct factors_double factors = factors_of(f);
+    if (!factor_double(&factors, anorm, l)) {
+        report_error("The factors came out too big for a double.");
+        goto fail;
+    }
+    f->rank = factors.rank;
+    f->sign = factors.sign;
+    free(l);
+    return f;
+fail:
+    free(l);
+    lu_release(f);
+    return NULL;
+}
+
+void lu_release (struct lu_factors *f)
+{
+    if (f == NULL || --f->refs > 0)
+        return;
+    free(f->perm);
+    free(f->pivots);
+    matrix_free(f->lu);
+    free(f);
+}
+
+/* Solving for columns with the factors, shared out by blocks of
+ * PANEL_COLS columns */
+struct lu_columns {
+    const struct lu_factors *f;
+    double *b;    // n rows of w columns, ldb apart
+    size_t ldb;
+    int w;
+    bool failed;  // scratch space ran out
+};
+
+static void columns_task (void *arg, int begin, int end)
+{
+    struct lu_columns *c = arg;
+    const double **rows = malloc(c->f->n * sizeof(double *));
+    if (rows == NULL) {
+        __atomic_store_n(&c->failed, true, __ATOMIC_RELAXED);
+    } else {
+        struct factors_double factors = factors_of(c->f);
+        int j0 = begin * PANEL_COLS;
+        int j1 = end * PANEL_COLS < c->w ? end * PANEL_COLS : c->w;
+        substitute_double(&factors, c->b + j0, c->ldb, j1 - j0, rows);
+    }
+    free(rows);
+}
+
+/* Solve for w columns with the factors.
+ *
+ * pre:  f->rank == f->n, b holds n rows of w doubles, ldb apart
+ * post: returns true once b holds A^-1 b, false after reporting an error
+ */
+static bool substitute (const struct lu_factors *f, double *b, size_t ldb,
+        int w)
+{
+    int n = f->n;
+    struct lu_columns c = { f, b, ldb, w, false };
+    stats_count(STAT_FLOPS, 2 * (int64_t) n * n * w);
+    pool_for(columns_task, &c, (w + PANEL_COLS - 1) / PANEL_COLS,
+             (size_t) 2 * n * n * PANEL_COLS);
+    if (c.failed)
+        report_error("Could not allocate the solve workspace.");
+    return !c.failed;
+}
+
+bool lu_solve (const struct lu_factors *f, struct matrix *matrix)
+{
+    int n = f->n;
+    if (f->rank < n) {
+        report_error("A has rank %d of %d, so it has no factors to solve with.",
+                     f->rank, n);
+        return false;
+    }
+
+    /* With a pivot in every column, A becomes I and B the solution */
+    int m = matrix->ncols - n;
+    if (m > 0 && !substitute(f, matrix_row(matrix, 0) + n, matrix->stride, m))
+        return false;
+    for (int i = 0; i < n; i++) {
+        double *row = matrix_row(matrix, i);
+        for (int j = 0; j < n; j++)
+            row[j] = i == j;
+    }
+    return true;
+}
+
+double lu_determinant (const struct lu_factors *f)
+{
+    if (f->rank < f->n)
+        return 0;
+    double det = f->sign;
+    for (int i = 0; i < f->n; i++)
+        det *= MAT(f->lu, i, i);
+    return det;
+}
+
+struct matrix *lu_inverse (const struct lu_factors *f)
+{
+    if (f->rank < f->n) {
+        report_error("The matrix is singular, so it has no inverse.");
+        return NULL;
+    }
+    struct matrix *inverse = matrix_create(f->n, f->n);
+    if (inverse == NULL) {
+        report_error("Could not allocate the inverse.");
+        return NULL;
+    }
+    for (int i = 0; i < f->n; i++)
+        MAT(inverse, i, i) = 1;
+    if (!substitute(f, matrix_row(inverse, 0), inverse->stride, f->n)) {
+        matrix_free(inverse);
+        return NULL;
+    }
+    return inverse;
+}
+
+bool lu_save (const struct lu_factors *f, const char *path)
+{
+    bool success = false;
+    size_t len = strlen(path) + 32;
+    char *temp = malloc(len);
+    FILE *out = NULL;
+    if (temp == NULL) {
+        report_error("Could not allocate a file name.");
+        return success;
+    }
+    snprintf(temp, len, "%s.%ld.tmp", path, (long) getpid());
+    out = fopen(temp, "wb");
+    if (out == NULL) {
+        report_error("%s: %s", temp, strerror(errno));
+        goto out;
+    }
+
+    struct lu_file_header h = { LU_FILE_MAGIC, LU_FILE_VERSION, 0,
+                                LU_FILE_BYTE_ORDER, f->sign, f->key, f->n,
+                                f->rank, { 0 } };
+    bool written = fwrite(&h, sizeof(h), 1, out) == 1;
+    for (int i = 0; i < f->n && written; i++)
+        written = fwrite(matrix_row(f->lu, i), sizeof(double), f->n, out)
+                  == (size_t) f->n;
+    for (int k = 0; k < f->rank && written; k++) {
+        int64_t swap = f->perm[k];
+        written = fwrite(&swap, sizeof(swap), 1, out) == 1;
+    }
+    for (int k = 0; k < f->rank && written; k++) {
+        int64_t pivot = f->pivots[k];
+        written = fwrite(&pivot, sizeof(pivot), 1, out) == 1;
+    }
+    int closed = fclose(out);
+    out = NULL;
+    if (!written || closed != 0) {
+        report_error("%s: could not write the factors", temp);
+        goto out;
+    }
+    if (rename(temp, path) != 0) {
+        report_error("%s: %s", path, strerror(errno));
+        goto out;
+    }
+    success = true;
+out:
+    if (out != NULL)
+        fclose(out);
+    if (!success)
+        remove(temp);
+    free(temp);
+    return success;
+}
+
+/* Read rank int64_ts into ints, each between low + its index and high.
+ *
+ * pre:  in is open
+ * post: returns true if they were all there and in range
+ */
+static bool read_indices (FILE *in, int *indices, int rank, int low, int high)
+{
+    for (int k = 0; k < rank; k++) {
+        int64_t index;
+        if (fread(&index, sizeof(index), 1, in) != 1 || index < low + k
+                || index >= high)
+            return false;
+        indices[k] = (int) index;
+    }
+    return true;
+}
+
+struct lu_factors *lu_load (const char *path, uint64_t key, int n)
+{
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+        return NULL; // not kept yet
+    struct lu_factors *f = NULL;
+    struct lu_file_header h;
+    if (fread(&h, sizeof(h), 1, in) != 1
+            || memcmp(h.magic, LU_FILE_MAGIC, sizeof(h.magic)) != 0
+            || h.byte_order != LU_FILE_BYTE_ORDER) {
+        report_error("%s: not a factor file", path);
+        goto fail;
+    }
+    if (h.version != LU_FILE_VERSION || h.key != key || h.n != (uint64_t) n || h.rank > h.n
+            || (h.sign != 1 && h.sign != -1))
+        goto fail; // older factors, or those of something else
+
+    f = calloc(1, sizeof(*f));
+    if (f == NULL)
+        goto fail;
+    f->key = key;
+    f->n = n;
+    f->rank = (int) h.rank;
+    f->sign = h.sign;
+    f->refs = 1;
+    f->perm = malloc(n * sizeof(int));
+    f->pivots = malloc(n * sizeof(int));
+    f->lu = matrix_create(n, n);
+    if (f->perm == NULL || f->pivots == NULL || f->lu == NULL)
+        goto fail;
+    bool complete = true;
+    for (int i = 0; i < n && complete; i++)
+        complete = fread(matrix_row(f->lu, i), sizeof(double), n, in) == (size_t) n;
+
+    /* Pivots go from left to right, so each is at least its row */
+    complete = complete && read_indices(in, f->perm, f->rank, 0, n)
+               && read_indices(in, f->pivots, f->rank, 0, n);
+    for (int k = 1; k < f->rank && complete; k++)
+        complete = f->pivots[k] > f->pivots[k - 1];
+    if (!complete) {
+        report_error("%s: damaged or cut short", path);
+        goto fail;
+    }
+    fclose(in);
+    return f;
+fail:
+    fclose(in);
+    lu_release(f);
+    return NULL;
+}
+
+struct lu_factors *lu_cache_get (struct lu_cache *cache,
+        const struct matrix *matrix, int n)
+{
+    uint64_t key = lu_key(matrix, n);
+    struct lu_factors *f = NULL;
+    int found = 0;
+    for (; found < LU_CACHE_SIZE; found++) {
+        struct lu_factors *entry = cache->entries[found];
+        if (entry != NULL && entry->key == key && entry->n == n) {
+            f = entry;
+            break;
+        }
+    }
+
+    if (f == NULL) {
+        char *path = NULL;
+        if (cache->dir != NULL) {
+            size_t len = strlen(cache->dir) + 24;
+            path = malloc(len);
+            if (path == NULL) {
+                report_error("Could not allocate a file name.");
+                return NULL;
+            }
+            snprintf(path, len, "%s/%016llx.lu", cache->dir,
+                     (unsigned long long) key);
+            f = lu_load(path, key, n);
+        }
+        if (f == NULL) {
+            f = lu_factor(matrix, n);
+            /* Factors that couldn't be saved still work, and the reason
+             * has been reported */
+            if (f != NULL && path != NULL)
+                lu_save(f, path);
+            cache->misses++;
+        } else {
+            cache->hits++;
+        }
+        free(path);
+        if (f == NULL)
+            return NULL;
+
+        /* The least recently used make room */
+        found = LU_CACHE_SIZE - 1;
+        lu_release(cache->entries[found]);
+    } else {
+        cache->hits++;
+    }
+    memmove(cache->entries + 1, cache->entries,
+            found * sizeof(cache->entries[0]));
+    cache->entries[0] = f;
+    f->refs++;
+    return f;
+}
+
+void lu_cache_clear (struct lu_cache *cache)
+{
+    for (int k = 0; k < LU_CACHE_SIZE; k++) {
+        lu_release(cache->entries[k]);
+        cache->entries[k] = NULL;
+    }
+}
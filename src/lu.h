@@ -0,0 +1,147 @@
+#ifndef __LU_H__
+#define __LU_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "matrix.h"
+
+/* Factoring the coefficients of a system once and solving with them many
+ * times over.
+ *
+ * A matrix [A | B], with A the square block of its first nrows columns,
+ * is usually reduced all at once, which costs O(n^3) however narrow B is.
+ * Instead A can be factored by itself, P A = L U, keeping the row swaps
+ * (P) and the multipliers of the rows added to each other (L) along with
+ * the echelon form they lead to (U). Any B then takes O(n^2) work per
+ * column to reduce with them, and the rank, determinant and inverse of A
+ * come from the same factors.
+ *
+ * Factors are found again by a hash of A, the key: in an lu_cache for as
+ * long as a program runs, and in files in a directory from one run to the
+ * next. Only the key and n are compared, not A itself, so two matrices
+ * whose keys collide would share factors. For matrices that aren't made
+ * to collide, that is a chance of about 2^-64 per pair; the hash is not
+ * meant to stand up to someone choosing them, so a cache directory should
+ * only hold factors its owner trusts.
+ *
+ * Unlike the other engines, a pivot has to be bigger than n * eps times
+ * the biggest row sum of |A|, since anything smaller may be nothing but
+ * rounding error: with exact zeros only, [[1,2,3],[4,5,6],[7,8,9]] would
+ * have rank 3. A column with no such entry is skipped, so the rank and
+ * determinant of a singular A come out right, but there is nothing to
+ * solve with or invert.
+ */
+
+/* Factors kept by an lu_cache before the least recently used are dropped */
+#define LU_CACHE_SIZE 8
+
+/* P A = L U in one matrix. U is in echelon form, and the multiplier that
+ * cancelled each entry below a pivot is kept where that entry was, negated
+ * as the blocked engine keeps them. */
+struct lu_factors {
+    uint64_t key;      // lu_key of A
+    int n;             // rows and columns of A
+    int rank;          // number of pivots
+    int sign;          // 1 or -1, for an even or odd number of swaps
+    int *perm;         // row k was swapped with row perm[k] >= k, k < rank
+    int *pivots;       // pivot column of row k, k < rank
+    struct matrix *lu; // U and the multipliers
+    int refs;          // holders of these factors, for lu_release
+};
+
+/* Recently used factors, with the files they are kept in between runs. Not
+ * safe to use from more than one thread at a time. */
+struct lu_cache {
+    struct lu_factors *entries[LU_CACHE_SIZE]; // most recently used first
+    const char *dir;   // directory of factor files, or NULL to keep none
+    long hits;         // lookups answered without factoring
+    long misses;       // lookups that had to factor
+};
+
+/* Hash the square block on the left of a matrix.
+ *
+ * pre:  matrix has at least n rows and n columns
+ * post: returns a 64-bit hash of n and the n x n entries' bytes, mixed
+ *       with the rounds and finish of xxHash64 though not equal to it
+ */
+uint64_t lu_key (const struct matrix *matrix, int n);
+
+/* Factor the square block on the left of a matrix.
+ *
+ * pre:  matrix has n rows and at least n columns, the kernels may have
+ *       been picked and the pool started
+ * post: returns factors held once, or NULL after reporting an error
+ */
+struct lu_factors *lu_factor (const struct matrix *matrix, int n);
+
+/* Let go of factors.
+ *
+ * pre:  f came from lu_factor, lu_load or lu_cache_get, or is NULL
+ * post: f is freed once nothing holds it any more
+ */
+void lu_release (struct lu_factors *f);
+
+/* Reduce a matrix whose left block was factored.
+ *
+ * pre:  matrix has f->n rows and at least as many columns, its left block
+ *       is the A that f came from
+ * post: returns true with matrix in reduced echelon form, [I | A^-1 B],
+ *       false after reporting an error, which includes A being singular
+ */
+bool lu_solve (const struct lu_factors *f, struct matrix *matrix);
+
+/* Return the determinant of A.
+ *
+ * pre:  f holds the factors of A
+ * post: returns the product of U's diagonal with the sign of P, or 0 if A
+ *       is singular
+ */
+double lu_determinant (const struct lu_factors *f);
+
+/* Find the inverse of A.
+ *
+ * pre:  f holds the factors of A
+ * post: returns a new n x n matrix, or NULL after reporting an error,
+ *       which includes A being singular
+ */
+struct matrix *lu_inverse (const struct lu_factors *f);
+
+/* Write factors to a file, through a temporary file renamed into place so
+ * that readers never see half of it.
+ *
+ * pre:  f holds factors
+ * post: returns true on success, false after reporting what went wrong
+ */
+bool lu_save (const struct lu_factors *f, const char *path);
+
+/* Read factors back from a file.
+ *
+ * pre:  none
+ * post: returns factors held once if path holds factors of an n x n matrix
+ *       with the given key, or NULL if it doesn't exist or holds anything
+ *       else, which is only reported if it isn't a factor file at all
+ */
+struct lu_factors *lu_load (const char *path, uint64_t key, int n);
+
+/* Find the factors of the left block of a matrix, factoring it only if
+ * neither the cache nor its directory has them already, and saving any
+ * new ones to the directory. Factors with the same key and size are taken
+ * to be A's, as above.
+ *
+ * pre:  cache is zeroed or was used before, with dir set as wanted, and
+ *       matrix is as for lu_factor
+ * post: returns factors held once more for the caller, or NULL after
+ *       reporting an error
+ */
+struct lu_factors *lu_cache_get (struct lu_cache *cache,
+        const struct matrix *matrix, int n);
+
+/* Drop everything in a cache.
+ *
+ * pre:  cache was used with lu_cache_get, or is zeroed
+ * post: the cache's hold on each of its factors is released, and the
+ *       cache is empty
+ */
+void lu_cache_clear (struct lu_cache *cache);
+
+#endif
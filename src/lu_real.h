@@ -0,0 +1,215 @@
+/* lu_real.h - LU factors with partial pivoting, written once for any
+ * floating point type
+ *
+ * lu.c includes this for double, and mixed_real.h once per precision the
+ * factors are kept in, with these defined:
+ *
+ *     REAL       the element type of the factors, float or double
+ *     EPSILON    the machine epsilon of REAL, like FLT_EPSILON
+ *     NAME(f)    the name to give f, like f##_float
+ *     AXPY       the row kernels for REALs, like kernels.axpy_float and so
+ *     SCALE      on
+ *     UPDATE
+ *     SOLVE_ROWS rows that a solve takes together, as many as UPDATE keeps
+ *                in registers at once
+ *
+ * which the file including it undefines again when it is done with them.
+ */
+
+/* A square matrix split into P A = L U, in one array. U is in echelon
+ * form on and above the pivots, and below them are the multipliers of the
+ * rows added to each other, which make up -L, with L's diagonal of 1s
+ * left out. Keeping them negated, as the blocked engine does, lets UPDATE
+ * add them in. */
+struct NAME(factors) {
+    REAL *a;     // n rows of lda entries
+    size_t lda;
+    int n;
+    int rank;    // number of pivots
+    int sign;    // 1 or -1, for an even or odd number of swaps
+    int *perm;   // row k was swapped with row perm[k] >= k, k < rank
+    int *pivots; // pivot column of row k, k < rank
+};
+
+/* Exchange two rows of REALs */
+static void NAME(swap_rows) (REAL *a, REAL *b, int n)
+{
+    for (int j = 0; j < n; j++) {
+        REAL temp = a[j];
+        a[j] = b[j];
+        b[j] = temp;
+    }
+}
+
+/* Cancelling out one column below its pivot, within a block of columns,
+ * shared out by rows */
+struct NAME(column) {
+    struct NAME(factors) *f;
+    REAL *l;   // the block's multipliers, PANEL_COLS per row from row r0
+    int r0;    // the block's first pivot row
+    int r;     // the pivot's row, item 0 being the row below it
+    int c;     // the pivot's column
+    int c_end; // end of the block
+    int npiv;  // pivots in the block before this one
+};
+
+static void NAME(column_task) (void *arg, int begin, int end)
+{
+    struct NAME(column) *c = arg;
+    const REAL *piv = c->f->a + (size_t) c->r * c->f->lda;
+    for (int i = c->r + 1 + begin; i < c->r + 1 + end; i++) {
+        REAL *row = c->f->a + (size_t) i * c->f->lda;
+        REAL temp = -1 * row[c->c] / piv[c->c];
+        row[c->c] = temp;
+        c->l[(size_t) (i - c->r0) * PANEL_COLS + c->npiv] = temp;
+        if (temp != 0)
+            AXPY(row + c->c + 1, piv + c->c + 1, temp, c->c_end - c->c - 1);
+    }
+}
+
+/* Bringing the rows below a block of pivots up to date right of the
+ * block, shared out by rows */
+struct NAME(trailing) {
+    struct NAME(factors) *f;
+    const REAL *l;        // multipliers of row r on, PANEL_COLS per row
+    const REAL *const *u; // the block's pivot rows, right of the block
+    int r;                // the row below the block's last pivot, item 0
+    int c_end;            // end of the block
+    int npiv;             // pivots in the block
+};
+
+static void NAME(trailing_task) (void *arg, int begin, int end)
+{
+    struct NAME(trailing) *t = arg;
+    const struct NAME(factors) *f = t->f;
+    UPDATE(f->a + (size_t) (t->r + begin) * f->lda + t->c_end, f->lda,
+           t->l + (size_t) begin * PANEL_COLS, PANEL_COLS, t->u, end - begin,
+           f->n - t->c_end, t->npiv);
+}
+
+/* Factor with partial pivoting, PANEL_COLS columns at a time. Within a
+ * block only its columns are updated, and the rest of each row once at
+ * the end of the block through UPDATE, like the blocked engine does.
+ *
+ * A pivot no bigger than n * EPSILON * anorm may be nothing but the
+ * rounding left in a column that should have cancelled, so a column with
+ * no bigger entry is skipped, its entries from the next pivot row down
+ * set to 0, and A is singular in this precision.
+ *
+ * pre:  f holds a square matrix whose infinity norm is anorm, f->perm and
+ *       f->pivots have room for n entries, l for n * PANEL_COLS REALs
+ * post: returns true with f holding its factors and their rank, false if
+ *       a pivot came out not finite, which leaves f in pieces
+ */
+static bool NAME(factor) (struct NAME(factors) *f, double anorm, REAL *l)
+{
+    double tolerance = f->n * EPSILON * anorm;
+    int n = f->n;
+    const REAL *u[PANEL_COLS];
+    int r = 0; // the next pivot row
+    f->sign = 1;
+    for (int c0 = 0; c0 < n && r < n; c0 += PANEL_COLS) {
+        int c_end = c0 + PANEL_COLS < n ? c0 + PANEL_COLS : n;
+        int r0 = r;
+        for (int c = c0; c < c_end && r < n; c++) {
+            /* The biggest entry in the column, for the smallest multipliers */
+            int p = r;
+            for (int i = r + 1; i < n; i++) {
+                if (fabs(f->a[(size_t) i * f->lda + c])
+                        > fabs(f->a[(size_t) p * f->lda + c]))
+                    p = i;
+            }
+            REAL pivot = f->a[(size_t) p * f->lda + c];
+            if (!isfinite(pivot))
+                return false;
+            if (!(fabs(pivot) > tolerance)) {
+                // nothing to pivot on in this column but rounding errors
+                for (int i = r; i < n; i++)
+                    f->a[(size_t) i * f->lda + c] = 0;
+                continue;
+            }
+            f->perm[r] = p;
+            f->pivots[r] = c;
+            if (p != r) {
+                NAME(swap_rows)(f->a + (size_t) r * f->lda,
+                                f->a + (size_t) p * f->lda, n);
+                NAME(swap_rows)(l + (size_t) (r - r0) * PANEL_COLS,
+                                l + (size_t) (p - r0) * PANEL_COLS, r - r0);
+                f->sign = -f->sign;
+            }
+
+            struct NAME(column) col = { f, l, r0, r, c, c_end, r - r0 };
+            stats_count(STAT_FLOPS, 2 * (int64_t) (n - r - 1) * (c_end - c));
+            pool_for(NAME(column_task), &col, n - r - 1, c_end - c);
+            r++;
+        }
+        int npiv = r - r0;
+        if (c_end == n || npiv == 0)
+            continue;
+
+        /* The block's pivot rows right of it, each taking the pivots
+         * above it */
+        for (int k = r0; k < r; k++) {
+            REAL *row = f->a + (size_t) k * f->lda;
+            u[k - r0] = row + c_end;
+            UPDATE(row + c_end, 0, l + (size_t) (k - r0) * PANEL_COLS, 0, u, 1,
+                   n - c_end, k - r0);
+        }
+
+        /* And the rows below it */
+        struct NAME(trailing) t = { f, l + (size_t) (r - r0) * PANEL_COLS, u, r,
+                                    c_end, npiv };
+        stats_count(STAT_FLOPS, 2 * (int64_t) (n - r0) * npiv * (n - c_end));
+        pool_for(NAME(trailing_task), &t, n - r, (size_t) npiv * (n - c_end));
+    }
+    f->rank = r;
+    return true;
+}
+
+/* Solve A X = B for a block of w columns in place, in the precision of
+ * the factors. The rows go SOLVE_ROWS at a time, taking what they need
+ * from the rows already solved all together, then from each other. With
+ * a pivot in every column, the multipliers of each row are side by side
+ * in the factors, as UPDATE takes them.
+ *
+ * pre:  f holds the factors of A with f->rank == f->n, b holds B in n rows
+ *       of w REALs, ldb apart, and rows has room for n pointers
+ * post: b holds X
+ */
+static void NAME(substitute) (const struct NAME(factors) *f, REAL *b,
+        size_t ldb, int w, const REAL **rows)
+{
+    int n = f->n;
+    for (int k = 0; k < n; k++) {
+        rows[k] = b + k * ldb;
+        if (f->perm[k] != k)
+            NAME(swap_rows)(b + k * ldb, b + f->perm[k] * ldb, w);
+    }
+
+    /* Forward through L, adding in the multipliers as they were added */
+    for (int i0 = 0; i0 < n; i0 += SOLVE_ROWS) {
+        int i1 = i0 + SOLVE_ROWS < n ? i0 + SOLVE_ROWS : n;
+        const REAL *l = f->a + (size_t) i0 * f->lda;
+        UPDATE(b + i0 * ldb, ldb, l, f->lda, rows, i1 - i0, w, i0);
+        for (int i = i0 + 1; i < i1; i++)
+            UPDATE(b + i * ldb, 0, f->a + (size_t) i * f->lda + i0, 0,
+                   rows + i0, 1, w, i - i0);
+    }
+
+    /* Back through U, which has to be subtracted, so the rows are negated
+     * around adding it in */
+    for (int i1 = n; i1 > 0; i1 -= SOLVE_ROWS) {
+        int i0 = i1 - SOLVE_ROWS > 0 ? i1 - SOLVE_ROWS : 0;
+        const REAL *u = f->a + (size_t) i0 * f->lda;
+        for (int i = i0; i < i1; i++)
+            SCALE(b + i * ldb, -1, w);
+        UPDATE(b + i0 * ldb, ldb, u + i1, f->lda, rows + i1, i1 - i0, w,
+               n - i1);
+        for (int i = i1 - 1; i >= i0; i--) {
+            u = f->a + (size_t) i * f->lda;
+            REAL *y = b + i * ldb;
+            UPDATE(y, 0, u + i + 1, 0, rows + i + 1, 1, w, i1 - i - 1);
+            SCALE(y, -1 / u[i], w);
+        }
+    }
+}
@@ -19,23 +19,312 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <getopt.h>     // getopt_long
 #include "automatic.h"  // ref and rref calculations done by the computer
+#include "batch.h"      // many matrices from one stream
+#include "exact.h"      // rational matrices solved without rounding
+#include "matrix.h"     // heap-allocated matrix storage
+#include "matrix_file.h" // binary matrix files
+#include "matrix_proc.h" // pivot columns of the result
+#include "kernels.h"    // row operation kernels
+#include "pool.h"       // worker threads for big matrices
+#include "reader.h"     // parsing the thread count
+#include "sparse.h"     // mostly-zero matrices
+#include "stats.h"      // counters and phase timers for --stats
+#include "gf2.h"        // bit-packed matrices mod 2
+#include "journal.h"    // recording and replaying the row operations
+#include "modp.h"       // matrices over the integers mod a prime
 #include "manual.h"     // allow the user to do their own calculations
+#include "mixed.h"      // single precision solves refined to double
+#include "lu.h"         // factors kept for solving again
+#include "outcore.h"    // files too big for memory, solved in place
+#include "server.h"     // requests from other programs
+#include "incremental.h" // rows added one at a time
+#include "format.h"     // how matrices are printed
 #include "user_io.h"    // matrix reading and printing
 
+/* Long options with no short form */
+#define OPT_STATS 256
+#define OPT_JOURNAL 257
+#define OPT_BINARY_JOURNAL 258
+#define OPT_REPLAY 259
+#define OPT_STEP 260
+#define OPT_MIXED 261
+#define OPT_LU 262
+#define OPT_LU_CACHE 263
+#define OPT_INVERSE 264
+#define OPT_OUT_OF_CORE 265
+#define OPT_SERVE 266
+#define OPT_INCREMENTAL 267
+#define OPT_FORMAT 268
+#define OPT_SERVE_LIMIT 269
+
+/* Memory --out-of-core holds the matrix in by default, in MB */
+#define OUTCORE_DEFAULT_MB 1024
+
+/* How to write the --stats report */
+static enum stats_format stats_format;
+
+/* The options and input a run uses, as bits, to check them against each
+ * other before anything is read */
+enum uses {
+    USES_MANUAL = 1 << 0,       // -m
+    USES_FULL_TRACE = 1 << 1,   // neither -s nor -q
+    USES_DIRECT = 1 << 2,       // -g
+    USES_EXACT = 1 << 3,        // -e
+    USES_BATCH = 1 << 4,        // -b
+    USES_MOD = 1 << 5,          // --mod
+    USES_SPARSE = 1 << 6,       // -S
+    USES_FILE = 1 << 7,         // -f
+    USES_BINARY = 1 << 8,       // -f naming a binary matrix file
+    USES_OUT = 1 << 9,          // -o
+    USES_MIXED = 1 << 10,       // --mixed
+    USES_LU = 1 << 11,          // --lu, --lu-cache or --inverse
+    USES_INVERSE = 1 << 12,     // --inverse
+    USES_JOURNAL = 1 << 13,     // --journal or --binary-journal
+    USES_REPLAY = 1 << 14,      // --replay
+    USES_STEP = 1 << 15,        // --step
+    USES_OUTCORE = 1 << 16,     // --out-of-core
+    USES_SERVE = 1 << 17,       // --serve
+    USES_SERVE_LIMIT = 1 << 18, // --serve-limit
+    USES_INCREMENTAL = 1 << 19, // --incremental
+    USES_FORMAT = 1 << 20,      // --format
+};
+
+/* Options the dense engines' steps are needed for */
+#define USES_OTHER_ENGINE (USES_MANUAL | USES_EXACT | USES_MOD | USES_SPARSE)
+
+/* What an option needs and rules out */
+struct option_rule {
+    unsigned option;    // the options the rule is for, any one of them
+    unsigned requires;  // what has to be used with them
+    unsigned excludes;  // what can't be
+    const char *message;
+};
+
+static const struct option_rule option_rules[] = {
+    /* The sparse engine can't show the matrix after every step, and
+     * manual mode works on a dense matrix */
+    { USES_SPARSE, 0, USES_MANUAL | USES_FULL_TRACE,
+      "-S only works in automatic mode with -s or -q." },
+    /* Only the dense engine has a single pass to the reduced form */
+    { USES_DIRECT, 0, USES_OTHER_ENGINE | USES_BATCH,
+      "-g only works in automatic mode, without -e, -b, --mod or -S." },
+    /* Mixed precision factors the matrix instead of eliminating it, so
+     * there are no row operations to show or record */
+    { USES_MIXED, 0, USES_OTHER_ENGINE | USES_BATCH | USES_JOURNAL | USES_REPLAY,
+      "--mixed only works in automatic mode, without -e, -b, --mod, -S, "
+      "--journal or --replay." },
+    /* So does --lu, with factors kept in double */
+    { USES_LU, 0, USES_OTHER_ENGINE | USES_MIXED | USES_JOURNAL | USES_REPLAY,
+      "--lu only works in automatic mode, without -e, --mod, -S, --mixed, "
+      "--journal or --replay." },
+    /* Journals hold the operations of the dense engines */
+    { USES_JOURNAL | USES_REPLAY, 0, USES_OTHER_ENGINE | USES_BATCH,
+      "--journal and --replay only work in automatic mode, without -e, -b, "
+      "--mod or -S." },
+    { USES_STEP, USES_REPLAY, 0, "--step only works with --replay." },
+    { USES_SERVE_LIMIT, USES_SERVE, 0, "--serve-limit only works with --serve." },
+    /* A server reads its matrices from requests, and answers in binary */
+    { USES_SERVE, 0, USES_OTHER_ENGINE | USES_BATCH | USES_FILE | USES_OUT
+                     | USES_MIXED | USES_LU | USES_OUTCORE | USES_JOURNAL
+                     | USES_REPLAY,
+      "--serve only works in automatic mode, without -e, -b, --mod, -S, -f, "
+      "-o, --mixed, --lu, --out-of-core, --journal or --replay." },
+    /* Out of core, the file is never loaded, and only the result is kept */
+    { USES_OUTCORE, USES_BINARY, USES_OTHER_ENGINE | USES_BATCH | USES_OUT
+                                 | USES_MIXED | USES_LU | USES_JOURNAL
+                                 | USES_REPLAY,
+      "--out-of-core only works in automatic mode on a binary file given "
+      "with -f, without -e, -b, --mod, -S, -o, --mixed, --lu, --journal or "
+      "--replay." },
+    /* Incremental rows come as text, and are reduced as they come, always
+     * to the reduced echelon form */
+    { USES_INCREMENTAL, 0, USES_OTHER_ENGINE | USES_BATCH | USES_BINARY
+                           | USES_DIRECT | USES_MIXED | USES_LU | USES_SERVE
+                           | USES_JOURNAL | USES_REPLAY,
+      "--incremental only works in automatic mode on text input, without "
+      "-e, -b, --mod, -S, -g, --mixed, --lu, --journal or --replay." },
+    /* Batch mode solves the usual way, just many times over */
+    { USES_BATCH, 0, USES_OTHER_ENGINE | USES_OUT | USES_BINARY | USES_INVERSE,
+      "-b only works in automatic mode on text input, without -e, --mod, "
+      "-S, -o or --inverse." },
+    /* Integers mod p have no result file format yet */
+    { USES_MOD, 0, USES_MANUAL | USES_EXACT | USES_SPARSE | USES_OUT,
+      "--mod only works in automatic mode, without -e, -S or -o." },
+    /* Exact mode reads the text itself, since a double has already lost
+     * what it needs, and has no result file format */
+    { USES_EXACT, 0, USES_MANUAL | USES_SPARSE | USES_OUT | USES_BINARY,
+      "-e only works in automatic mode on text input, without -S or -o." },
+    /* Exact and modular entries are printed as what they are, and the
+     * server and --out-of-core print no matrices at all */
+    { USES_FORMAT, 0, USES_EXACT | USES_MOD | USES_SERVE | USES_OUTCORE,
+      "--format only works on decimal matrices, without -e, --mod, --serve "
+      "or --out-of-core." },
+};
+
+// Report the first rule the options used break, false if there is one
+static bool check_options (unsigned uses) {
+    for (size_t r = 0; r < sizeof(option_rules) / sizeof(option_rules[0]); r++) {
+        const struct option_rule *rule = &option_rules[r];
+        if ((uses & rule->option) != 0
+                && ((uses & rule->requires) != rule->requires
+                    || (uses & rule->excludes) != 0)) {
+            report_error("%s", rule->message);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write the --stats report to stderr, once everything else is done
+static void report_stats(void) {
+    stats_report(stats_format);
+}
+
 /* Run in automatic mode on a matrix.
  * 
  * pre:  matrix is initialized
+ *       trace says how much of each step to print
+ *       direct says to go straight to the reduced echelon form in one pass,
+ *       without stopping at the echelon form
+ *       out_path is a binary matrix file to write the result to, or NULL
+ * post: returns 0 on success, nonzero on failure
+ */
+int automatic_mode(struct matrix *matrix, enum trace_mode trace, bool direct,
+        const char *out_path);
+
+/* Run in automatic mode on a matrix, straight to the reduced echelon form
+ * in mixed precision, printing only the finished matrix.
+ *
+ * pre:  matrix is initialized
+ *       out_path is a binary matrix file to write the result to, or NULL
+ * post: returns 0 on success, nonzero on failure
+ */
+int mixed_mode(struct matrix *matrix, const char *out_path);
+
+/* Run in automatic mode on a matrix [A | B], reducing it with the factors
+ * of A, or as -g would if A is singular, and printing the rank and
+ * determinant of A as well. Or, with inverse, printing the inverse of A
+ * instead.
+ *
+ * pre:  matrix is initialized
+ *       cache_dir is a directory to keep factors in, or NULL
+ *       out_path is a binary matrix file to write the result to, or NULL
+ * post: returns 0 on success, nonzero on failure
+ */
+int lu_mode(struct matrix *matrix, const char *cache_dir, bool inverse,
+        const char *out_path);
+
+/* Put a binary matrix file into reduced echelon form in place, holding
+ * only part of it in memory at a time, and print its rank.
+ *
+ * pre:  path names a binary matrix file
+ *       memory_mb is how much of it to hold in memory, in MB
+ * post: returns 0 on success, nonzero on failure
+ */
+int outcore_mode(const char *path, int memory_mb);
+
+/* Read the number of columns, then rows one at a time until the input
+ * ends, keeping the reduced echelon form of the rows so far and saying
+ * after each one whether it added a pivot.
+ *
+ * pre:  path is a text file to read, or NULL for stdin
+ *       system says the last column is the right-hand side of a system,
+ *       so rows that contradict the ones before are reported and left out
+ *       out_path is a binary matrix file to write the result to, or NULL
+ * post: returns 0 on success, nonzero on failure
+ */
+int incremental_mode(const char *path, bool system, const char *out_path);
+
+/* Run in automatic mode on a sparse matrix.
+ *
+ * pre:  matrix is initialized
+ *       trace says how much of each step to print, and isn't TRACE_FULL
+ *       out_path is a binary matrix file to write the result to, or NULL
+ * post: returns 0 on success, nonzero on failure
+ */
+int sparse_mode(struct sparse_matrix *matrix, enum trace_mode trace,
+        const char *out_path);
+
+/* Run in automatic mode on an exact matrix, printing only the finished
+ * matrices.
+ *
+ * pre:  matrix is initialized
+ * post: returns 0 on success, nonzero on failure
+ */
+int exact_mode(struct exact_matrix *matrix);
+
+/* Replay a journal on the matrix it was recorded from, printing the
+ * matrix after each of a list of steps.
+ *
+ * pre:  matrix is initialized
+ *       journal_path names a journal
+ *       steps is a comma separated list of step numbers, or NULL for the
+ *       last step
+ * post: returns 0 on success, nonzero on failure
+ */
+int replay_mode(struct matrix *matrix, const char *journal_path,
+        const char *steps);
+
+/* The operations on one kind of matrix that reading its text and
+ * field_mode need, so that those are written once for every kind. Each
+ * takes and returns the kind's own struct through void pointers, and p is
+ * the prime of the kinds that have one. */
+struct matrix_kind {
+    const char *name; // for messages, like "sparse matrix"
+    void *(*create)(int nrows, int ncols, uint64_t p);
+    bool (*read)(struct reader *in, void *matrix);
+    void (*free)(void *matrix);
+
+    // The rest only for the kinds that field_mode takes, NULL otherwise
+    void *(*from_dense)(const struct matrix *dense, uint64_t p);
+    int (*nrows)(const void *matrix);
+    bool (*echelon)(void *matrix, enum trace_mode trace);
+    void (*reduced_echelon)(void *matrix, enum trace_mode trace);
+    void (*print)(const void *matrix);
+    int (*pivot_columns)(const void *matrix, int *pivots);
+};
+
+static const struct matrix_kind dense_kind, sparse_kind, exact_kind,
+        modp_kind, gf2_kind;
+
+/* Run in automatic mode on a matrix mod p or mod 2, printing its rank and
+ * pivot columns along with the echelon form.
+ *
+ * pre:  matrix is initialized, and of a kind with all its operations
+ *       trace says how much of each step to print
  * post: returns 0 on success, nonzero on failure
  */
-int automatic_mode(int nrows, int ncols, double matrix[nrows][ncols]);
+int field_mode(void *matrix, const struct matrix_kind *kind,
+        enum trace_mode trace);
+
+// Print the rank and the first rank pivot columns of an echelon form
+static void print_rank(int rank, const int *pivots);
+
+// Ask whether to go on to the reduced echelon form, true unless told no
+static bool want_reduced(void);
+
+/* Read a text matrix of a kind from path, or stdin if NULL, with p for
+ * the kinds that have one; NULL after an error */
+static void *read_text_matrix(const char *path, const struct matrix_kind *kind,
+        uint64_t p);
+
+// Write an echelon form, reduced or not, to a binary matrix file
+static bool write_result(const char *path, const struct matrix *matrix,
+        bool reduced);
+
+// Like write_result, for the result of sparse mode
+static bool write_sparse_result(const char *path,
+        const struct sparse_matrix *matrix, bool reduced);
 
 /* Run in manual ode on a matrix.
  * 
  * pre:  matrix is initialized
  * post: returns 0 on success, nonzero on failure
  */
-int manual_mode(int nrows, int ncols, double matrix[nrows][ncols]);
+int manual_mode(struct matrix *matrix);
 
 /* Prompt the user to enter a matrix and perform reduced echelon
  * calculations on it, printing out the results as you go.
@@ -45,104 +334,803 @@ int manual_mode(int nrows, int ncols, double matrix[nrows][ncols]);
  */
 int main (int argc, char * argv[]) {
     bool manual = false; // manual mode?
-    bool success;        // operation success
+    enum trace_mode trace = TRACE_FULL; // how much to print while solving
+    const char *path = NULL; // file to read from, NULL for stdin
+    const char *out_path = NULL; // binary file to write the result to
+    int threads = 1;     // threads to solve with, 0 for one per CPU
+    char storage = 'a';  // 'S' for sparse, 'D' for dense, 'a' to pick
+    bool exact = false;  // solve with exact rationals?
+    bool batch = false;  // reduce a whole stream of matrices?
+    bool direct = false; // straight to the reduced echelon form in one pass?
+    bool mixed = false;  // solve in single precision, refined to double?
+    bool lu = false;     // solve with the factors of the left block?
+    const char *cache_dir = NULL; // directory to keep the factors in
+    bool inverse = false; // print the inverse of the left block instead?
+    int outcore_mb = 0;  // MB to solve a file in place with, 0 to load it
+    bool server = false; // serve requests instead of solving one matrix?
+    const char *socket_path = NULL; // socket to serve on, NULL for stdin
+    int serve_mb = 0;    // MB of entries a request may carry, 0 for the default
+    bool incremental = false; // add rows one at a time?
+    bool formatted = false; // was --format given?
+    bool system = false; // is the last column a right-hand side?
+    uint64_t modulus = 0; // prime to solve mod, 0 to use real numbers
+    const char *journal_path = NULL; // journal to record the operations in
+    bool binary_journal = false; // write the journal in binary?
+    const char *replay_path = NULL; // journal to replay instead of solving
+    const char *steps = NULL; // steps of the replay to show
     int ret;             // program return status
 
     /* Parse arguments */
-    for (int i = 0; i < argc; i++) {
-        if (argv[i][0] == '-') {
-            for (int j = 1; argv[i][j] != 0; j++) {
-                switch (argv[i][j]) {
-                    case 'h': // help
-                        printf("Usage: %s [FLAGS]\n\n"
-                               "FLAGS:\n"
-                               "  -m  Manually enter row operations\n"
-                               "  -a  Automatic calculation (default)\n", argv[0]);
-                        return 0;
-                    case 'm': // manual mode
-                        manual = true;
-                        break;
-                    case 'a': // automatic mode (default, but can also be set)
-                        manual = false;
-                        break;
-                    default:  // halt on unrecognized option
-                        fprintf(stderr, "Unknown option: %s.\n"
-                                        "Use %s -h for help.\n", argv[i], argv[0]);
-                        return EXIT_FAILURE;
-                        break;
+    static const struct option long_options[] = {
+        { "mod", required_argument, NULL, 'p' },
+        { "stats", optional_argument, NULL, OPT_STATS },
+        { "journal", required_argument, NULL, OPT_JOURNAL },
+        { "binary-journal", required_argument, NULL, OPT_BINARY_JOURNAL },
+        { "replay", required_argument, NULL, OPT_REPLAY },
+        { "step", required_argument, NULL, OPT_STEP },
+        { "mixed", no_argument, NULL, OPT_MIXED },
+        { "lu", no_argument, NULL, OPT_LU },
+        { "lu-cache", required_argument, NULL, OPT_LU_CACHE },
+        { "inverse", no_argument, NULL, OPT_INVERSE },
+        { "out-of-core", optional_argument, NULL, OPT_OUT_OF_CORE },
+        { "serve", optional_argument, NULL, OPT_SERVE },
+        { "serve-limit", required_argument, NULL, OPT_SERVE_LIMIT },
+        { "incremental", optional_argument, NULL, OPT_INCREMENTAL },
+        { "format", required_argument, NULL, OPT_FORMAT },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hmasqgebp:f:o:j:SD", long_options,
+                              NULL)) != -1) {
+        switch (opt) {
+            case 'h': // help
+                printf("Usage: %s [FLAGS]\n\n"
+                       "FLAGS:\n"
+                       "  -m       Manually enter row operations\n"
+                       "  -a       Automatic calculation (default)\n"
+                       "  -s       Print each step on one line, without the matrix\n"
+                       "  -q       Quiet, print only the finished matrices\n"
+                       "  -g       Gauss-Jordan, go straight to the reduced echelon form\n"
+                       "           in one pass, without asking\n"
+                       "  -e       Exact, solve with fractions instead of decimals (like -q)\n"
+                       "  -b       Batch, reduce every matrix in the input without asking\n"
+                       "           and print only the reduced echelon forms\n"
+                       "  -p P, --mod P\n"
+                       "           Solve over the integers mod P, a prime below 2^63\n"
+                       "  -f PATH  Read the matrix from a text or binary file instead of stdin\n"
+                       "  -o PATH  Write the result, with its rank and pivots, to a binary file\n"
+                       "  -j N     Solve with N threads, or one per CPU if N is 0 (default 1)\n"
+                       "  -S       Store the matrix sparsely (needs -s or -q)\n"
+                       "  -D       Store the matrix densely, even if it is mostly zeroes\n"
+                       "  --stats[=FORMAT]\n"
+                       "           Report operation counts and time per phase to stderr,\n"
+                       "           as a table (text, the default) or as json\n"
+                       "  --journal PATH, --binary-journal PATH\n"
+                       "           Record every row operation in a text or binary journal\n"
+                       "  --replay PATH\n"
+                       "           Replay a journal on the matrix it was recorded from\n"
+                       "  --step N[,N...]\n"
+                       "           Steps of the replay to print (default the last one)\n"
+                       "  --mixed  Solve [A | B], with A square, in single precision\n"
+                       "           refined to double accuracy (like -q -g)\n"
+                       "  --lu     Solve [A | B], with A the first columns, by factoring A\n"
+                       "           first (like -q -g), and print its rank and determinant\n"
+                       "  --lu-cache DIR\n"
+                       "           Like --lu, keeping the factors in DIR for the next run\n"
+                       "  --inverse\n"
+                       "           Like --lu, printing the inverse of A instead\n"
+                       "  --out-of-core[=MB]\n"
+                       "           Put the binary file given with -f into reduced echelon\n"
+                       "           form in place, holding about MB of it in memory\n"
+                       "           (default 1024)\n"
+                       "  --serve[=SOCKET]\n"
+                       "           Solve binary requests from stdin, or from clients of a\n"
+                       "           Unix socket, until stopped (see src/server.h)\n"
+                       "  --serve-limit=MB\n"
+                       "           Refuse requests with more than MB of entries (default 256)\n"
+                       "  --incremental[=system]\n"
+                       "           Read the number of columns, then rows until the input\n"
+                       "           ends, saying after each whether it added a pivot; with\n"
+                       "           system, rows that contradict the ones before are left out\n"
+                       "  --format FORMAT\n"
+                       "           Print decimal matrices as plain (the default), aligned\n"
+                       "           (padded to line up), csv or fractions (like 1/3 where an\n"
+                       "           entry is that close to one, aligned)\n",
+                       argv[0]);
+                return 0;
+            case 'm': // manual mode
+                manual = true;
+                break;
+            case 'a': // automatic mode (default, but can also be set)
+                manual = false;
+                break;
+            case 's': // one line summary per step
+                trace = TRACE_SUMMARY;
+                break;
+            case 'q': // no per-step output at all
+                trace = TRACE_QUIET;
+                break;
+            case 'g': // single pass to the reduced echelon form
+                direct = true;
+                break;
+            case 'e': // exact rational arithmetic
+                exact = true;
+                break;
+            case 'b': // a stream of matrices
+                batch = true;
+                break;
+            case 'p': // integers mod a prime
+                if (!parse_modulus(optarg, &modulus)) {
+                    fprintf(stderr, "Bad modulus: %s (it has to be a prime "
+                                    "below 2^63)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'f': // read from a file
+                path = optarg;
+                break;
+            case 'o': // write the result to a binary file
+                out_path = optarg;
+                break;
+            case 'j': // number of threads
+                if (!parse_int(optarg, &threads) || threads < 0) {
+                    fprintf(stderr, "Bad thread count: %s\n", optarg);
+                    return EXIT_FAILURE;
                 }
-            }
+                break;
+            case 'S': // sparse storage
+            case 'D': // dense storage
+                storage = opt;
+                break;
+            case OPT_STATS: // counters and timers
+                if (optarg == NULL || strcmp(optarg, "text") == 0) {
+                    stats_format = STATS_TEXT;
+                } else if (strcmp(optarg, "json") == 0) {
+                    stats_format = STATS_JSON;
+                } else {
+                    fprintf(stderr, "Bad stats format: %s (it has to be text "
+                                    "or json)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                if (!stats_enabled) // report once, even if given twice
+                    atexit(report_stats);
+                stats_enable();
+                break;
+            case OPT_JOURNAL: // record the operations
+            case OPT_BINARY_JOURNAL:
+                journal_path = optarg;
+                binary_journal = opt == OPT_BINARY_JOURNAL;
+                break;
+            case OPT_REPLAY: // replay recorded operations
+                replay_path = optarg;
+                break;
+            case OPT_STEP: // which steps to replay
+                steps = optarg;
+                break;
+            case OPT_MIXED: // single precision with refinement
+                mixed = true;
+                break;
+            case OPT_LU: // reuse the factors of the left block
+                lu = true;
+                break;
+            case OPT_LU_CACHE: // and keep them between runs
+                lu = true;
+                cache_dir = optarg;
+                break;
+            case OPT_INVERSE: // the inverse of the left block
+                lu = true;
+                inverse = true;
+                break;
+            case OPT_OUT_OF_CORE: // solve a file in place
+                outcore_mb = OUTCORE_DEFAULT_MB;
+                if (optarg != NULL && (!parse_int(optarg, &outcore_mb)
+                                       || outcore_mb <= 0)) {
+                    fprintf(stderr, "Bad memory size: %s (it has to be a "
+                                    "number of MB)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_SERVE: // keep solving for other programs
+                server = true;
+                socket_path = optarg;
+                break;
+            case OPT_SERVE_LIMIT: // the biggest request to serve
+                if (!parse_int(optarg, &serve_mb) || serve_mb <= 0) {
+                    fprintf(stderr, "Bad memory size: %s (it has to be a "
+                                    "number of MB)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_INCREMENTAL: // rows one at a time
+                incremental = true;
+                if (optarg != NULL && strcmp(optarg, "system") != 0) {
+                    fprintf(stderr, "Bad --incremental argument: %s (it can "
+                                    "only be system)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                system = optarg != NULL;
+                break;
+            case OPT_FORMAT: // how to print matrices
+                formatted = true;
+                if (strcmp(optarg, "plain") == 0) {
+                    matrix_format = FORMAT_PLAIN;
+                } else if (strcmp(optarg, "aligned") == 0) {
+                    matrix_format = FORMAT_ALIGNED;
+                } else if (strcmp(optarg, "csv") == 0) {
+                    matrix_format = FORMAT_CSV;
+                } else if (strcmp(optarg, "fractions") == 0) {
+                    matrix_format = FORMAT_FRACTIONS;
+                } else {
+                    fprintf(stderr, "Bad format: %s (it has to be plain, "
+                                    "aligned, csv or fractions)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:  // halt on unrecognized option, getopt has complained
+                fprintf(stderr, "Use %s -h for help.\n", argv[0]);
+                return EXIT_FAILURE;
         }
     }
 
+    bool binary = path != NULL && matrix_file_detect(path);
+    unsigned uses = (manual ? USES_MANUAL : 0)
+                    | (trace == TRACE_FULL ? USES_FULL_TRACE : 0)
+                    | (direct ? USES_DIRECT : 0)
+                    | (exact ? USES_EXACT : 0)
+                    | (batch ? USES_BATCH : 0)
+                    | (modulus != 0 ? USES_MOD : 0)
+                    | (storage == 'S' ? USES_SPARSE : 0)
+                    | (path != NULL ? USES_FILE : 0)
+                    | (binary ? USES_BINARY : 0)
+                    | (out_path != NULL ? USES_OUT : 0)
+                    | (mixed ? USES_MIXED : 0)
+                    | (lu ? USES_LU : 0)
+                    | (inverse ? USES_INVERSE : 0)
+                    | (journal_path != NULL ? USES_JOURNAL : 0)
+                    | (replay_path != NULL ? USES_REPLAY : 0)
+                    | (steps != NULL ? USES_STEP : 0)
+                    | (outcore_mb != 0 ? USES_OUTCORE : 0)
+                    | (server ? USES_SERVE : 0)
+                    | (serve_mb != 0 ? USES_SERVE_LIMIT : 0)
+                    | (incremental ? USES_INCREMENTAL : 0)
+                    | (formatted ? USES_FORMAT : 0);
+    if (!check_options(uses))
+        return EXIT_FAILURE;
+
+    /* A server reads its matrices from requests, and answers in binary */
+    if (server) {
+        kernels_init();
+        if (!pool_start(threads))
+            return EXIT_FAILURE;
+        ret = serve(socket_path, serve_mb != 0 ? serve_mb : SERVER_DEFAULT_MB)
+              ? EXIT_SUCCESS : EXIT_FAILURE;
+        pool_stop();
+        return ret;
+    }
+
+    /* Out of core, the file is never loaded */
+    if (outcore_mb != 0) {
+        kernels_init();
+        if (!pool_start(threads))
+            return EXIT_FAILURE;
+        ret = outcore_mode(path, outcore_mb);
+        pool_stop();
+        return ret;
+    }
+
+    /* Incremental rows are reduced as they come */
+    if (incremental) {
+        kernels_init();
+        if (!pool_start(threads))
+            return EXIT_FAILURE;
+        ret = incremental_mode(path, system, out_path);
+        pool_stop();
+        return ret;
+    }
+
+    /* Batch mode solves the usual way, just many times over */
+    if (batch) {
+        kernels_init();
+        if (!pool_start(threads))
+            return EXIT_FAILURE;
+        struct lu_cache cache = { { NULL }, cache_dir, 0, 0 };
+        ret = batch_reduce(path, lu ? &cache : NULL) ? EXIT_SUCCESS : EXIT_FAILURE;
+        lu_cache_clear(&cache);
+        pool_stop();
+        return ret;
+    }
+
+    /* Integers mod p are read and printed as integers */
+    if (modulus != 0) {
+        /* A bit per entry mod 2, rather than a word */
+        const struct matrix_kind *kind = modulus == 2 ? &gf2_kind : &modp_kind;
+        void *matrix;
+        int64_t start = stats_start();
+        if (binary) {
+            struct matrix *dense = matrix_file_read(path);
+            if (dense == NULL)
+                return EXIT_FAILURE;
+            matrix = kind->from_dense(dense, modulus);
+            matrix_free(dense);
+        } else {
+            matrix = read_text_matrix(path, kind, modulus);
+        }
+        stats_stop(PHASE_READ, start);
+        if (matrix == NULL)
+            return EXIT_FAILURE;
+        kernels_init();
+        if (!pool_start(threads)) {
+            kind->free(matrix);
+            return EXIT_FAILURE;
+        }
+        ret = field_mode(matrix, kind, trace);
+        pool_stop();
+        kind->free(matrix);
+        return ret;
+    }
+
+    /* Exact mode reads the text itself, since a double has already lost
+     * what it needs */
+    if (exact) {
+        int64_t start = stats_start();
+        struct exact_matrix *matrix = read_text_matrix(path, &exact_kind, 0);
+        stats_stop(PHASE_READ, start);
+        if (matrix == NULL)
+            return EXIT_FAILURE;
+        if (!pool_start(threads)) {
+            exact_free(matrix);
+            return EXIT_FAILURE;
+        }
+        ret = exact_mode(matrix);
+        pool_stop();
+        exact_free(matrix);
+        return ret;
+    }
+
+    /* Sparse text input never has to be stored densely */
+    if (storage == 'S' && !binary) {
+        int64_t start = stats_start();
+        struct sparse_matrix *sparse = read_text_matrix(path, &sparse_kind, 0);
+        stats_stop(PHASE_READ, start);
+        if (sparse == NULL)
+            return EXIT_FAILURE;
+        ret = sparse_mode(sparse, trace, out_path);
+        sparse_free(sparse);
+        return ret;
+    }
+
     /* Regardless of whether running in automatic or manual mode, 
      * we need to read dimensions and create a matrix accordingly */ 
-    int nrows, ncols;
-    success = read_size_stdin(&nrows, &ncols);
-    if (!success) {
-        fprintf(stderr, "Error encountered while reading matrix size\n");
+    struct matrix *matrix;
+    int64_t start = stats_start();
+    if (binary)
+        matrix = matrix_file_read(path);
+    else
+        matrix = read_text_matrix(path, &dense_kind, 0);
+    stats_stop(PHASE_READ, start);
+    if (matrix == NULL)
         return EXIT_FAILURE;
+
+    /* A replay only does what the journal says */
+    if (replay_path != NULL) {
+        kernels_init();
+        ret = replay_mode(matrix, replay_path, steps);
+        matrix_free(matrix);
+        return ret;
     }
-    double matrix[nrows][ncols];
-    success = read_matrix_stdin(nrows, ncols, matrix);
-    if (!success) {
-        fprintf(stderr, "Error encountered while reading matrix values\n");
+
+    /* Mostly-zero matrices go to the sparse engine when nothing rules it
+     * out */
+    if (storage == 'S' || (storage == 'a' && !manual && trace != TRACE_FULL
+                           && journal_path == NULL && !direct && !mixed && !lu
+                           && sparse_worthwhile(matrix))) {
+        struct sparse_matrix *sparse = sparse_from_dense(matrix);
+        matrix_free(matrix);
+        if (sparse == NULL)
+            return EXIT_FAILURE;
+        ret = sparse_mode(sparse, trace, out_path);
+        sparse_free(sparse);
+        return ret;
+    }
+
+    /* The workers all call the kernels, so pick them before any start */
+    kernels_init();
+    if (!pool_start(threads)) {
+        matrix_free(matrix);
+        return EXIT_FAILURE;
+    }
+    if (journal_path != NULL && !journal_open(journal_path, binary_journal,
+                                              matrix->nrows, matrix->ncols)) {
+        pool_stop();
+        matrix_free(matrix);
         return EXIT_FAILURE;
     }
 
     // Run either in manual or automatic mode
     if (manual)
-        ret = manual_mode(nrows, ncols, matrix);
+        ret = manual_mode(matrix);
+    else if (mixed)
+        ret = mixed_mode(matrix, out_path);
+    else if (lu)
+        ret = lu_mode(matrix, cache_dir, inverse, out_path);
     else
-        ret = automatic_mode(nrows, ncols, matrix);
+        ret = automatic_mode(matrix, trace, direct, out_path);
+    if (journal_path != NULL && !journal_close())
+        ret = EXIT_FAILURE;
 
+    pool_stop();
+    matrix_free(matrix);
     return ret;
 }
 
-int automatic_mode(int nrows, int ncols, double matrix[nrows][ncols]) {
-    bool success;
-    printf("inital state\n");
-    print_matrix(nrows, ncols, matrix);
-
-    success = auto_echelon(nrows, ncols, matrix);
+static void *read_text_matrix(const char *path, const struct matrix_kind *kind,
+        uint64_t p) {
+    struct reader in;
+    if (!reader_open(&in, path)) {
+        perror(path);
+        return NULL;
+    }
+    int nrows, ncols;
+    if (!read_size(&in, &nrows, &ncols)) {
+        fprintf(stderr, "Error encountered while reading matrix size\n");
+        reader_close(&in);
+        return NULL;
+    }
+    void *matrix = kind->create(nrows, ncols, p);
+    if (matrix == NULL) {
+        if (p != 0)
+            fprintf(stderr, "Could not allocate a %d x %d %s mod %llu\n",
+                    nrows, ncols, kind->name, (unsigned long long) p);
+        else
+            fprintf(stderr, "Could not allocate a %d x %d %s\n", nrows, ncols,
+                    kind->name);
+        reader_close(&in);
+        return NULL;
+    }
+    bool success = kind->read(&in, matrix);
+    reader_close(&in);
     if (!success) {
-        fprintf(stderr, "Error encountered in the echelon form. Exiting...\n");
-        return EXIT_FAILURE;
+        fprintf(stderr, "Error encountered while reading matrix values\n");
+        kind->free(matrix);
+        return NULL;
+    }
+    return matrix;
+}
+
+static bool write_result(const char *path, const struct matrix *matrix,
+        bool reduced) {
+    struct matrix_result result;
+    result.flags = MATRIX_FILE_ECHELON | (reduced ? MATRIX_FILE_REDUCED : 0);
+    result.pivots = malloc(matrix->nrows * sizeof(int));
+    if (result.pivots == NULL) {
+        fprintf(stderr, "Could not allocate the pivot list\n");
+        return false;
+    }
+    result.rank = pivot_columns(matrix, result.pivots);
+    bool success = matrix_file_write(path, matrix, &result);
+    free(result.pivots);
+    return success;
+}
+
+static bool write_sparse_result(const char *path,
+        const struct sparse_matrix *matrix, bool reduced) {
+    struct matrix_result result;
+    result.flags = MATRIX_FILE_ECHELON | (reduced ? MATRIX_FILE_REDUCED : 0);
+    result.pivots = malloc(matrix->nrows * sizeof(int));
+    if (result.pivots == NULL) {
+        fprintf(stderr, "Could not allocate the pivot list\n");
+        return false;
     }
+    result.rank = sparse_pivot_columns(matrix, result.pivots);
+    bool success = matrix_file_write_sparse(path, matrix, &result);
+    free(result.pivots);
+    return success;
+}
 
+static bool want_reduced(void) {
     printf("Echelon form calculation completed.\n"
             "Want to go to the reduced echelon form? [Y/n]: ");
     char ch = tolower(getchar());
     if (ch == 'n') {
         printf("\nProgram completed!\n");
+        return false;
+    }
+    return true;
+}
+
+int automatic_mode(struct matrix *matrix, enum trace_mode trace, bool direct,
+        const char *out_path) {
+    bool success;
+    if (trace == TRACE_FULL) {
+        printf("inital state\n");
+        print_matrix(matrix);
+    }
+
+    int64_t start;
+    if (direct) {
+        /* Cancel out above and below each pivot as it is found */
+        start = stats_start();
+        success = auto_gauss_jordan(matrix, trace);
+        stats_stop(PHASE_REDUCED, start);
+    } else {
+        start = stats_start();
+        success = auto_echelon(matrix, trace);
+        stats_stop(PHASE_ECHELON, start);
+        if (!success) {
+            fprintf(stderr, "Error encountered in the echelon form. Exiting...\n");
+            return EXIT_FAILURE;
+        }
+        if (trace != TRACE_FULL) // the steps didn't show it, so show the result
+            print_matrix(matrix);
+
+        if (!want_reduced()) {
+            if (out_path != NULL && !write_result(out_path, matrix, false))
+                return EXIT_FAILURE;
+            return EXIT_SUCCESS;
+        }
+
+        // implicit else for auto_accept and ch == 'n'
+        start = stats_start();
+        success = auto_reduced_echelon(matrix, trace);
+        stats_stop(PHASE_REDUCED, start);
+    }
+    if (!success) {
+        fprintf(stderr, "Error encountered in reduced echelon form. Exiting...\n");
+        return EXIT_FAILURE;
+    }
+    if (trace != TRACE_FULL)
+        print_matrix(matrix);
+    printf("Reduced echelon form calculation completed.\n");
+    if (out_path != NULL && !write_result(out_path, matrix, true))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+int mixed_mode(struct matrix *matrix, const char *out_path) {
+    struct mixed_report report;
+    int64_t start = stats_start();
+    bool success = mixed_reduced_echelon(matrix, &report);
+    stats_stop(PHASE_REDUCED, start);
+    if (!success) {
+        fprintf(stderr, "Error encountered in reduced echelon form. Exiting...\n");
+        return EXIT_FAILURE;
+    }
+    if (report.path == MIXED_DOUBLE) {
+        fprintf(stderr, "Note: refinement did not converge for %d of the "
+                        "columns, which were solved in double.\n",
+                report.fallbacks);
+    } else if (report.path == MIXED_ELIMINATION) {
+        fprintf(stderr, "Note: the left part of the matrix is not square and "
+                        "invertible, or refining did not converge, so it was "
+                        "eliminated in double.\n");
+    }
+    print_matrix(matrix);
+    printf("Reduced echelon form calculation completed.\n");
+    if (out_path != NULL && !write_result(out_path, matrix, true))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+int lu_mode(struct matrix *matrix, const char *cache_dir, bool inverse,
+        const char *out_path) {
+    if (matrix->ncols < matrix->nrows) {
+        fprintf(stderr, "--lu needs at least as many columns as rows.\n");
+        return EXIT_FAILURE;
+    }
+    struct lu_cache cache = { { NULL }, cache_dir, 0, 0 };
+    int64_t start = stats_start();
+    struct lu_factors *f = lu_cache_get(&cache, matrix, matrix->nrows);
+    stats_stop(PHASE_ECHELON, start);
+    lu_cache_clear(&cache); // f is still held
+    if (f == NULL) {
+        fprintf(stderr, "Error encountered in the factors. Exiting...\n");
+        return EXIT_FAILURE;
+    }
+
+    int ret = EXIT_FAILURE;
+    if (inverse) {
+        start = stats_start();
+        struct matrix *result = lu_inverse(f);
+        stats_stop(PHASE_REDUCED, start);
+        if (result != NULL) {
+            print_matrix(result);
+            printf("Determinant: %g\n\nInverse calculation completed.\n",
+                   lu_determinant(f));
+            if (out_path == NULL || matrix_file_write(out_path, result, NULL))
+                ret = EXIT_SUCCESS;
+            matrix_free(result);
+        }
+    } else {
+        /* A singular A has no factors to solve with, so the matrix is
+         * reduced as -g would, and A's rank and determinant still hold */
+        bool singular = f->rank < f->n;
+        if (singular)
+            fprintf(stderr, "Note: A has rank %d of %d, so the matrix was "
+                            "eliminated with -g instead.\n", f->rank, f->n);
+        start = stats_start();
+        bool success = singular ? auto_gauss_jordan(matrix, TRACE_QUIET)
+                                : lu_solve(f, matrix);
+        stats_stop(PHASE_REDUCED, start);
+        if (!success) {
+            fprintf(stderr, "Error encountered in reduced echelon form. Exiting...\n");
+        } else {
+            print_matrix(matrix);
+            printf("Rank of A: %d\nDeterminant of A: %g\n\n", f->rank,
+                   lu_determinant(f));
+            printf("Reduced echelon form calculation completed.\n");
+            if (out_path == NULL || write_result(out_path, matrix, true))
+                ret = EXIT_SUCCESS;
+        }
+    }
+    lu_release(f);
+    return ret;
+}
+
+int sparse_mode(struct sparse_matrix *matrix, enum trace_mode trace,
+        const char *out_path) {
+    int64_t start = stats_start();
+    bool success = sparse_echelon(matrix, trace);
+    stats_stop(PHASE_ECHELON, start);
+    if (!success) {
+        fprintf(stderr, "Error encountered in the echelon form. Exiting...\n");
+        return EXIT_FAILURE;
+    }
+    print_sparse_matrix(matrix);
+
+    if (!want_reduced()) {
+        if (out_path != NULL && !write_sparse_result(out_path, matrix, false))
+            return EXIT_FAILURE;
         return EXIT_SUCCESS;
     }
 
-    // implicit else for auto_accept and ch == 'n'
-    success = auto_reduced_echelon(nrows, ncols, matrix);
+    start = stats_start();
+    success = sparse_reduced_echelon(matrix, trace);
+    stats_stop(PHASE_REDUCED, start);
     if (!success) {
         fprintf(stderr, "Error encountered in reduced echelon form. Exiting...\n");
         return EXIT_FAILURE;
     }
+    print_sparse_matrix(matrix);
     printf("Reduced echelon form calculation completed.\n");
+    if (out_path != NULL && !write_sparse_result(out_path, matrix, true))
+        return EXIT_FAILURE;
 
     return EXIT_SUCCESS;
 }
 
-int manual_mode(int nrows, int ncols, double matrix[nrows][ncols]) {
+int exact_mode(struct exact_matrix *matrix) {
+    int64_t start = stats_start();
+    bool success = exact_echelon(matrix);
+    stats_stop(PHASE_ECHELON, start);
+    if (!success || !print_exact_matrix(matrix)) {
+        fprintf(stderr, "Ran out of memory in the echelon form. Exiting...\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!want_reduced())
+        return EXIT_SUCCESS;
+
+    start = stats_start();
+    success = exact_reduced_echelon(matrix);
+    stats_stop(PHASE_REDUCED, start);
+    if (!success || !print_exact_matrix(matrix)) {
+        fprintf(stderr, "Ran out of memory in reduced echelon form. Exiting...\n");
+        return EXIT_FAILURE;
+    }
+    printf("Reduced echelon form calculation completed.\n");
+    return EXIT_SUCCESS;
+}
+
+int replay_mode(struct matrix *matrix, const char *journal_path,
+        const char *steps) {
+    int ret = EXIT_FAILURE;
+    struct replay *replay = NULL;
+    struct journal *journal = journal_load(journal_path);
+    if (journal == NULL)
+        goto out;
+    replay = replay_create(journal, matrix);
+    if (replay == NULL)
+        goto out;
+
+    /* Check the whole list before printing anything */
+    for (const char *p = steps; p != NULL; ) {
+        char *end;
+        long step = strtol(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0') || step < 0
+                || step > journal->nentries) {
+            fprintf(stderr, "Bad step list: %s (the steps go from 0 to %ld)\n",
+                    steps, journal->nentries);
+            goto out;
+        }
+        p = *end == ',' ? end + 1 : NULL;
+    }
+
+    const char *p = steps;
+    do {
+        long step = journal->nentries; // the finished matrix by default
+        if (p != NULL) {
+            char *end;
+            step = strtol(p, &end, 10);
+            p = *end == ',' ? end + 1 : NULL;
+        }
+
+        struct matrix *at = replay_seek(replay, step);
+        if (step == 0) {
+            printf("step 0 of %ld: inital state\n", journal->nentries);
+        } else {
+            char op[96];
+            journal_describe(&journal->entries[step-1], op, sizeof(op));
+            printf("step %ld of %ld: %s\n", step, journal->nentries, op);
+        }
+        print_matrix(at);
+    } while (p != NULL);
+    ret = EXIT_SUCCESS;
+out:
+    replay_free(replay);
+    journal_free(journal);
+    return ret;
+}
+
+int field_mode(void *matrix, const struct matrix_kind *kind,
+        enum trace_mode trace) {
+    if (trace == TRACE_FULL) {
+        printf("inital state\n");
+        kind->print(matrix);
+    }
+    int64_t start = stats_start();
+    bool success = kind->echelon(matrix, trace);
+    stats_stop(PHASE_ECHELON, start);
+    if (!success) {
+        fprintf(stderr, "Error encountered in the echelon form. Exiting...\n");
+        return EXIT_FAILURE;
+    }
+    if (trace != TRACE_FULL)
+        kind->print(matrix);
+
+    /* Pivots are where they are in the echelon form, so report them now */
+    int *pivots = malloc(kind->nrows(matrix) * sizeof(int));
+    if (pivots == NULL) {
+        fprintf(stderr, "Could not allocate the pivot list\n");
+        return EXIT_FAILURE;
+    }
+    print_rank(kind->pivot_columns(matrix, pivots), pivots);
+    free(pivots);
+
+    if (!want_reduced())
+        return EXIT_SUCCESS;
+
+    start = stats_start();
+    kind->reduced_echelon(matrix, trace);
+    stats_stop(PHASE_REDUCED, start);
+    if (trace != TRACE_FULL)
+        kind->print(matrix);
+    printf("Reduced echelon form calculation completed.\n");
+    return EXIT_SUCCESS;
+}
+
+static void print_rank(int rank, const int *pivots) {
+    printf("Rank: %d\nPivot columns:", rank);
+    for (int i = 0; i < rank; i++)
+        printf(" %d", pivots[i] + 1);
+    printf("\n\n");
+}
+
+int manual_mode(struct matrix *matrix) {
     int option;
     do {
-        print_matrix(nrows, ncols, matrix);
+        print_matrix(matrix);
         option = matrix_menu();
         switch (option) {
             case 1: // swap rows
-                manual_swap(nrows, ncols, matrix);
+                manual_swap(matrix);
                 break;
             case 2: // add rows (with scalar)
-                manual_add_scaled(nrows, ncols, matrix);
+                manual_add_scaled(matrix);
                 break;
             case 3: // scale row
-                manual_scale(nrows, ncols, matrix);
+                manual_scale(matrix);
                 break;
         }
     } while (option != 0);
@@ -150,3 +1138,243 @@ int manual_mode(int nrows, int ncols, double matrix[nrows][ncols]) {
     return EXIT_SUCCESS;
 }
 
+int outcore_mode(const char *path, int memory_mb) {
+    int rank;
+    int64_t start = stats_start();
+    bool success = outcore_reduce(path, (size_t) memory_mb << 20, &rank);
+    stats_stop(PHASE_REDUCED, start);
+    if (!success) {
+        fprintf(stderr, "Error encountered in reduced echelon form. Exiting...\n");
+        return EXIT_FAILURE;
+    }
+    printf("Rank: %d\n\nReduced echelon form written to %s.\n", rank, path);
+    return EXIT_SUCCESS;
+}
+
+int incremental_mode(const char *path, bool system, const char *out_path) {
+    int ret = EXIT_FAILURE;
+    struct incremental *inc = NULL;
+    struct matrix *form = NULL;
+    double *row = NULL;
+    int *pivots = NULL;
+    struct reader in;
+    if (!reader_open(&in, path)) {
+        perror(path);
+        return ret;
+    }
+    int ncols;
+    if (!read_columns(&in, &ncols))
+        goto out;
+    if (system && ncols < 2) {
+        fprintf(stderr, "A system needs at least one column besides the "
+                        "right-hand side.\n");
+        goto out;
+    }
+    inc = incremental_create(ncols, system);
+    if (inc == NULL)
+        goto out;
+    row = malloc(ncols * sizeof(double));
+    if (row == NULL) {
+        fprintf(stderr, "Could not allocate a row\n");
+        goto out;
+    }
+
+    /* Say what each row did as soon as it is in */
+    int got;
+    for (int i = 0; (got = read_next_row(&in, row, i, ncols)) == 1; i++) {
+        int lead;
+        int64_t start = stats_start();
+        enum incremental_outcome outcome = incremental_add(inc, row, &lead);
+        stats_stop(PHASE_REDUCED, start);
+        switch (outcome) {
+            case INCREMENTAL_PIVOT:
+                printf("Row %d: pivot in column %d, rank %d\n", i+1, lead+1,
+                       inc->rank);
+                break;
+            case INCREMENTAL_DEPENDENT:
+                printf("Row %d: depends on the rows before it, rank %d\n",
+                       i+1, inc->rank);
+                break;
+            case INCREMENTAL_INCONSISTENT:
+                printf("Row %d: inconsistent with the rows before it, "
+                       "left out\n", i+1);
+                break;
+            case INCREMENTAL_ERROR:
+                goto out;
+        }
+        fflush(stdout);
+    }
+    if (got < 0)
+        goto out;
+    printf("\n");
+
+    if (inc->rank == 0) {
+        print_rank(0, NULL);
+        if (out_path != NULL) {
+            fprintf(stderr, "Every row was zero, so there is no matrix to "
+                            "write to %s.\n", out_path);
+            goto out;
+        }
+        printf("Reduced echelon form calculation completed.\n");
+        ret = EXIT_SUCCESS;
+        goto out;
+    }
+    form = incremental_form(inc);
+    if (form == NULL)
+        goto out;
+    pivots = malloc(inc->rank * sizeof(int));
+    if (pivots == NULL) {
+        fprintf(stderr, "Could not allocate the pivot list\n");
+        goto out;
+    }
+    print_matrix(form);
+    print_rank(pivot_columns(form, pivots), pivots);
+    printf("Reduced echelon form calculation completed.\n");
+    if (out_path != NULL && !write_result(out_path, form, true))
+        goto out;
+    ret = EXIT_SUCCESS;
+
+out:
+    free(pivots);
+    matrix_free(form);
+    free(row);
+    incremental_free(inc);
+    reader_close(&in);
+    return ret;
+}
+
+/* The kinds of matrix, each operation passing its void pointers on to the
+ * functions for the kind's own struct */
+
+static void *dense_kind_create(int nrows, int ncols, uint64_t p) {
+    return matrix_create(nrows, ncols);
+}
+
+static bool dense_kind_read(struct reader *in, void *matrix) {
+    return read_matrix(in, matrix);
+}
+
+static void dense_kind_free(void *matrix) {
+    matrix_free(matrix);
+}
+
+static const struct matrix_kind dense_kind = {
+    "matrix", dense_kind_create, dense_kind_read, dense_kind_free,
+};
+
+static void *sparse_kind_create(int nrows, int ncols, uint64_t p) {
+    return sparse_create(nrows, ncols);
+}
+
+static bool sparse_kind_read(struct reader *in, void *matrix) {
+    return read_sparse_matrix(in, matrix);
+}
+
+static void sparse_kind_free(void *matrix) {
+    sparse_free(matrix);
+}
+
+static const struct matrix_kind sparse_kind = {
+    "sparse matrix", sparse_kind_create, sparse_kind_read, sparse_kind_free,
+};
+
+static void *exact_kind_create(int nrows, int ncols, uint64_t p) {
+    return exact_create(nrows, ncols);
+}
+
+static bool exact_kind_read(struct reader *in, void *matrix) {
+    return read_exact_matrix(in, matrix);
+}
+
+static void exact_kind_free(void *matrix) {
+    exact_free(matrix);
+}
+
+static const struct matrix_kind exact_kind = {
+    "exact matrix", exact_kind_create, exact_kind_read, exact_kind_free,
+};
+
+static void *modp_kind_create(int nrows, int ncols, uint64_t p) {
+    return modp_create(nrows, ncols, p);
+}
+
+static bool modp_kind_read(struct reader *in, void *matrix) {
+    return read_modp_matrix(in, matrix);
+}
+
+static void modp_kind_free(void *matrix) {
+    modp_free(matrix);
+}
+
+static void *modp_kind_from_dense(const struct matrix *dense, uint64_t p) {
+    return modp_from_dense(dense, p);
+}
+
+static int modp_kind_nrows(const void *matrix) {
+    return ((const struct modp_matrix *) matrix)->nrows;
+}
+
+static bool modp_kind_echelon(void *matrix, enum trace_mode trace) {
+    return modp_echelon(matrix, trace);
+}
+
+static void modp_kind_reduced_echelon(void *matrix, enum trace_mode trace) {
+    modp_reduced_echelon(matrix, trace);
+}
+
+static void modp_kind_print(const void *matrix) {
+    print_modp_matrix(matrix);
+}
+
+static int modp_kind_pivot_columns(const void *matrix, int *pivots) {
+    return modp_pivot_columns(matrix, pivots);
+}
+
+static const struct matrix_kind modp_kind = {
+    "matrix", modp_kind_create, modp_kind_read, modp_kind_free,
+    modp_kind_from_dense, modp_kind_nrows, modp_kind_echelon,
+    modp_kind_reduced_echelon, modp_kind_print, modp_kind_pivot_columns,
+};
+
+// The prime is always 2, so gf2 takes no p
+static void *gf2_kind_create(int nrows, int ncols, uint64_t p) {
+    return gf2_create(nrows, ncols);
+}
+
+static bool gf2_kind_read(struct reader *in, void *matrix) {
+    return read_gf2_matrix(in, matrix);
+}
+
+static void gf2_kind_free(void *matrix) {
+    gf2_free(matrix);
+}
+
+static void *gf2_kind_from_dense(const struct matrix *dense, uint64_t p) {
+    return gf2_from_dense(dense);
+}
+
+static int gf2_kind_nrows(const void *matrix) {
+    return ((const struct gf2_matrix *) matrix)->nrows;
+}
+
+static bool gf2_kind_echelon(void *matrix, enum trace_mode trace) {
+    return gf2_echelon(matrix, trace);
+}
+
+static void gf2_kind_reduced_echelon(void *matrix, enum trace_mode trace) {
+    gf2_reduced_echelon(matrix, trace);
+}
+
+static void gf2_kind_print(const void *matrix) {
+    print_gf2_matrix(matrix);
+}
+
+static int gf2_kind_pivot_columns(const void *matrix, int *pivots) {
+    return gf2_pivot_columns(matrix, pivots);
+}
+
+static const struct matrix_kind gf2_kind = {
+    "matrix", gf2_kind_create, gf2_kind_read, gf2_kind_free,
+    gf2_kind_from_dense, gf2_kind_nrows, gf2_kind_echelon,
+    gf2_kind_reduced_echelon, gf2_kind_print, gf2_kind_pivot_columns,
+};
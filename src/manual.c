@@ -74,8 +74,9 @@ bool scan_scalar (double * scalar)
     return true;
 }
 
-int manual_scale (int nrows, int ncols, double matrix[nrows][ncols])
+int manual_scale (struct matrix *matrix)
 {
+    int nrows = matrix->nrows;
     int row;       // which row to scale
     double scalar; // what to scale it by
     
@@ -95,12 +96,13 @@ int manual_scale (int nrows, int ncols, double matrix[nrows][ncols])
     }
 
     /* If we passed all those checks, it's time to scale */
-    scale_row(row-1, scalar, nrows, ncols, matrix);
+    scale_row(row-1, scalar, matrix);
     return 0;
 }
 
-int manual_add_scaled (int nrows, int ncols, double matrix[nrows][ncols])
+int manual_add_scaled (struct matrix *matrix)
 {
+    int nrows = matrix->nrows;
     int row1;      // the row that will be changed
     int row2;      // the row to add to it
     double scalar; // the scalar to multiply by
@@ -126,12 +128,13 @@ int manual_add_scaled (int nrows, int ncols, double matrix[nrows][ncols])
     }
 
     /* by now all our values are good, so we do the function. */
-    add_scaled(row1-1, row2-1, scalar, nrows, ncols, matrix);
+    add_scaled(row1-1, row2-1, scalar, matrix);
     return 0;
 }
 
-int manual_swap (int nrows, int ncols, double matrix[nrows][ncols])
+int manual_swap (struct matrix *matrix)
 {
+    int nrows = matrix->nrows;
     int row1;      // the two rows we swap 
     int row2;
     int scanned;   // the number of arguments scanned (validation)
@@ -158,6 +161,6 @@ int manual_swap (int nrows, int ncols, double matrix[nrows][ncols])
     }
 
     /* if we make it past the checks we're safe to run the command */
-    swap_rows(row1-1, row2-1, nrows, ncols, matrix);
+    swap_rows(row1-1, row2-1, matrix);
     return 0;
 }
@@ -2,6 +2,7 @@
 #define __MANUAL_H__
 
 #include <stdbool.h>
+#include "matrix.h"
 
 /* Print a menu asking the user what they would like to do with the matrix.
  * Reprompts until they give a valid answer.
@@ -17,8 +18,9 @@ int matrix_menu(void);
  *
  * pre:  matrix is initialized
  * post: matrix will be modified such that row1 *= scalar
+ *       returns 0 on success, nonzero if the input was rejected
  */
-void manual_scale (int nrows, int ncols, double matrix[nrows][ncols]);
+int manual_scale (struct matrix *matrix);
 
 /* Manually prompt and validate input for adding a scaled version of one row
  * to another.
@@ -27,8 +29,9 @@ void manual_scale (int nrows, int ncols, double matrix[nrows][ncols]);
  *
  * pre:  matrix is initialized
  * post: matrix will be modified such that row1 += (scalar * row2)
+ *       returns 0 on success, nonzero if the input was rejected
  */
-void manual_add_scaled (int nrows, int ncols, double matrix[nrows][ncols]);
+int manual_add_scaled (struct matrix *matrix);
 
 /* Manually prompt and validate input for swapping two rows.
  *
@@ -36,7 +39,8 @@ void manual_add_scaled (int nrows, int ncols, double matrix[nrows][ncols]);
  *
  * pre:  matrix is initialized
  * post: matrix will be modified such that rows are swapped
+ *       returns 0 on success, nonzero if the input was rejected
  */
-void manual_swap (int nrows, int ncols, double matrix[nrows][ncols]);
+int manual_swap (struct matrix *matrix);
 
 #endif
@@ -0,0 +1,53 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "matrix.h"
+
+/* Number of doubles that fit in one aligned block */
+#define ALIGN_DOUBLES (MATRIX_ALIGN / sizeof(double))
+
+size_t matrix_stride (int ncols)
+{
+    return ((size_t) ncols + ALIGN_DOUBLES - 1) / ALIGN_DOUBLES * ALIGN_DOUBLES;
+}
+
+struct matrix *matrix_create (int nrows, int ncols)
+{
+    if (nrows <= 0 || ncols <= 0)
+        return NULL;
+
+    /* Pad each row out to a whole number of aligned blocks */
+    size_t stride = matrix_stride(ncols);
+    if (stride > INT32_MAX || (size_t) nrows > SIZE_MAX / sizeof(double) / stride)
+        return NULL; // would overflow the size computation
+
+    struct matrix *m = malloc(sizeof(*m));
+    if (m == NULL)
+        return NULL;
+
+    size_t bytes = (size_t) nrows * stride * sizeof(double);
+    if (posix_memalign((void **) &m->data, MATRIX_ALIGN, bytes) != 0) {
+        free(m);
+        return NULL;
+    }
+    memset(m->data, 0, bytes);
+
+    m->nrows = nrows;
+    m->ncols = ncols;
+    m->stride = (int) stride;
+    m->map = NULL;
+    m->map_size = 0;
+    return m;
+}
+
+void matrix_free (struct matrix *m)
+{
+    if (m == NULL)
+        return;
+    if (m->map != NULL)
+        munmap(m->map, m->map_size);
+    else
+        free(m->data);
+    free(m);
+}
@@ -0,0 +1,60 @@
+#ifndef __MATRIX_H__
+#define __MATRIX_H__
+
+#include <stddef.h>
+
+/* Byte alignment of every row in a matrix. One cache line, which is also
+ * wide enough for the largest vector registers we care about. */
+#define MATRIX_ALIGN 64
+
+/* A dense matrix of doubles stored row by row, either on the heap or in
+ * a private mapping of a matrix file.
+ *
+ * Each row starts on a MATRIX_ALIGN boundary: the row stride is ncols
+ * rounded up to a whole number of aligned blocks, and the padding at the
+ * end of each row is kept at zero.
+ */
+struct matrix {
+    int nrows;       // number of rows
+    int ncols;       // number of columns in use
+    int stride;      // number of doubles between the starts of two rows
+    double *data;    // nrows * stride doubles
+    void *map;       // the file mapping data points into, or NULL
+    size_t map_size; // length of map in bytes
+};
+
+/* Return the row stride matrix_create uses for a number of columns.
+ *
+ * pre:  ncols > 0
+ * post: returns ncols rounded up to a whole number of aligned blocks
+ */
+size_t matrix_stride (int ncols);
+
+/* Allocate a zeroed matrix.
+ *
+ * pre:  nrows > 0, ncols > 0
+ * post: returns a new matrix, or NULL if it could not be allocated
+ */
+struct matrix *matrix_create (int nrows, int ncols);
+
+/* Release a matrix and its storage.
+ *
+ * pre:  m was returned by matrix_create or matrix_file_read, or is NULL
+ * post: m is freed, and any file mapping is unmapped
+ */
+void matrix_free (struct matrix *m);
+
+/* Return a pointer to the first entry of a row.
+ *
+ * pre:  m is initialized, 0 <= row < m->nrows
+ * post: returns a MATRIX_ALIGN-aligned pointer to m->ncols doubles
+ */
+static inline double *matrix_row (const struct matrix *m, int row)
+{
+    return m->data + (size_t) row * m->stride;
+}
+
+/* Access the entry at (row, col) as an lvalue. */
+#define MAT(m, row, col) (matrix_row((m), (row))[(col)])
+
+#endif
@@ -0,0 +1,298 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "matrix_file.h"
+#include "sparse.h"
+
+_Static_assert(sizeof(struct matrix_file_header) == 64,
+               "matrix file header must stay 64 bytes");
+
+bool matrix_file_detect (const char *path)
+{
+    char magic[4];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+    bool found = fread(magic, 1, sizeof(magic), f) == sizeof(magic)
+                 && memcmp(magic, MATRIX_FILE_MAGIC, sizeof(magic)) == 0;
+    fclose(f);
+    return found;
+}
+
+/* Make sure a header describes something we can load from a file of the
+ * given size.
+ *
+ * pre:  h was read from the start of a file of size bytes
+ * post: returns true if the header is usable, false after reporting why
+ */
+static bool check_header (const char *path, const struct matrix_file_header *h,
+        size_t size)
+{
+    if (memcmp(h->magic, MATRIX_FILE_MAGIC, sizeof(h->magic)) != 0) {
+        fprintf(stderr, "%s: not a matrix file\n", path);
+        return false;
+    } else if (h->byte_order != MATRIX_FILE_BYTE_ORDER) {
+        fprintf(stderr, "%s: written with a different byte order\n", path);
+        return false;
+    } else if (h->version != MATRIX_FILE_VERSION) {
+        fprintf(stderr, "%s: unsupported version %u\n", path, h->version);
+        return false;
+    } else if (h->elem_type != MATRIX_ELEM_F64) {
+        fprintf(stderr, "%s: unsupported element type %u\n", path, h->elem_type);
+        return false;
+    } else if (h->nrows == 0 || h->ncols == 0 || h->nrows > INT32_MAX
+            || h->ncols > INT32_MAX || h->stride < h->ncols
+            || h->data_offset < sizeof(*h)) {
+        fprintf(stderr, "%s: bad dimensions in header\n", path);
+        return false;
+    }
+
+    size_t data_bytes = h->nrows * h->stride * sizeof(double);
+    if (h->stride > SIZE_MAX / sizeof(double) / h->nrows
+            || h->data_offset > size || data_bytes > size - h->data_offset) {
+        fprintf(stderr, "%s: file is shorter than its header says\n", path);
+        return false;
+    }
+    return true;
+}
+
+struct matrix *matrix_file_read (const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror(path);
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    if (size < sizeof(struct matrix_file_header)) {
+        fprintf(stderr, "%s: too short to be a matrix file\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    /* A private mapping lets the solver work on the data in place without
+     * ever touching the file */
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+
+    const struct matrix_file_header *h = map;
+    if (!check_header(path, h, size)) {
+        munmap(map, size);
+        return NULL;
+    }
+    int nrows = (int) h->nrows;
+    int ncols = (int) h->ncols;
+    double *data = (double *) ((char *) map + h->data_offset);
+
+    /* Use the mapping directly when it is laid out just like our own
+     * matrices, otherwise copy row by row */
+    if (h->stride == matrix_stride(ncols) && h->data_offset % MATRIX_ALIGN == 0) {
+        struct matrix *m = malloc(sizeof(*m));
+        if (m == NULL) {
+            munmap(map, size);
+            return NULL;
+        }
+        m->nrows = nrows;
+        m->ncols = ncols;
+        m->stride = (int) h->stride;
+        m->data = data;
+        m->map = map;
+        m->map_size = size;
+        madvise(map, size, MADV_WILLNEED);
+        return m;
+    }
+
+    struct matrix *m = matrix_create(nrows, ncols);
+    if (m == NULL) {
+        fprintf(stderr, "%s: could not allocate a %d x %d matrix\n",
+                path, nrows, ncols);
+    } else {
+        for (int i = 0; i < nrows; i++)
+            memcpy(matrix_row(m, i), data + (size_t) i * h->stride,
+                   ncols * sizeof(double));
+    }
+    munmap(map, size);
+    return m;
+}
+
+/* Write all of a buffer, retrying short writes.
+ *
+ * pre:  fd is open for writing
+ * post: returns true if every byte was written
+ */
+static bool write_all (int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Fill in the header for a file being written.
+ *
+ * pre:  result is NULL or describes the matrix
+ * post: h describes an nrows x ncols matrix with the given stride, its
+ *       data right after the header
+ */
+static void fill_header (struct matrix_file_header *h, int nrows, int ncols,
+        int stride, const struct matrix_result *result)
+{
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, MATRIX_FILE_MAGIC, sizeof(h->magic));
+    h->version = MATRIX_FILE_VERSION;
+    h->elem_type = MATRIX_ELEM_F64;
+    h->byte_order = MATRIX_FILE_BYTE_ORDER;
+    h->flags = result != NULL ? result->flags : 0;
+    h->nrows = nrows;
+    h->ncols = ncols;
+    h->stride = stride;
+    h->rank = result != NULL ? result->rank : -1;
+    h->data_offset = sizeof(*h);
+}
+
+/* Write the pivot columns that follow the data.
+ *
+ * pre:  fd is open for writing, result is NULL or describes the matrix
+ * post: returns true if they were all written
+ */
+static bool write_pivots (int fd, const struct matrix_result *result)
+{
+    if (result == NULL || result->rank <= 0)
+        return true;
+    int64_t *cols = malloc(result->rank * sizeof(*cols));
+    if (cols == NULL)
+        return false;
+    for (int i = 0; i < result->rank; i++)
+        cols[i] = result->pivots[i];
+    bool ok = write_all(fd, cols, result->rank * sizeof(*cols));
+    free(cols);
+    return ok;
+}
+
+/* Finish writing a file, reporting any error.
+ *
+ * pre:  fd is open, ok says whether everything so far was written
+ * post: fd is closed, returns true if the whole file made it out
+ */
+static bool finish_file (const char *path, int fd, bool ok)
+{
+    if (!ok)
+        perror(path);
+    if (close(fd) < 0 && ok) {
+        perror(path);
+        ok = false;
+    }
+    return ok;
+}
+
+bool matrix_file_write (const char *path, const struct matrix *matrix,
+        const struct matrix_result *result)
+{
+    struct matrix_file_header h;
+    fill_header(&h, matrix->nrows, matrix->ncols, matrix->stride, result);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+
+    /* The rows are contiguous, padding included, so the data goes out in
+     * one piece */
+    bool ok = write_all(fd, &h, sizeof(h))
+              && write_all(fd, matrix->data,
+                           (size_t) matrix->nrows * matrix->stride * sizeof(double))
+              && write_pivots(fd, result);
+    return finish_file(path, fd, ok);
+}
+
+bool matrix_file_write_sparse (const char *path, const struct sparse_matrix *matrix,
+        const struct matrix_result *result)
+{
+    struct matrix_file_header h;
+    int stride = (int) matrix_stride(matrix->ncols);
+    fill_header(&h, matrix->nrows, matrix->ncols, stride, result);
+
+    /* Rows are filled in one at a time, so the whole matrix is never
+     * held densely */
+    double *row = calloc(stride, sizeof(double));
+    if (row == NULL) {
+        fprintf(stderr, "%s: could not allocate a row buffer\n", path);
+        return false;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror(path);
+        free(row);
+        return false;
+    }
+
+    bool ok = write_all(fd, &h, sizeof(h));
+    for (int i = 0; i < matrix->nrows && ok; i++) {
+        const struct sparse_row *r = &matrix->rows[i];
+        for (int e = 0; e < r->nnz; e++)
+            row[r->cols[e]] = r->vals[e];
+        ok = write_all(fd, row, stride * sizeof(double));
+        for (int e = 0; e < r->nnz; e++)
+            row[r->cols[e]] = 0;
+    }
+    ok = ok && write_pivots(fd, result);
+    free(row);
+    return finish_file(path, fd, ok);
+}
+
+int matrix_file_open (const char *path, struct matrix_file_header *h)
+{
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || pread(fd, h, sizeof(*h), 0) != sizeof(*h)) {
+        fprintf(stderr, "%s: too short to be a matrix file\n", path);
+        close(fd);
+        return -1;
+    }
+    if (!check_header(path, h, st.st_size)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool matrix_file_close (const char *path, int fd, struct matrix_file_header *h,
+        const struct matrix_result *result)
+{
+    /* The pivots go right after the data, in place of any there were */
+    off_t end = h->data_offset + h->nrows * h->stride * sizeof(double);
+    h->flags = result->flags;
+    h->rank = result->rank;
+    bool ok = pwrite(fd, h, sizeof(*h), 0) == sizeof(*h)
+              && lseek(fd, end, SEEK_SET) == end && write_pivots(fd, result)
+              && ftruncate(fd, end + result->rank * sizeof(int64_t)) == 0;
+    return finish_file(path, fd, ok);
+}
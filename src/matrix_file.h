@@ -0,0 +1,106 @@
+#ifndef __MATRIX_FILE_H__
+#define __MATRIX_FILE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "matrix.h"
+
+struct sparse_matrix; // see sparse.h
+
+/* Binary matrix files.
+ *
+ * A file is a fixed 64 byte header, then nrows * stride elements of row
+ * major data, then (for results) rank pivot column numbers as int64_t.
+ * Everything is in the byte order of the machine that wrote it, which
+ * readers check through the byte_order field. The data starts 64 bytes
+ * into the file, so a mapping of the file is aligned well enough to be
+ * used as a matrix in place.
+ */
+
+#define MATRIX_FILE_MAGIC "ECHM"
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_FILE_BYTE_ORDER 0x01020304u
+
+/* Element types a file may hold */
+enum matrix_elem {
+    MATRIX_ELEM_F64 = 1, // IEEE 754 double
+};
+
+/* Bits of matrix_file_header.flags */
+#define MATRIX_FILE_ECHELON 0x1 // data is in echelon form, pivots follow it
+#define MATRIX_FILE_REDUCED 0x2 // data is in reduced echelon form
+
+struct matrix_file_header {
+    char magic[4];         // MATRIX_FILE_MAGIC, not NUL terminated
+    uint16_t version;      // MATRIX_FILE_VERSION
+    uint16_t elem_type;    // an enum matrix_elem
+    uint32_t byte_order;   // MATRIX_FILE_BYTE_ORDER as the writer saw it
+    uint32_t flags;        // MATRIX_FILE_* bits
+    uint64_t nrows;        // number of rows
+    uint64_t ncols;        // number of columns in use
+    uint64_t stride;       // elements between the starts of two rows
+    int64_t rank;          // number of pivots, or -1 if not a result
+    uint64_t data_offset;  // byte offset of the first row
+    uint8_t reserved[8];   // zero
+};
+
+/* The outcome of a reduction, stored alongside the matrix */
+struct matrix_result {
+    uint32_t flags; // MATRIX_FILE_ECHELON, plus MATRIX_FILE_REDUCED if so
+    int rank;       // number of pivots
+    int *pivots;    // column of each pivot, in row order
+};
+
+/* Check whether a file starts with the matrix file magic.
+ *
+ * pre:  path names a file
+ * post: returns true if it looks like a binary matrix file
+ */
+bool matrix_file_detect (const char *path);
+
+/* Load a binary matrix file. When the file's stride and alignment match
+ * what matrix_create would use, the matrix is a private mapping of the file
+ * and loading copies nothing. Changes are never written back to the file.
+ *
+ * pre:  path names a binary matrix file
+ * post: returns the matrix, or NULL after reporting what was wrong
+ */
+struct matrix *matrix_file_read (const char *path);
+
+/* Write a matrix, and optionally the result of reducing it, to a file.
+ *
+ * pre:  matrix is initialized, result is NULL or describes matrix
+ * post: returns true on success, false after reporting what went wrong
+ */
+bool matrix_file_write (const char *path, const struct matrix *matrix,
+        const struct matrix_result *result);
+
+/* Write a sparse matrix, and optionally the result of reducing it, to a
+ * file. The file is laid out just like one from matrix_file_write.
+ *
+ * pre:  matrix is initialized, result is NULL or describes matrix
+ * post: returns true on success, false after reporting what went wrong
+ */
+bool matrix_file_write_sparse (const char *path, const struct sparse_matrix *matrix,
+        const struct matrix_result *result);
+
+/* Open a matrix file to be worked on in place, with pread and pwrite.
+ *
+ * pre:  path names a binary matrix file
+ * post: returns a descriptor open for reading and writing and fills in h,
+ *       or returns -1 after reporting what was wrong
+ */
+int matrix_file_open (const char *path, struct matrix_file_header *h);
+
+/* Record the result of working on an open file in place, then close it.
+ *
+ * pre:  fd came from matrix_file_open, which filled in h, and the data in
+ *       the file is what result describes
+ * post: the header and the pivots after the data describe result, and fd
+ *       is closed; returns true on success, false after reporting what
+ *       went wrong
+ */
+bool matrix_file_close (const char *path, int fd, struct matrix_file_header *h,
+        const struct matrix_result *result);
+
+#endif
@@ -1,36 +1,81 @@
+#include <math.h>
+#include "kernels.h"
 #include "matrix_proc.h"
+#include "stats.h"
 
-void add_scaled (int row1, int row2, double scalar,
-        int nrows, int ncols, double matrix[nrows][ncols]) {
-    for (int j = 0; j < ncols; j++)
-        matrix[row1][j] += scalar * matrix[row2][j];
+void add_scaled (int row1, int row2, double scalar, struct matrix *matrix) {
+    stats_count(STAT_ADDS, 1);
+    stats_count(STAT_FLOPS, 2 * (int64_t) matrix->ncols);
+    kernels.axpy(matrix_row(matrix, row1), matrix_row(matrix, row2),
+                 scalar, matrix->ncols);
 }
 
-int leading_pos (int row, int nrows, int ncols,
-        double matrix[nrows][ncols]) {
-    for (int j = 0; j < ncols; j++) {
-        if (matrix[row][j] != 0)
+void add_scaled_from (int row1, int row2, double scalar, int col,
+        struct matrix *matrix) {
+    stats_count(STAT_ADDS, 1);
+    stats_count(STAT_FLOPS, 2 * (int64_t) (matrix->ncols - col));
+    kernels.axpy(matrix_row(matrix, row1) + col, matrix_row(matrix, row2) + col,
+                 scalar, matrix->ncols - col);
+}
+
+int leading_pos (int row, const struct matrix *matrix) {
+    stats_count(STAT_LEADING_SCANS, 1);
+    const double *r = matrix_row(matrix, row);
+    for (int j = 0; j < matrix->ncols; j++) {
+        if (r[j] != 0)
             return j;
     }
     return -1; // leading value not found
 }
 
-void scale_row (int row, double scalar,
-        int nrows, int ncols, double matrix[nrows][ncols]) {
+int leading_between (int row, int from, int to, const struct matrix *matrix) {
+    stats_count(STAT_LEADING_SCANS, 1);
+    const double *r = matrix_row(matrix, row);
+    int j = from;
+    while (j < to && r[j] == 0)
+        j++;
+    return j;
+}
+
+bool row_finite (int row, const struct matrix *matrix) {
+    const double *r = matrix_row(matrix, row);
+    for (int j = 0; j < matrix->ncols; j++) {
+        if (!isfinite(r[j]))
+            return false;
+    }
+    return true;
+}
+
+int pivot_columns (const struct matrix *matrix, int *pivots) {
+    int rank = 0;
+    for (int i = 0; i < matrix->nrows; i++) {
+        int lead = leading_pos(i, matrix);
+        if (lead != -1)
+            pivots[rank++] = lead;
+    }
+    return rank;
+}
+
+void scale_row (int row, double scalar, struct matrix *matrix) {
     if (scalar == 0) {
         return;
     } else {
-        for (int j = 0; j < ncols; j++) {
-            matrix[row][j] = matrix[row][j] * scalar;
-        }
+        stats_count(STAT_SCALES, 1);
+        stats_count(STAT_FLOPS, matrix->ncols);
+        kernels.scale(matrix_row(matrix, row), scalar, matrix->ncols);
     }
 }
 
-void swap_rows (int row1, int row2,
-        int nrows, int ncols, double matrix[nrows][ncols]) {
-    for (int j = 0; j < ncols; j++) {
-        double temp = matrix[row1][j];
-        matrix[row1][j] = matrix[row2][j];
-        matrix[row2][j] = temp;
-    }
+void scale_pivot (int row, int col, struct matrix *matrix) {
+    double scalar = 1 / MAT(matrix, row, col);
+    if (scalar == 0)
+        return;
+    scale_row(row, scalar, matrix);
+    MAT(matrix, row, col) = 1;
+}
+
+void swap_rows (int row1, int row2, struct matrix *matrix) {
+    stats_count(STAT_SWAPS, 1);
+    kernels.swap(matrix_row(matrix, row1), matrix_row(matrix, row2),
+                 matrix->ncols);
 }
@@ -1,14 +1,26 @@
 #ifndef __MATRIX_PROC_H__
 #define __MATRIX_PROC_H__
 
+#include <stdbool.h>
+#include "matrix.h"
+
 /* Add a scaled version of row2 to row1, modifying the values in row1.
  *
  * pre:  matrix is initialized
  *       row1 and row2 are rows within matrix (0 <= x < nrows)
  * post: modifies matrix such that row1 += (scalar * row2)
  */
-void add_scaled (int row1, int row2, double scalar,
-		int nrows, int ncols, double matrix[nrows][ncols]);
+void add_scaled (int row1, int row2, double scalar, struct matrix *matrix);
+
+/* Like add_scaled, only for the columns from col on, for when row2 is all
+ * zeroes left of col and scalar is finite, so the rest wouldn't change
+ * (except that -0 could become 0).
+ *
+ * pre:  as for add_scaled, 0 <= col <= ncols
+ * post: row1 += (scalar * row2) from column col on
+ */
+void add_scaled_from (int row1, int row2, double scalar, int col,
+        struct matrix *matrix);
 
 /* Return the location of the leading entry of a row.
  *
@@ -17,26 +29,56 @@ void add_scaled (int row1, int row2, double scalar,
  * post: returns the index of the leading entry of the row 
  *       (0 <= index <= ncols), or -1 if there is no leading entry
  */
-int leading_pos (int row, 
-		int nrows, int ncols, 
-		double matrix[nrows][ncols]);
+int leading_pos (int row, const struct matrix *matrix);
+
+/* Return the location of the leading entry of a row, looking only at
+ * columns from <= col < to.
+ *
+ * pre:  matrix is initialized
+ *       row is a valid row, 0 <= from <= to <= ncols
+ * post: returns the index of the first nonzero entry in that range, or
+ *       to if there is none
+ */
+int leading_between (int row, int from, int to, const struct matrix *matrix);
+
+/* Check a row for infinities and NaNs.
+ *
+ * pre:  matrix is initialized
+ *       row is a valid row
+ * post: returns true if every entry of the row is finite
+ */
+bool row_finite (int row, const struct matrix *matrix);
+
+/* Find the pivot columns of a matrix in echelon form.
+ *
+ * pre:  matrix is initialized and in echelon form
+ *       pivots has room for nrows ints
+ * post: stores the leading column of each nonzero row in pivots, and
+ *       returns how many there are (the rank)
+ */
+int pivot_columns (const struct matrix *matrix, int *pivots);
 
 /* pre: row is a row in the matrix
  *                scalar is a nonzero double
- *                nrows and ncols are the dimensions of the matrix
- *                matrix is an array of doubles
+ *                matrix is initialized
  * post: row = (scalar * row) */
-void scale_row (int row, 
-		double scalar, 
-		int nrows, int ncols, 
-		double matrix[nrows][ncols]);
+void scale_row (int row, double scalar, struct matrix *matrix);
+
+/* Scale a row so its entry in column col is exactly 1, the way the
+ * automatic engines scale a pivot row. Multiplying by 1/pivot can leave
+ * the pivot a unit in the last place away from 1, and the entries it is
+ * used to cancel out would then keep a tiny remainder and never become
+ * zero, so the pivot is set to 1 afterwards.
+ *
+ * pre:  row is a row in the matrix, col a column, entry (row, col) nonzero
+ * post: row = (1/pivot) * row, with the pivot exactly 1, unless 1/pivot
+ *       is 0, which leaves the row alone as scale_row does
+ */
+void scale_pivot (int row, int col, struct matrix *matrix);
 
 /* pre: row1 and row2 are rows in the matrix
- *                nrows and ncols are the dimensions of the matrix
- *                matrix is an array of doubles
+ *                matrix is initialized
  * post: row1 and row2 swap all their values */
-void swap_rows (int row1, int row2, 
-		int nrows, int ncols, 
-		double matrix[nrows][ncols]);
+void swap_rows (int row1, int row2, struct matrix *matrix);
 
 #endif
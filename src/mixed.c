@@ -0,0 +1,109 @@
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "automatic.h"
+#include "blocked.h"
+#include "kernels.h"
+#include "mixed.h"
+#include "pool.h"
+#include "stats.h"
+#include "user_io.h"
+
+/* Rows that a solve with the factors takes together, as many as the
+ * update kernels keep in registers at once */
+#define SOLVE_ROWS 4
+
+/* Columns that a solve pads its block out to a multiple of, a vector of
+ * floats in the widest kernels */
+#define SOLVE_COLS 16
+
+#define REAL float
+#define EPSILON FLT_EPSILON
+#define NAME(f) f##_float
+#define AXPY kernels.axpy_float
+#define SCALE kernels.scale_float
+#define UPDATE kernels.update_float
+#include "mixed_real.h"
+
+#define REAL double
+#define EPSILON DBL_EPSILON
+#define NAME(f) f##_double
+#define AXPY kernels.axpy
+#define SCALE kernels.scale
+#define UPDATE kernels.update
+#include "mixed_real.h"
+
+bool mixed_reduced_echelon (struct matrix *matrix, struct mixed_report *report)
+{
+    bool success = false;
+    int n = matrix->nrows;
+    int m = matrix->ncols - n;
+    *report = (struct mixed_report) { MIXED_SINGLE, 0, 0 };
+
+    /* With nothing right of A there is nothing to refine, and no telling
+     * whether A is singular short of eliminating it */
+    if (m <= 0) {
+        report->path = MIXED_ELIMINATION;
+        return auto_gauss_jordan(matrix, TRACE_QUIET);
+    }
+
+    double *x = malloc((size_t) n * m * sizeof(double));
+    bool *done = calloc(m, sizeof(bool));
+    if (x == NULL || done == NULL) {
+        report_error("Could not allocate the solutions.");
+        goto out;
+    }
+
+    /* The biggest row sum of A, for telling when a solution is close */
+    double anorm = 0;
+    for (int i = 0; i < n; i++) {
+        double sum = 0;
+        for (int j = 0; j < n; j++)
+            sum += fabs(MAT(matrix, i, j));
+        anorm = fmax(anorm, sum);
+    }
+
+    bool factored;
+    int iterations = 0;
+    if (!solve_columns_float(matrix, anorm, x, done, &factored, &iterations))
+        goto out;
+    report->iterations = iterations;
+
+    /* Whatever the float factors couldn't solve gets the double ones, and
+     * whatever they can't either, elimination */
+    int left = 0;
+    for (int j = 0; j < m; j++)
+        left += !done[j];
+    if (left > 0) {
+        report->path = MIXED_DOUBLE;
+        report->fallbacks = left;
+        if (!solve_columns_double(matrix, anorm, x, done, &factored,
+                                  &iterations))
+            goto out;
+        if (iterations > report->iterations)
+            report->iterations = iterations;
+        left = 0;
+        for (int j = 0; j < m && factored; j++)
+            left += !done[j];
+        if (!factored || left > 0) {
+            report->path = MIXED_ELIMINATION;
+            success = auto_gauss_jordan(matrix, TRACE_QUIET);
+            goto out;
+        }
+    }
+
+    /* A is invertible, so its reduced echelon form is I */
+    for (int i = 0; i < n; i++) {
+        double *row = matrix_row(matrix, i);
+        memset(row, 0, n * sizeof(double));
+        row[i] = 1;
+        for (int j = 0; j < m; j++)
+            row[n + j] = x[(size_t) j * n + i];
+    }
+    success = true;
+out:
+    free(x);
+    free(done);
+    return success;
+}
@@ -0,0 +1,51 @@
+#ifndef __MIXED_H__
+#define __MIXED_H__
+
+#include <stdbool.h>
+#include "matrix.h"
+
+/* Solving square systems in single precision, to double accuracy.
+ *
+ * A matrix [A | B] with A square is reduced to [I | X], where A X = B.
+ * A is factored in float, which moves half the bytes and fits twice as
+ * many entries to a vector as double, and each column of X is solved with
+ * the factors, then corrected against A itself in double until it is as
+ * accurate as a double solution would be (iterative refinement). Columns
+ * that don't get there fall back to factors in double. A matrix whose A
+ * is not square, or that has no B, goes to auto_gauss_jordan, and so does
+ * one with columns the double factors can't refine either, or whose A is
+ * singular to working precision: a pivot of the factors no bigger than
+ * n * eps times the infinity norm of A, like lu_factor's, is taken for the
+ * rounding error of a column that should have cancelled.
+ *
+ * The LU factors are partially pivoted, swapping the biggest entry of each
+ * column onto the diagonal, so the solutions can differ from the ones
+ * auto_gauss_jordan would give by what rounding they are left with.
+ */
+
+/* Corrections made to a solution before giving up on its factors */
+#define MIXED_MAX_REFINEMENTS 30
+
+/* How a matrix ended up being reduced */
+enum mixed_path {
+    MIXED_SINGLE,      // every column refined from the float factors
+    MIXED_DOUBLE,      // some columns needed the double factors
+    MIXED_ELIMINATION, // auto_gauss_jordan did it instead
+};
+
+struct mixed_report {
+    enum mixed_path path;
+    int iterations; // most corrections any column took
+    int fallbacks;  // columns solved with the double factors
+};
+
+/* Put a matrix into reduced echelon form, mostly in single precision.
+ *
+ * pre:  matrix is initialized, the kernels may have been picked and the
+ *       pool started
+ * post: returns true if reached reduced echelon form, false after
+ *       reporting an error. report says how it went.
+ */
+bool mixed_reduced_echelon (struct matrix *matrix, struct mixed_report *report);
+
+#endif
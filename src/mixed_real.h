@@ -0,0 +1,234 @@
+/* mixed_real.h - refined solves with the factors of lu_real.h, written
+ * once for any floating point type
+ *
+ * mixed.c includes this once per precision the factors are kept in, with
+ * REAL, EPSILON, NAME(f), AXPY, SCALE, UPDATE and SOLVE_ROWS defined as
+ * lu_real.h takes them, and this undefines them again at the end, apart
+ * from SOLVE_ROWS. Whatever the precision of the factors, the solutions
+ * and their residuals are kept in double.
+ */
+
+#include "lu_real.h"
+
+/* Solve A X = B for a block of w columns in the precision of the
+ * factors.
+ *
+ * pre:  f holds the factors of A with f->rank == f->n, x holds B in n rows
+ *       of w doubles, work has room for n * w REALs and rows for n
+ *       pointers
+ * post: x holds X
+ */
+static void NAME(solve) (const struct NAME(factors) *f, double *x, int w,
+        REAL *work, const REAL **rows)
+{
+    for (size_t e = 0; e < (size_t) f->n * w; e++)
+        work[e] = x[e];
+    NAME(substitute)(f, work, w, w, rows);
+    for (size_t e = 0; e < (size_t) f->n * w; e++)
+        x[e] = work[e];
+}
+
+/* Scratch space for refining a block of columns */
+struct NAME(block) {
+    double *b;         // the columns of B, n rows of w
+    double *x;         // their solutions, laid out the same
+    double *r;         // their residuals A X - B, the same again
+    REAL *work;        // n * PANEL_COLS REALs for NAME(solve)
+    const REAL **rows; // n pointers for NAME(solve)
+    const double **u;  // the rows of x, for kernels.update
+    bool *converged;   // whether each column is close enough
+};
+
+/* Solve A X = B for a block of w columns with the factors of A, then
+ * correct each column x until its residual, worked out in double against
+ * A itself, is as small as double precision allows: no bigger than
+ * |x| |A| sqrt(n) DBL_EPSILON, in the infinity norm. Columns that get
+ * there are left alone from then on.
+ *
+ * pre:  f holds the factors of the first n columns of matrix, anorm is
+ *       their infinity norm, s->b holds B and 0 < w <= PANEL_COLS
+ * post: s->x holds the last solutions, s->converged says which are close
+ *       enough, and the number of corrections made is returned
+ */
+static int NAME(refine) (const struct matrix *matrix, double anorm,
+        const struct NAME(factors) *f, struct NAME(block) *s, int w)
+{
+    int n = f->n;
+    size_t size = (size_t) n * w;
+    memcpy(s->x, s->b, size * sizeof(double));
+    NAME(solve)(f, s->x, w, s->work, s->rows);
+    for (int i = 0; i < n; i++)
+        s->u[i] = s->x + (size_t) i * w;
+    for (int j = 0; j < w; j++)
+        s->converged[j] = false;
+
+    for (int iteration = 0; ; iteration++) {
+        for (size_t e = 0; e < size; e++)
+            s->r[e] = -s->b[e];
+        kernels.update(s->r, w, matrix_row(matrix, 0), matrix->stride, s->u, n,
+                       w, n);
+        stats_count(STAT_FLOPS, 2 * (int64_t) size * n);
+
+        /* A column stops once it is close enough, or hopeless */
+        bool more = false;
+        for (int j = 0; j < w; j++) {
+            if (s->converged[j])
+                continue;
+            double rnorm = 0, xnorm = 0;
+            for (int i = 0; i < n; i++) {
+                rnorm = fmax(rnorm, fabs(s->r[(size_t) i * w + j]));
+                xnorm = fmax(xnorm, fabs(s->x[(size_t) i * w + j]));
+            }
+            if (rnorm <= xnorm * anorm * sqrt(n) * DBL_EPSILON)
+                s->converged[j] = true;
+            else
+                more = more || (isfinite(rnorm) && isfinite(xnorm));
+        }
+        if (!more || iteration == MIXED_MAX_REFINEMENTS)
+            return iteration;
+
+        NAME(solve)(f, s->r, w, s->work, s->rows);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < w; j++) {
+                if (!s->converged[j])
+                    s->x[(size_t) i * w + j] -= s->r[(size_t) i * w + j];
+            }
+        }
+        stats_count(STAT_REFINEMENTS, 1);
+    }
+}
+
+/* Solving for the columns right of a square matrix, shared out by blocks
+ * of PANEL_COLS columns */
+struct NAME(columns) {
+    const struct matrix *matrix;
+    double anorm;
+    const struct NAME(factors) *f;
+    double *x;      // solution j at x + j * n
+    bool *done;     // columns already solved, which are skipped
+    int iterations; // most corrections any block needed
+    bool failed;    // scratch space ran out
+};
+
+static void NAME(columns_task) (void *arg, int begin, int end)
+{
+    struct NAME(columns) *c = arg;
+    const struct matrix *matrix = c->matrix;
+    int n = c->f->n;
+    int m = matrix->ncols - n;
+    size_t size = (size_t) n * PANEL_COLS;
+    struct NAME(block) s = {
+        malloc(3 * size * sizeof(double)), NULL, NULL,
+        malloc(size * sizeof(REAL)), malloc(n * sizeof(REAL *)),
+        malloc(n * sizeof(double *)), malloc(PANEL_COLS * sizeof(bool)),
+    };
+    if (s.b == NULL || s.work == NULL || s.rows == NULL || s.u == NULL
+            || s.converged == NULL) {
+        __atomic_store_n(&c->failed, true, __ATOMIC_RELAXED);
+        end = begin; // nothing to do but clean up
+    }
+    s.x = s.b + size;
+    s.r = s.x + size;
+
+    for (int block = begin; block < end; block++) {
+        /* The columns of the block still to be solved, side by side */
+        int cols[PANEL_COLS];
+        int w = 0;
+        for (int j = block * PANEL_COLS; j < m && j < (block + 1) * PANEL_COLS; j++) {
+            if (!c->done[j])
+                cols[w++] = j;
+        }
+        if (w == 0)
+            continue;
+
+        /* Padded out with columns of zeroes, which are solved right away,
+         * so the kernels work a whole vector at a time */
+        int width = (w + SOLVE_COLS - 1) / SOLVE_COLS * SOLVE_COLS;
+        width = width < PANEL_COLS ? width : PANEL_COLS;
+        for (int i = 0; i < n; i++) {
+            for (int q = 0; q < width; q++)
+                s.b[(size_t) i * width + q] = q < w ? MAT(matrix, i, n + cols[q])
+                                                    : 0;
+        }
+
+        int iterations = NAME(refine)(matrix, c->anorm, c->f, &s, width);
+        int most = __atomic_load_n(&c->iterations, __ATOMIC_RELAXED);
+        while (iterations > most
+               && !__atomic_compare_exchange_n(&c->iterations, &most, iterations,
+                                               false, __ATOMIC_RELAXED,
+                                               __ATOMIC_RELAXED))
+            ;
+
+        for (int q = 0; q < w; q++) {
+            if (!s.converged[q])
+                continue;
+            double *x = c->x + (size_t) cols[q] * n;
+            for (int i = 0; i < n; i++)
+                x[i] = s.x[(size_t) i * width + q];
+            c->done[cols[q]] = true;
+        }
+    }
+    free(s.b);
+    free(s.work);
+    free(s.rows);
+    free(s.u);
+    free(s.converged);
+}
+
+/* Factor the first n columns of matrix in REAL, then solve for each
+ * column right of them that isn't done yet.
+ *
+ * pre:  matrix has n rows and n + m columns, x has room for n * m doubles
+ * post: returns false if memory ran out, after reporting it. Otherwise
+ *       factored says whether the factors came out, and if they did, the
+ *       columns solved to double accuracy are marked done. iterations is
+ *       the most corrections any of them took.
+ */
+static bool NAME(solve_columns) (const struct matrix *matrix, double anorm,
+        double *x, bool *done, bool *factored, int *iterations)
+{
+    bool success = false;
+    int n = matrix->nrows;
+    int m = matrix->ncols - n;
+    struct NAME(factors) f = { NULL, matrix_stride(n), n, 0, 1, NULL, NULL };
+    f.a = malloc((size_t) n * f.lda * sizeof(REAL));
+    f.perm = malloc((size_t) n * sizeof(int));
+    f.pivots = malloc((size_t) n * sizeof(int));
+    REAL *l = malloc((size_t) n * PANEL_COLS * sizeof(REAL));
+    if (f.a == NULL || f.perm == NULL || f.pivots == NULL || l == NULL) {
+        report_error("Could not allocate the factors.");
+        goto out;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++)
+            f.a[(size_t) i * f.lda + j] = MAT(matrix, i, j);
+    }
+    *factored = NAME(factor)(&f, anorm, l) && f.rank == n;
+    if (!*factored) {
+        success = true;
+        goto out;
+    }
+
+    struct NAME(columns) c = { matrix, anorm, &f, x, done, 0, false };
+    int nblocks = (m + PANEL_COLS - 1) / PANEL_COLS;
+    pool_for(NAME(columns_task), &c, nblocks, (size_t) 4 * n * n * PANEL_COLS);
+    if (c.failed) {
+        report_error("Could not allocate the refinement workspace.");
+        goto out;
+    }
+    *iterations = c.iterations;
+    success = true;
+out:
+    free(f.a);
+    free(f.perm);
+    free(f.pivots);
+    free(l);
+    return success;
+}
+
+#undef REAL
+#undef EPSILON
+#undef NAME
+#undef AXPY
+#undef SCALE
+#undef UPDATE
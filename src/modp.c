@@ -0,0 +1,363 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bigint.h"
+#include "exact.h"
+#include "kernels.h"
+#include "modp.h"
+#include "pool.h"
+
+/* Number of words that fit in one aligned block */
+#define ALIGN_WORDS (MATRIX_ALIGN / sizeof(uint64_t))
+
+typedef unsigned __int128 u128;
+
+/* pre:  a, b < p
+ * post: returns a * b mod p */
+static uint64_t mul_mod (uint64_t a, uint64_t b, uint64_t p)
+{
+    return (uint64_t) ((u128) a * b % p);
+}
+
+/* pre:  a < p
+ * post: returns a^e mod p */
+static uint64_t pow_mod (uint64_t a, uint64_t e, uint64_t p)
+{
+    uint64_t r = 1 % p;
+    for (; e > 0; e >>= 1) {
+        if (e & 1)
+            r = mul_mod(r, a, p);
+        a = mul_mod(a, a, p);
+    }
+    return r;
+}
+
+/* Find the inverse of a mod p by the extended Euclidean algorithm.
+ *
+ * pre:  0 < a < p, p is prime
+ * post: returns the x with a * x = 1 mod p
+ */
+static uint64_t inverse_mod (uint64_t a, uint64_t p)
+{
+    int64_t x = 0, new_x = 1;
+    uint64_t r = p, new_r = a;
+    while (new_r != 0) {
+        uint64_t q = r / new_r;
+        int64_t t = x - (int64_t) q * new_x;
+        x = new_x;
+        new_x = t;
+        uint64_t u = r - q * new_r;
+        r = new_r;
+        new_r = u;
+    }
+    return x < 0 ? (uint64_t) x + p : (uint64_t) x;
+}
+
+/* Miller-Rabin with the first twelve primes as bases, which gets every
+ * 64-bit number right.
+ *
+ * pre:  none
+ * post: returns whether n is prime
+ */
+static bool is_prime (uint64_t n)
+{
+    static const uint64_t bases[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+    if (n < 2)
+        return false;
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); i++) {
+        if (n % bases[i] == 0)
+            return n == bases[i];
+    }
+
+    /* n - 1 = d * 2^s with d odd */
+    uint64_t d = n - 1;
+    int s = 0;
+    while ((d & 1) == 0) {
+        d >>= 1;
+        s++;
+    }
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); i++) {
+        uint64_t x = pow_mod(bases[i], d, n);
+        if (x == 1 || x == n - 1)
+            continue;
+        int k = 1;
+        for (; k < s; k++) {
+            x = mul_mod(x, x, n);
+            if (x == n - 1)
+                break;
+        }
+        if (k == s)
+            return false;
+    }
+    return true;
+}
+
+bool parse_modulus (const char *s, uint64_t *p)
+{
+    if (*s < '0' || *s > '9')
+        return false; // strtoull would take a sign or spaces
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(s, &end, 10);
+    if (errno != 0 || *end != '\0' || value >= MODP_LIMIT || !is_prime(value))
+        return false;
+    *p = value;
+    return true;
+}
+
+/* Reduce an integer mod p.
+ *
+ * pre:  x and big_p were initialized, big_p holds p
+ * post: returns true after storing x mod p, between 0 and p-1, in value,
+ *       false if memory ran out
+ */
+static bool reduce (const struct bigint *x, const struct bigint *big_p,
+        uint64_t *value)
+{
+    struct bigint r;
+    bigint_init(&r);
+    bool success = bigint_divmod(NULL, &r, x, big_p);
+    if (success) // the remainder is smaller than p, so it's never big
+        *value = r.small < 0 ? (uint64_t) (r.small + big_p->small) : (uint64_t) r.small;
+    bigint_clear(&r);
+    return success;
+}
+
+bool parse_modular (const char *tok, uint64_t p, uint64_t *value)
+{
+    bool success = false;
+    struct bigint num, den, big_p;
+    bigint_init(&num);
+    bigint_init(&den);
+    bigint_init(&big_p);
+    bigint_set_int(&big_p, (int64_t) p);
+
+    uint64_t n, d;
+    if (!parse_rational(tok, &num, &den) || !reduce(&num, &big_p, &n)
+            || !reduce(&den, &big_p, &d) || d == 0)
+        goto out;
+    *value = mul_mod(n, inverse_mod(d, p), p);
+    success = true;
+out:
+    bigint_clear(&num);
+    bigint_clear(&den);
+    bigint_clear(&big_p);
+    return success;
+}
+
+struct modp_matrix *modp_create (int nrows, int ncols, uint64_t p)
+{
+    if (nrows <= 0 || ncols <= 0)
+        return NULL;
+
+    /* Pad each row out to a whole number of aligned blocks */
+    size_t stride = ((size_t) ncols + ALIGN_WORDS - 1) / ALIGN_WORDS * ALIGN_WORDS;
+    if ((size_t) nrows > SIZE_MAX / sizeof(uint64_t) / stride)
+        return NULL; // would overflow the size computation
+
+    struct modp_matrix *m = malloc(sizeof(*m));
+    if (m == NULL)
+        return NULL;
+    m->rows = malloc(nrows * sizeof(uint64_t *));
+    size_t bytes = (size_t) nrows * stride * sizeof(uint64_t);
+    if (m->rows == NULL || posix_memalign((void **) &m->data, MATRIX_ALIGN, bytes) != 0) {
+        free(m->rows);
+        free(m);
+        return NULL;
+    }
+    memset(m->data, 0, bytes);
+    for (int i = 0; i < nrows; i++)
+        m->rows[i] = m->data + (size_t) i * stride;
+
+    m->nrows = nrows;
+    m->ncols = ncols;
+    m->p = p;
+    return m;
+}
+
+struct modp_matrix *modp_from_dense (const struct matrix *dense, uint64_t p)
+{
+    struct modp_matrix *m = modp_create(dense->nrows, dense->ncols, p);
+    if (m == NULL) {
+        fprintf(stderr, "Could not allocate a %d x %d matrix mod %llu\n",
+                dense->nrows, dense->ncols, (unsigned long long) p);
+        return NULL;
+    }
+    for (int i = 0; i < dense->nrows; i++) {
+        for (int j = 0; j < dense->ncols; j++) {
+            double x = MAT(dense, i, j);
+            /* Out of the range of an int64_t, or with a fractional part */
+            if (!(x > -9.2e18 && x < 9.2e18) || (double) (int64_t) x != x) {
+                fprintf(stderr, "The value at row %d, column %d is not a "
+                                "whole number.\n", i+1, j+1);
+                modp_free(m);
+                return NULL;
+            }
+            int64_t r = (int64_t) x % (int64_t) p;
+            MODP(m, i, j) = r < 0 ? (uint64_t) r + p : (uint64_t) r;
+        }
+    }
+    return m;
+}
+
+void modp_free (struct modp_matrix *matrix)
+{
+    if (matrix == NULL)
+        return;
+    free(matrix->data);
+    free(matrix->rows);
+    free(matrix);
+}
+
+/* Find the leading column of a row, knowing it is at least from.
+ *
+ * pre:  matrix is initialized, 0 <= from <= ncols
+ * post: returns the column of the first nonzero entry, ncols if none
+ */
+static int leading_from (const struct modp_matrix *matrix, int row, int from)
+{
+    const uint64_t *r = matrix->rows[row];
+    while (from < matrix->ncols && r[from] == 0)
+        from++;
+    return from;
+}
+
+/* An entry as a person would rather read it, between -p/2 and p/2 */
+static long long centered (uint64_t x, uint64_t p)
+{
+    return x > p / 2 ? -(long long) (p - x) : (long long) x;
+}
+
+/* Cancel the entries under (or over) a leading 1 in a range of rows,
+ * shared out by pool_for */
+struct cancel_rows {
+    struct modp_matrix *matrix;
+    int pivot_row; // row with the leading 1
+    int first_row; // row that task item 0 stands for
+    int lead;      // column of the leading 1
+    int *leads;    // leading columns to keep up to date, or NULL
+};
+
+static void cancel_task (void *arg, int begin, int end)
+{
+    struct cancel_rows *c = arg;
+    struct modp_matrix *matrix = c->matrix;
+    uint64_t p = matrix->p;
+    const uint64_t *pivot = matrix->rows[c->pivot_row] + c->lead;
+    int n = matrix->ncols - c->lead; // the pivot row is zero to the left
+    for (int k = c->first_row + begin; k < c->first_row + end; k++) {
+        uint64_t *row = matrix->rows[k] + c->lead;
+        if (row[0] == 0)
+            continue;
+        kernels.axpy_mod(row, pivot, p - row[0], p, n);
+        if (c->leads != NULL)
+            c->leads[k] = leading_from(matrix, k, c->lead + 1);
+    }
+}
+
+/* Cancel the entries in a range of rows, printing as much as trace asks.
+ *
+ * pre:  c describes the pivot, the rows are first_row <= k < end
+ * post: those rows are zero in the pivot's column
+ */
+static void cancel_all (struct cancel_rows *c, int end, enum trace_mode trace)
+{
+    struct modp_matrix *matrix = c->matrix;
+    uint64_t p = matrix->p;
+    if (trace == TRACE_FULL) {
+        for (int k = c->first_row; k < end; k++) {
+            uint64_t temp = MODP(matrix, k, c->lead);
+            if (temp == 0)
+                continue;
+            cancel_task(c, k - c->first_row, k - c->first_row + 1);
+            trace_modp(trace, matrix, "add R%d + (%lld * R%d)", k+1,
+                       centered(p - temp, p), c->pivot_row+1);
+        }
+    } else {
+        /* Without the matrix to show in between, the rows can be done in
+         * any order, so report them first and share them out */
+        for (int k = c->first_row; k < end && trace != TRACE_QUIET; k++) {
+            uint64_t temp = MODP(matrix, k, c->lead);
+            if (temp != 0)
+                trace_modp(trace, matrix, "add R%d + (%lld * R%d)", k+1,
+                           centered(p - temp, p), c->pivot_row+1);
+        }
+        pool_for(cancel_task, c, end - c->first_row, matrix->ncols - c->lead);
+    }
+}
+
+bool modp_echelon (struct modp_matrix *matrix, enum trace_mode trace)
+{
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+    uint64_t p = matrix->p;
+    int last_leading = -1;
+
+    int *leads = malloc(nrows * sizeof(int));
+    if (leads == NULL) {
+        fprintf(stderr, "Could not allocate the leading column list.\n");
+        return false;
+    }
+    for (int i = 0; i < nrows; i++)
+        leads[i] = leading_from(matrix, i, 0);
+
+    for (int i = 0; i < nrows; i++) {
+        /* Look for a row leading just right of the last pivot, taking any
+         * row that leads further left than the best so far, just like
+         * echelon_step */
+        int desired_leading = last_leading + 1;
+        int current_leading = leads[i];
+        for (int k = i+1; k < nrows && current_leading != desired_leading; k++) {
+            int k_leading = leads[k];
+            if (k_leading < current_leading) {
+                uint64_t *temp = matrix->rows[i];
+                matrix->rows[i] = matrix->rows[k];
+                matrix->rows[k] = temp;
+                leads[k] = current_leading;
+                leads[i] = k_leading;
+                trace_modp(trace, matrix, "swap R%d <--> R%d", i+1, k+1);
+                current_leading = k_leading;
+            }
+        }
+        if (current_leading == ncols)
+            break; // only rows of zeroes are left
+
+        /* Scale the row so that the leading value is 1 */
+        uint64_t *row = matrix->rows[i] + current_leading;
+        if (row[0] != 1) {
+            uint64_t temp = row[0];
+            kernels.scale_mod(row, inverse_mod(temp, p), p, ncols - current_leading);
+            trace_modp(trace, matrix, "scale (1/%lld) * R%d", centered(temp, p), i+1);
+        }
+
+        struct cancel_rows c = { matrix, i, i+1, current_leading, leads };
+        cancel_all(&c, nrows, trace);
+        last_leading = current_leading;
+    }
+    free(leads);
+    return true;
+}
+
+void modp_reduced_echelon (struct modp_matrix *matrix, enum trace_mode trace)
+{
+    for (int i = matrix->nrows-1; i >= 0; i--) {
+        int lead = leading_from(matrix, i, 0);
+        if (lead == matrix->ncols)
+            continue;
+        struct cancel_rows c = { matrix, i, 0, lead, NULL };
+        cancel_all(&c, i, trace);
+    }
+}
+
+int modp_pivot_columns (const struct modp_matrix *matrix, int *pivots)
+{
+    int rank = 0;
+    for (int i = 0; i < matrix->nrows; i++) {
+        int lead = leading_from(matrix, i, 0);
+        if (lead == matrix->ncols)
+            break;
+        pivots[rank++] = lead;
+    }
+    return rank;
+}
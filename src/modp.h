@@ -0,0 +1,94 @@
+#ifndef __MODP_H__
+#define __MODP_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "matrix.h"
+#include "user_io.h"
+
+/* Matrices over the integers mod a prime p, solved exactly.
+ *
+ * Every entry is kept reduced, between 0 and p-1, in a 64-bit word, and
+ * every row starts on an aligned block so the modular kernels can work
+ * through it a vector at a time. Rows are reached through pointers, so
+ * swapping two of them doesn't move any entries.
+ */
+
+/* Moduli have to be below this, so that a sum of two entries fits a word */
+#define MODP_LIMIT ((uint64_t) 1 << 63)
+
+struct modp_matrix {
+    int nrows;
+    int ncols;
+    uint64_t p;      // the prime modulus
+    uint64_t **rows; // rows[i][j] is the entry at (i, j)
+    uint64_t *data;  // the storage the rows point into
+};
+
+/* Access the entry at (row, col) of a matrix mod p. */
+#define MODP(m, row, col) ((m)->rows[row][col])
+
+/* Parse a modulus.
+ *
+ * pre:  s is a NUL terminated string
+ * post: returns true and stores it in p if s is a prime below MODP_LIMIT
+ *       written in decimal, false otherwise
+ */
+bool parse_modulus (const char *s, uint64_t *p);
+
+/* Parse a token as an element of the integers mod p: an integer, decimal
+ * or fraction, as parse_rational reads them, reduced mod p.
+ *
+ * pre:  tok is a NUL terminated token, p is prime
+ * post: returns true and stores the value, false if tok is not a number,
+ *       its denominator is a multiple of p, or memory ran out
+ */
+bool parse_modular (const char *tok, uint64_t p, uint64_t *value);
+
+/* Make a matrix of zeroes mod p.
+ *
+ * pre:  nrows > 0, ncols > 0, p is prime
+ * post: returns the matrix, or NULL if it could not be allocated
+ */
+struct modp_matrix *modp_create (int nrows, int ncols, uint64_t p);
+
+/* Reduce a dense matrix of whole numbers mod p.
+ *
+ * pre:  dense is initialized, p is prime
+ * post: returns the matrix, or NULL after reporting an entry that isn't a
+ *       whole number or an allocation that failed
+ */
+struct modp_matrix *modp_from_dense (const struct matrix *dense, uint64_t p);
+
+/* Free a matrix mod p.
+ *
+ * pre:  matrix came from modp_create, or is NULL
+ * post: its memory is released
+ */
+void modp_free (struct modp_matrix *matrix);
+
+/* Put a matrix mod p into echelon form with each leading entry 1,
+ * choosing pivot rows the same way auto_echelon does.
+ *
+ * pre:  matrix is initialized
+ * post: returns true if reached echelon form, false if memory ran out
+ */
+bool modp_echelon (struct modp_matrix *matrix, enum trace_mode trace);
+
+/* Given a matrix mod p in echelon form, cancel out the entries above each
+ * leading 1.
+ *
+ * pre:  matrix was put in echelon form by modp_echelon
+ * post: matrix is in reduced echelon form
+ */
+void modp_reduced_echelon (struct modp_matrix *matrix, enum trace_mode trace);
+
+/* List the pivot columns of a matrix mod p in echelon form.
+ *
+ * pre:  matrix is in echelon form, pivots has room for nrows entries
+ * post: returns the rank, after storing the pivot column of each nonzero
+ *       row in pivots
+ */
+int modp_pivot_columns (const struct modp_matrix *matrix, int *pivots);
+
+#endif
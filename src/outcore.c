@@ -0,0 +1,552 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "automatic.h"
+#include "kernels.h"
+#include "matrix_file.h"
+#include "matrix_proc.h"
+#include "outcore.h"
+#include "pool.h"
+#include "stats.h"
+#include "user_io.h"
+
+/* Reads and writes the I/O thread can have waiting at once */
+#define IO_QUEUE 8
+
+/* A read or write of one slab */
+struct io_request {
+    bool write;    // write buf out, rather than reading it in
+    void *buf;
+    size_t len;    // bytes
+    off_t offset;  // in the file
+    bool done;     // set by the I/O thread under the queue's lock
+};
+
+/* Requests handed to the I/O thread, which serves them in the order they
+ * came in. A read into a buffer can therefore follow the write out of it
+ * without waiting for that write first. */
+struct io_queue {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t posted;   // a request came in, or stop was set
+    pthread_cond_t finished; // a request is done
+    int fd;
+    struct io_request *ring[IO_QUEUE];
+    int head;                // next request to serve
+    int tail;                // where the next request goes
+    bool stop;
+    int error;               // errno of the first request that failed
+};
+
+/* Read or write all of a request, however many calls that takes.
+ *
+ * pre:  r describes a range of the file fd
+ * post: returns 0 on success, or an errno value (EIO for a short read)
+ */
+static int io_transfer (int fd, const struct io_request *r)
+{
+    char *buf = r->buf;
+    size_t left = r->len;
+    off_t offset = r->offset;
+    while (left > 0) {
+        ssize_t n = r->write ? pwrite(fd, buf, left, offset)
+                             : pread(fd, buf, left, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return errno;
+        if (n == 0)
+            return EIO;
+        buf += n;
+        left -= n;
+        offset += n;
+    }
+    stats_count(r->write ? STAT_BYTES_WRITTEN : STAT_BYTES_READ, r->len);
+    return 0;
+}
+
+static void *io_thread (void *arg)
+{
+    struct io_queue *q = arg;
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        while (q->head == q->tail && !q->stop)
+            pthread_cond_wait(&q->posted, &q->lock);
+        if (q->head == q->tail)
+            break;
+        struct io_request *r = q->ring[q->head % IO_QUEUE];
+        pthread_mutex_unlock(&q->lock);
+
+        // Once something has failed, the rest are skipped
+        int error = q->error ? q->error : io_transfer(q->fd, r);
+
+        pthread_mutex_lock(&q->lock);
+        if (error && !q->error)
+            q->error = error;
+        r->done = true;
+        q->head++;
+        pthread_cond_broadcast(&q->finished);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+/* Start the I/O thread.
+ *
+ * pre:  q is zeroed apart from fd
+ * post: returns true if the thread is running, false after reporting why
+ */
+static bool io_start (struct io_queue *q)
+{
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->posted, NULL);
+    pthread_cond_init(&q->finished, NULL);
+    int error = pthread_create(&q->thread, NULL, io_thread, q);
+    if (error) {
+        report_error("Could not start the I/O thread: %s", strerror(error));
+        pthread_cond_destroy(&q->finished);
+        pthread_cond_destroy(&q->posted);
+        pthread_mutex_destroy(&q->lock);
+        return false;
+    }
+    return true;
+}
+
+/* Finish every request, then stop the I/O thread.
+ *
+ * pre:  io_start succeeded on q
+ * post: the thread has exited, and q->error says whether anything failed
+ */
+static void io_stop (struct io_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->stop = true;
+    pthread_cond_signal(&q->posted);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->thread, NULL);
+    pthread_cond_destroy(&q->finished);
+    pthread_cond_destroy(&q->posted);
+    pthread_mutex_destroy(&q->lock);
+}
+
+/* Queue a request, waiting for room if the queue is full.
+ *
+ * pre:  r isn't queued already
+ * post: r is queued, and done is false until it is served
+ */
+static void io_submit (struct io_queue *q, struct io_request *r)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->tail - q->head == IO_QUEUE)
+        pthread_cond_wait(&q->finished, &q->lock);
+    r->done = false;
+    q->ring[q->tail++ % IO_QUEUE] = r;
+    pthread_cond_signal(&q->posted);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Wait for a request to be served.
+ *
+ * pre:  r was queued with io_submit
+ * post: returns true if it and everything before it succeeded
+ */
+static bool io_wait (struct io_queue *q, struct io_request *r)
+{
+    pthread_mutex_lock(&q->lock);
+    while (!r->done)
+        pthread_cond_wait(&q->finished, &q->lock);
+    bool ok = q->error == 0;
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+/* A slab of rows in memory, with its own read and write so that the write
+ * out of one slab and the read of the next into the same buffer can both
+ * be queued */
+struct slab {
+    struct matrix *m;       // the rows, nrows of them in use
+    int first;              // row of the file they came from
+    struct io_request read;
+    struct io_request write;
+};
+
+/* Everything the elimination keeps between slabs */
+struct outcore {
+    const char *path;
+    struct io_queue io;
+    off_t data_offset;   // where the rows start in the file
+    size_t row_bytes;    // bytes from one row of the file to the next
+    int nrows;           // rows in the file
+    int slab_rows;       // rows in a full slab
+    int *leads;          // leading column of every row, -1 for none
+    const double **u;    // pivot rows being cancelled out, for kernels.update
+    int *pivot_leads;    // their leading columns
+    double *l;           // multipliers, one per pivot for each row
+    struct workspace ws; // for auto_gauss_jordan
+    struct slab slabs[OUTCORE_SLABS];
+};
+
+/* Queue the read of a slab of the file into a buffer.
+ *
+ * pre:  the buffer's last read, if any, is done
+ * post: s holds slab t once s->read is done
+ */
+static void read_slab (struct outcore *o, struct slab *s, int t)
+{
+    s->first = t * o->slab_rows;
+    s->m->nrows = o->nrows - s->first < o->slab_rows ? o->nrows - s->first
+                                                     : o->slab_rows;
+    s->read = (struct io_request) {
+        .write = false,
+        .buf = s->m->data,
+        .len = s->m->nrows * o->row_bytes,
+        .offset = o->data_offset + s->first * o->row_bytes,
+    };
+    io_submit(&o->io, &s->read);
+}
+
+/* Queue the write of a buffer back to where it was read from.
+ *
+ * pre:  the buffer's last write, if any, is done
+ * post: the slab is in the file once s->write is done
+ */
+static void write_slab (struct outcore *o, struct slab *s)
+{
+    s->write = (struct io_request) {
+        .write = true,
+        .buf = s->m->data,
+        .len = s->m->nrows * o->row_bytes,
+        .offset = o->data_offset + s->first * o->row_bytes,
+    };
+    io_submit(&o->io, &s->write);
+}
+
+/* Cancelling the pivots of one slab out of the rows of another, shared
+ * out by rows */
+struct cancel {
+    struct matrix *rows;
+    const double *const *u; // the pivot rows, from column from on
+    const int *leads;       // their leading columns
+    double *l;              // k multipliers per row
+    int k;                  // pivot rows
+    int from;               // first column a pivot row has a nonzero in
+};
+
+static void cancel_task (void *arg, int begin, int end)
+{
+    struct cancel *c = arg;
+    for (int i = begin; i < end; i++) {
+        const double *row = matrix_row(c->rows, i);
+        double *l = c->l + (size_t) i * c->k;
+        for (int p = 0; p < c->k; p++)
+            l[p] = -row[c->leads[p]];
+    }
+    kernels.update(matrix_row(c->rows, begin) + c->from, c->rows->stride,
+                   c->l + (size_t) begin * c->k, c->k, c->u, end - begin,
+                   c->rows->ncols - c->from, c->k);
+
+    // The pivots' own columns are left at exactly 0, as scale_pivot leaves them
+    for (int i = begin; i < end; i++) {
+        double *row = matrix_row(c->rows, i);
+        for (int p = 0; p < c->k; p++)
+            row[c->leads[p]] = 0;
+    }
+}
+
+/* Cancel the pivots of one slab out of the rows of another.
+ *
+ * pre:  pivots is in reduced echelon form, its rows' leading columns given
+ *       by the leads of o, and rows is another slab
+ * post: rows has zeroes in every pivot column of pivots
+ */
+static void cancel_pivots (struct outcore *o, struct slab *rows,
+        const struct slab *pivots)
+{
+    int k = 0;
+    int from = rows->m->ncols;
+    for (int i = 0; i < pivots->m->nrows; i++) {
+        int lead = o->leads[pivots->first + i];
+        if (lead < 0)
+            continue;
+        o->pivot_leads[k++] = lead;
+        if (lead < from)
+            from = lead;
+    }
+    if (k == 0)
+        return;
+
+    // In reduced echelon form, every pivot row is zero left of its lead
+    for (int i = 0, p = 0; i < pivots->m->nrows; i++) {
+        if (o->leads[pivots->first + i] >= 0)
+            o->u[p++] = matrix_row(pivots->m, i) + from;
+    }
+
+    int n = rows->m->ncols - from;
+    struct cancel c = {
+        rows->m, o->u, o->pivot_leads, o->l, k, from,
+    };
+    pool_for(cancel_task, &c, rows->m->nrows, (size_t) k * n);
+    stats_count(STAT_ADDS, (int64_t) rows->m->nrows * k);
+    stats_count(STAT_FLOPS, 2 * (int64_t) rows->m->nrows * k * n);
+}
+
+/* Find the pivots of a slab that had all earlier pivots cancelled out.
+ *
+ * pre:  s has zeroes in the pivot columns of every slab before it
+ * post: returns true with s in reduced echelon form and the leads of o
+ *       set for its rows, false after reporting an error
+ */
+static bool solve_slab (struct outcore *o, struct slab *s)
+{
+    if (!auto_gauss_jordan_with(s->m, TRACE_QUIET, &o->ws)) {
+        report_error("Could not reduce rows %d to %d", s->first + 1,
+                     s->first + s->m->nrows);
+        return false;
+    }
+    for (int i = 0; i < s->m->nrows; i++)
+        o->leads[s->first + i] = leading_pos(i, s->m);
+    return true;
+}
+
+/* Move the rows of the file into the order of their leading columns, the
+ * rows of zeroes last, reading and writing each row that moves once.
+ *
+ * pre:  the I/O thread is stopped, and the leads of o describe the file
+ * post: returns true with the rows in order and result filled in, false
+ *       after reporting an error
+ */
+static bool sort_rows (struct outcore *o, int ncols, struct matrix_result *result)
+{
+    bool success = false;
+    int fd = o->io.fd;
+    int error;
+    int *row_of_col = malloc(ncols * sizeof(int));
+    int *order = malloc(o->nrows * sizeof(int)); // row that goes to each row
+    char *moved = calloc(o->nrows, 1);
+    double *held = malloc(o->row_bytes);
+    double *row = malloc(o->row_bytes);
+    result->pivots = malloc((ncols < o->nrows ? ncols : o->nrows) * sizeof(int));
+    if (!row_of_col || !order || !moved || !held || !row || !result->pivots) {
+        report_error("Could not allocate space to sort the rows");
+        goto out;
+    }
+
+    // Every pivot is in a column of its own, so the columns sort the rows
+    for (int j = 0; j < ncols; j++)
+        row_of_col[j] = -1;
+    for (int i = 0; i < o->nrows; i++) {
+        if (o->leads[i] >= 0)
+            row_of_col[o->leads[i]] = i;
+    }
+    int k = 0;
+    for (int j = 0; j < ncols; j++) {
+        if (row_of_col[j] >= 0) {
+            result->pivots[k] = j;
+            order[k++] = row_of_col[j];
+        }
+    }
+    result->rank = k;
+    for (int i = 0; i < o->nrows; i++) {
+        if (o->leads[i] < 0)
+            order[k++] = i;
+    }
+
+    // Follow each cycle of the permutation, holding the row it starts with
+    for (int start = 0; start < o->nrows; start++) {
+        if (moved[start] || order[start] == start)
+            continue;
+        struct io_request get = { false, held, o->row_bytes,
+                                  o->data_offset + start * o->row_bytes };
+        if ((error = io_transfer(fd, &get)) != 0)
+            goto io_fail;
+        int to = start;
+        for (;;) {
+            moved[to] = 1;
+            int from = order[to];
+            struct io_request put = { true, from == start ? held : row,
+                                      o->row_bytes,
+                                      o->data_offset + to * o->row_bytes };
+            if (from != start) {
+                get = (struct io_request) { false, row, o->row_bytes,
+                                            o->data_offset + from * o->row_bytes };
+                if ((error = io_transfer(fd, &get)) != 0)
+                    goto io_fail;
+            }
+            if ((error = io_transfer(fd, &put)) != 0)
+                goto io_fail;
+            if (from == start)
+                break;
+            to = from;
+        }
+    }
+    success = true;
+    goto out;
+
+io_fail:
+    report_error("%s: %s", o->path, strerror(error));
+out:
+    free(row);
+    free(held);
+    free(moved);
+    free(order);
+    free(row_of_col);
+    return success;
+}
+
+/* Allocate a buffer for a slab with the file's row stride, so that a
+ * slab is one read. Rows in memory need not be aligned, as the kernels
+ * load them unaligned.
+ *
+ * pre:  rows > 0
+ * post: returns the buffer, or NULL if it could not be allocated
+ */
+static struct matrix *slab_create (int rows, int ncols, size_t stride)
+{
+    struct matrix *m = calloc(1, sizeof(*m));
+    if (m == NULL || posix_memalign((void **) &m->data, MATRIX_ALIGN,
+                                    rows * stride * sizeof(double)) != 0) {
+        free(m);
+        return NULL;
+    }
+    m->nrows = rows;
+    m->ncols = ncols;
+    m->stride = (int) stride;
+    return m;
+}
+
+bool outcore_reduce (const char *path, size_t memory, int *rank)
+{
+    bool success = false;
+    struct matrix_file_header h;
+    int fd = matrix_file_open(path, &h);
+    if (fd < 0)
+        return false;
+
+    struct outcore o = {
+        .path = path,
+        .io = { .fd = fd },
+        .data_offset = h.data_offset,
+        .row_bytes = h.stride * sizeof(double),
+        .nrows = (int) h.nrows,
+    };
+    int ncols = (int) h.ncols;
+    struct matrix_result result = { MATRIX_FILE_ECHELON | MATRIX_FILE_REDUCED };
+    bool io_running = false;
+
+    size_t slab_rows = memory / OUTCORE_SLABS / o.row_bytes;
+    if (h.stride > INT32_MAX) {
+        report_error("%s: rows are too long", path);
+        goto out;
+    } else if (slab_rows == 0) {
+        report_error("Need at least %zu MB to hold %d slabs of one row",
+                     (OUTCORE_SLABS * o.row_bytes + (1 << 20) - 1) >> 20,
+                     OUTCORE_SLABS);
+        goto out;
+    }
+    o.slab_rows = slab_rows < h.nrows ? (int) slab_rows : o.nrows;
+
+    // A slab has at most ncols pivots to cancel out of another
+    int max_pivots = o.slab_rows < ncols ? o.slab_rows : ncols;
+    o.leads = malloc(o.nrows * sizeof(int));
+    o.u = malloc(max_pivots * sizeof(*o.u));
+    o.pivot_leads = malloc(max_pivots * sizeof(int));
+    o.l = malloc((size_t) o.slab_rows * max_pivots * sizeof(double));
+    if (!o.leads || !o.u || !o.pivot_leads || !o.l) {
+        report_error("Could not allocate space for the pivots");
+        goto out;
+    }
+    for (int s = 0; s < OUTCORE_SLABS; s++) {
+        o.slabs[s].m = slab_create(o.slab_rows, ncols, h.stride);
+        if (o.slabs[s].m == NULL) {
+            report_error("Could not allocate %d slabs of %d rows",
+                         OUTCORE_SLABS, o.slab_rows);
+            goto out;
+        }
+    }
+    if (!io_start(&o.io))
+        goto out;
+    io_running = true;
+
+    /* cur holds the slab whose pivots were found last. With the next slab
+     * read in, each slab before cur comes through blocks in turn: read,
+     * cur's pivots cancelled out of it, its pivots cancelled out of next,
+     * and written back, with one read and one write queued around it. The
+     * last pass has no next slab, and only clears the last pivots. */
+    int nslabs = (o.nrows + o.slab_rows - 1) / o.slab_rows;
+    struct slab *cur = &o.slabs[0];
+    struct slab *next = &o.slabs[1];
+    struct slab *blocks = &o.slabs[2];
+    read_slab(&o, cur, 0);
+    if (!io_wait(&o.io, &cur->read) || !solve_slab(&o, cur))
+        goto out;
+
+    for (int t = 1; t <= nslabs; t++) {
+        bool last = t == nslabs;
+        if (!last)
+            read_slab(&o, next, t);
+        if (t > 1)
+            read_slab(&o, &blocks[0], 0);
+        if (!last) {
+            if (!io_wait(&o.io, &next->read))
+                goto out;
+            cancel_pivots(&o, next, cur);
+        }
+
+        for (int j = 0; j < t - 1; j++) {
+            struct slab *b = &blocks[j % 3];
+            if (j + 1 < t - 1)
+                read_slab(&o, &blocks[(j + 1) % 3], j + 1);
+            if (!io_wait(&o.io, &b->read))
+                goto out;
+            cancel_pivots(&o, b, cur);
+            if (!last)
+                cancel_pivots(&o, next, b);
+            write_slab(&o, b);
+        }
+
+        write_slab(&o, cur);
+        if (last)
+            break;
+        if (!solve_slab(&o, next))
+            goto out;
+        struct slab *done = cur;
+        cur = next;
+        next = done;
+    }
+    if (!io_wait(&o.io, &cur->write))
+        goto out;
+    io_stop(&o.io);
+    io_running = false;
+
+    if (!sort_rows(&o, ncols, &result))
+        goto out;
+    success = true;
+
+out:
+    if (io_running) {
+        io_stop(&o.io);
+        if (o.io.error)
+            report_error("%s: %s", path, strerror(o.io.error));
+    }
+    for (int s = 0; s < OUTCORE_SLABS; s++)
+        matrix_free(o.slabs[s].m);
+    workspace_free(&o.ws);
+    free(o.l);
+    free(o.pivot_leads);
+    free(o.u);
+    free(o.leads);
+
+    // The file is closed either way, with the result recorded on success
+    if (success) {
+        success = matrix_file_close(path, fd, &h, &result);
+        *rank = result.rank;
+    } else {
+        close(fd);
+    }
+    free(result.pivots);
+    return success;
+}
@@ -0,0 +1,61 @@
+#ifndef __OUTCORE_H__
+#define __OUTCORE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Solving matrices too big for memory, in their binary files.
+ *
+ * The rows of a matrix file are split into slabs of consecutive rows, so
+ * that each slab is a single read or write, and only OUTCORE_SLABS of them
+ * are in memory at a time. The file is brought to reduced echelon form one
+ * slab at a time:
+ *
+ *   1. the next slab is read, and the pivot rows found so far are
+ *      cancelled out of it, one slab of them at a time,
+ *   2. its own pivots are found in memory by auto_gauss_jordan,
+ *   3. and they are cancelled out of the slabs before it, on the same pass
+ *      over those slabs as step 1 of the slab after it.
+ *
+ * Every pivot row found so far stays in reduced echelon form with the
+ * others, so the slabs can be taken in any order. Each slab is read and
+ * written once for every slab after it, and a helper thread reads the
+ * next slab and writes out the last one while the current one is worked
+ * on.
+ *
+ * So with a file F times the size of the memory given, about 2.6 F times
+ * the file is read and as much written: quadratic in the file's size,
+ * where square tiles would make it grow like n^3 / sqrt(memory). Slabs are
+ * kept anyway. Each is one sequential read in the file's row order, and
+ * pivots are chosen within it exactly as auto_gauss_jordan chooses them,
+ * where tiles would need their pivots chosen across a whole column of
+ * tiles. The arithmetic is n^3 while the I/O is about 2.6 * 8 n^2 * F
+ * bytes each way, so there are about memory / (42 n) flops for each byte
+ * moved, some 90 for a 10 GB file in 1 GB. Disks that keep up with that
+ * are hidden behind the arithmetic by the helper thread.
+ *
+ * At the end the rows are moved into the order of their pivots, the rows
+ * of zeroes last, and the rank and pivots go in the file like any other
+ * result.
+ *
+ * Like -g, this is Gauss-Jordan elimination in floating point, but with
+ * pivots chosen a slab at a time, so the result can differ from the
+ * in-memory one by rounding.
+ */
+
+/* Slabs in memory at once: the one whose pivots were just found, the next
+ * one, and three for reading, updating and writing the ones before them */
+#define OUTCORE_SLABS 5
+
+/* Put a binary matrix file into reduced echelon form in place, holding
+ * about memory bytes of it in memory at a time.
+ *
+ * pre:  path names a binary matrix file, the kernels may have been picked
+ *       and the pool started
+ * post: returns true with the file holding the reduced echelon form and
+ *       its rank and pivots, and rank set, or false after reporting an
+ *       error, which can leave the file partly reduced
+ */
+bool outcore_reduce (const char *path, size_t memory, int *rank);
+
+#endif
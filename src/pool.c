@@ -0,0 +1,177 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pool.h"
+#include "user_io.h"
+
+/* How many times a waiting thread checks for news before going to sleep.
+ * Pivot steps come in quick succession, so a worker that has just finished
+ * usually sees the next loop within this many checks. */
+#define POOL_SPIN 4000
+
+static struct {
+    pthread_t *threads;
+    int nthreads;          // workers plus the calling thread
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;  // signalled when a new loop is posted
+    pthread_cond_t done;   // signalled when the last chunk is finished
+    unsigned generation;   // bumped for every loop, and to stop
+    bool stopping;
+
+    /* The loop being run */
+    pool_task task;
+    void *arg;
+    int n;
+    int nchunks;
+    int remaining;         // chunks not yet finished by the workers
+} pool = {
+    .nthreads = 1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+/* Whether this thread is running a chunk of a loop, in which case loops it
+ * starts itself run on it alone */
+static __thread bool in_task;
+
+/* Run one chunk of the current loop.
+ *
+ * pre:  0 <= chunk < pool.nchunks
+ * post: the chunk's items have been handled
+ */
+static void run_chunk (int chunk)
+{
+    int begin = (int) ((long) pool.n * chunk / pool.nchunks);
+    int end = (int) ((long) pool.n * (chunk + 1) / pool.nchunks);
+    if (begin < end) {
+        in_task = true;
+        pool.task(pool.arg, begin, end);
+        in_task = false;
+    }
+}
+
+static void *worker (void *data)
+{
+    int id = (int) (long) data; // 1 .. nthreads-1, the caller runs chunk 0
+    unsigned seen = 0;
+
+    for (;;) {
+        /* Wait for a new loop, spinning first and then sleeping */
+        for (int spin = 0; spin < POOL_SPIN; spin++) {
+            if (__atomic_load_n(&pool.generation, __ATOMIC_ACQUIRE) != seen)
+                break;
+        }
+        pthread_mutex_lock(&pool.lock);
+        while (pool.generation == seen)
+            pthread_cond_wait(&pool.start, &pool.lock);
+        seen = pool.generation;
+        bool stopping = pool.stopping;
+        bool mine = id < pool.nchunks;
+        pthread_mutex_unlock(&pool.lock);
+        if (stopping)
+            break;
+        if (!mine)
+            continue;
+
+        run_chunk(id);
+
+        pthread_mutex_lock(&pool.lock);
+        if (__atomic_sub_fetch(&pool.remaining, 1, __ATOMIC_RELEASE) == 0)
+            pthread_cond_signal(&pool.done);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+bool pool_start (int nthreads)
+{
+    if (nthreads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cpus > 0 ? (int) cpus : 1;
+    }
+    if (nthreads <= 1)
+        return true;
+
+    pool.threads = malloc((nthreads - 1) * sizeof(pthread_t));
+    if (pool.threads == NULL) {
+        report_error("Could not allocate the thread pool");
+        return false;
+    }
+    pool.stopping = false;
+    for (int id = 1; id < nthreads; id++) {
+        int err = pthread_create(&pool.threads[id - 1], NULL, worker,
+                                 (void *) (long) id);
+        if (err != 0) {
+            report_error("Could not start a worker thread: %s", strerror(err));
+            pool.nthreads = id; // the ones started so far
+            pool_stop();
+            return false;
+        }
+    }
+    pool.nthreads = nthreads;
+    return true;
+}
+
+void pool_stop (void)
+{
+    if (pool.threads == NULL)
+        return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = true;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int id = 1; id < pool.nthreads; id++)
+        pthread_join(pool.threads[id - 1], NULL);
+    free(pool.threads);
+    pool.threads = NULL;
+    pool.nthreads = 1;
+}
+
+int pool_size (void)
+{
+    return pool.nthreads;
+}
+
+void pool_for (pool_task task, void *arg, int n, size_t cost)
+{
+    /* Only split as far as there is enough work to go around */
+    size_t work = (size_t) n * (cost > 0 ? cost : 1);
+    int nchunks = pool.nthreads;
+    if (work / POOL_MIN_WORK < (size_t) nchunks)
+        nchunks = (int) (work / POOL_MIN_WORK);
+    if (nchunks > n)
+        nchunks = n;
+    if (nchunks <= 1 || in_task) {
+        if (n > 0)
+            task(arg, 0, n);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.task = task;
+    pool.arg = arg;
+    pool.n = n;
+    pool.nchunks = nchunks;
+    pool.remaining = nchunks - 1;
+    __atomic_add_fetch(&pool.generation, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_chunk(0);
+
+    /* Wait for the workers, spinning first and then sleeping */
+    for (int spin = 0; spin < POOL_SPIN; spin++) {
+        if (__atomic_load_n(&pool.remaining, __ATOMIC_ACQUIRE) == 0)
+            return;
+    }
+    pthread_mutex_lock(&pool.lock);
+    while (pool.remaining > 0)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
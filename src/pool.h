@@ -0,0 +1,56 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A fixed set of worker threads that share loops over independent rows.
+ *
+ * There is only one pool. Until pool_start is called, or after pool_stop,
+ * pool_for simply runs the whole loop on the calling thread, so code can
+ * use it unconditionally.
+ */
+
+/* Rough number of entries a chunk of a loop has to touch before handing
+ * it to another thread pays for the hand-off */
+#define POOL_MIN_WORK 16384
+
+/* A piece of a loop: handle items begin <= item < end, with arg being
+ * whatever was passed to pool_for */
+typedef void (*pool_task) (void *arg, int begin, int end);
+
+/* Start the pool.
+ *
+ * pre:  nthreads >= 1, counting the calling thread; 0 means one thread
+ *       per online CPU. The pool isn't already running.
+ * post: returns true if the workers are running, false after reporting
+ *       an error
+ */
+bool pool_start (int nthreads);
+
+/* Stop the pool and wait for its workers to exit.
+ *
+ * pre:  no pool_for call is in progress
+ * post: pool_for runs everything on the calling thread again
+ */
+void pool_stop (void);
+
+/* How many threads share the work, the calling thread included.
+ *
+ * pre:  none
+ * post: returns the size of the pool, 1 if it isn't running
+ */
+int pool_size (void);
+
+/* Run task over the items 0 <= item < n, split into contiguous chunks, one
+ * per thread. cost is roughly how many entries each item touches; small
+ * loops run on the calling thread alone, and so do loops started by a task
+ * that is itself part of a loop.
+ *
+ * pre:  the items are independent of each other, n >= 0
+ * post: task has been run for every item, and everything it wrote is
+ *       visible to the caller
+ */
+void pool_for (pool_task task, void *arg, int n, size_t cost);
+
+#endif
@@ -0,0 +1,402 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "reader.h"
+
+/* Most significant digits that are guaranteed to fit in a uint64_t */
+#define MAX_DIGITS 19
+
+/* Powers of ten that a double represents exactly */
+static const double pow10_exact[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+bool reader_open (struct reader *in, const char *path)
+{
+    if (path == NULL) {
+        in->file = stdin;
+        in->owned = false;
+        in->prompt = true;
+    } else {
+        in->file = fopen(path, "r");
+        if (in->file == NULL)
+            return false;
+        in->owned = true;
+        in->prompt = false;
+    }
+    in->bulk = in->owned;
+    in->line = 0;
+    in->buf = NULL;
+    in->size = 0;
+    in->pos = NULL;
+    in->end = NULL;
+    in->newline = false;
+    in->eof = false;
+    return true;
+}
+
+void reader_close (struct reader *in)
+{
+    if (in->owned)
+        fclose(in->file);
+    free(in->buf);
+    in->file = NULL;
+    in->buf = NULL;
+}
+
+static inline bool is_digit (char ch)
+{
+    return (unsigned char) (ch - '0') < 10;
+}
+
+/* Which bytes separate tokens: whitespace, commas and semicolons */
+static const bool separators[256] = {
+    [' '] = true, ['\t'] = true, ['\n'] = true, ['\r'] = true, ['\v'] = true,
+    ['\f'] = true, [','] = true, [';'] = true,
+};
+
+static inline bool is_separator (char ch)
+{
+    return separators[(unsigned char) ch];
+}
+
+/* Read the next piece of the file in bulk, after the first keep bytes of
+ * the buffer, which hold the start of a token the last piece cut off.
+ *
+ * pre:  in is in bulk, and the keep bytes are at the start of in->buf
+ * post: returns true if more text came in, false at the end of the file
+ *       or if the buffer couldn't grow; the text ends at in->end either way
+ */
+static bool refill (struct reader *in, size_t keep)
+{
+    size_t wanted = keep + READER_CHUNK + 1;
+    if (in->size < wanted) {
+        char *buf = realloc(in->buf, wanted);
+        if (buf == NULL) {
+            in->eof = true;
+        } else {
+            in->buf = buf;
+            in->size = wanted;
+        }
+    }
+    ssize_t n = 0;
+    if (!in->eof) {
+        do {
+            n = read(fileno(in->file), in->buf + keep, READER_CHUNK);
+        } while (n < 0 && errno == EINTR);
+        in->eof = n <= 0;
+    }
+    if (in->buf == NULL)
+        return false;
+    in->pos = in->buf;
+    in->end = in->buf + keep + (n > 0 ? n : 0);
+    *in->end = '\0'; // stops the scans without checking for the end
+    return n > 0;
+}
+
+/* Find the start of the next token of input read in bulk.
+ *
+ * pre:  in is open, in bulk
+ * post: returns the token's first byte, or NULL at the end of the input
+ */
+static char *bulk_skip (struct reader *in)
+{
+    if (in->pos == NULL) {
+        in->line = 1;
+        if (!refill(in, 0))
+            return NULL;
+    } else if (in->newline) {
+        in->line++;
+        in->newline = false;
+    }
+
+    /* Skip anything between tokens, pulling in pieces as we run out */
+    char *p = in->pos;
+    while (true) {
+        while (is_separator(*p)) {
+            if (*p == '\n')
+                in->line++;
+            p++;
+        }
+        if (p < in->end && *p != '\0')
+            return p;
+        if (p < in->end)
+            p++; // a NUL in the text, which no token can hold
+        else if (!refill(in, 0))
+            return NULL;
+        else
+            p = in->pos;
+    }
+}
+
+/* End the token that starts at p, in input read in bulk. One cut off by
+ * the end of the piece is moved to the start of the buffer, and the rest
+ * of it read in after it.
+ *
+ * pre:  p came from bulk_skip
+ * post: returns the NUL terminated token, and the next search starts
+ *       after it
+ */
+static char *bulk_finish (struct reader *in, char *p)
+{
+    char *tok = p;
+    while (!is_separator(*p) && *p != '\0')
+        p++;
+    while (p == in->end && !in->eof) {
+        size_t keep = p - tok;
+        memmove(in->buf, tok, keep);
+        refill(in, keep);
+        tok = in->buf;
+        for (p = tok + keep; !is_separator(*p) && *p != '\0'; p++)
+            ;
+    }
+    if (p < in->end) {
+        in->newline = *p == '\n'; // counted once the token has been used
+        *p++ = '\0';
+    }
+    in->pos = p;
+    return tok;
+}
+
+char *reader_token (struct reader *in)
+{
+    if (in->bulk) {
+        char *p = bulk_skip(in);
+        return p != NULL ? bulk_finish(in, p) : NULL;
+    }
+    char *p = in->pos;
+
+    /* Skip anything between tokens, pulling in lines as we run out */
+    while (true) {
+        while (p != NULL && is_separator(*p))
+            p++;
+        if (p != NULL && *p != '\0')
+            break;
+        if (getline(&in->buf, &in->size, in->file) < 0) {
+            in->pos = NULL;
+            return NULL;
+        }
+        in->line++;
+        p = in->buf;
+    }
+
+    char *tok = p;
+    while (*p != '\0' && !is_separator(*p))
+        p++;
+    if (*p != '\0')
+        *p++ = '\0';
+    in->pos = p;
+    return tok;
+}
+
+void reader_skip_line (struct reader *in)
+{
+    if (!in->bulk) {
+        in->pos = NULL; // the rest of the line was already read in
+        return;
+    }
+    if (in->newline) { // the last token was the end of its line
+        in->line++;
+        in->newline = false;
+        return;
+    }
+    if (in->pos == NULL) {
+        in->line = 1;
+        if (!refill(in, 0))
+            return;
+    }
+    while (true) {
+        char *nl = memchr(in->pos, '\n', in->end - in->pos);
+        if (nl != NULL) {
+            in->pos = nl + 1;
+            in->line++;
+            return;
+        }
+        if (!refill(in, 0))
+            return;
+    }
+}
+
+/* Parse one decimal number from the start of s, stopping at the first
+ * character that can't be part of it.
+ *
+ * pre:  s is NUL terminated
+ * post: returns true, stores the value and points end past the number on
+ *       success, false if s doesn't start with a number
+ */
+static bool parse_decimal (const char *s, const char **end, double *value)
+{
+    const char *p = s;
+    uint64_t mantissa = 0; // the first MAX_DIGITS significant digits
+    int ndigits = 0;       // how many digits are in mantissa
+    bool inexact = false;  // whether nonzero digits were dropped
+
+    /* Without a branch, since signs come and go at random */
+    bool negative = *p == '-';
+    p += *p == '-' || *p == '+';
+
+    /* Most numbers have few enough digits for all of them to fit, which
+     * takes a multiply and an add per digit */
+    const char *digits = p;
+    for (; is_digit(*p); p++)
+        mantissa = mantissa * 10 + (*p - '0');
+    int nint = p - digits;
+    int nfrac = 0;
+    if (*p == '.') {
+        const char *frac = ++p;
+        for (; is_digit(*p); p++)
+            mantissa = mantissa * 10 + (*p - '0');
+        nfrac = p - frac;
+    }
+    bool any = nint + nfrac > 0; // whether we saw any digits at all
+    int exponent = -nfrac;       // power of ten to scale mantissa by
+
+    /* Longer ones keep their first MAX_DIGITS significant digits */
+    if (nint + nfrac > MAX_DIGITS) {
+        mantissa = 0;
+        exponent = 0;
+        for (p = digits; is_digit(*p); p++) {
+            if (ndigits < MAX_DIGITS) {
+                mantissa = mantissa * 10 + (*p - '0');
+                ndigits += (mantissa != 0); // leading zeros don't count
+            } else {
+                exponent++;
+                inexact |= (*p != '0');
+            }
+        }
+        if (*p == '.') {
+            for (p++; is_digit(*p); p++) {
+                if (ndigits < MAX_DIGITS) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    ndigits += (mantissa != 0);
+                    exponent--;
+                } else {
+                    inexact |= (*p != '0');
+                }
+            }
+        }
+    }
+    if (!any)
+        return false;
+
+    if (*p == 'e' || *p == 'E') {
+        const char *q = p + 1;
+        bool exp_negative = false;
+        int exp = 0;
+        if (*q == '+' || *q == '-')
+            exp_negative = (*q++ == '-');
+        if (*q < '0' || *q > '9')
+            return false;
+        for (; *q >= '0' && *q <= '9'; q++) {
+            if (exp < 100000) // far past the range of a double already
+                exp = exp * 10 + (*q - '0');
+        }
+        exponent += exp_negative ? -exp : exp;
+        p = q;
+    }
+    *end = p;
+
+    /* Both the mantissa and the power of ten are exact doubles here, so
+     * one multiplication or division rounds correctly */
+    if (!inexact && mantissa < (UINT64_C(1) << 53)
+            && exponent >= -22 && exponent <= 22) {
+        double v = (double) mantissa;
+        if (exponent < 0)
+            v /= pow10_exact[-exponent];
+        else
+            v *= pow10_exact[exponent];
+        *value = negative ? -v : v;
+        return true;
+    }
+
+    /* Anything else is rare enough to hand to strtod, which rounds
+     * correctly in every case */
+    char buf[64];
+    size_t len = p - s;
+    if (len < sizeof(buf)) {
+        memcpy(buf, s, len);
+        buf[len] = '\0';
+        *value = strtod(buf, NULL);
+    } else {
+        char *copy = strndup(s, len);
+        if (copy == NULL)
+            return false;
+        *value = strtod(copy, NULL);
+        free(copy);
+    }
+    return true;
+}
+
+bool parse_double (const char *tok, double *value)
+{
+    const char *p;
+    double num, den;
+
+    if (!parse_decimal(tok, &p, &num))
+        return false;
+    if (*p == '/') {
+        if (!parse_decimal(p + 1, &p, &den) || den == 0)
+            return false;
+        num /= den;
+    }
+    if (*p != '\0')
+        return false;
+
+    *value = num;
+    return true;
+}
+
+char *reader_double (struct reader *in, double *value, bool *number)
+{
+    if (!in->bulk) {
+        char *tok = reader_token(in);
+        if (tok != NULL)
+            *number = parse_double(tok, value);
+        return tok;
+    }
+
+    /* Most tokens are plain decimals, which are parsed straight off the
+     * text in the same pass that finds where they end. The rest, and any
+     * cut off by the end of the piece, are split off first. */
+    char *p = bulk_skip(in);
+    if (p == NULL)
+        return NULL;
+    const char *end;
+    if (parse_decimal(p, &end, value) && end < in->end
+            && is_separator(*end)) {
+        char *q = (char *) end;
+        in->newline = *q == '\n';
+        *q = '\0';
+        in->pos = q + 1;
+        *number = true;
+        return p;
+    }
+    char *tok = bulk_finish(in, p);
+    *number = parse_double(tok, value);
+    return tok;
+}
+
+bool parse_int (const char *tok, int *value)
+{
+    const char *p = tok;
+    bool negative = false;
+    long n = 0;
+
+    if (*p == '+' || *p == '-')
+        negative = (*p++ == '-');
+    if (*p == '\0')
+        return false;
+    for (; *p != '\0'; p++) {
+        if (*p < '0' || *p > '9')
+            return false;
+        n = n * 10 + (*p - '0');
+        if (n > INT32_MAX)
+            return false;
+    }
+
+    *value = (int) (negative ? -n : n);
+    return true;
+}
@@ -0,0 +1,90 @@
+#ifndef __READER_H__
+#define __READER_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* A source of whitespace or comma separated tokens.
+ *
+ * Files opened by the reader are read in READER_CHUNK sized pieces
+ * straight into a buffer of its own, and the tokens are split in place
+ * there, so nothing goes through stdio. stdin is shared with the prompts
+ * and with any scanf or getchar calls made on it afterwards, so by default
+ * it is pulled in a whole line at a time instead, and nothing past the
+ * current line is consumed. A caller that owns all of stdin can set bulk
+ * before the first token to read it in pieces too.
+ */
+
+/* Bytes read from a file at a time */
+#define READER_CHUNK (1 << 20)
+
+struct reader {
+    FILE *file;   // where the text comes from
+    bool owned;   // whether reader_close should close file
+    bool prompt;  // whether a person is typing, and wants prompts
+    bool bulk;    // whether to read in pieces rather than lines
+    long line;    // line number of the current token, starting at 1
+    char *buf;    // the current line, or piece of the file
+    size_t size;  // allocated size of buf
+    char *pos;    // where the next token search starts within buf
+    char *end;    // end of the text in buf, in bulk, where a NUL is kept
+    bool newline; // whether the last token ended its line, in bulk
+    bool eof;     // whether the file has run out, in bulk
+};
+
+/* Start reading from a file, or from stdin.
+ *
+ * pre:  path is a file to open, or NULL for stdin
+ * post: returns true and initializes in on success, false otherwise
+ */
+bool reader_open (struct reader *in, const char *path);
+
+/* Stop reading, closing the file if reader_open opened it.
+ *
+ * pre:  in was initialized by reader_open
+ * post: in may no longer be used
+ */
+void reader_close (struct reader *in);
+
+/* Read the next token. Tokens are separated by whitespace, commas and
+ * semicolons.
+ *
+ * pre:  in is open
+ * post: returns the NUL terminated token, valid until the next call, or
+ *       NULL at the end of the input
+ */
+char *reader_token (struct reader *in);
+
+/* Skip what is left of the current line.
+ *
+ * pre:  in is open
+ * post: the next token will come from a new line
+ */
+void reader_skip_line (struct reader *in);
+
+/* Parse a token as a number. Accepts decimals with an optional exponent,
+ * and fractions of two such numbers like -1/3.
+ *
+ * pre:  tok is a NUL terminated token
+ * post: returns true and stores the value on success, false if tok is not
+ *       a number or is a fraction with a zero denominator
+ */
+bool parse_double (const char *tok, double *value);
+
+/* Read the next token and parse it as a number, like parse_double on what
+ * reader_token returns, but without going over the text twice.
+ *
+ * pre:  in is open
+ * post: returns the token like reader_token, or NULL at the end of the
+ *       input; number says whether it was a number, stored in value
+ */
+char *reader_double (struct reader *in, double *value, bool *number);
+
+/* Parse a token as a decimal integer that fits in an int.
+ *
+ * pre:  tok is a NUL terminated token
+ * post: returns true and stores the value on success, false otherwise
+ */
+bool parse_int (const char *tok, int *value);
+
+#endif
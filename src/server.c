@@ -0,0 +1,382 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "arena.h"
+#include "automatic.h"
+#include "matrix_proc.h"
+#include "server.h"
+#include "user_io.h"
+
+_Static_assert(sizeof(struct server_request) == 32,
+               "request header must stay 32 bytes");
+_Static_assert(sizeof(struct server_response) == 32,
+               "response header must stay 32 bytes");
+
+/* Bytes of requests read ahead, and of responses held back to be sent
+ * together */
+#define SERVER_BUFFER 65536
+
+/* Connections the socket holds on to while another is served */
+#define SERVER_BACKLOG 16
+
+/* Longest error message sent back, counting the NUL */
+#define SERVER_ERROR_SIZE 256
+
+/* One client, and everything kept for it from one request to the next */
+struct session {
+    int in_fd;
+    int out_fd;
+    char *in;            // requests read ahead
+    size_t in_pos;       // where the next byte of in is
+    size_t in_end;       // end of what was read into in
+    char *out;           // responses not sent yet
+    size_t out_len;
+    uint64_t max_bytes;  // most bytes of entries a request may carry
+    struct arena arena;  // the matrix and pivots of the current request
+    struct workspace ws; // the engines' scratch space
+    char error[SERVER_ERROR_SIZE]; // where report_error leaves messages
+    bool broken;         // reading or writing failed, or the client left
+};
+
+/* Write bytes to the client, however many calls that takes.
+ *
+ * pre:  s is open
+ * post: returns true if they all went out, false with s broken otherwise
+ */
+static bool write_all (struct session *s, const char *p, size_t n)
+{
+    while (n > 0 && !s->broken) {
+        ssize_t w = write(s->out_fd, p, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0) {
+            s->broken = true;
+        } else {
+            p += w;
+            n -= w;
+        }
+    }
+    return !s->broken;
+}
+
+/* Send everything held back.
+ *
+ * pre:  s is open
+ * post: returns true if it all went out, false with s broken otherwise
+ */
+static bool flush (struct session *s)
+{
+    bool ok = write_all(s, s->out, s->out_len);
+    s->out_len = 0;
+    return ok;
+}
+
+/* Send bytes after everything before them, holding small ones back to go
+ * out together.
+ *
+ * pre:  s is open
+ * post: the bytes are held back or sent, unless s is broken
+ */
+static void send_bytes (struct session *s, const void *p, size_t n)
+{
+    if (n > SERVER_BUFFER - s->out_len && !flush(s))
+        return;
+    if (n < SERVER_BUFFER) {
+        memcpy(s->out + s->out_len, p, n);
+        s->out_len += n;
+    } else {
+        write_all(s, p, n);
+    }
+}
+
+/* Receive bytes, reading ahead as far as the client has sent.
+ *
+ * pre:  s is open
+ * post: returns how many bytes were stored at dst, fewer than n if the
+ *       input ended or s broke
+ */
+static size_t recv_bytes (struct session *s, void *dst, size_t n)
+{
+    char *p = dst;
+    size_t got = 0;
+    while (got < n) {
+        size_t have = s->in_end - s->in_pos;
+        if (have > 0) {
+            size_t take = have < n - got ? have : n - got;
+            memcpy(p + got, s->in + s->in_pos, take);
+            s->in_pos += take;
+            got += take;
+            continue;
+        }
+
+        // The client may be waiting on the answers to what it sent before
+        if (!flush(s))
+            return got;
+
+        // Big payloads are read in place rather than through the buffer
+        bool direct = n - got >= SERVER_BUFFER;
+        ssize_t r = direct ? read(s->in_fd, p + got, n - got)
+                           : read(s->in_fd, s->in, SERVER_BUFFER);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            s->broken = true;
+        if (r <= 0)
+            return got;
+        if (direct) {
+            got += r;
+        } else {
+            s->in_pos = 0;
+            s->in_end = r;
+        }
+    }
+    return got;
+}
+
+/* Skip over the entries of a request that won't be served.
+ *
+ * pre:  s is open
+ * post: returns true if all n bytes were there
+ */
+static bool discard (struct session *s, size_t n)
+{
+    char scratch[4096];
+    while (n > 0) {
+        size_t k = n < sizeof(scratch) ? n : sizeof(scratch);
+        if (recv_bytes(s, scratch, k) < k)
+            return false;
+        n -= k;
+    }
+    return true;
+}
+
+/* Send a response, with the rows of matrix unless it is NULL, the first
+ * rank pivots, and an error message unless it is NULL.
+ *
+ * pre:  s is open
+ * post: the response is held back or sent, unless s is broken
+ */
+static void respond (struct session *s, enum server_status status,
+        const struct matrix *matrix, const int *pivots, int rank,
+        const char *error)
+{
+    struct server_response r = {
+        .magic = SERVER_RESPONSE_MAGIC,
+        .version = SERVER_VERSION,
+        .status = status,
+        .byte_order = SERVER_BYTE_ORDER,
+        .rank = status == SERVER_OK ? rank : -1,
+        .nrows = matrix != NULL ? matrix->nrows : 0,
+        .ncols = matrix != NULL ? matrix->ncols : 0,
+        .length = error != NULL ? strlen(error) : 0,
+    };
+    send_bytes(s, &r, sizeof(r));
+    for (int i = 0; matrix != NULL && i < matrix->nrows; i++)
+        send_bytes(s, matrix_row(matrix, i), matrix->ncols * sizeof(double));
+    for (int k = 0; k < rank && status == SERVER_OK; k++) {
+        int64_t pivot = pivots[k];
+        send_bytes(s, &pivot, sizeof(pivot));
+    }
+    if (error != NULL)
+        send_bytes(s, error, r.length);
+}
+
+/* Serve one request whose header has been read.
+ *
+ * pre:  s is open
+ * post: returns true if the connection can go on to the next request,
+ *       false if the request or the connection was too broken to
+ */
+static bool handle_request (struct session *s, const struct server_request *req)
+{
+    if (memcmp(req->magic, SERVER_REQUEST_MAGIC, sizeof(req->magic)) != 0
+            || req->version != SERVER_VERSION
+            || req->byte_order != SERVER_BYTE_ORDER) {
+        respond(s, SERVER_BAD_REQUEST, NULL, NULL, 0,
+                "not a request of this version and byte order");
+        return false;
+    }
+    if (req->nrows == 0 || req->ncols == 0 || req->nrows > INT32_MAX
+            || req->ncols > INT32_MAX) {
+        respond(s, SERVER_BAD_REQUEST, NULL, NULL, 0, "bad dimensions");
+        return false;
+    }
+    /* Two dimensions below 2^31 and the size of a double can make more
+     * than 64 bits, so the limit is checked by dividing. Entries that can't
+     * even be counted can't be skipped either. */
+    if (req->ncols > s->max_bytes / sizeof(double) / req->nrows) {
+        snprintf(s->error, sizeof(s->error), "%u x %u is over the limit of "
+                 "%llu MB", req->nrows, req->ncols,
+                 (unsigned long long) (s->max_bytes >> 20));
+        respond(s, SERVER_BAD_REQUEST, NULL, NULL, 0, s->error);
+        if (req->ncols > SIZE_MAX / sizeof(double) / req->nrows)
+            return false;
+        return discard(s, (size_t) req->nrows * req->ncols * sizeof(double));
+    }
+    uint64_t bytes = (uint64_t) req->nrows * req->ncols * sizeof(double);
+    if (req->op < SERVER_ECHELON || req->op > SERVER_RANK || req->flags != 0) {
+        snprintf(s->error, sizeof(s->error), "unknown operation %u or flags %u",
+                 req->op, req->flags);
+        respond(s, SERVER_BAD_REQUEST, NULL, NULL, 0, s->error);
+        return discard(s, bytes);
+    }
+
+    /* The rows are laid out in the arena as matrix_create lays them out,
+     * each starting on a MATRIX_ALIGN boundary */
+    int nrows = req->nrows;
+    int ncols = req->ncols;
+    size_t stride = matrix_stride(ncols);
+    size_t row_bytes = ncols * sizeof(double);
+    if ((size_t) nrows > SIZE_MAX / sizeof(double) / stride) {
+        snprintf(s->error, sizeof(s->error), "%d x %d is too big", nrows, ncols);
+        respond(s, SERVER_BAD_REQUEST, NULL, NULL, 0, s->error);
+        return discard(s, bytes);
+    }
+    size_t padded = (size_t) nrows * stride * sizeof(double);
+    if (!arena_reset(&s->arena, arena_size(padded)
+                                + arena_size(nrows * sizeof(int)))) {
+        respond(s, SERVER_FAILED, NULL, NULL, 0, s->error);
+        return discard(s, bytes);
+    }
+    struct matrix matrix = {
+        nrows, ncols, stride, arena_alloc(&s->arena, padded), NULL, 0,
+    };
+    int *pivots = arena_alloc(&s->arena, nrows * sizeof(int));
+    for (int i = 0; i < nrows; i++) {
+        double *row = matrix_row(&matrix, i);
+        if (recv_bytes(s, row, row_bytes) < row_bytes)
+            return false;
+        memset(row + ncols, 0, (stride - ncols) * sizeof(double));
+    }
+
+    bool solved = false;
+    switch (req->op) {
+        case SERVER_ECHELON:
+        case SERVER_RANK:
+            solved = auto_echelon_with(&matrix, TRACE_QUIET, &s->ws);
+            break;
+        case SERVER_REDUCE:
+            solved = auto_echelon_with(&matrix, TRACE_QUIET, &s->ws)
+                     && auto_reduced_echelon_with(&matrix, TRACE_QUIET, &s->ws);
+            break;
+        case SERVER_GAUSS_JORDAN:
+            solved = auto_gauss_jordan_with(&matrix, TRACE_QUIET, &s->ws);
+            break;
+    }
+    if (!solved) {
+        respond(s, SERVER_FAILED, NULL, NULL, 0, s->error);
+    } else {
+        int rank = pivot_columns(&matrix, pivots);
+        respond(s, SERVER_OK, req->op == SERVER_RANK ? NULL : &matrix,
+                pivots, rank, NULL);
+    }
+    return true;
+}
+
+/* Serve the requests of one client until it is done.
+ *
+ * pre:  in_fd and out_fd are open, the calling thread reports to no sink,
+ *       max_bytes is the most bytes of entries a request may carry
+ * post: returns true if the client ended its input after a whole request,
+ *       false after reporting why not
+ */
+static bool serve_client (int in_fd, int out_fd, uint64_t max_bytes)
+{
+    struct session s = { .in_fd = in_fd, .out_fd = out_fd,
+                         .max_bytes = max_bytes };
+    s.in = malloc(SERVER_BUFFER);
+    s.out = malloc(SERVER_BUFFER);
+    if (s.in == NULL || s.out == NULL) {
+        report_error("Could not allocate the buffers of a connection");
+        free(s.out);
+        free(s.in);
+        return false;
+    }
+
+    /* Engine errors go back to the client instead of stderr */
+    struct report_sink sink = { NULL, NULL, s.error, sizeof(s.error) };
+    report_to(&sink);
+    bool done = false;
+    for (;;) {
+        struct server_request req;
+        size_t got = recv_bytes(&s, &req, sizeof(req));
+        if (got == 0 && !s.broken)
+            done = true;
+        if (got < sizeof(req) || !handle_request(&s, &req))
+            break;
+    }
+    flush(&s);
+    report_to(NULL);
+    if (!done)
+        report_error("A client left partway through a request, or sent one "
+                     "that could not be read");
+
+    arena_free(&s.arena);
+    workspace_free(&s.ws);
+    free(s.out);
+    free(s.in);
+    return done;
+}
+
+/* Start listening on a Unix socket, replacing any socket left there by a
+ * server before.
+ *
+ * pre:  path isn't NULL
+ * post: returns the listening socket, or -1 after reporting an error
+ */
+static int listen_on (const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        report_error("%s: socket path is too long", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+            || listen(fd, SERVER_BACKLOG) < 0) {
+        report_error("%s: %s", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool serve (const char *socket_path, int max_mb)
+{
+    uint64_t max_bytes = (uint64_t) max_mb << 20;
+    // A client that goes away is noticed when writing to it fails
+    signal(SIGPIPE, SIG_IGN);
+    if (socket_path == NULL)
+        return serve_client(STDIN_FILENO, STDOUT_FILENO, max_bytes);
+
+    int listener = listen_on(socket_path);
+    if (listener < 0)
+        return false;
+    fprintf(stderr, "Listening on %s\n", socket_path);
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0 && (errno == EINTR || errno == ECONNABORTED))
+            continue;
+        if (fd < 0) {
+            report_error("%s: %s", socket_path, strerror(errno));
+            break;
+        }
+        serve_client(fd, fd, max_bytes);
+        close(fd);
+    }
+    close(listener);
+    unlink(socket_path);
+    return false;
+}
@@ -0,0 +1,84 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Solving matrices for other programs, one request after another, without
+ * starting a process for each.
+ *
+ * A client sends requests over stdin or a Unix socket, each a fixed 32
+ * byte server_request followed by nrows * ncols doubles, row by row with
+ * no padding. Each gets a 32 byte server_response back, followed by the
+ * result's rows the same way, then one int64_t pivot column per unit of
+ * rank, then length bytes of error message. Responses come back in the
+ * order the requests were sent, and a client may send more before reading
+ * them. Like matrix files, everything is in the byte order of the machine,
+ * which the byte_order fields check.
+ *
+ * Each connection keeps an arena for its matrices and the engines' scratch
+ * space from one request to the next, so once a connection has solved a
+ * matrix, solving more no bigger than it allocates nothing. Connections to
+ * the socket are served one at a time. A request with more entries than
+ * the server takes is answered with SERVER_BAD_REQUEST and skipped over
+ * without allocating anything for it.
+ */
+
+#define SERVER_REQUEST_MAGIC "ECHQ"
+#define SERVER_RESPONSE_MAGIC "ECHR"
+#define SERVER_VERSION 1
+#define SERVER_BYTE_ORDER 0x01020304u
+
+/* Most MB of entries a request may carry, unless the server is told
+ * otherwise */
+#define SERVER_DEFAULT_MB 256
+
+/* What a request asks for */
+enum server_op {
+    SERVER_ECHELON = 1,      // the echelon form, like auto_echelon
+    SERVER_REDUCE = 2,       // the reduced echelon form, in two passes
+    SERVER_GAUSS_JORDAN = 3, // the reduced echelon form, in one pass like -g
+    SERVER_RANK = 4,         // only the rank and pivots, with no rows
+};
+
+/* How a request went */
+enum server_status {
+    SERVER_OK = 0,
+    SERVER_BAD_REQUEST = 1, // not a request that can be served
+    SERVER_FAILED = 2,      // the engine couldn't reach the form asked for
+};
+
+struct server_request {
+    char magic[4];         // SERVER_REQUEST_MAGIC, not NUL terminated
+    uint16_t version;      // SERVER_VERSION
+    uint16_t op;           // an enum server_op
+    uint32_t byte_order;   // SERVER_BYTE_ORDER as the client saw it
+    uint32_t flags;        // zero
+    uint32_t nrows;        // rows of entries that follow
+    uint32_t ncols;        // entries in each
+    uint8_t reserved[8];   // zero
+};
+
+struct server_response {
+    char magic[4];         // SERVER_RESPONSE_MAGIC, not NUL terminated
+    uint16_t version;      // SERVER_VERSION
+    uint16_t status;       // an enum server_status
+    uint32_t byte_order;   // SERVER_BYTE_ORDER
+    int32_t rank;          // pivots that follow the rows, -1 on failure
+    uint32_t nrows;        // rows of entries that follow
+    uint32_t ncols;        // entries in each
+    uint32_t length;       // bytes of error message after the pivots
+    uint8_t reserved[4];   // zero
+};
+
+/* Serve requests until the client is done, or forever on a socket.
+ *
+ * pre:  socket_path is the Unix socket to listen on, or NULL for stdin and
+ *       stdout; max_mb > 0 is the most MB of entries to take in one
+ *       request; the kernels may have been picked and the pool started
+ * post: returns true once stdin ends, false after reporting an error
+ *       that stopped the server
+ */
+bool serve (const char *socket_path, int max_mb);
+
+#endif
@@ -0,0 +1,170 @@
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include "small.h"
+#include "user_io.h"
+
+/* Every size written out, as (rows, columns) */
+#define SMALL_SIZES(X) \
+    X(2, 2) X(2, 3) X(3, 3) X(3, 4) X(4, 4) X(4, 5) X(5, 5) X(5, 6) \
+    X(6, 6) X(6, 7) X(7, 7) X(7, 8) X(8, 8) X(8, 9)
+
+/* The loops below are written once for any size, and inlined into a
+ * function for each size where R and C are constants */
+#define SMALL_INLINE static inline __attribute__((always_inline))
+
+/* dst[j] += s * src[j] for from <= j < C, like add_scaled_from */
+SMALL_INLINE void small_axpy (double *dst, const double *src, double s,
+        int from, int C)
+{
+#pragma GCC unroll 16
+    for (int j = from; j < C; j++)
+        dst[j] += s * src[j];
+}
+
+/* The first nonzero entry of a row from column from on, or C if there
+ * is none, like leading_between */
+SMALL_INLINE int small_leading (const double *row, int from, int C)
+{
+    int j = from;
+    while (j < C && row[j] == 0)
+        j++;
+    return j;
+}
+
+/* The steps of auto_echelon, or of auto_gauss_jordan if above is set, as
+ * echelon_step takes them on an R x C matrix of consecutive rows */
+SMALL_INLINE bool small_forward (double *a, int R, int C, bool above)
+{
+    int leads[SMALL_MAX_ROWS];
+#pragma GCC unroll 16
+    for (int i = 0; i < R; i++)
+        leads[i] = small_leading(a + i * C, 0, C);
+
+    int last_leading = -1;
+    for (int i = 0; i < R; i++) {
+        /* Swap up the rows that lead further left, nearest first */
+        int desired_leading = last_leading + 1;
+        int current_leading = leads[i];
+        for (int k = i + 1; k < R && current_leading != desired_leading; k++) {
+            int k_leading = leads[k];
+            if (k_leading < current_leading) {
+#pragma GCC unroll 16
+                for (int j = 0; j < C; j++) {
+                    double t = a[i * C + j];
+                    a[i * C + j] = a[k * C + j];
+                    a[k * C + j] = t;
+                }
+                leads[k] = current_leading;
+                leads[i] = k_leading;
+                current_leading = k_leading;
+            }
+        }
+        if (current_leading == C) {
+            return true;
+        } else if (current_leading < last_leading) {
+            report_error("Could not find a row to swap with.");
+            return false;
+        }
+
+        /* Scale the pivot to 1, as scale_pivot does */
+        double *pivot = a + i * C;
+        if (pivot[current_leading] != 1) {
+            double scalar = 1 / pivot[current_leading];
+            if (scalar != 0) {
+#pragma GCC unroll 16
+                for (int j = 0; j < C; j++)
+                    pivot[j] = pivot[j] * scalar;
+                pivot[current_leading] = 1;
+            }
+        }
+        bool finite = true;
+#pragma GCC unroll 16
+        for (int j = 0; j < C; j++)
+            finite = finite && isfinite(pivot[j]);
+
+        /* Cancel out the pivot column, as cancel_task does */
+        for (int k = above ? 0 : i + 1; k < R; k++) {
+            if (k == i)
+                continue;
+            double *row = a + k * C;
+            bool skip_zero = k < i;
+            double temp = -1 * row[current_leading];
+            if ((temp != 0 || !skip_zero) && isfinite(temp))
+                small_axpy(row, pivot, temp, current_leading, C);
+            else if (temp != 0 || !skip_zero)
+                small_axpy(row, pivot, temp, 0, C);
+            if (k < i)
+                continue;
+            if (!finite || !isfinite(temp))
+                leads[k] = small_leading(row, 0, C);
+            else if (leads[k] == current_leading)
+                leads[k] = small_leading(row, current_leading, C);
+        }
+        last_leading = current_leading;
+    }
+    return true;
+}
+
+/* The back pass of auto_reduced_echelon on an R x C matrix in echelon form */
+SMALL_INLINE void small_back (double *a, int R, int C)
+{
+    for (int i = R - 1; i >= 0; i--) {
+        const double *pivot = a + i * C;
+        int lead = small_leading(pivot, 0, C);
+        if (lead == C)
+            continue;
+        for (int k = 0; k < i; k++) {
+            double *row = a + k * C;
+            double temp = -1 * row[lead] / pivot[lead];
+            if (temp != 0 && isfinite(temp))
+                small_axpy(row, pivot, temp, lead, C);
+            else if (temp != 0)
+                small_axpy(row, pivot, temp, 0, C);
+        }
+    }
+}
+
+/* Copy the matrix into a local array, do the work there, and copy it
+ * back, so the compiler is free to keep the entries in registers */
+SMALL_INLINE bool small_run (struct matrix *matrix, enum small_form form,
+        double *a, int R, int C)
+{
+#pragma GCC unroll 16
+    for (int i = 0; i < R; i++)
+        memcpy(a + i * C, matrix_row(matrix, i), C * sizeof(double));
+
+    bool success = true;
+    if (form == SMALL_REDUCED)
+        small_back(a, R, C);
+    else if (form == SMALL_GAUSS_JORDAN)
+        success = small_forward(a, R, C, true);
+    else
+        success = small_forward(a, R, C, false);
+
+#pragma GCC unroll 16
+    for (int i = 0; i < R; i++)
+        memcpy(matrix_row(matrix, i), a + i * C, C * sizeof(double));
+    return success;
+}
+
+typedef bool (*small_fn) (struct matrix *matrix, enum small_form form);
+
+/* One function per size */
+#define SMALL_FN(R, C) \
+    static bool small_##R##x##C (struct matrix *matrix, enum small_form form) \
+    { \
+        double a[R * C]; \
+        return small_run(matrix, form, a, R, C); \
+    }
+SMALL_SIZES(SMALL_FN)
+
+#define SMALL_ENTRY(R, C) [R][C - R] = small_##R##x##C,
+static const small_fn small_table[SMALL_MAX_ROWS + 1][2] = {
+    SMALL_SIZES(SMALL_ENTRY)
+};
+
+bool small_solve (struct matrix *matrix, enum small_form form)
+{
+    return small_table[matrix->nrows][matrix->ncols - matrix->nrows](matrix, form);
+}
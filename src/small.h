@@ -0,0 +1,57 @@
+#ifndef __SMALL_H__
+#define __SMALL_H__
+
+#include <stdbool.h>
+#include "matrix.h"
+
+/* Elimination written out for each size of small matrix.
+ *
+ * For a matrix of a few rows, the general engines spend more time on loop
+ * bookkeeping, kernel calls and leading entry scans than on arithmetic. So
+ * for each size from SMALL_MIN_ROWS up to SMALL_MAX_ROWS rows, square or
+ * with one more column (a system and its right-hand side), the engines are
+ * compiled once more with the size fixed. The loops are then unrolled, and
+ * the matrix is copied into a local array the compiler can keep in
+ * registers.
+ *
+ * The automatic engines hand matrices of these sizes over when they have
+ * nothing to print, record or count. The row operations are the very same
+ * in the same order, rounded like the kernels round them, so the results
+ * match the general engines bit for bit.
+ */
+
+#define SMALL_MIN_ROWS 2
+#define SMALL_MAX_ROWS 8
+
+/* What to bring a small matrix to */
+enum small_form {
+    SMALL_ECHELON,       // echelon form, like auto_echelon
+    SMALL_REDUCED,       // reduced echelon form from echelon form, like
+                         // auto_reduced_echelon
+    SMALL_GAUSS_JORDAN,  // reduced echelon form in one pass, like
+                         // auto_gauss_jordan
+};
+
+/* Check whether a matrix is one of the sizes written out.
+ *
+ * pre:  matrix is initialized
+ * post: returns true if small_solve takes it
+ */
+static inline bool small_fits (const struct matrix *matrix)
+{
+    int extra = matrix->ncols - matrix->nrows;
+    return matrix->nrows >= SMALL_MIN_ROWS && matrix->nrows <= SMALL_MAX_ROWS
+           && (extra == 0 || extra == 1);
+}
+
+/* Do what auto_echelon, auto_reduced_echelon or auto_gauss_jordan would,
+ * with nothing traced.
+ *
+ * pre:  small_fits(matrix), and for SMALL_REDUCED matrix is in echelon
+ *       form
+ * post: returns true if matrix reached the form, false after reporting an
+ *       error as the general engine would
+ */
+bool small_solve (struct matrix *matrix, enum small_form form);
+
+#endif
@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sparse.h"
+
+struct sparse_matrix *sparse_create (int nrows, int ncols)
+{
+    struct sparse_matrix *matrix = malloc(sizeof(*matrix));
+    if (matrix == NULL)
+        return NULL;
+    matrix->nrows = nrows;
+    matrix->ncols = ncols;
+    matrix->rows = calloc(nrows, sizeof(struct sparse_row));
+    if (matrix->rows == NULL) {
+        free(matrix);
+        return NULL;
+    }
+    return matrix;
+}
+
+void sparse_free (struct sparse_matrix *matrix)
+{
+    if (matrix == NULL)
+        return;
+    for (int i = 0; i < matrix->nrows; i++) {
+        free(matrix->rows[i].cols);
+        free(matrix->rows[i].vals);
+    }
+    free(matrix->rows);
+    free(matrix);
+}
+
+/* Make room for a number of entries in a row.
+ *
+ * pre:  row is initialized, cap >= 0
+ * post: returns true if row->cap >= cap, false if memory ran out (in
+ *       which case the row is unchanged)
+ */
+static bool reserve (struct sparse_row *row, int cap)
+{
+    if (row->cap >= cap)
+        return true;
+    int *cols = realloc(row->cols, cap * sizeof(int));
+    if (cols == NULL)
+        return false;
+    row->cols = cols;
+    double *vals = realloc(row->vals, cap * sizeof(double));
+    if (vals == NULL)
+        return false;
+    row->vals = vals;
+    row->cap = cap;
+    return true;
+}
+
+bool sparse_set_row (struct sparse_matrix *matrix, int row, const double *values)
+{
+    struct sparse_row *r = &matrix->rows[row];
+    int nnz = 0;
+    for (int j = 0; j < matrix->ncols; j++)
+        nnz += values[j] != 0;
+    if (!reserve(r, nnz))
+        return false;
+    r->nnz = 0;
+    for (int j = 0; j < matrix->ncols; j++) {
+        if (values[j] != 0) {
+            r->cols[r->nnz] = j;
+            r->vals[r->nnz] = values[j];
+            r->nnz++;
+        }
+    }
+    return true;
+}
+
+struct sparse_matrix *sparse_from_dense (const struct matrix *dense)
+{
+    struct sparse_matrix *matrix = sparse_create(dense->nrows, dense->ncols);
+    if (matrix == NULL) {
+        fprintf(stderr, "Could not allocate a sparse matrix.\n");
+        return NULL;
+    }
+    for (int i = 0; i < dense->nrows; i++) {
+        if (!sparse_set_row(matrix, i, matrix_row(dense, i))) {
+            fprintf(stderr, "Could not allocate a sparse matrix.\n");
+            sparse_free(matrix);
+            return NULL;
+        }
+    }
+    return matrix;
+}
+
+bool sparse_worthwhile (const struct matrix *matrix)
+{
+    long entries = (long) matrix->nrows * matrix->ncols;
+    if (entries < SPARSE_MIN_ENTRIES)
+        return false;
+
+    long limit = (long) (entries * SPARSE_MAX_DENSITY);
+    long nnz = 0;
+    for (int i = 0; i < matrix->nrows; i++) {
+        const double *r = matrix_row(matrix, i);
+        for (int j = 0; j < matrix->ncols; j++)
+            nnz += r[j] != 0;
+        if (nnz > limit)
+            return false;
+    }
+    return true;
+}
+
+long sparse_nonzeroes (const struct sparse_matrix *matrix)
+{
+    long nnz = 0;
+    for (int i = 0; i < matrix->nrows; i++)
+        nnz += matrix->rows[i].nnz;
+    return nnz;
+}
+
+/* dst += scalar * src, leaving out column skip, whose entries the caller
+ * knows cancel out. Entries that come out as exactly 0 are dropped.
+ *
+ * pre:  scratch has room for ncols entries, dst and src are different rows
+ * post: returns true on success, false if memory ran out
+ */
+static bool add_sparse (struct sparse_row *dst, const struct sparse_row *src,
+        double scalar, int skip, struct sparse_row *scratch)
+{
+    int a = 0, b = 0, n = 0;
+    while (a < dst->nnz || b < src->nnz) {
+        int col;
+        double value;
+        if (b == src->nnz || (a < dst->nnz && dst->cols[a] < src->cols[b])) {
+            col = dst->cols[a];
+            value = dst->vals[a++];
+        } else if (a == dst->nnz || src->cols[b] < dst->cols[a]) {
+            col = src->cols[b];
+            value = scalar * src->vals[b++];
+        } else {
+            col = dst->cols[a];
+            value = dst->vals[a++] + scalar * src->vals[b++];
+        }
+        if (col != skip && value != 0) {
+            scratch->cols[n] = col;
+            scratch->vals[n] = value;
+            n++;
+        }
+    }
+    if (!reserve(dst, n))
+        return false;
+    memcpy(dst->cols, scratch->cols, n * sizeof(int));
+    memcpy(dst->vals, scratch->vals, n * sizeof(double));
+    dst->nnz = n;
+    return true;
+}
+
+/* Find the entry of a row in a column.
+ *
+ * pre:  row is initialized
+ * post: returns the value, 0 if the row has no entry there
+ */
+static double entry (const struct sparse_row *row, int col)
+{
+    int lo = 0, hi = row->nnz;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (row->cols[mid] < col)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < row->nnz && row->cols[lo] == col ? row->vals[lo] : 0;
+}
+
+/* Scale a row so its leading entry is exactly 1, the way scale_row would
+ * scale it.
+ *
+ * pre:  row has at least one entry
+ * post: row *= 1/(its leading entry), dropping anything that underflowed
+ */
+static void scale_leading (struct sparse_row *row)
+{
+    double scalar = 1 / row->vals[0];
+    if (scalar == 0)
+        return; // scale_row leaves the row alone too
+    int n = 0;
+    for (int e = 0; e < row->nnz; e++) {
+        double value = e == 0 ? 1 : row->vals[e] * scalar;
+        if (value != 0) {
+            row->cols[n] = row->cols[e];
+            row->vals[n] = value;
+            n++;
+        }
+    }
+    row->nnz = n;
+}
+
+/* Make room for the result of any row operation */
+static bool create_scratch (struct sparse_row *scratch, int ncols)
+{
+    memset(scratch, 0, sizeof(*scratch));
+    if (!reserve(scratch, ncols)) {
+        fprintf(stderr, "Could not allocate the sparse workspace.\n");
+        free(scratch->cols);
+        free(scratch->vals);
+        return false;
+    }
+    return true;
+}
+
+bool sparse_echelon (struct sparse_matrix *matrix, enum trace_mode trace)
+{
+    bool success = false;
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+    struct sparse_row *rows = matrix->rows;
+
+    /* Rows keep their index while being worked on; order and pos say where
+     * each one stands in the matrix as the trace shows it. Every nonzero
+     * row is in the bucket of its leading column, a linked list through
+     * next. */
+    struct sparse_row scratch;
+    int *head = malloc(ncols * sizeof(int));
+    int *next = malloc(nrows * sizeof(int));
+    int *order = malloc(nrows * sizeof(int));
+    int *pos = malloc(nrows * sizeof(int));
+    struct sparse_row *sorted = malloc(nrows * sizeof(struct sparse_row));
+    if (head == NULL || next == NULL || order == NULL || pos == NULL
+            || sorted == NULL || !create_scratch(&scratch, ncols)) {
+        fprintf(stderr, "Could not allocate the sparse workspace.\n");
+        free(head);
+        free(next);
+        free(order);
+        free(pos);
+        free(sorted);
+        return success;
+    }
+    for (int j = 0; j < ncols; j++)
+        head[j] = -1;
+    for (int k = nrows - 1; k >= 0; k--) {
+        order[k] = k;
+        pos[k] = k;
+        if (rows[k].nnz > 0) {
+            next[k] = head[rows[k].cols[0]];
+            head[rows[k].cols[0]] = k;
+        }
+    }
+
+    int i = 0;
+    int col = 0;
+    while (i < nrows) {
+        /* The leftmost leading column is the next pivot column. Every row
+         * in a bucket left of it has already been dealt with. */
+        while (col < ncols && head[col] == -1)
+            col++;
+        if (col == ncols)
+            break; // only rows of zeroes are left
+
+        /* Of the rows leading there, the shortest makes the least fill-in */
+        int pivot = head[col];
+        for (int k = next[pivot]; k != -1; k = next[k]) {
+            if (rows[k].nnz < rows[pivot].nnz
+                    || (rows[k].nnz == rows[pivot].nnz && pos[k] < pos[pivot]))
+                pivot = k;
+        }
+
+        /* Bring it up to row i */
+        if (pos[pivot] != i) {
+            int from = pos[pivot];
+            int other = order[i];
+            order[i] = pivot;
+            order[from] = other;
+            pos[pivot] = i;
+            pos[other] = from;
+            trace_swap(trace, i, from, NULL);
+        }
+
+        if (rows[pivot].vals[0] != 1) {
+            double temp = rows[pivot].vals[0];
+            scale_leading(&rows[pivot]);
+            trace_scale(trace, i, temp, NULL);
+        }
+
+        /* Only the other rows in the bucket have an entry in this column */
+        double pivot_value = rows[pivot].vals[0];
+        int k = head[col];
+        head[col] = -1;
+        while (k != -1) {
+            int k_next = next[k];
+            if (k != pivot) {
+                double temp = -1 * rows[k].vals[0] / pivot_value;
+                if (!add_sparse(&rows[k], &rows[pivot], temp, col, &scratch)) {
+                    fprintf(stderr, "Ran out of memory for the sparse matrix.\n");
+                    goto out;
+                }
+                trace_add(trace, pos[k], temp, i, NULL);
+                if (rows[k].nnz > 0) {
+                    next[k] = head[rows[k].cols[0]];
+                    head[rows[k].cols[0]] = k;
+                }
+            }
+            k = k_next;
+        }
+        i++;
+        col++;
+    }
+
+    /* Put the rows where the trace says they are */
+    for (int p = 0; p < nrows; p++)
+        sorted[p] = rows[order[p]];
+    memcpy(rows, sorted, nrows * sizeof(struct sparse_row));
+    success = true;
+
+out:
+    free(head);
+    free(next);
+    free(order);
+    free(pos);
+    free(sorted);
+    free(scratch.cols);
+    free(scratch.vals);
+    return success;
+}
+
+bool sparse_reduced_echelon (struct sparse_matrix *matrix, enum trace_mode trace)
+{
+    bool success = false;
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+    struct sparse_row *rows = matrix->rows;
+
+    /* For each pivot column, the rows above its pivot with an entry there.
+     * Cancelling a pivot only adds entries right of its column, where every
+     * pivot has already been dealt with, so the lists stay accurate. */
+    struct sparse_row scratch;
+    int *pivot_row = malloc(ncols * sizeof(int));
+    int *start = calloc(ncols + 1, sizeof(int));
+    if (pivot_row == NULL || start == NULL || !create_scratch(&scratch, ncols)) {
+        fprintf(stderr, "Could not allocate the sparse workspace.\n");
+        free(pivot_row);
+        free(start);
+        return success;
+    }
+    for (int j = 0; j < ncols; j++)
+        pivot_row[j] = -1;
+    for (int i = 0; i < nrows; i++) {
+        if (rows[i].nnz > 0)
+            pivot_row[rows[i].cols[0]] = i;
+    }
+    for (int k = 0; k < nrows; k++) {
+        for (int e = 0; e < rows[k].nnz; e++) {
+            int j = rows[k].cols[e];
+            if (pivot_row[j] > k)
+                start[j + 1]++;
+        }
+    }
+    for (int j = 0; j < ncols; j++)
+        start[j + 1] += start[j];
+    int *above = malloc((start[ncols] > 0 ? start[ncols] : 1) * sizeof(int));
+    int *fill = malloc(ncols * sizeof(int));
+    if (above == NULL || fill == NULL) {
+        fprintf(stderr, "Could not allocate the sparse workspace.\n");
+        goto out;
+    }
+    memcpy(fill, start, ncols * sizeof(int));
+    for (int k = 0; k < nrows; k++) {
+        for (int e = 0; e < rows[k].nnz; e++) {
+            int j = rows[k].cols[e];
+            if (pivot_row[j] > k)
+                above[fill[j]++] = k;
+        }
+    }
+
+    /* Cancel out what you can in all the rows above, bottom up */
+    for (int i = nrows - 1; i >= 0; i--) {
+        if (rows[i].nnz == 0)
+            continue;
+        int col = rows[i].cols[0];
+        double pivot_value = rows[i].vals[0];
+        for (int e = start[col + 1] - 1; e >= start[col]; e--) {
+            int k = above[e];
+            double temp = -1 * entry(&rows[k], col) / pivot_value;
+            if (temp == 0)
+                continue;
+            if (!add_sparse(&rows[k], &rows[i], temp, col, &scratch)) {
+                fprintf(stderr, "Ran out of memory for the sparse matrix.\n");
+                goto out;
+            }
+            trace_add(trace, k, temp, i, NULL);
+        }
+    }
+    success = true;
+
+out:
+    free(pivot_row);
+    free(start);
+    free(above);
+    free(fill);
+    free(scratch.cols);
+    free(scratch.vals);
+    return success;
+}
+
+int sparse_pivot_columns (const struct sparse_matrix *matrix, int *pivots)
+{
+    int rank = 0;
+    for (int i = 0; i < matrix->nrows; i++) {
+        if (matrix->rows[i].nnz > 0)
+            pivots[rank++] = matrix->rows[i].cols[0];
+    }
+    return rank;
+}
@@ -0,0 +1,107 @@
+#ifndef __SPARSE_H__
+#define __SPARSE_H__
+
+#include <stdbool.h>
+#include "matrix.h"
+#include "user_io.h"
+
+/* Matrices that are mostly zeroes, stored as a list of nonzero entries per
+ * row. Memory and the cost of row operations grow with the number of
+ * nonzeroes rather than with nrows * ncols.
+ */
+
+/* Inputs with at most this fraction of nonzero entries go to the sparse
+ * engine, as long as they are big enough for it to matter */
+#define SPARSE_MAX_DENSITY 0.10
+#define SPARSE_MIN_ENTRIES (128 * 128)
+
+/* The nonzero entries of one row, in order of column */
+struct sparse_row {
+    int nnz;      // number of entries in use
+    int cap;      // number of entries allocated
+    int *cols;    // column of each entry, strictly increasing
+    double *vals; // value of each entry, never 0
+};
+
+struct sparse_matrix {
+    int nrows;
+    int ncols;
+    struct sparse_row *rows;
+};
+
+/* Make an empty (all zero) sparse matrix.
+ *
+ * pre:  nrows > 0, ncols > 0
+ * post: returns the matrix, or NULL if it could not be allocated
+ */
+struct sparse_matrix *sparse_create (int nrows, int ncols);
+
+/* Free a sparse matrix.
+ *
+ * pre:  matrix came from sparse_create or sparse_from_dense, or is NULL
+ * post: its memory is released
+ */
+void sparse_free (struct sparse_matrix *matrix);
+
+/* Set the entries of a row from a dense row, leaving out the zeroes.
+ *
+ * pre:  values holds ncols doubles
+ * post: returns true on success, false if memory ran out
+ */
+bool sparse_set_row (struct sparse_matrix *matrix, int row, const double *values);
+
+/* Make a sparse copy of a dense matrix.
+ *
+ * pre:  dense is initialized
+ * post: returns the copy, or NULL after reporting an error
+ */
+struct sparse_matrix *sparse_from_dense (const struct matrix *dense);
+
+/* Decide whether a dense matrix is sparse enough for the sparse engine.
+ *
+ * pre:  matrix is initialized
+ * post: returns true if it is big and its density is at most
+ *       SPARSE_MAX_DENSITY
+ */
+bool sparse_worthwhile (const struct matrix *matrix);
+
+/* Count the nonzero entries of a sparse matrix.
+ *
+ * pre:  matrix is initialized
+ * post: returns the number of stored entries
+ */
+long sparse_nonzeroes (const struct sparse_matrix *matrix);
+
+/* Put a sparse matrix into echelon form.
+ *
+ * Pivot columns are taken left to right like auto_echelon, so the result
+ * has the same pivot columns and, after reduction, the same reduced form
+ * (up to rounding). Where several rows could supply a pivot, the one with
+ * the fewest entries is used, which keeps fill-in down: every other row
+ * with an entry in the pivot column gains at most that many entries.
+ * Entries of the pivot column are dropped from the rows below rather than
+ * left as rounding residue. Rows never touched by a pivot cost nothing.
+ *
+ * pre:  matrix is initialized, trace is not TRACE_FULL
+ * post: returns true if reached echelon form, false otherwise
+ */
+bool sparse_echelon (struct sparse_matrix *matrix, enum trace_mode trace);
+
+/* Given a sparse matrix in echelon form, cancel out the entries above each
+ * pivot.
+ *
+ * pre:  matrix was put in echelon form by sparse_echelon, trace is not
+ *       TRACE_FULL
+ * post: returns true if reached reduced echelon form, false otherwise
+ */
+bool sparse_reduced_echelon (struct sparse_matrix *matrix, enum trace_mode trace);
+
+/* Find the pivot columns of a sparse matrix in echelon form.
+ *
+ * pre:  matrix is in echelon form, pivots has room for nrows ints
+ * post: stores the leading column of each nonzero row in pivots, and
+ *       returns how many there are (the rank)
+ */
+int sparse_pivot_columns (const struct sparse_matrix *matrix, int *pivots);
+
+#endif
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <time.h>
+#include "stats.h"
+
+bool stats_enabled = false;
+int64_t stats_counts[NSTAT_COUNTERS];
+
+/* Nanoseconds spent in each phase */
+static int64_t phase_ns[NSTAT_PHASES];
+
+static const char *counter_names[NSTAT_COUNTERS] = {
+    "swaps", "scales", "row_adds", "flops", "leading_scans",
+    "refinements", "factorizations", "bytes_read", "bytes_written",
+};
+
+static const char *phase_names[NSTAT_PHASES] = {
+    "read", "echelon", "reduced", "pivot_search", "row_updates", "print",
+};
+
+void stats_enable (void)
+{
+    stats_enabled = true;
+}
+
+int64_t stats_start (void)
+{
+    if (!stats_enabled)
+        return 0;
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+void stats_stop (enum stats_phase phase, int64_t start)
+{
+    if (!stats_enabled)
+        return;
+    __atomic_fetch_add(&phase_ns[phase], stats_start() - start, __ATOMIC_RELAXED);
+}
+
+void stats_report (enum stats_format format)
+{
+    /* Rate of the row operations over the time spent solving */
+    int64_t solve_ns = phase_ns[PHASE_ECHELON] + phase_ns[PHASE_REDUCED];
+    double gflops = solve_ns > 0 ? (double) stats_counts[STAT_FLOPS] / solve_ns : 0;
+
+    if (format == STATS_JSON) {
+        fprintf(stderr, "{\"counters\": {");
+        for (int c = 0; c < NSTAT_COUNTERS; c++)
+            fprintf(stderr, "%s\"%s\": %lld", c ? ", " : "", counter_names[c],
+                    (long long) stats_counts[c]);
+        fprintf(stderr, "}, \"phases_ms\": {");
+        for (int p = 0; p < NSTAT_PHASES; p++)
+            fprintf(stderr, "%s\"%s\": %.3f", p ? ", " : "", phase_names[p],
+                    phase_ns[p] / 1e6);
+        fprintf(stderr, "}, \"gflops\": %.3f}\n", gflops);
+        return;
+    }
+
+    fprintf(stderr, "Statistics:\n");
+    for (int c = 0; c < NSTAT_COUNTERS; c++)
+        fprintf(stderr, "  %-14s %14lld\n", counter_names[c],
+                (long long) stats_counts[c]);
+    for (int p = 0; p < NSTAT_PHASES; p++)
+        fprintf(stderr, "  %-14s %11.3f ms\n", phase_names[p], phase_ns[p] / 1e6);
+    fprintf(stderr, "  %-14s %14.3f\n", "gflops", gflops);
+}
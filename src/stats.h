@@ -0,0 +1,102 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Counters and phase timers for finding out where a run spends its time.
+ *
+ * Everything is off until stats_enable is called. While off, counting is a
+ * single test of stats_enabled, and timing doesn't read the clock at all.
+ * While on, counts and times are added atomically, since the row
+ * operations run on the worker threads of the pool.
+ *
+ * The counters cover the dense engines (automatic.c, blocked.c and the row
+ * operations in matrix_proc.c), the flops and refinements of mixed.c, and
+ * the flops and factorizations of lu.c, and the bytes outcore.c reads and
+ * writes.
+ * The read, echelon, reduced and print phases are timed for every engine.
+ * Pivot search and row updates are only timed step by step, outside the
+ * blocked engine, and are part of the echelon or reduced phase they happen
+ * in. Time spent printing the steps is part of
+ * that phase too.
+ */
+
+/* What gets counted */
+enum stats_counter {
+    STAT_SWAPS,         // rows swapped
+    STAT_SCALES,        // rows scaled
+    STAT_ADDS,          // multiples of one row added to another
+    STAT_FLOPS,         // floating point operations in those row operations
+    STAT_LEADING_SCANS, // searches of a row for its leading entry
+    STAT_REFINEMENTS,   // corrections to a solution in mixed precision
+    STAT_FACTORIZATIONS, // coefficient matrices factored for lu.c
+    STAT_BYTES_READ,    // bytes of a matrix file read by outcore.c
+    STAT_BYTES_WRITTEN, // and written back
+    NSTAT_COUNTERS,
+};
+
+/* What gets timed */
+enum stats_phase {
+    PHASE_READ,         // parsing the input
+    PHASE_ECHELON,      // finding the echelon form
+    PHASE_REDUCED,      // finding the reduced echelon form
+    PHASE_PIVOT_SEARCH, // looking for the next pivot row
+    PHASE_ROW_UPDATES,  // scaling the pivot row and cancelling its column
+    PHASE_PRINT,        // printing matrices and steps
+    NSTAT_PHASES,
+};
+
+/* How to write the report */
+enum stats_format {
+    STATS_TEXT, // a table for people
+    STATS_JSON, // one JSON object for scripts
+};
+
+/* Whether anything is being counted, read by stats_count */
+extern bool stats_enabled;
+
+/* Totals so far, only meant to be touched through the functions below */
+extern int64_t stats_counts[NSTAT_COUNTERS];
+
+/* Start counting and timing.
+ *
+ * pre:  no other thread is running
+ * post: counts and phase times are collected from now on
+ */
+void stats_enable (void);
+
+/* Add to a counter.
+ *
+ * pre:  none
+ * post: the counter has gone up by n, if stats are enabled
+ */
+static inline void stats_count (enum stats_counter counter, int64_t n)
+{
+    if (stats_enabled)
+        __atomic_fetch_add(&stats_counts[counter], n, __ATOMIC_RELAXED);
+}
+
+/* Start timing a phase.
+ *
+ * pre:  none
+ * post: returns a start time to give stats_stop, 0 if stats are disabled
+ */
+int64_t stats_start (void);
+
+/* Finish timing a phase.
+ *
+ * pre:  start came from stats_start
+ * post: the time since start has been added to the phase, if stats are
+ *       enabled
+ */
+void stats_stop (enum stats_phase phase, int64_t start);
+
+/* Write the counts and phase times to stderr.
+ *
+ * pre:  stats_enable was called, no pool_for call is in progress
+ * post: the report has been written
+ */
+void stats_report (enum stats_format format);
+
+#endif
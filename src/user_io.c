@@ -1,77 +1,582 @@
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "exact.h"
+#include "format.h"
+#include "gf2.h"
+#include "journal.h"
+#include "modp.h"
+#include "sparse.h"
+#include "stats.h"
 #include "user_io.h"
 
-void print_matrix (int nrows, int ncols, double matrix[nrows][ncols])
+void print_matrix (const struct matrix *matrix)
 {
+    fprint_matrix(stdout, matrix);
+}
+
+void fprint_matrix (FILE *out, const struct matrix *matrix)
+{
+    int64_t start = stats_start();
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+    struct formatter f;
+    formatter_start(&f, out, matrix_format);
+    for (int i = 0; i < nrows && formatter_aligned(&f); i++) {
+        const double *row = matrix_row(matrix, i);
+        for (int j = 0; j < ncols; j++)
+            formatter_fit(&f, row[j]);
+    }
+    formatter_banner(&f, ncols);
+    for (int i = 0; i < nrows; i++) {
+        const double *row = matrix_row(matrix, i);
+        for (int j = 0; j < ncols; j++)
+            formatter_entry(&f, row[j], j == ncols-1);
+    }
+    formatter_finish(&f);
+    stats_stop(PHASE_PRINT, start);
+}
+
+void print_sparse_matrix (const struct sparse_matrix *matrix)
+{
+    int64_t start = stats_start();
+    int ncols = matrix->ncols;
+    struct formatter f;
+    formatter_start(&f, stdout, matrix_format);
+    if (formatter_aligned(&f)) {
+        formatter_fit(&f, 0.0);
+        for (int i = 0; i < matrix->nrows; i++) {
+            const struct sparse_row *row = &matrix->rows[i];
+            for (int e = 0; e < row->nnz; e++)
+                formatter_fit(&f, row->vals[e]);
+        }
+    }
+    formatter_banner(&f, ncols);
+    for (int i = 0; i < matrix->nrows; i++) {
+        const struct sparse_row *row = &matrix->rows[i];
+        int e = 0;
+        for (int j = 0; j < ncols; j++) {
+            double value = 0.0;
+            if (e < row->nnz && row->cols[e] == j)
+                value = row->vals[e++];
+            formatter_entry(&f, value, j == ncols-1);
+        }
+    }
+    formatter_finish(&f);
+    stats_stop(PHASE_PRINT, start);
+}
+
+bool print_exact_matrix (const struct exact_matrix *matrix)
+{
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+
+    /* Every entry has to be written out before the widths are known */
+    int64_t start = stats_start();
+    size_t n = (size_t) nrows * ncols;
+    char **strings = calloc(n, sizeof(char *));
+    int *widths = calloc(ncols, sizeof(int));
+    bool success = strings != NULL && widths != NULL;
+    for (int i = 0; i < nrows && success; i++) {
+        for (int j = 0; j < ncols && success; j++) {
+            char *s = exact_entry_string(matrix, i, j);
+            strings[(size_t) i * ncols + j] = s;
+            if (s == NULL)
+                success = false;
+            else if ((int) strlen(s) > widths[j])
+                widths[j] = strlen(s);
+        }
+    }
+
+    if (success) {
+        for (int i = 0; i < ncols+2; i++)
+            printf("*****");
+        printf("\n");
+        for (int i = 0; i < nrows; i++) {
+            for (int j = 0; j < ncols; j++)
+                printf("%*s ", widths[j], strings[(size_t) i * ncols + j]);
+            printf("\n");
+        }
+        printf("\n");
+    }
+    for (size_t k = 0; strings != NULL && k < n; k++)
+        free(strings[k]);
+    free(strings);
+    free(widths);
+    stats_stop(PHASE_PRINT, start);
+    return success;
+}
+
+void print_modp_matrix (const struct modp_matrix *matrix)
+{
+    int64_t start = stats_start();
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+    int *widths = calloc(ncols, sizeof(int));
+    for (int j = 0; j < ncols; j++) {
+        uint64_t widest = 0;
+        for (int i = 0; i < nrows; i++) {
+            if (MODP(matrix, i, j) > widest)
+                widest = MODP(matrix, i, j);
+        }
+        int width = 1;
+        for (; widest >= 10; widest /= 10)
+            width++;
+        if (widths != NULL)
+            widths[j] = width;
+    }
+
     for (int i = 0; i < ncols+2; i++)
         printf("*****");
     printf("\n");
     for (int i = 0; i < nrows; i++) {
-        for (int j = 0; j < ncols; j++) {
-            if (matrix[i][j] == -0) {
-                matrix[i][j] = 0.0;
-            }
-            printf("%5.4lf ", matrix[i][j]);
-        }
+        for (int j = 0; j < ncols; j++)
+            printf("%*llu ", widths != NULL ? widths[j] : 1,
+                   (unsigned long long) MODP(matrix, i, j));
         printf("\n");
     }
     printf("\n");
+    free(widths);
+    stats_stop(PHASE_PRINT, start);
+}
+
+void print_gf2_matrix (const struct gf2_matrix *matrix)
+{
+    int64_t start = stats_start();
+    for (int i = 0; i < matrix->ncols+2; i++)
+        printf("*****");
+    printf("\n");
+    /* Build each row as a line rather than printing entry by entry,
+     * since these matrices can be huge */
+    char *line = malloc(2 * (size_t) matrix->ncols + 2);
+    for (int i = 0; i < matrix->nrows; i++) {
+        if (line == NULL) {
+            for (int j = 0; j < matrix->ncols; j++)
+                printf("%d ", GF2(matrix, i, j));
+            printf("\n");
+            continue;
+        }
+        char *end = line;
+        for (int j = 0; j < matrix->ncols; j++) {
+            *end++ = '0' + GF2(matrix, i, j);
+            *end++ = ' ';
+        }
+        *end++ = '\n';
+        fwrite(line, 1, end - line, stdout);
+    }
+    printf("\n");
+    free(line);
+    stats_stop(PHASE_PRINT, start);
+}
+
+/* The sink of this thread, if any */
+static __thread struct report_sink *sink;
+
+void report_to (struct report_sink *new_sink)
+{
+    sink = new_sink;
+}
+
+void report_error (const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    if (sink == NULL) {
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "\n");
+    } else if (sink->error != NULL) {
+        vsnprintf(sink->error, sink->error_size, format, args);
+    }
+    va_end(args);
+}
+
+/* Pass a row operation on to the journal and the thread's sink.
+ *
+ * pre:  the operation was just done
+ * post: none
+ */
+static void record_step (enum journal_op op, int row1, int row2, double scalar)
+{
+    journal_record(op, row1, row2, scalar);
+    if (sink != NULL && sink->step != NULL)
+        sink->step(sink->arg, op, row1, row2, scalar);
+}
+
+bool tracing (enum trace_mode trace)
+{
+    return trace != TRACE_QUIET || journal_active()
+           || (sink != NULL && sink->step != NULL);
+}
+
+void trace_swap (enum trace_mode trace, int row1, int row2,
+        struct matrix *matrix)
+{
+    record_step(JOURNAL_SWAP, row1, row2, 0);
+    if (trace != TRACE_QUIET) {
+        int64_t start = stats_start();
+        printf("swap R%d <--> R%d\n", row1+1, row2+1);
+        stats_stop(PHASE_PRINT, start);
+    }
+    if (trace == TRACE_FULL)
+        print_matrix(matrix);
+}
+
+void trace_scale (enum trace_mode trace, int row, double pivot,
+        struct matrix *matrix)
+{
+    record_step(JOURNAL_SCALE, row, -1, 1/pivot); // what scale_row was given
+    if (trace != TRACE_QUIET) {
+        int64_t start = stats_start();
+        printf("scale (1/%.2lf) * R%d\n", pivot, row+1);
+        stats_stop(PHASE_PRINT, start);
+    }
+    if (trace == TRACE_FULL)
+        print_matrix(matrix);
+}
+
+void trace_add (enum trace_mode trace, int row1, double scalar, int row2,
+        struct matrix *matrix)
+{
+    record_step(JOURNAL_ADD, row1, row2, scalar);
+    if (trace != TRACE_QUIET) {
+        int64_t start = stats_start();
+        printf("add R%d + (%.2lf * R%d)\n", row1+1, scalar, row2+1);
+        stats_stop(PHASE_PRINT, start);
+    }
+    if (trace == TRACE_FULL)
+        print_matrix(matrix);
+}
+
+void trace_modp (enum trace_mode trace, const struct modp_matrix *matrix,
+        const char *format, ...)
+{
+    if (trace != TRACE_QUIET) {
+        int64_t start = stats_start();
+        va_list args;
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+        printf("\n");
+        stats_stop(PHASE_PRINT, start);
+    }
+    if (trace == TRACE_FULL)
+        print_modp_matrix(matrix);
+}
+
+void trace_gf2 (enum trace_mode trace, const struct gf2_matrix *matrix,
+        const char *format, ...)
+{
+    if (trace != TRACE_QUIET) {
+        int64_t start = stats_start();
+        va_list args;
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+        printf("\n");
+        stats_stop(PHASE_PRINT, start);
+    }
+    if (trace == TRACE_FULL)
+        print_gf2_matrix(matrix);
+}
+
+/* Tell a person at the keyboard how to enter the matrix.
+ *
+ * pre:  in is open
+ * post: prints the instructions if in is prompting
+ */
+static void prompt_matrix (struct reader *in)
+{
+    if (in->prompt)
+        printf("Next, enter the matrix. Put spaces or commas between columns,\n"
+               "and press enter for each row. Fractions like -1/3 are fine.\n"
+               "Here is an example:\n\n"
+               "3 4 5\n6 7 8\n1 9 0\n\n"
+               "Enter your matrix below.\n\n");
+}
+
+/* Read the entries of one row.
+ *
+ * pre:  in is open, row has room for ncols doubles, i is the row's index
+ * post: returns true if all of them were read, false after reporting the
+ *       row and column of the problem
+ */
+static bool read_row (struct reader *in, double *row, int i, int nrows, int ncols)
+{
+    for (int j = 0; j < ncols; j++) {
+        bool number;
+        char *tok = reader_double(in, &row[j], &number);
+        if (tok == NULL) {
+            fprintf(stderr, "Input ended before row %d, column %d "
+                            "(expected %d x %d values).\n",
+                            i+1, j+1, nrows, ncols);
+            return false;
+        } else if (!number) {
+            fprintf(stderr, "Could not read a value for row %d, column %d "
+                            "on line %ld: \"%.20s%s\" is not a number.\n",
+                            i+1, j+1, in->line, tok,
+                            strlen(tok) > 20 ? "..." : "");
+            return false;
+        }
+    }
+    return true;
 }
 
-bool read_matrix_stdin (int nrows, int ncols, double matrix[nrows][ncols])
+bool read_matrix (struct reader *in, struct matrix *matrix)
 {
     bool success = false;
-    int num_read;
 
-    printf("Next, enter the matrix. Put spaces between columns,\n"
-           "and press enter for each row.\n"
-           "Here is an example:\n\n"
-           "3 4 5\n6 7 8\n1 9 0\n\n"
-           "Enter your matrix below.\n\n");
+    prompt_matrix(in);
+
+    /* Parse numbers into the array */
+    for (int i = 0; i < matrix->nrows; i++) {
+        if (!read_row(in, matrix_row(matrix, i), i, matrix->nrows, matrix->ncols))
+            return success;
+    }
+    reader_skip_line(in); // clear out the line to be a good citizen
+
+    if (in->prompt)
+        printf("\n"); // formatting before we go into the calculations
+    success = true;
+    return success;
+}
+
+bool read_sparse_matrix (struct reader *in, struct sparse_matrix *matrix)
+{
+    bool success = false;
 
-    /* Scan doubles into the array */
+    /* Only one row is ever held densely */
+    double *row = malloc(matrix->ncols * sizeof(double));
+    if (row == NULL) {
+        fprintf(stderr, "Could not allocate a row buffer.\n");
+        return success;
+    }
+
+    prompt_matrix(in);
+    for (int i = 0; i < matrix->nrows; i++) {
+        if (!read_row(in, row, i, matrix->nrows, matrix->ncols)) {
+            free(row);
+            return success;
+        } else if (!sparse_set_row(matrix, i, row)) {
+            fprintf(stderr, "Ran out of memory for the sparse matrix.\n");
+            free(row);
+            return success;
+        }
+    }
+    reader_skip_line(in);
+    free(row);
+
+    if (in->prompt)
+        printf("\n");
+    success = true;
+    return success;
+}
+
+bool read_exact_matrix (struct reader *in, struct exact_matrix *matrix)
+{
+    bool success = false;
+    int nrows = matrix->nrows;
+    int ncols = matrix->ncols;
+
+    /* One row of fractions at a time, before their denominators are
+     * cleared */
+    struct bigint *nums = malloc(ncols * sizeof(struct bigint));
+    struct bigint *dens = malloc(ncols * sizeof(struct bigint));
+    if (nums == NULL || dens == NULL) {
+        fprintf(stderr, "Could not allocate a row buffer.\n");
+        free(nums);
+        free(dens);
+        return success;
+    }
+    for (int j = 0; j < ncols; j++) {
+        bigint_init(&nums[j]);
+        bigint_init(&dens[j]);
+    }
+
+    prompt_matrix(in);
     for (int i = 0; i < nrows; i++) {
         for (int j = 0; j < ncols; j++) {
-            num_read = scanf("%lf", &matrix[i][j]);
-            if (num_read == 0) {
-                printf("Could not read a value.\n");
-                return success;
+            char *tok = reader_token(in);
+            if (tok == NULL) {
+                fprintf(stderr, "Input ended before row %d, column %d "
+                                "(expected %d x %d values).\n",
+                                i+1, j+1, nrows, ncols);
+                goto out;
+            } else if (!parse_rational(tok, &nums[j], &dens[j])) {
+                fprintf(stderr, "Could not read a value for row %d, column %d "
+                                "on line %ld: \"%.20s%s\" is not a number.\n",
+                                i+1, j+1, in->line, tok,
+                                strlen(tok) > 20 ? "..." : "");
+                goto out;
             }
         }
+        if (!exact_set_row(matrix, i, nums, dens)) {
+            fprintf(stderr, "Ran out of memory for the exact matrix.\n");
+            goto out;
+        }
     }
-    while (getchar() != '\n') // clear out the buffer to be a good citizen 
-        ;
+    reader_skip_line(in);
 
-    printf("\n"); // formatting before we go into the calculations
+    if (in->prompt)
+        printf("\n");
     success = true;
+out:
+    for (int j = 0; j < ncols; j++) {
+        bigint_clear(&nums[j]);
+        bigint_clear(&dens[j]);
+    }
+    free(nums);
+    free(dens);
     return success;
 }
 
-bool read_size_stdin (int * nrows, int * ncols)
+bool read_modp_matrix (struct reader *in, struct modp_matrix *matrix)
+{
+    prompt_matrix(in);
+    for (int i = 0; i < matrix->nrows; i++) {
+        for (int j = 0; j < matrix->ncols; j++) {
+            char *tok = reader_token(in);
+            if (tok == NULL) {
+                fprintf(stderr, "Input ended before row %d, column %d "
+                                "(expected %d x %d values).\n",
+                                i+1, j+1, matrix->nrows, matrix->ncols);
+                return false;
+            } else if (!parse_modular(tok, matrix->p, &MODP(matrix, i, j))) {
+                fprintf(stderr, "Could not read a value for row %d, column %d "
+                                "on line %ld: \"%.20s%s\" is not a number mod %llu.\n",
+                                i+1, j+1, in->line, tok,
+                                strlen(tok) > 20 ? "..." : "",
+                                (unsigned long long) matrix->p);
+                return false;
+            }
+        }
+    }
+    reader_skip_line(in);
+
+    if (in->prompt)
+        printf("\n");
+    return true;
+}
+
+bool read_gf2_matrix (struct reader *in, struct gf2_matrix *matrix)
+{
+    prompt_matrix(in);
+    for (int i = 0; i < matrix->nrows; i++) {
+        for (int j = 0; j < matrix->ncols; j++) {
+            char *tok = reader_token(in);
+            uint64_t value;
+            if (tok == NULL) {
+                fprintf(stderr, "Input ended before row %d, column %d "
+                                "(expected %d x %d values).\n",
+                                i+1, j+1, matrix->nrows, matrix->ncols);
+                return false;
+            } else if ((tok[0] == '0' || tok[0] == '1') && tok[1] == '\0') {
+                value = tok[0] - '0'; // nearly every entry, so skip parsing
+            } else if (!parse_modular(tok, 2, &value)) {
+                fprintf(stderr, "Could not read a value for row %d, column %d "
+                                "on line %ld: \"%.20s%s\" is not a number mod 2.\n",
+                                i+1, j+1, in->line, tok,
+                                strlen(tok) > 20 ? "..." : "");
+                return false;
+            }
+            if (value)
+                gf2_set(matrix, i, j, 1);
+        }
+    }
+    reader_skip_line(in);
+
+    if (in->prompt)
+        printf("\n");
+    return true;
+}
+
+/* Read one dimension of the matrix.
+ *
+ * pre:  in is open, what names the dimension for error messages
+ * post: returns true and stores the dimension on success, false otherwise
+ */
+static bool read_dimension (struct reader *in, const char *what, int *dim)
+{
+    char *tok = reader_token(in);
+    if (tok == NULL || !parse_int(tok, dim)) {
+        fprintf(stderr, "Failed to read number of %s on line %ld. "
+                        "Make sure it was an integer.\n", what, in->line);
+        return false;
+    }
+    return true;
+}
+
+bool read_size (struct reader *in, int * nrows, int * ncols)
 {
     bool success = false;
-    int num_read;
 
-    printf("This program will calculate the echelon form\n"
-           "of a matrix that you input.\n"
-           "First, enter the size of your matrix:\n");
+    if (in->prompt)
+        printf("This program will calculate the echelon form\n"
+               "of a matrix that you input.\n"
+               "First, enter the size of your matrix:\n");
+
+    if (in->prompt)
+        printf("Number of rows? ");
+    if (!read_dimension(in, "rows", nrows))
+        return success;
+
+    if (in->prompt)
+        printf("Number of columns? ");
+    if (!read_dimension(in, "columns", ncols))
+        return success;
 
-    printf("Number of rows? ");
-    num_read = scanf("%d", nrows);
-    if (num_read == 0) {
-        fprintf(stderr, "Failed to read number of rows. Make sure it was an integer.\n");
+    /* Reject sizes we can't build a matrix out of */
+    if (*nrows <= 0 || *ncols <= 0) {
+        fprintf(stderr, "The matrix must have at least one row and one column.\n");
         return success;
     }
 
-    printf("Number of columns? ");
-    num_read = scanf("%d", ncols);
-    if (num_read == 0) {
-        fprintf(stderr, "Failed to read number of rows. Make sure it was an integer.\n");
+    success = true;
+    return success;
+}
+
+bool read_columns (struct reader *in, int *ncols)
+{
+    bool success = false;
+
+    if (in->prompt)
+        printf("This program will keep the reduced echelon form of a matrix\n"
+               "up to date as you add rows to it, and end when the input does.\n"
+               "Number of columns? ");
+    if (!read_dimension(in, "columns", ncols))
+        return success;
+    if (*ncols <= 0) {
+        fprintf(stderr, "The matrix must have at least one column.\n");
         return success;
     }
+    reader_skip_line(in);
 
     success = true;
     return success;
 }
 
+int read_next_row (struct reader *in, double *row, int i, int ncols)
+{
+    if (in->prompt)
+        printf("Row %d? ", i+1);
+    for (int j = 0; j < ncols; j++) {
+        bool number;
+        char *tok = reader_double(in, &row[j], &number);
+        if (tok == NULL && j == 0) {
+            if (in->prompt)
+                printf("\n");
+            return 0;
+        } else if (tok == NULL) {
+            fprintf(stderr, "Input ended partway through row %d, at column %d "
+                            "(expected %d values).\n", i+1, j+1, ncols);
+            return -1;
+        } else if (!number) {
+            fprintf(stderr, "Could not read a value for row %d, column %d "
+                            "on line %ld: \"%.20s%s\" is not a number.\n",
+                            i+1, j+1, in->line, tok,
+                            strlen(tok) > 20 ? "..." : "");
+            return -1;
+        }
+    }
+    return 1;
+}
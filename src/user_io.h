@@ -2,27 +2,217 @@
 #define __USER_IO_H__
 
 #include <stdbool.h>
+#include <stdio.h>
+#include "journal.h"
+#include "matrix.h"
+#include "reader.h"
 
-/* Initialize a matrix from stdin.
+struct sparse_matrix; // see sparse.h
+struct exact_matrix;  // see exact.h
+struct modp_matrix;   // see modp.h
+struct gf2_matrix;    // see gf2.h
+
+/* How much of the work to print while solving */
+enum trace_mode {
+    TRACE_FULL,    // each row operation, followed by the whole matrix
+    TRACE_SUMMARY, // each row operation on one line, no matrices
+    TRACE_QUIET,   // nothing at all, the caller prints the result
+};
+
+/* Where the reports of one thread go instead of stdout and stderr, for
+ * callers that embed the engines rather than run the program */
+struct report_sink {
+    /* Called with every row operation given to trace_swap, trace_scale
+     * and trace_add, in the form a journal records it, or NULL */
+    void (*step) (void *arg, enum journal_op op, int row1, int row2,
+                  double scalar);
+    void *arg;
+    char *error;       // where report_error leaves its message, or NULL
+    size_t error_size; // room there, counting the NUL
+};
+
+/* Send the reports of the calling thread to a sink, or back to stdout and
+ * stderr.
  *
- * pre:  none
- * post: reads values from stdin into matrix
+ * pre:  sink is NULL, or stays valid until the next call
+ * post: trace functions and report_error called on this thread use sink
+ */
+void report_to (struct report_sink *sink);
+
+/* Report an error, like fprintf to stderr with a newline added, unless
+ * the calling thread has a sink, in which case the message goes there.
+ *
+ * pre:  format is a printf format with no trailing newline
+ * post: none
+ */
+void report_error (const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/* Initialize a matrix from a reader, prompting if a person is typing.
+ *
+ * pre:  in is open, matrix has been created with the expected size
+ * post: reads values from in into matrix, returns false and reports the
+ *       row and column of the problem if the input is bad
+ */
+bool read_matrix (struct reader *in, struct matrix *matrix);
+
+/* Like read_matrix, but for a sparse matrix, which only ever stores the
+ * nonzero entries.
+ *
+ * pre:  in is open, matrix has been created with the expected size
+ * post: reads values from in into matrix, returns false and reports the
+ *       row and column of the problem if the input is bad
+ */
+bool read_sparse_matrix (struct reader *in, struct sparse_matrix *matrix);
+
+/* Like read_matrix, but for an exact matrix, which keeps every value as
+ * written instead of rounding it to a double.
+ *
+ * pre:  in is open, matrix has been created with the expected size
+ * post: reads values from in into matrix, returns false and reports the
+ *       row and column of the problem if the input is bad
+ */
+bool read_exact_matrix (struct reader *in, struct exact_matrix *matrix);
+
+/* Like read_matrix, but for a matrix mod p, which reduces every value as
+ * it is read.
+ *
+ * pre:  in is open, matrix has been created with the expected size
+ * post: reads values from in into matrix, returns false and reports the
+ *       row and column of the problem if the input is bad
+ */
+bool read_modp_matrix (struct reader *in, struct modp_matrix *matrix);
+
+/* Like read_modp_matrix, but for a matrix mod 2, packed into bits.
+ *
+ * pre:  in is open, matrix has been created with the expected size
+ * post: reads values from in into matrix, returns false and reports the
+ *       row and column of the problem if the input is bad
+ */
+bool read_gf2_matrix (struct reader *in, struct gf2_matrix *matrix);
+
+/* Read the dimensions of an array from a reader, prompting if a person
+ * is typing.
+ *
+ * pre:  in is open
+ * post: nrows and ncols will reflect the user's input, and are both positive
+ */
+bool read_size (struct reader *in, int* nrows, int* ncols);
+
+/* Read just the number of columns of a matrix whose rows come one at a
+ * time, prompting if a person is typing.
+ *
+ * pre:  in is open
+ * post: returns true and stores a positive ncols on success, false
+ *       otherwise
  */
-bool read_matrix_stdin (int nrows, int ncols,
-		       double matrix[nrows][ncols]);
+bool read_columns (struct reader *in, int *ncols);
 
-/* Read the dimensions of an array from stdin.
+/* Read the next row of such a matrix, if there is one, prompting if a
+ * person is typing.
  *
- * pre:  none 
- * post: nrows and ncols will reflect the user's input
+ * pre:  in is open, row has room for ncols doubles, i is the row's index
+ * post: returns 1 if a whole row was read, 0 if the input ended before
+ *       it, or -1 after reporting the column of a problem
  */
-bool read_size_stdin (int* nrows, int* ncols);
+int read_next_row (struct reader *in, double *row, int i, int ncols);
 
-/* Print a matrix.
+/* Print a matrix, laid out as matrix_format in format.h says.
  *
  * pre:  matrix is initialized
+ * post: none, the matrix isn't changed
+ */
+void print_matrix (const struct matrix *matrix);
+
+/* Print a matrix to a stream, just like print_matrix prints to stdout.
+ *
+ * pre:  matrix is initialized, out is open for writing
+ * post: none
+ */
+void fprint_matrix (FILE *out, const struct matrix *matrix);
+
+/* Print a sparse matrix, just like print_matrix prints a dense one.
+ *
+ * pre:  matrix is initialized
+ * post: none
+ */
+void print_sparse_matrix (const struct sparse_matrix *matrix);
+
+/* Print an exact matrix as fractions in lowest terms, each row divided
+ * through by its leading entry, each column as wide as its widest entry.
+ *
+ * pre:  matrix is initialized
+ * post: returns false if memory ran out before it could be printed
+ */
+bool print_exact_matrix (const struct exact_matrix *matrix);
+
+/* Print a matrix mod p as whole numbers from 0 to p-1, each column as
+ * wide as its widest entry.
+ *
+ * pre:  matrix is initialized
+ * post: none
+ */
+void print_modp_matrix (const struct modp_matrix *matrix);
+
+/* Print a matrix mod 2 as 0s and 1s.
+ *
+ * pre:  matrix is initialized
+ * post: none
+ */
+void print_gf2_matrix (const struct gf2_matrix *matrix);
+
+/* Check whether the steps of a solve have to be reported through the
+ * trace functions, either to print them or to write them to a journal.
+ *
+ * pre:  none
+ * post: returns true unless trace is TRACE_QUIET, no journal is open and
+ *       the calling thread's sink takes no steps
+ */
+bool tracing (enum trace_mode trace);
+
+/* Report a swap of two rows, as much as trace asks for.
+ * Also written to the journal and the calling thread's sink, if any.
+ *
+ * pre:  row1 and row2 were just swapped in matrix, which may be NULL
+ *       unless trace is TRACE_FULL
+ * post: none
+ */
+void trace_swap (enum trace_mode trace, int row1, int row2,
+        struct matrix *matrix);
+
+/* Report a row being scaled so that its leading entry becomes 1.
+ * Also written to the journal and the calling thread's sink, if any.
+ *
+ * pre:  row was just scaled by 1/pivot, matrix may be NULL unless trace
+ *       is TRACE_FULL
+ * post: none
+ */
+void trace_scale (enum trace_mode trace, int row, double pivot,
+        struct matrix *matrix);
+
+/* Report a scaled row being added to another.
+ * Also written to the journal and the calling thread's sink, if any.
+ *
+ * pre:  row1 += (scalar * row2) was just done to matrix, which may be
+ *       NULL unless trace is TRACE_FULL
+ * post: none
+ */
+void trace_add (enum trace_mode trace, int row1, double scalar, int row2,
+        struct matrix *matrix);
+
+/* Report a row operation on a matrix mod p, as much as trace asks for.
+ *
+ * pre:  the operation that format describes was just done to matrix
+ * post: none
+ */
+void trace_modp (enum trace_mode trace, const struct modp_matrix *matrix,
+        const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+/* Report a row operation on a matrix mod 2, as much as trace asks for.
+ *
+ * pre:  the operation that format describes was just done to matrix
  * post: none
  */
-void print_matrix (int nrows, int ncols, double matrix[nrows][ncols]);
+void trace_gf2 (enum trace_mode trace, const struct gf2_matrix *matrix,
+        const char *format, ...) __attribute__((format(printf, 3, 4)));
 
 #endif
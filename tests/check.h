@@ -0,0 +1,131 @@
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "kernels.h"
+#include "matrix.h"
+#include "user_io.h"
+
+/* What the tests share. Each test is a program that runs its checks,
+ * prints the ones that fail, and exits nonzero if any did. make check
+ * runs every test once with each version of the kernels. */
+
+static int check_failures;
+
+/* Note a failure, with a printf style message, unless cond holds */
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            check_failures++; \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+        } \
+    } while (0)
+
+/* Say how the test went.
+ *
+ * pre:  name is the test's name
+ * post: returns the exit status for main
+ */
+static inline int check_done (const char *name)
+{
+    kernels_init();
+    printf("%s (%s kernels): %s\n", name, kernels.name,
+           check_failures == 0 ? "ok" : "FAILED");
+    return check_failures == 0 ? 0 : 1;
+}
+
+/* Keep the errors the engines report to the test, since some checks
+ * expect them. The last one is left in check_error.
+ *
+ * pre:  none
+ * post: report_error on the calling thread writes to check_error
+ */
+static char check_error[256];
+static struct report_sink check_sink = { NULL, NULL, check_error, sizeof(check_error) };
+
+static inline void check_quiet (void)
+{
+    report_to(&check_sink);
+}
+
+/* xorshift64, so every run checks the same numbers */
+static inline uint64_t check_random (uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* A random integer from lo to hi */
+static inline int check_int (uint64_t *state, int lo, int hi)
+{
+    return lo + (int) (check_random(state) % (uint64_t) (hi - lo + 1));
+}
+
+/* A random double of either sign, its magnitude anywhere from 2^-20 to 2^20 */
+static inline double check_double (uint64_t *state)
+{
+    double x = (double) (check_random(state) >> 11) * 0x1p-53;
+    int e = check_int(state, -20, 20);
+    x = x * (double) (1ull << (e < 0 ? 0 : e)) / (double) (1ull << (e < 0 ? -e : 0));
+    return check_random(state) & 1 ? -x : x;
+}
+
+/* Make a matrix out of its entries, row by row.
+ *
+ * pre:  v holds nrows * ncols entries
+ * post: returns the matrix, or NULL if it could not be allocated
+ */
+static inline struct matrix *check_matrix (int nrows, int ncols, const double *v)
+{
+    struct matrix *m = matrix_create(nrows, ncols);
+    for (int i = 0; i < nrows && m != NULL; i++)
+        memcpy(matrix_row(m, i), v + (size_t) i * ncols, ncols * sizeof(double));
+    return m;
+}
+
+/* Fill a matrix with random integers from -9 to 9, then make the rows
+ * from the rank-th on combinations of the rows before them, so it has
+ * rank at most rank. Every entry stays a small integer.
+ *
+ * pre:  m is initialized, 0 < rank
+ * post: m is filled in
+ */
+static inline void check_fill (struct matrix *m, int rank, uint64_t *state)
+{
+    for (int i = 0; i < m->nrows; i++) {
+        double *row = matrix_row(m, i);
+        if (i < rank) {
+            for (int j = 0; j < m->ncols; j++)
+                row[j] = check_int(state, -9, 9);
+            continue;
+        }
+        memset(row, 0, m->ncols * sizeof(double));
+        for (int k = 0; k < rank; k++) {
+            int c = check_int(state, -2, 2);
+            for (int j = 0; j < m->ncols; j++)
+                row[j] += c * MAT(m, k, j);
+        }
+    }
+}
+
+/* Check whether two matrices have the same size and the same entries, bit
+ * for bit */
+static inline bool check_same (const struct matrix *a, const struct matrix *b)
+{
+    if (a->nrows != b->nrows || a->ncols != b->ncols)
+        return false;
+    for (int i = 0; i < a->nrows; i++) {
+        if (memcmp(matrix_row(a, i), matrix_row(b, i), a->ncols * sizeof(double)) != 0)
+            return false;
+    }
+    return true;
+}
+
+#endif
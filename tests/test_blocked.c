@@ -0,0 +1,138 @@
+#include <math.h>
+#include "automatic.h"
+#include "blocked.h"
+#include "check.h"
+#include "matrix_proc.h"
+
+/* The blocked engine against the plain steps it batches up, which the
+ * automatic engine only takes for small matrices: the same results bit
+ * for bit, up to the sign of zeroes for Gauss-Jordan. */
+
+#define TRIES 6
+#define MAXN 300
+
+/* auto_echelon or auto_gauss_jordan the plain way, a step at a time */
+static bool plain_steps (struct matrix *m, bool above)
+{
+    struct workspace ws = { 0 };
+    bool success = workspace_reserve(&ws, m->nrows, false);
+    int last_leading = -1;
+    if (success)
+        leading_columns(m, ws.leads);
+    for (int i = 0; i < m->nrows && success; i++) {
+        int lead = echelon_step(m, ws.leads, i, last_leading, above, TRACE_QUIET);
+        if (lead == STEP_DONE)
+            break;
+        success = lead != STEP_FAIL;
+        last_leading = lead;
+    }
+    workspace_free(&ws);
+    return success;
+}
+
+/* auto_reduced_echelon the plain way, cancelling each pivot out of the
+ * rows above it from the bottom up */
+static void plain_reduce (struct matrix *m)
+{
+    for (int i = m->nrows - 1; i >= 0; i--) {
+        int lead = leading_pos(i, m);
+        if (lead == -1)
+            continue;
+        for (int k = i - 1; k >= 0; k--) {
+            double temp = -1 * MAT(m, k, lead) / MAT(m, i, lead);
+            // Both rows are zero left of the pivot, unless 0 * inf says not
+            if (temp != 0 && isfinite(temp))
+                add_scaled_from(k, i, temp, lead, m);
+            else if (temp != 0)
+                add_scaled(k, i, temp, m);
+        }
+    }
+}
+
+/* Check whether two matrices have the same entries, taking 0 and -0 as
+ * the same */
+static bool same_values (const struct matrix *a, const struct matrix *b)
+{
+    for (int i = 0; i < a->nrows; i++)
+        for (int j = 0; j < a->ncols; j++)
+            if (MAT(a, i, j) != MAT(b, i, j))
+                return false;
+    return true;
+}
+
+static struct matrix *copy (const struct matrix *m)
+{
+    struct matrix *c = matrix_create(m->nrows, m->ncols);
+    for (int i = 0; i < m->nrows && c != NULL; i++)
+        memcpy(matrix_row(c, i), matrix_row(m, i), m->ncols * sizeof(double));
+    return c;
+}
+
+/* Every blocked routine on one matrix, against the plain steps */
+static void check_matrix_blocked (const struct matrix *m)
+{
+    int n = m->nrows, c = m->ncols;
+    struct workspace ws = { 0 };
+    struct matrix *blocked = copy(m);
+    struct matrix *plain = copy(m);
+    if (blocked == NULL || plain == NULL) {
+        CHECK(false, "could not allocate a %d x %d matrix", n, c);
+        goto out;
+    }
+
+    CHECK(blocked_worthwhile(m), "%d x %d not blocked", n, c);
+    CHECK(blocked_echelon(blocked, TRACE_QUIET, &ws), "%d x %d: blocked echelon failed", n, c);
+    CHECK(plain_steps(plain, false), "%d x %d: plain echelon failed", n, c);
+    CHECK(check_same(blocked, plain), "%d x %d: echelon forms differ", n, c);
+
+    /* Rounding can leave a row leading left of the one above, which the
+     * blocked reduction leaves to the plain one */
+    if (blocked_reduce_worthwhile(blocked)) {
+        CHECK(blocked_reduced_echelon(blocked, TRACE_QUIET, &ws),
+              "%d x %d: blocked reduction failed", n, c);
+        plain_reduce(plain);
+        CHECK(check_same(blocked, plain), "%d x %d: reduced forms differ", n, c);
+    }
+
+    for (int i = 0; i < n; i++) {
+        memcpy(matrix_row(blocked, i), matrix_row(m, i), c * sizeof(double));
+        memcpy(matrix_row(plain, i), matrix_row(m, i), c * sizeof(double));
+    }
+    CHECK(blocked_gauss_jordan(blocked, TRACE_QUIET, &ws),
+          "%d x %d: blocked gauss jordan failed", n, c);
+    CHECK(plain_steps(plain, true), "%d x %d: plain gauss jordan failed", n, c);
+    CHECK(same_values(blocked, plain), "%d x %d: gauss jordan forms differ", n, c);
+
+out:
+    matrix_free(blocked);
+    matrix_free(plain);
+    workspace_free(&ws);
+}
+
+int main (void)
+{
+    uint64_t state = 6364136223846793005ull;
+    check_quiet();
+    kernels_init();
+    for (int t = 0; t < TRIES; t++) {
+        /* Sizes that leave a partial panel, and a known rank, so that
+         * whole panels can go by without a pivot */
+        int n = check_int(&state, 2 * PANEL_COLS, MAXN);
+        int c = check_int(&state, 2 * PANEL_COLS, MAXN);
+        struct matrix *m = matrix_create(n, c);
+        if (m == NULL) {
+            CHECK(false, "could not allocate a %d x %d matrix", n, c);
+            continue;
+        }
+        check_fill(m, t % 2 == 0 ? n : check_int(&state, 1, n), &state);
+        check_matrix_blocked(m);
+
+        // Reals, which leave rounding for the panels to get the same
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < c; j++)
+                MAT(m, i, j) = check_double(&state);
+        check_matrix_blocked(m);
+        matrix_free(m);
+    }
+    return check_done("blocked");
+}
@@ -0,0 +1,247 @@
+#include <errno.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "automatic.h"
+#include "check.h"
+#include "echelon.h"
+#include "matrix_proc.h"
+
+/* libechelon from the outside: a solve gives what the engines give, bit
+ * for bit, and the steps passed to the callback redo it; a solver that has
+ * solved a matrix solves any no bigger without allocating; and a solve
+ * that fails leaves its message for echelon_error. */
+
+#define TRIES 6
+#define MAXN 200
+#define THREADS 3
+
+/* Every allocation in the program, from any thread, goes through these
+ * and is counted, so a solve can be checked for making none */
+static atomic_long allocations;
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t count, size_t size);
+extern void *__libc_realloc (void *p, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+void *malloc (size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc (size_t count, size_t size)
+{
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc (void *p, size_t size)
+{
+    allocations++;
+    return __libc_realloc(p, size);
+}
+
+int posix_memalign (void **p, size_t alignment, size_t size)
+{
+    allocations++;
+    *p = __libc_memalign(alignment, size);
+    return *p != NULL ? 0 : ENOMEM;
+}
+
+void *aligned_alloc (size_t alignment, size_t size)
+{
+    allocations++;
+    return __libc_memalign(alignment, size);
+}
+
+/* The steps of a solve, as the callback got them */
+struct steps {
+    long count;
+    long size;
+    struct echelon_step *list;
+    bool bad; // whether a step named rows that don't exist
+    int nrows;
+};
+
+static void record_step (void *arg, const struct echelon_step *step)
+{
+    struct steps *s = arg;
+    bool rows_ok = step->row1 >= 0 && step->row1 < s->nrows
+                   && (step->op == ECHELON_SCALE ? step->row2 == -1
+                                                 : step->row2 >= 0 && step->row2 < s->nrows);
+    s->bad = s->bad || !rows_ok || (step->op == ECHELON_SWAP && step->scalar != 0);
+    if (s->count == s->size) {
+        s->size = s->size > 0 ? 2 * s->size : 1024;
+        struct echelon_step *list = realloc(s->list, s->size * sizeof(*list));
+        if (list == NULL) {
+            s->bad = true;
+            return;
+        }
+        s->list = list;
+    }
+    s->list[s->count++] = *step;
+}
+
+/* Redo a step the way the engines did it, as a journal replay does */
+static void redo (const struct echelon_step *step, struct matrix *m)
+{
+    if (step->op == ECHELON_SWAP) {
+        swap_rows(step->row1, step->row2, m);
+    } else if (step->op == ECHELON_SCALE) {
+        scale_row(step->row1, step->scalar, m);
+        int lead = leading_pos(step->row1, m);
+        if (step->scalar != 0 && lead != -1)
+            MAT(m, step->row1, lead) = 1;
+    } else {
+        int lead = leading_pos(step->row2, m);
+        if (isfinite(step->scalar) && lead != -1)
+            add_scaled_from(step->row1, step->row2, step->scalar, lead, m);
+        else
+            add_scaled(step->row1, step->row2, step->scalar, m);
+    }
+}
+
+static struct matrix *copy (const struct matrix *m)
+{
+    struct matrix *c = echelon_matrix_create(m->nrows, m->ncols);
+    for (int i = 0; i < m->nrows && c != NULL; i++)
+        memcpy(echelon_matrix_row(c, i), matrix_row(m, i), m->ncols * sizeof(double));
+    return c;
+}
+
+/* A solve with the callback against the engines called directly, and the
+ * steps it passed redone on the matrix it started from */
+static void check_steps (struct echelon_solver *solver, const struct matrix *m,
+        bool reduced)
+{
+    int n = m->nrows, c = m->ncols;
+    struct steps steps = { .nrows = n };
+    struct matrix *solved = copy(m);
+    struct matrix *direct = copy(m);
+    struct matrix *redone = copy(m);
+    if (solved == NULL || direct == NULL || redone == NULL) {
+        CHECK(false, "could not allocate a %d x %d matrix", n, c);
+        goto out;
+    }
+
+    echelon_on_step(solver, record_step, &steps);
+    CHECK(echelon_solve(solver, solved, reduced), "%d x %d: %s", n, c,
+          echelon_error(solver));
+    echelon_on_step(solver, NULL, NULL);
+    CHECK(auto_echelon(direct, TRACE_QUIET)
+          && (!reduced || auto_reduced_echelon(direct, TRACE_QUIET)),
+          "%d x %d: the engines failed", n, c);
+    CHECK(check_same(solved, direct), "%d x %d: the solve differs from the engines", n, c);
+
+    CHECK(!steps.bad && (steps.count > 0 || echelon_rank(solved, NULL) == 0),
+          "%d x %d: %ld steps, some not making sense", n, c, steps.count);
+    for (long k = 0; k < steps.count && !steps.bad; k++)
+        redo(&steps.list[k], redone);
+    CHECK(check_same(redone, solved), "%d x %d: the %ld steps don't redo the solve",
+          n, c, steps.count);
+
+    /* With the callback gone, nothing more is passed to it */
+    long count = steps.count;
+    memcpy(echelon_matrix_row(solved, 0), matrix_row(m, 0), c * sizeof(double));
+    echelon_solve(solver, solved, reduced);
+    CHECK(steps.count == count, "%d x %d: steps passed after the callback was removed",
+          n, c);
+out:
+    free(steps.list);
+    echelon_matrix_free(solved);
+    echelon_matrix_free(direct);
+    echelon_matrix_free(redone);
+}
+
+/* Solves of matrices no bigger than one solved already, allocating
+ * nothing */
+static void check_reuse (struct echelon_solver *solver, uint64_t *state)
+{
+    struct matrix *biggest = echelon_matrix_create(MAXN, MAXN);
+    if (biggest == NULL) {
+        CHECK(false, "could not allocate a %d x %d matrix", MAXN, MAXN);
+        return;
+    }
+    check_fill(biggest, MAXN, state);
+    CHECK(echelon_solve(solver, biggest, true), "%s", echelon_error(solver));
+    echelon_matrix_free(biggest);
+
+    for (int t = 0; t < 4 * TRIES; t++) {
+        // Sizes for the small, plain and blocked engines
+        int n = t % 3 == 0 ? check_int(state, 1, 8) : check_int(state, 1, MAXN);
+        int c = t % 3 == 0 ? check_int(state, 1, 8) : check_int(state, 1, MAXN);
+        struct matrix *m = echelon_matrix_create(n, c);
+        if (m == NULL) {
+            CHECK(false, "could not allocate a %d x %d matrix", n, c);
+            continue;
+        }
+        check_fill(m, check_int(state, 0, n), state);
+
+        long before = allocations;
+        bool solved = echelon_solve(solver, m, t % 2 == 0);
+        long made = allocations - before;
+        CHECK(solved, "%d x %d: %s", n, c, echelon_error(solver));
+        CHECK(made == 0, "%d x %d: %ld allocations after a %d x %d solve", n, c, made,
+              MAXN, MAXN);
+        echelon_matrix_free(m);
+    }
+}
+
+/* An infinity under a pivot multiplies the zeroes left of the pivot into
+ * NaNs, which leave a row leading left of the next pivot */
+static void check_failure (struct echelon_solver *solver)
+{
+    const double values[] = {
+        1, 0, 0,
+        0, 1, 0,
+        0, INFINITY, 1,
+    };
+    struct matrix *m = check_matrix(3, 3, values);
+    CHECK(strcmp(echelon_error(solver), "") == 0, "an error before any failed: %s",
+          echelon_error(solver));
+    CHECK(m != NULL && !echelon_solve(solver, m, false), "a row of NaNs solved");
+    CHECK(strcmp(echelon_error(solver), "Could not find a row to swap with.") == 0,
+          "the error is \"%s\"", echelon_error(solver));
+    echelon_matrix_free(m);
+
+    /* The message stays until another solve fails */
+    m = check_matrix(3, 3, (const double[]) { 1, 2, 3, 4, 5, 6, 7, 8, 10 });
+    CHECK(m != NULL && echelon_solve(solver, m, true), "a solve after a failure failed");
+    CHECK(strcmp(echelon_error(solver), "Could not find a row to swap with.") == 0,
+          "the error after a solve is \"%s\"", echelon_error(solver));
+    echelon_matrix_free(m);
+}
+
+int main (void)
+{
+    uint64_t state = 0xa0761d6478bd642full;
+    if (!echelon_init(THREADS)) {
+        fprintf(stderr, "echelon_init failed\n");
+        return 1;
+    }
+    struct echelon_solver *solver = echelon_solver_create();
+    if (solver == NULL) {
+        fprintf(stderr, "echelon_solver_create failed\n");
+        return 1;
+    }
+
+    check_failure(solver);
+    for (int t = 0; t < TRIES; t++) {
+        int n = check_int(&state, 1, MAXN), c = check_int(&state, 1, MAXN);
+        struct matrix *m = echelon_matrix_create(n, c);
+        if (m == NULL) {
+            CHECK(false, "could not allocate a %d x %d matrix", n, c);
+            continue;
+        }
+        check_fill(m, check_int(&state, 0, n), &state);
+        check_steps(solver, m, t % 2 == 0);
+        echelon_matrix_free(m);
+    }
+    check_reuse(solver, &state);
+
+    echelon_solver_free(solver);
+    echelon_shutdown();
+    return check_done("echelon");
+}
@@ -0,0 +1,232 @@
+#include <math.h>
+#include <stdlib.h>
+#include "automatic.h"
+#include "check.h"
+#include "exact.h"
+#include "reader.h"
+
+/* Exact arithmetic against the automatic engine: the same reduced echelon
+ * form where rounding doesn't get in the way, the right rank where it
+ * does, and fractions that no double holds. */
+
+#define TRIES 100
+#define MAXN 10
+
+/* Check that a token parses to the fraction given as text */
+static void check_parse (const char *tok, const char *num, const char *den)
+{
+    struct bigint n, d;
+    bigint_init(&n);
+    bigint_init(&d);
+    bool parsed = parse_rational(tok, &n, &d);
+    if (num == NULL) {
+        CHECK(!parsed, "\"%s\" parsed", tok);
+    } else {
+        char *ns = parsed ? bigint_to_string(&n) : NULL;
+        char *ds = parsed ? bigint_to_string(&d) : NULL;
+        CHECK(ns != NULL && ds != NULL && strcmp(ns, num) == 0 && strcmp(ds, den) == 0,
+              "\"%s\" parsed as %s/%s, not %s/%s", tok, ns ? ns : "?",
+              ds ? ds : "?", num, den);
+        free(ns);
+        free(ds);
+    }
+    bigint_clear(&n);
+    bigint_clear(&d);
+}
+
+/* Make an exact matrix with the entries of m, or of the fractions
+ * 1/(i+j+1) of the Hilbert matrix beside an identity if m is NULL */
+static struct exact_matrix *exact_from (const struct matrix *m, int n)
+{
+    int nrows = m != NULL ? m->nrows : n;
+    int ncols = m != NULL ? m->ncols : 2 * n;
+    struct exact_matrix *e = exact_create(nrows, ncols);
+    struct bigint *nums = malloc(ncols * sizeof(struct bigint));
+    struct bigint *dens = malloc(ncols * sizeof(struct bigint));
+    if (e == NULL || nums == NULL || dens == NULL) {
+        exact_free(e);
+        free(nums);
+        free(dens);
+        return NULL;
+    }
+    for (int j = 0; j < ncols; j++) {
+        bigint_init(&nums[j]);
+        bigint_init(&dens[j]);
+    }
+    for (int i = 0; i < nrows && e != NULL; i++) {
+        for (int j = 0; j < ncols; j++) {
+            if (m != NULL) {
+                bigint_set_int(&nums[j], (int64_t) MAT(m, i, j));
+                bigint_set_int(&dens[j], 1);
+            } else {
+                bigint_set_int(&nums[j], j < n ? 1 : j - n == i);
+                bigint_set_int(&dens[j], j < n ? i + j + 1 : 1);
+            }
+        }
+        if (!exact_set_row(e, i, nums, dens)) {
+            exact_free(e);
+            e = NULL;
+        }
+    }
+    for (int j = 0; j < ncols; j++) {
+        bigint_clear(&nums[j]);
+        bigint_clear(&dens[j]);
+    }
+    free(nums);
+    free(dens);
+    return e;
+}
+
+/* The rows of an exact matrix that aren't all zeroes */
+static int exact_rank (const struct exact_matrix *e)
+{
+    int rank = 0;
+    for (int i = 0; i < e->nrows; i++) {
+        for (int j = 0; j < e->ncols; j++) {
+            if (bigint_sign(&EXACT(e, i, j)) != 0) {
+                rank++;
+                break;
+            }
+        }
+    }
+    return rank;
+}
+
+/* The value of an entry, as printed */
+static double exact_value (const struct exact_matrix *e, int i, int j)
+{
+    char *text = exact_entry_string(e, i, j);
+    double value = NAN;
+    if (text == NULL || !parse_double(text, &value))
+        value = NAN;
+    free(text);
+    return value;
+}
+
+/* A random integer matrix of known rank, both ways. A big diagonal keeps
+ * the first rows independent, the way check_fill only all but surely
+ * does, since a row of a small matrix can come out all zeroes. */
+static void check_ranked (int n, int c, int rank, uint64_t *state)
+{
+    struct matrix *m = matrix_create(n, c);
+    if (m == NULL) {
+        CHECK(false, "could not allocate a %d x %d matrix", n, c);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < c; j++)
+            MAT(m, i, j) = i < rank ? check_int(state, -9, 9) + 100 * (i == j) : 0;
+        for (int k = 0; k < rank && i >= rank; k++) {
+            int f = check_int(state, -2, 2);
+            for (int j = 0; j < c; j++)
+                MAT(m, i, j) += f * MAT(m, k, j);
+        }
+    }
+    struct exact_matrix *e = exact_from(m, 0);
+    CHECK(e != NULL, "could not make a %d x %d exact matrix", n, c);
+    if (e == NULL) {
+        matrix_free(m);
+        return;
+    }
+
+    CHECK(exact_echelon(e) && exact_reduced_echelon(e), "%d x %d: exact failed", n, c);
+    CHECK(auto_echelon(m, TRACE_QUIET) && auto_reduced_echelon(m, TRACE_QUIET),
+          "%d x %d: auto failed", n, c);
+
+    int expected = rank < n ? rank : n;
+    expected = expected < c ? expected : c;
+    CHECK(exact_rank(e) == expected, "%d x %d of rank %d: exact rank %d",
+          n, c, expected, exact_rank(e));
+
+    // Without dependent rows to leave rounding behind, the forms agree
+    if (rank >= n && n <= c) {
+        double worst = 0;
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < c; j++)
+                worst = fmax(worst, fabs(exact_value(e, i, j) - MAT(m, i, j)));
+        CHECK(worst < 1e-9, "%d x %d: off by %g", n, c, worst);
+    }
+    exact_free(e);
+    matrix_free(m);
+}
+
+/* The rows of 1 to 9, which rounding can leave at rank 3 */
+static void check_rounding (void)
+{
+    const double v[] = { 1, 2, 3,
+                         4, 5, 6,
+                         7, 8, 9 };
+    const char *expected[] = { "1", "0", "-1",
+                               "0", "1", "2",
+                               "0", "0", "0" };
+    struct matrix *m = check_matrix(3, 3, v);
+    struct exact_matrix *e = m != NULL ? exact_from(m, 0) : NULL;
+    CHECK(e != NULL && exact_echelon(e) && exact_reduced_echelon(e), "exact failed");
+    for (int k = 0; k < 9 && e != NULL; k++) {
+        char *text = exact_entry_string(e, k / 3, k % 3);
+        CHECK(text != NULL && strcmp(text, expected[k]) == 0, "(%d, %d) is %s, not %s",
+              k / 3, k % 3, text ? text : "?", expected[k]);
+        free(text);
+    }
+    exact_free(e);
+    matrix_free(m);
+}
+
+/* The inverse of the Hilbert matrix, whose corners are n^2 and
+ * (2n - 1) * C(2n - 2, n - 1)^2, far too ill-conditioned for doubles */
+static void check_hilbert (int n)
+{
+    struct exact_matrix *e = exact_from(NULL, n);
+    CHECK(e != NULL && exact_echelon(e) && exact_reduced_echelon(e),
+          "hilbert %d: exact failed", n);
+    if (e == NULL)
+        return;
+    CHECK(exact_rank(e) == n, "hilbert %d: rank %d", n, exact_rank(e));
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            char *text = exact_entry_string(e, i, j);
+            CHECK(text != NULL && strcmp(text, i == j ? "1" : "0") == 0,
+                  "hilbert %d: (%d, %d) is %s", n, i, j, text ? text : "?");
+            free(text);
+        }
+    }
+
+    int64_t binomial = 1;
+    for (int k = 1; k < n; k++)
+        binomial = binomial * (n - 1 + k) / k;
+    char first[32], last[32];
+    snprintf(first, sizeof(first), "%d", n * n);
+    snprintf(last, sizeof(last), "%lld", (long long) ((2 * n - 1) * binomial * binomial));
+    char *text = exact_entry_string(e, 0, n);
+    CHECK(text != NULL && strcmp(text, first) == 0, "hilbert %d: corner %s, not %s",
+          n, text ? text : "?", first);
+    free(text);
+    text = exact_entry_string(e, n - 1, 2 * n - 1);
+    CHECK(text != NULL && strcmp(text, last) == 0, "hilbert %d: corner %s, not %s",
+          n, text ? text : "?", last);
+    free(text);
+    exact_free(e);
+}
+
+int main (void)
+{
+    uint64_t state = 2685821657736338717ull;
+    check_quiet();
+    kernels_init();
+    check_parse("-1/3", "-1", "3");
+    check_parse("6/4", "3", "2");
+    check_parse("0.5/7", "1", "14");
+    check_parse("-2.5e3", "-2500", "1");
+    check_parse("1.25e-2", "1", "80");
+    check_parse("1/0", NULL, NULL);
+    check_parse("1/", NULL, NULL);
+    check_parse("x", NULL, NULL);
+    check_rounding();
+    for (int n = 1; n <= 12; n++)
+        check_hilbert(n);
+    for (int t = 0; t < TRIES; t++) {
+        int n = check_int(&state, 1, MAXN), c = check_int(&state, 1, MAXN);
+        check_ranked(n, c, t % 2 == 0 ? n : check_int(&state, 1, n), &state);
+    }
+    return check_done("exact");
+}
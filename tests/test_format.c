@@ -0,0 +1,240 @@
+#include <math.h>
+#include <stdlib.h>
+#include "check.h"
+#include "format.h"
+#include "reader.h"
+
+/* The formatter against printf: every entry as "%.4f" writes it, rounded
+ * the same way from the exact binary value, apart from -0, and fractions
+ * against trying every denominator. Then whole matrices in each layout,
+ * big enough to fill the buffer more than once, against the same text
+ * put together with snprintf. */
+
+#define TRIES 200000
+#define MAXN 60
+
+/* Where fractions within a billionth of an entry relative to it stop being
+ * at least 2 / FORMAT_MAX_DENOMINATOR^2 apart */
+#define FRACTION_UNIQUE 500
+
+/* A double of any size, with most of them in the range format_fixed
+ * converts itself, and many of those ending in a 5 past the fourth
+ * decimal, which is where the rounding is in doubt */
+static double random_value (uint64_t *state)
+{
+    uint64_t bits = check_random(state);
+    switch (check_int(state, 0, 5)) {
+        case 0:
+        {
+            // anything at all, NaNs and infinities included
+            double any;
+            memcpy(&any, &bits, sizeof(any));
+            return any;
+        }
+        case 1:
+            // a halfway case n.dddd5 that a double holds exactly
+            return (double) (int64_t) (bits >> 24) / 0x1p16 * (bits & 1 ? -1 : 1);
+        case 2:
+            // just either side of a halfway case
+            return nextafter(((int64_t) (bits % 2000000) * 2 + 1) / 20000.0,
+                             bits & 1 ? INFINITY : -INFINITY);
+        case 3:
+            // near 2^53, where conversion moves to snprintf
+            return 0x1p53 + (int64_t) (bits % 64) - 32;
+        default:
+            return ldexp(check_double(state), check_int(state, -30, 60));
+    }
+}
+
+/* format_fixed on one value against snprintf */
+static void check_fixed (double value)
+{
+    char want[FORMAT_ENTRY_MAX + 1], got[FORMAT_ENTRY_MAX + 1];
+    snprintf(want, sizeof(want), "%.4f", value == 0 ? 0.0 : value);
+    int len = format_fixed(got, value);
+    got[len] = '\0';
+    CHECK(strcmp(got, want) == 0, "%a written as %s, not %s", value, got, want);
+}
+
+/* What format_fraction should write, found by trying every denominator in
+ * turn. Below FRACTION_UNIQUE, fractions with small denominators are too
+ * far apart for more than one to be close enough, so the first is the one
+ * the continued fraction finds, in lowest terms. */
+static void reference_fraction (char *dst, size_t size, double value)
+{
+    double a = fabs(value);
+    if (a < 0x1p53 && a == trunc(a)) {
+        snprintf(dst, size, "%s%.0f", value < 0 ? "-" : "", a);
+        return;
+    }
+    if (a < 0x1p40) {
+        double tolerance = 1e-9 * (a > 1 ? a : 1);
+        for (int64_t k = 1; k <= FORMAT_MAX_DENOMINATOR; k++) {
+            int64_t h = llround(a * k);
+            if (fabs(a - (double) h / k) <= tolerance) {
+                if (k == 1)
+                    snprintf(dst, size, "%s%lld", value < 0 ? "-" : "", (long long) h);
+                else
+                    snprintf(dst, size, "%s%lld/%lld", value < 0 ? "-" : "",
+                             (long long) h, (long long) k);
+                return;
+            }
+        }
+    }
+    snprintf(dst, size, "%.4f", value == 0 ? 0.0 : value);
+}
+
+/* format_fraction on one value against the reference, or above
+ * FRACTION_UNIQUE, where the tolerance lets more than one fraction be
+ * close enough, against the tolerance */
+static void check_fraction (double value)
+{
+    char want[FORMAT_ENTRY_MAX + 1], got[FORMAT_ENTRY_MAX + 1];
+    reference_fraction(want, sizeof(want), value);
+    int len = format_fraction(got, value);
+    got[len] = '\0';
+    double a = fabs(value), parsed;
+    char *slash = strchr(got, '/');
+    if (!(a >= FRACTION_UNIQUE && a < 0x1p40 && a != trunc(a)))
+        CHECK(strcmp(got, want) == 0, "%a written as %s, not %s", value, got, want);
+    else if (slash != NULL)
+        CHECK(parse_double(got, &parsed) && atoi(slash + 1) <= FORMAT_MAX_DENOMINATOR
+              && fabs(value - parsed) <= 1e-9 * a, "%a written as %s", value, got);
+}
+
+static void check_entries (uint64_t *state)
+{
+    const double edges[] = {
+        0, -0.0, 0.00005, -0.00005, 0.00015, 0.99995, 9.99995, 0.5, -0.5,
+        1e-300, -1e-300, 0x1p53, -0x1p53, 0x1p53 - 1, 0x1p53 + 2, 1e22, 1e308,
+        INFINITY, -INFINITY, NAN, 4503599627370495.5, 0.30000000000000004,
+    };
+    for (size_t k = 0; k < sizeof(edges) / sizeof(edges[0]); k++) {
+        check_fixed(edges[k]);
+        check_fraction(edges[k]);
+    }
+
+    char got[FORMAT_ENTRY_MAX + 1];
+    got[format_fixed(got, -0.0)] = '\0';
+    CHECK(strcmp(got, "0.0000") == 0, "-0 written as %s", got);
+
+    for (int t = 0; t < TRIES; t++)
+        check_fixed(random_value(state));
+
+    /* Fractions, near misses, and things that aren't fractions at all */
+    for (int t = 0; t < TRIES / 10; t++) {
+        int64_t h = check_int(state, -3000000, 3000000);
+        int k = check_int(state, 1, FORMAT_MAX_DENOMINATOR + 10);
+        double value = (double) h / k;
+        check_fraction(value);
+        check_fraction(value * (1 + 2e-9));
+        check_fraction(value + 1e-10);
+        check_fraction(random_value(state));
+    }
+}
+
+/* The text of a matrix in one layout, put together with snprintf. The
+ * fractions were checked on their own, and above FRACTION_UNIQUE there is
+ * more than one right answer, so they come from format_fraction. */
+static char *reference_matrix (const struct matrix *m, enum matrix_format format,
+        size_t *size)
+{
+    char *text;
+    FILE *out = open_memstream(&text, size);
+    if (out == NULL)
+        return NULL;
+    char entry[FORMAT_ENTRY_MAX + 1];
+    int width = format == FORMAT_PLAIN ? 5 : 0;
+    for (int i = 0; i < m->nrows; i++) {
+        for (int j = 0; j < m->ncols && format != FORMAT_PLAIN; j++) {
+            int len = format == FORMAT_FRACTIONS
+                      ? format_fraction(entry, MAT(m, i, j))
+                      : snprintf(entry, sizeof(entry), "%.4f",
+                                 MAT(m, i, j) == 0 ? 0.0 : MAT(m, i, j));
+            if (len > width)
+                width = len;
+        }
+    }
+    if (format != FORMAT_CSV) {
+        for (int k = 0; k < 5 * (m->ncols + 2); k++)
+            fputc('*', out);
+        fputc('\n', out);
+    }
+    for (int i = 0; i < m->nrows; i++) {
+        for (int j = 0; j < m->ncols; j++) {
+            double value = MAT(m, i, j) == 0 ? 0.0 : MAT(m, i, j);
+            if (format == FORMAT_FRACTIONS)
+                entry[format_fraction(entry, value)] = '\0';
+            else
+                snprintf(entry, sizeof(entry), "%.4f", value);
+            if (format == FORMAT_CSV)
+                fprintf(out, "%s%c", entry, j == m->ncols - 1 ? '\n' : ',');
+            else
+                fprintf(out, "%*s %s", width, entry, j == m->ncols - 1 ? "\n" : "");
+        }
+    }
+    fputc('\n', out);
+    fclose(out);
+    return text;
+}
+
+static const char *format_names[] = { "plain", "aligned", "csv", "fractions" };
+
+/* fprint_matrix in each layout against the reference */
+static void check_layouts (const struct matrix *m)
+{
+    for (enum matrix_format format = FORMAT_PLAIN; format <= FORMAT_FRACTIONS; format++) {
+        char *got = NULL;
+        size_t got_size = 0, want_size = 0;
+        char *want = reference_matrix(m, format, &want_size);
+        FILE *out = open_memstream(&got, &got_size);
+        if (want == NULL || out == NULL) {
+            CHECK(false, "could not open a stream");
+            free(want);
+            continue;
+        }
+        matrix_format = format;
+        fprint_matrix(out, m);
+        fclose(out);
+        size_t k = 0;
+        while (k < got_size && k < want_size && got[k] == want[k])
+            k++;
+        CHECK(got_size == want_size && k == got_size,
+              "%d x %d %s: text differs at byte %zu of %zu: \"%.40s\", not \"%.40s\"",
+              m->nrows, m->ncols, format_names[format], k, want_size,
+              got + (k < got_size ? k : got_size), want + (k < want_size ? k : want_size));
+        free(got);
+        free(want);
+    }
+    matrix_format = FORMAT_PLAIN;
+}
+
+int main (void)
+{
+    uint64_t state = 0x853c49e6748fea9bull;
+    check_quiet();
+    check_entries(&state);
+
+    /* A small matrix, and ones of thirds, big and small values, and
+     * anything at all, that take several buffers of text */
+    const double small[] = { 1, -0.0, 1.0 / 3, -2.5, 1e6 / 7, INFINITY };
+    struct matrix *m = check_matrix(2, 3, small);
+    if (m != NULL)
+        check_layouts(m);
+    matrix_free(m);
+    for (int t = 0; t < 8; t++) {
+        int n = check_int(&state, 1, MAXN), c = check_int(&state, 1, MAXN);
+        m = matrix_create(n * 10, c);
+        if (m == NULL) {
+            CHECK(false, "could not allocate a %d x %d matrix", n * 10, c);
+            continue;
+        }
+        for (int i = 0; i < m->nrows; i++)
+            for (int j = 0; j < c; j++)
+                MAT(m, i, j) = t % 2 == 0 ? check_int(&state, -99, 99) / 3.0
+                                          : random_value(&state);
+        check_layouts(m);
+        matrix_free(m);
+    }
+    return check_done("format");
+}
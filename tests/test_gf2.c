@@ -0,0 +1,142 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "check.h"
+#include "gf2.h"
+
+/* The Method of Four Russians against going a pivot at a time, on
+ * matrices mod 2 big enough for it: the same pivot columns and the same
+ * reduced echelon form, which is unique, with rows that end on a word and
+ * rows that don't, dependent rows, and more pivots than fit in one block. */
+
+#define TRIES 8
+#define MAXN 400
+
+static struct gf2_matrix *copy (const struct gf2_matrix *m)
+{
+    struct gf2_matrix *c = gf2_create(m->nrows, m->ncols);
+    for (int i = 0; i < m->nrows && c != NULL; i++)
+        memcpy(c->rows[i], m->rows[i], m->words * sizeof(uint64_t));
+    return c;
+}
+
+static bool same (const struct gf2_matrix *a, const struct gf2_matrix *b)
+{
+    for (int i = 0; i < a->nrows; i++)
+        for (int j = 0; j < a->ncols; j++)
+            if (GF2(a, i, j) != GF2(b, i, j))
+                return false;
+    return true;
+}
+
+static void add_row (struct gf2_matrix *m, int dst, int src)
+{
+    for (int w = 0; w < m->words; w++)
+        m->rows[dst][w] ^= m->rows[src][w];
+}
+
+/* A random matrix of the given rank, with pivots in the columns of its
+ * reduced echelon form listed in pivots. It starts as rank rows leading in
+ * those columns, over rows of zeroes, and is mixed up with row additions,
+ * which keep the rank, until every row depends on the others. */
+static struct gf2_matrix *ranked (int n, int c, int rank, int *pivots, uint64_t *state)
+{
+    struct gf2_matrix *m = gf2_create(n, c);
+    if (m == NULL)
+        return NULL;
+    // rank distinct columns, in order
+    for (int k = 0, j = 0; k < rank; j++) {
+        if (check_int(state, 1, c - j) <= rank - k)
+            pivots[k++] = j;
+    }
+    for (int k = 0; k < rank; k++) {
+        gf2_set(m, k, pivots[k], 1);
+        for (int j = pivots[k] + 1; j < c; j++)
+            gf2_set(m, k, j, check_random(state) & 1);
+    }
+    for (int t = 0; t < 4 * n; t++) {
+        int dst = check_int(state, 0, n - 1), src = check_int(state, 0, n - 1);
+        if (dst != src)
+            add_row(m, dst, src);
+    }
+    return m;
+}
+
+/* Put a matrix into reduced echelon form a pivot at a time. Any trace
+ * takes the engine that way, so the steps it prints are thrown away. */
+static bool stepwise (struct gf2_matrix *m)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO), null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    bool success = gf2_echelon(m, TRACE_SUMMARY);
+    if (success)
+        gf2_reduced_echelon(m, TRACE_SUMMARY);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(null);
+    return success;
+}
+
+/* Both ways on one matrix, against each other and the pivots it was made
+ * with */
+static void check_ranked (int n, int c, int rank, uint64_t *state)
+{
+    int *expected = malloc(c * sizeof(int));
+    int *blocked_pivots = malloc(n * sizeof(int));
+    int *stepwise_pivots = malloc(n * sizeof(int));
+    struct gf2_matrix *blocked = expected != NULL ? ranked(n, c, rank, expected, state)
+                                                  : NULL;
+    struct gf2_matrix *plain = blocked != NULL ? copy(blocked) : NULL;
+    if (plain == NULL || blocked_pivots == NULL || stepwise_pivots == NULL) {
+        CHECK(false, "could not allocate a %d x %d matrix", n, c);
+        goto out;
+    }
+
+    CHECK(gf2_echelon(blocked, TRACE_QUIET), "%d x %d: blocked echelon failed", n, c);
+    int blocked_rank = gf2_pivot_columns(blocked, blocked_pivots);
+    gf2_reduced_echelon(blocked, TRACE_QUIET);
+    CHECK(stepwise(plain), "%d x %d: stepwise echelon failed", n, c);
+    int stepwise_rank = gf2_pivot_columns(plain, stepwise_pivots);
+
+    CHECK(blocked_rank == rank && stepwise_rank == rank,
+          "%d x %d of rank %d: blocked rank %d, stepwise rank %d", n, c, rank,
+          blocked_rank, stepwise_rank);
+    if (blocked_rank == rank && stepwise_rank == rank) {
+        CHECK(memcmp(blocked_pivots, expected, rank * sizeof(int)) == 0,
+              "%d x %d: blocked pivots differ", n, c);
+        CHECK(memcmp(stepwise_pivots, expected, rank * sizeof(int)) == 0,
+              "%d x %d: stepwise pivots differ", n, c);
+    }
+    CHECK(same(blocked, plain), "%d x %d of rank %d: reduced forms differ", n, c, rank);
+    for (int k = 0; k < rank && k < blocked_rank; k++)
+        CHECK(GF2(blocked, k, expected[k]) == 1, "%d x %d: no 1 at pivot %d", n, c, k);
+
+out:
+    gf2_free(blocked);
+    gf2_free(plain);
+    free(expected);
+    free(blocked_pivots);
+    free(stepwise_pivots);
+}
+
+int main (void)
+{
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    check_quiet();
+    kernels_init();
+    for (int t = 0; t < TRIES; t++) {
+        /* A row of exactly one word, one just over, and wider ones with
+         * room for more pivots than a block takes */
+        int n = check_int(&state, GF2_BLOCKED_MIN_ROWS, MAXN);
+        int widths[] = { 64, 65, check_int(&state, 130, 300) };
+        int c = widths[t % 3];
+        int most = n < c ? n : c;
+        check_ranked(n, c, t % 2 == 0 ? most : check_int(&state, 1, most), &state);
+    }
+    // Nothing to pivot on at all, and more than 64 pivots over few rows
+    check_ranked(GF2_BLOCKED_MIN_ROWS, 70, 0, &state);
+    check_ranked(GF2_BLOCKED_MIN_ROWS, 300, 200, &state);
+    return check_done("gf2");
+}
@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include "automatic.h"
+#include "check.h"
+#include "incremental.h"
+#include "matrix_proc.h"
+
+/* Adding rows one at a time against knowing what each one is: rows that
+ * bring in a known pivot, rows that are combinations of those before, and
+ * for systems rows that say 0 = c, each reported as such. Then the rows
+ * kept against auto_echelon and auto_reduced_echelon on the same rows:
+ * the same reduced echelon form, exactly. */
+
+#define TRIES 16
+#define MAXN 40
+
+/* What a test row is made to be */
+enum kind { PIVOT, DEPENDENT, INCONSISTENT };
+
+/* Add the rows of m one at a time, checking each outcome against kinds
+ * and the pivot of each new one against leads, then the form against the
+ * automatic engine on the same rows. Neither looks for the biggest pivot,
+ * and rounding could leave the engine a pivot where there is none, so it
+ * is given the basis rows the others were made from first, in the order
+ * of their pivots. Every pivot it meets is then 1, and it stays in
+ * integers all the way. */
+static void check_rows (const struct matrix *m, const struct matrix *basis,
+        int rank, bool system, const enum kind *kinds, const int *leads)
+{
+    int n = m->nrows, c = m->ncols;
+    struct incremental *inc = incremental_create(c, system);
+    struct matrix *all = matrix_create(rank + n, c);
+    struct matrix *form = NULL;
+    if (inc == NULL || all == NULL) {
+        CHECK(false, "could not start a %d x %d matrix", n, c);
+        goto out;
+    }
+    for (int k = 0; k < rank; k++)
+        memcpy(matrix_row(all, k), matrix_row(basis, k), c * sizeof(double));
+
+    int used = rank;
+    for (int i = 0; i < n; i++) {
+        int lead = -1;
+        enum incremental_outcome outcome = incremental_add(inc, matrix_row(m, i), &lead);
+        if (kinds[i] == PIVOT) {
+            CHECK(outcome == INCREMENTAL_PIVOT && lead == leads[i],
+                  "%d x %d: row %d is outcome %d leading at %d, not a pivot at %d",
+                  n, c, i, outcome, lead, leads[i]);
+        } else {
+            enum incremental_outcome want = kinds[i] == DEPENDENT
+                                          ? INCREMENTAL_DEPENDENT
+                                          : INCREMENTAL_INCONSISTENT;
+            CHECK(outcome == want, "%d x %d: row %d is outcome %d, not %d", n, c,
+                  i, outcome, want);
+        }
+        if (outcome != INCREMENTAL_INCONSISTENT)
+            memcpy(matrix_row(all, used++), matrix_row(m, i), c * sizeof(double));
+    }
+    CHECK(inc->rank == rank, "%d x %d: rank %d, not %d", n, c, inc->rank, rank);
+    if (inc->rank != rank || rank == 0)
+        goto out;
+
+    form = incremental_form(inc);
+    if (form == NULL) {
+        CHECK(false, "%d x %d: no form: %s", n, c, check_error);
+        goto out;
+    }
+    for (int i = used; i < rank + n; i++)
+        memset(matrix_row(all, i), 0, c * sizeof(double));
+    CHECK(auto_echelon(all, TRACE_QUIET) && auto_reduced_echelon(all, TRACE_QUIET),
+          "%d x %d: the engine failed", n, c);
+    for (int i = 0; i < rank + n; i++) {
+        for (int j = 0; j < c; j++) {
+            double want = i < rank ? MAT(form, i, j) : 0;
+            if (MAT(all, i, j) != want) {
+                CHECK(false, "%d x %d: entry %d, %d is %g, but %g from the engine",
+                      n, c, i, j, want, MAT(all, i, j));
+                goto out;
+            }
+        }
+    }
+out:
+    incremental_free(inc);
+    matrix_free(all);
+    matrix_free(form);
+}
+
+/* Row dst of m += s * row src of b */
+static void add_row (struct matrix *m, int dst, const struct matrix *b, int src, int s)
+{
+    for (int j = 0; j < m->ncols; j++)
+        MAT(m, dst, j) += s * MAT(b, src, j);
+}
+
+/* Rows of known kinds. There are rank basis rows, each 1 at its pivot and
+ * 0 left of it, with entries of -1, 0 or 1 right of it, even in the others'
+ * pivot columns, so that kept rows have new pivots cancelled out of them.
+ * The basis rows come in in any order, each plus a combination of those
+ * already in, with other combinations and, for a system, 0 = c rows in
+ * between. Reducing integer rows like these against each other only ever
+ * takes integer multiples, so whether a row depends on the others comes
+ * out exactly. */
+static void check_kinds (int c, int rank, bool system, uint64_t *state)
+{
+    int n = 2 * rank + check_int(state, 1, 8);
+    // A row more than needed, for a rank of 0
+    struct matrix *basis = matrix_create(rank + 1, c);
+    struct matrix *m = matrix_create(n, c);
+    int *pivots = malloc((rank + 1) * sizeof(int));
+    int *order = malloc((rank + 1) * sizeof(int));
+    enum kind *kinds = malloc(n * sizeof(enum kind));
+    int *leads = malloc(n * sizeof(int));
+    if (basis == NULL || m == NULL || pivots == NULL || order == NULL
+            || kinds == NULL || leads == NULL) {
+        CHECK(false, "could not allocate a %d x %d matrix", n, c);
+        goto out;
+    }
+
+    /* rank distinct pivot columns, in order, short of the right-hand side
+     * for a system */
+    int width = system ? c - 1 : c;
+    for (int k = 0, j = 0; k < rank; j++) {
+        if (check_int(state, 1, width - j) <= rank - k)
+            pivots[k++] = j;
+    }
+    for (int k = 0; k < rank; k++) {
+        for (int j = 0; j < c; j++)
+            MAT(basis, k, j) = j < pivots[k] ? 0 : check_int(state, -1, 1);
+        MAT(basis, k, pivots[k]) = 1;
+        order[k] = k;
+    }
+    for (int k = rank - 1; k > 0; k--) {
+        int other = check_int(state, 0, k);
+        int temp = order[k];
+        order[k] = order[other];
+        order[other] = temp;
+    }
+
+    /* The pivots in the order picked, with the other rows scattered in */
+    int added = 0;
+    for (int i = 0; i < n; i++) {
+        int left = n - i;
+        if (rank - added == left || (added < rank && check_int(state, 0, 1) == 0)) {
+            kinds[i] = PIVOT;
+            leads[i] = pivots[order[added]];
+        } else {
+            kinds[i] = system && check_int(state, 0, 2) == 0 ? INCONSISTENT : DEPENDENT;
+        }
+        memset(matrix_row(m, i), 0, c * sizeof(double));
+        for (int k = 0; k < added; k++)
+            add_row(m, i, basis, order[k], check_int(state, -1, 1));
+        if (kinds[i] == PIVOT)
+            add_row(m, i, basis, order[added++], 1);
+        else if (kinds[i] == INCONSISTENT)
+            MAT(m, i, c - 1) += check_int(state, 0, 1) ? 1 : -2;
+    }
+    check_rows(m, basis, rank, system, kinds, leads);
+out:
+    matrix_free(basis);
+    matrix_free(m);
+    free(pivots);
+    free(order);
+    free(kinds);
+    free(leads);
+}
+
+int main (void)
+{
+    uint64_t state = 0xd1b54a32d192ed03ull;
+    check_quiet();
+    kernels_init();
+    for (int t = 0; t < TRIES; t++) {
+        bool system = t % 2 == 1;
+        int c = check_int(&state, 2, MAXN);
+        int most = system ? c - 1 : c;
+        check_kinds(c, t < 2 ? most : check_int(&state, 1, most), system, &state);
+    }
+    // Nothing but dependent rows
+    check_kinds(5, 0, false, &state);
+    return check_done("incremental");
+}
@@ -0,0 +1,220 @@
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "automatic.h"
+#include "blocked.h"
+#include "check.h"
+#include "journal.h"
+#include "matrix_proc.h"
+
+/* Journals of the engines, text and binary, replayed: both load to the
+ * same operations, and seeking to steps in any order, back past
+ * checkpoints as well as forward, gives the matrix that doing the first
+ * that many operations by hand does, bit for bit, and the last step gives
+ * what the engine left. */
+
+#define TRIES 4
+#define SEEKS 24
+
+enum engine { AUTO, BLOCKED_ECHELON, BLOCKED_GAUSS_JORDAN };
+
+static const char *engine_names[] = { "auto", "blocked echelon", "blocked gauss jordan" };
+
+static char text_path[] = "/tmp/test_journal_text_XXXXXX";
+static char binary_path[] = "/tmp/test_journal_binary_XXXXXX";
+
+static struct matrix *copy (const struct matrix *m)
+{
+    struct matrix *c = matrix_create(m->nrows, m->ncols);
+    for (int i = 0; i < m->nrows && c != NULL; i++)
+        memcpy(matrix_row(c, i), matrix_row(m, i), m->ncols * sizeof(double));
+    return c;
+}
+
+/* Run an engine on m with a journal open */
+static bool run (enum engine engine, struct matrix *m, const char *path, bool binary)
+{
+    struct workspace ws = { 0 };
+    if (!journal_open(path, binary, m->nrows, m->ncols))
+        return false;
+    bool success;
+    if (engine == AUTO)
+        success = auto_echelon(m, TRACE_QUIET) && auto_reduced_echelon(m, TRACE_QUIET);
+    else if (engine == BLOCKED_ECHELON)
+        success = blocked_echelon(m, TRACE_QUIET, &ws);
+    else
+        success = blocked_gauss_jordan(m, TRACE_QUIET, &ws);
+    workspace_free(&ws);
+    return journal_close() && success;
+}
+
+/* Check that two journals hold the same operations, with the same scalars
+ * bit for bit */
+static bool same_entries (const struct journal *a, const struct journal *b)
+{
+    if (a->nrows != b->nrows || a->ncols != b->ncols || a->nentries != b->nentries)
+        return false;
+    for (long k = 0; k < a->nentries; k++) {
+        const struct journal_entry *x = &a->entries[k], *y = &b->entries[k];
+        if (x->op != y->op || x->row1 != y->row1
+                || (x->op != JOURNAL_SCALE && x->row2 != y->row2)
+                || (x->op != JOURNAL_SWAP
+                    && memcmp(&x->scalar, &y->scalar, sizeof(double)) != 0))
+            return false;
+    }
+    return true;
+}
+
+/* Do one operation by hand, as the journal says the engines did it: a
+ * scaled row's leading entry is set to exactly 1, and a row is only added
+ * from its leading entry on, to keep the sign of the zeroes before it */
+static void apply (const struct journal_entry *e, struct matrix *m)
+{
+    if (e->op == JOURNAL_SWAP) {
+        swap_rows(e->row1, e->row2, m);
+    } else if (e->op == JOURNAL_SCALE) {
+        scale_row(e->row1, e->scalar, m);
+        int lead = leading_pos(e->row1, m);
+        if (e->scalar != 0 && lead != -1)
+            MAT(m, e->row1, lead) = 1;
+    } else {
+        int lead = leading_pos(e->row2, m);
+        if (isfinite(e->scalar) && lead != -1)
+            add_scaled_from(e->row1, e->row2, e->scalar, lead, m);
+        else
+            add_scaled(e->row1, e->row2, e->scalar, m);
+    }
+}
+
+static int compare_steps (const void *a, const void *b)
+{
+    long x = *(const long *) a, y = *(const long *) b;
+    return (x > y) - (x < y);
+}
+
+/* Seek a replay of journal to random steps, in random order, against
+ * copies made going forward once by hand */
+static void check_seeks (const struct journal *journal, const struct matrix *initial,
+        const struct matrix *final, const char *what, uint64_t *state)
+{
+    long steps[SEEKS], sorted[SEEKS];
+    struct matrix *expected[SEEKS] = { NULL };
+    struct matrix *m = copy(initial);
+    struct replay *replay = replay_create(journal, initial);
+    if (m == NULL || replay == NULL) {
+        CHECK(false, "%s: could not start the replay", what);
+        goto out;
+    }
+
+    /* The last and first steps, one on a checkpoint and one just before
+     * it, for matrices small enough to have them all, and the rest
+     * anywhere */
+    long n = journal->nentries;
+    long interval = (n + REPLAY_MAX_CHECKPOINTS - 1) / REPLAY_MAX_CHECKPOINTS;
+    for (int s = 0; s < SEEKS; s++)
+        steps[s] = (long) (check_random(state) % (n + 1));
+    steps[0] = n;
+    steps[1] = 0;
+    steps[2] = interval > 0 ? n / interval / 2 * interval : 0;
+    steps[3] = steps[2] > 0 ? steps[2] - 1 : 0;
+    memcpy(sorted, steps, sizeof(steps));
+    qsort(sorted, SEEKS, sizeof(long), compare_steps);
+
+    long done = 0;
+    for (int s = 0; s < SEEKS; s++) {
+        while (done < sorted[s])
+            apply(&journal->entries[done++], m);
+        expected[s] = copy(m);
+        if (expected[s] == NULL) {
+            CHECK(false, "%s: could not copy step %ld", what, done);
+            goto out;
+        }
+    }
+    CHECK(check_same(m, final), "%s: the operations by hand don't give the result", what);
+
+    for (int s = 0; s < SEEKS; s++) {
+        int k = 0;
+        while (sorted[k] != steps[s])
+            k++;
+        CHECK(check_same(replay_seek(replay, steps[s]), expected[k]),
+              "%s: step %ld of %ld differs", what, steps[s], n);
+    }
+    CHECK(check_same(replay_seek(replay, n), final), "%s: the last step differs", what);
+out:
+    for (int s = 0; s < SEEKS; s++)
+        matrix_free(expected[s]);
+    matrix_free(m);
+    replay_free(replay);
+}
+
+/* Journal one engine on one matrix both ways, and replay them */
+static void check_engine (enum engine engine, const struct matrix *m, uint64_t *state)
+{
+    char what[64];
+    snprintf(what, sizeof(what), "%s, %d x %d", engine_names[engine], m->nrows, m->ncols);
+    struct matrix *text_result = copy(m);
+    struct matrix *binary_result = copy(m);
+    struct journal *text = NULL, *binary = NULL;
+    if (text_result == NULL || binary_result == NULL) {
+        CHECK(false, "%s: could not allocate", what);
+        goto out;
+    }
+
+    CHECK(run(engine, text_result, text_path, false), "%s: text journal failed", what);
+    CHECK(run(engine, binary_result, binary_path, true), "%s: binary journal failed", what);
+    CHECK(check_same(text_result, binary_result), "%s: journals changed the result", what);
+    text = journal_load(text_path);
+    binary = journal_load(binary_path);
+    if (text == NULL || binary == NULL) {
+        CHECK(false, "%s: could not load the journals", what);
+        goto out;
+    }
+    CHECK(text->nentries > 0, "%s: nothing journaled", what);
+    CHECK(same_entries(text, binary), "%s: text and binary journals differ", what);
+
+    check_seeks(text, m, text_result, what, state);
+    check_seeks(binary, m, binary_result, what, state);
+out:
+    journal_free(text);
+    journal_free(binary);
+    matrix_free(text_result);
+    matrix_free(binary_result);
+}
+
+int main (void)
+{
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    check_quiet();
+    kernels_init();
+    int fd = mkstemp(text_path);
+    if (fd < 0 || close(fd) != 0 || (fd = mkstemp(binary_path)) < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    for (int t = 0; t < TRIES; t++) {
+        /* Small enough for the plain engine, and big enough for panels,
+         * with reals that round and a rank that leaves rows of zeroes */
+        int n = t < 2 ? check_int(&state, 2, 40) : check_int(&state, 2 * PANEL_COLS, 200);
+        int c = t < 2 ? check_int(&state, 2, 40) : check_int(&state, 2 * PANEL_COLS, 200);
+        struct matrix *m = matrix_create(n, c);
+        if (m == NULL) {
+            CHECK(false, "could not allocate a %d x %d matrix", n, c);
+            continue;
+        }
+        check_fill(m, check_int(&state, 1, n), &state);
+        for (enum engine e = AUTO; e <= BLOCKED_GAUSS_JORDAN; e++)
+            check_engine(e, m, &state);
+
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < c; j++)
+                MAT(m, i, j) = check_double(&state);
+        for (enum engine e = AUTO; e <= BLOCKED_GAUSS_JORDAN; e++)
+            check_engine(e, m, &state);
+        matrix_free(m);
+    }
+    unlink(text_path);
+    unlink(binary_path);
+    return check_done("journal");
+}
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include "automatic.h"
+#include "check.h"
+#include "matrix_proc.h"
+
+/* Each version of the kernels against plain loops, bit for bit. */
+
+/* Lengths to try, across every vector width and the update column blocks */
+static const int lengths[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32,
+                               33, 63, 64, 65, 70, 511, 512, 513, 600 };
+#define NLENGTHS ((int) (sizeof(lengths) / sizeof(lengths[0])))
+#define MAXLEN 600
+#define OFFSETS 4
+#define MAXROWS 6
+
+static double a[MAXLEN + OFFSETS], b[MAXLEN + OFFSETS];
+static double ref_a[MAXLEN + OFFSETS], ref_b[MAXLEN + OFFSETS];
+
+static void fill (double *x, int n, uint64_t *state)
+{
+    for (int j = 0; j < n; j++)
+        x[j] = check_double(state);
+}
+
+static void check_rows (uint64_t *state)
+{
+    for (int t = 0; t < NLENGTHS; t++) {
+        int n = lengths[t];
+        for (int off = 0; off < OFFSETS; off++) {
+            double s = check_double(state);
+            fill(a, MAXLEN + OFFSETS, state);
+            fill(b, MAXLEN + OFFSETS, state);
+            memcpy(ref_a, a, sizeof(a));
+            memcpy(ref_b, b, sizeof(b));
+
+            kernels.axpy(a + off, b + off, s, n);
+            for (int j = 0; j < n; j++)
+                ref_a[off + j] += s * ref_b[off + j];
+            CHECK(memcmp(a, ref_a, sizeof(a)) == 0, "axpy, n %d offset %d", n, off);
+
+            kernels.scale(b + off, s, n);
+            for (int j = 0; j < n; j++)
+                ref_b[off + j] *= s;
+            CHECK(memcmp(b, ref_b, sizeof(b)) == 0, "scale, n %d offset %d", n, off);
+
+            kernels.swap(a + off, b + off, n);
+            for (int j = 0; j < n; j++) {
+                double temp = ref_a[off + j];
+                ref_a[off + j] = ref_b[off + j];
+                ref_b[off + j] = temp;
+            }
+            CHECK(memcmp(a, ref_a, sizeof(a)) == 0 && memcmp(b, ref_b, sizeof(b)) == 0,
+                  "swap, n %d offset %d", n, off);
+        }
+    }
+}
+
+static void check_update (uint64_t *state)
+{
+    static double c[MAXROWS][MAXLEN], ref[MAXROWS][MAXLEN], u[MAXROWS][MAXLEN];
+    double l[MAXROWS][MAXROWS];
+    const double *rows[MAXROWS];
+
+    for (int t = 0; t < NLENGTHS; t++) {
+        int n = lengths[t];
+        for (int m = 1; m <= MAXROWS; m++) {
+            for (int k = 0; k < MAXROWS; k++) {
+                fill(&c[0][0], MAXROWS * MAXLEN, state);
+                fill(&u[0][0], MAXROWS * MAXLEN, state);
+                fill(&l[0][0], MAXROWS * MAXROWS, state);
+                memcpy(ref, c, sizeof(c));
+                for (int p = 0; p < k; p++)
+                    rows[p] = u[p];
+
+                kernels.update(&c[0][0], MAXLEN, &l[0][0], MAXROWS, rows, m, n, k);
+                for (int i = 0; i < m; i++)
+                    for (int p = 0; p < k; p++)
+                        for (int j = 0; j < n; j++)
+                            ref[i][j] += l[i][p] * u[p][j];
+                CHECK(memcmp(c, ref, sizeof(c)) == 0, "update, m %d n %d k %d", m, n, k);
+            }
+        }
+    }
+}
+
+/* Two rows that cancel exactly, as long as nothing is fused: the second
+ * row is twice the first, and 1/3 rounds the same way both times */
+static void check_cancelling (void)
+{
+    const double v[] = { -3, -1, -2, 2,
+                         -6, -2, -4, 4 };
+    int pivots[2];
+
+    struct matrix *m = check_matrix(2, 4, v);
+    CHECK(m != NULL && auto_gauss_jordan(m, TRACE_QUIET), "gauss jordan failed");
+    if (m != NULL) {
+        CHECK(pivot_columns(m, pivots) == 1, "gauss jordan found rank %d",
+              pivot_columns(m, pivots));
+        matrix_free(m);
+    }
+
+    m = check_matrix(2, 4, v);
+    CHECK(m != NULL && auto_echelon(m, TRACE_QUIET) &&
+          auto_reduced_echelon(m, TRACE_QUIET), "echelon failed");
+    if (m != NULL) {
+        CHECK(pivot_columns(m, pivots) == 1, "echelon found rank %d",
+              pivot_columns(m, pivots));
+        matrix_free(m);
+    }
+}
+
+int main (void)
+{
+    uint64_t state = 88172645463325252ull;
+    kernels_init();
+    check_rows(&state);
+    check_update(&state);
+    check_cancelling();
+    return check_done("kernels");
+}
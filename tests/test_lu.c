@@ -0,0 +1,139 @@
+#include <math.h>
+#include "automatic.h"
+#include "check.h"
+#include "lu.h"
+
+/* Factors against the automatic engine: the same rank, and solutions
+ * and inverses that agree to rounding error. */
+
+#define TRIES 20
+#define MAXN 150
+
+/* The biggest difference between two matrices' entries, relative to the
+ * biggest entry of either */
+static double difference (const struct matrix *a, const struct matrix *b)
+{
+    double diff = 0, size = 1;
+    for (int i = 0; i < a->nrows; i++) {
+        for (int j = 0; j < a->ncols; j++) {
+            diff = fmax(diff, fabs(MAT(a, i, j) - MAT(b, i, j)));
+            size = fmax(size, fmax(fabs(MAT(a, i, j)), fabs(MAT(b, i, j))));
+        }
+    }
+    return diff / size;
+}
+
+static struct matrix *copy (const struct matrix *m)
+{
+    struct matrix *c = matrix_create(m->nrows, m->ncols);
+    for (int i = 0; i < m->nrows && c != NULL; i++)
+        memcpy(matrix_row(c, i), matrix_row(m, i), m->ncols * sizeof(double));
+    return c;
+}
+
+/* A system [A | B] with a random A of full rank against -g */
+static void check_solve (int n, int m, uint64_t *state)
+{
+    struct matrix *a = matrix_create(n, n + m);
+    check_fill(a, n, state);
+    struct matrix *expected = copy(a);
+    CHECK(auto_gauss_jordan(expected, TRACE_QUIET), "gauss jordan failed");
+
+    struct lu_factors *f = lu_factor(a, n);
+    CHECK(f != NULL, "%d x %d: could not factor", n, n + m);
+    if (f != NULL) {
+        // Random integer rows are independent, all but surely
+        CHECK(f->rank == n, "%d x %d: rank %d", n, n + m, f->rank);
+        if (f->rank == n) {
+            CHECK(lu_solve(f, a), "%d x %d: could not solve", n, n + m);
+            CHECK(difference(a, expected) < 1e-8, "%d x %d: solution off by %g",
+                  n, n + m, difference(a, expected));
+        }
+        lu_release(f);
+    }
+    matrix_free(a);
+    matrix_free(expected);
+}
+
+/* An A of known rank, which the automatic engine would likely get wrong,
+ * since the rows that should cancel leave rounding errors behind */
+static void check_singular (int n, int rank, uint64_t *state)
+{
+    struct matrix *a = matrix_create(n, n + 1);
+    check_fill(a, rank, state);
+    struct lu_factors *f = lu_factor(a, n);
+    CHECK(f != NULL, "%d x %d: could not factor", n, n + 1);
+    if (f != NULL) {
+        CHECK(f->rank == rank, "%d x %d of rank %d: factors have rank %d",
+              n, n, rank, f->rank);
+        if (f->rank < n) {
+            CHECK(lu_determinant(f) == 0, "singular determinant %g", lu_determinant(f));
+            CHECK(!lu_solve(f, a), "solved with singular factors");
+            struct matrix *inverse = lu_inverse(f);
+            CHECK(inverse == NULL, "inverted singular factors");
+            matrix_free(inverse);
+        }
+        lu_release(f);
+    }
+    matrix_free(a);
+}
+
+/* The inverse times A is I */
+static void check_inverse (int n, uint64_t *state)
+{
+    struct matrix *a = matrix_create(n, n);
+    check_fill(a, n, state);
+    struct lu_factors *f = lu_factor(a, n);
+    struct matrix *inverse = f != NULL && f->rank == n ? lu_inverse(f) : NULL;
+    if (inverse != NULL) {
+        double worst = 0;
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                double x = 0;
+                for (int p = 0; p < n; p++)
+                    x += MAT(inverse, i, p) * MAT(a, p, j);
+                worst = fmax(worst, fabs(x - (i == j)));
+            }
+        }
+        CHECK(worst < 1e-8, "%d x %d inverse off by %g", n, n, worst);
+    }
+    matrix_free(inverse);
+    lu_release(f);
+    matrix_free(a);
+}
+
+/* The matrix that exact zero pivots took for rank 3, with determinant
+ * -9.5e-16 */
+static void check_rounding (void)
+{
+    const double v[] = { 1, 2, 3,
+                         4, 5, 6,
+                         7, 8, 9 };
+    struct matrix *a = check_matrix(3, 3, v);
+    struct lu_factors *f = a != NULL ? lu_factor(a, 3) : NULL;
+    CHECK(f != NULL, "could not factor");
+    if (f != NULL) {
+        CHECK(f->rank == 2, "rank %d", f->rank);
+        CHECK(lu_determinant(f) == 0, "determinant %g", lu_determinant(f));
+        struct matrix *inverse = lu_inverse(f);
+        CHECK(inverse == NULL, "inverted a singular matrix");
+        matrix_free(inverse);
+        lu_release(f);
+    }
+    matrix_free(a);
+}
+
+int main (void)
+{
+    uint64_t state = 1181783497276652981ull;
+    check_quiet();
+    kernels_init();
+    check_rounding();
+    for (int t = 0; t < TRIES; t++) {
+        int n = check_int(&state, 1, MAXN);
+        check_solve(n, check_int(&state, 1, 5), &state);
+        check_singular(n, check_int(&state, 1, n), &state);
+        check_inverse(n, &state);
+    }
+    return check_done("lu");
+}
@@ -0,0 +1,152 @@
+#include <math.h>
+#include "automatic.h"
+#include "check.h"
+#include "mixed.h"
+
+/* Mixed precision against auto_gauss_jordan: solutions that agree to
+ * rounding error, and singular or non-square matrices handed over to it. */
+
+#define TRIES 20
+#define MAXN 120
+
+static struct matrix *copy (const struct matrix *m)
+{
+    struct matrix *c = matrix_create(m->nrows, m->ncols);
+    for (int i = 0; i < m->nrows && c != NULL; i++)
+        memcpy(matrix_row(c, i), matrix_row(m, i), m->ncols * sizeof(double));
+    return c;
+}
+
+/* Reduce a matrix both ways.
+ *
+ * pre:  m is initialized
+ * post: returns the biggest difference between the results, relative to
+ *       their biggest entry, or -1 if they differ in shape or success;
+ *       report says how mixed precision went
+ */
+static double compare (const struct matrix *m, struct mixed_report *report)
+{
+    struct matrix *mixed = copy(m);
+    struct matrix *expected = copy(m);
+    double diff = -1;
+    if (mixed != NULL && expected != NULL
+            && mixed_reduced_echelon(mixed, report)
+            && auto_gauss_jordan(expected, TRACE_QUIET)) {
+        double size = 1;
+        diff = 0;
+        for (int i = 0; i < m->nrows; i++) {
+            for (int j = 0; j < m->ncols; j++) {
+                double x = MAT(mixed, i, j), y = MAT(expected, i, j);
+                diff = fmax(diff, fabs(x - y));
+                size = fmax(size, fmax(fabs(x), fabs(y)));
+            }
+        }
+        diff /= size;
+    }
+    matrix_free(mixed);
+    matrix_free(expected);
+    return diff;
+}
+
+/* Random systems, which the float factors solve */
+static void check_systems (uint64_t *state)
+{
+    for (int t = 0; t < TRIES; t++) {
+        int n = check_int(state, 1, MAXN), m = check_int(state, 1, 40);
+        struct matrix *a = matrix_create(n, n + m);
+        check_fill(a, n, state);
+        struct mixed_report report;
+        double diff = compare(a, &report);
+        CHECK(diff >= 0 && diff < 1e-9, "%d x %d: off by %g", n, n + m, diff);
+        CHECK(report.path != MIXED_ELIMINATION, "%d x %d: eliminated", n, n + m);
+        matrix_free(a);
+    }
+}
+
+/* Singular systems, whose A has rows that are combinations of the others,
+ * eliminated just like -g would */
+static void check_singular (uint64_t *state)
+{
+    for (int t = 0; t < TRIES; t++) {
+        int n = check_int(state, 2, MAXN);
+        struct matrix *a = matrix_create(n, n + 1);
+        check_fill(a, check_int(state, 1, n - 1), state);
+        struct mixed_report report;
+        double diff = compare(a, &report);
+        CHECK(diff == 0, "%d x %d singular: off by %g", n, n + 1, diff);
+        CHECK(report.path == MIXED_ELIMINATION, "%d x %d singular: path %d",
+              n, n + 1, report.path);
+        matrix_free(a);
+    }
+}
+
+/* The matrix whose rounding errors the float factors took for pivots */
+static void check_rounding (void)
+{
+    const double v[] = { 1, 2, 3, 1,
+                         4, 5, 6, 1,
+                         7, 8, 9, 1 };
+    struct matrix *a = check_matrix(3, 4, v);
+    struct mixed_report report;
+    CHECK(compare(a, &report) == 0, "[1..9 | 1] differs from -g");
+    CHECK(report.path == MIXED_ELIMINATION, "[1..9 | 1] took path %d", report.path);
+    matrix_free(a);
+}
+
+/* A Hilbert matrix, far too ill-conditioned for float factors but solved
+ * to double accuracy some other way */
+static void check_hilbert (void)
+{
+    int n = 10;
+    struct matrix *a = matrix_create(n, n + 1);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++)
+            MAT(a, i, j) = 1.0 / (i + j + 1);
+        MAT(a, i, n) = 1;
+    }
+    struct mixed_report report;
+    struct matrix *x = copy(a);
+    CHECK(mixed_reduced_echelon(x, &report), "hilbert failed");
+    CHECK(report.path != MIXED_SINGLE, "hilbert solved in float");
+
+    double worst = 0;
+    for (int i = 0; i < n; i++) {
+        double r = -MAT(a, i, n);
+        for (int j = 0; j < n; j++)
+            r += MAT(a, i, j) * MAT(x, j, n);
+        worst = fmax(worst, fabs(r));
+    }
+    CHECK(worst < 1e-6, "hilbert residual %g", worst);
+    matrix_free(x);
+    matrix_free(a);
+}
+
+/* No right-hand side, or more rows than columns */
+static void check_shapes (uint64_t *state)
+{
+    struct mixed_report report;
+    struct matrix *a = matrix_create(6, 6);
+    check_fill(a, 6, state);
+    CHECK(compare(a, &report) == 0 && report.path == MIXED_ELIMINATION,
+          "square matrix not eliminated");
+    matrix_free(a);
+
+    a = matrix_create(7, 5);
+    check_fill(a, 4, state);
+    CHECK(compare(a, &report) == 0 && report.path == MIXED_ELIMINATION,
+          "tall matrix not eliminated");
+    matrix_free(a);
+}
+
+int main (void)
+{
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    check_quiet();
+    kernels_init();
+    check_rounding();
+    check_systems(&state);
+    check_singular(&state);
+    check_hilbert();
+    check_shapes(&state);
+    return check_done("mixed");
+}
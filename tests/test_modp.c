@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include "check.h"
+#include "modp.h"
+
+/* Elimination mod p against a plain version of the same steps, with
+ * products in 128 bits and inverses by Fermat's little theorem: the same
+ * echelon and reduced echelon forms exactly, for primes that the kernels
+ * take through vectors and primes near 2^63 that they take through Shoup's
+ * method. Also moduli and tokens at the edges of what parses. */
+
+#define TRIES 12
+#define MAXN 40
+
+static const uint64_t primes[] = {
+    3, 65521, 2147483647,                        // below 2^31
+    4294967311ull,                               // just over 2^32
+    9223372036854775783ull,                      // the largest below 2^63
+};
+
+static uint64_t mul (uint64_t a, uint64_t b, uint64_t p)
+{
+    return (uint64_t) ((unsigned __int128) a * b % p);
+}
+
+static uint64_t inverse (uint64_t a, uint64_t p)
+{
+    uint64_t r = 1;
+    for (uint64_t e = p - 2; e > 0; e >>= 1) {
+        if (e & 1)
+            r = mul(r, a, p);
+        a = mul(a, a, p);
+    }
+    return r;
+}
+
+/* row dst += s * row src, from column from on */
+static void add_scaled_mod (struct modp_matrix *m, int dst, int src, uint64_t s, int from)
+{
+    for (int j = from; j < m->ncols; j++) {
+        uint64_t t = mul(s, MODP(m, src, j), m->p);
+        MODP(m, dst, j) = MODP(m, dst, j) >= m->p - t ? MODP(m, dst, j) - (m->p - t)
+                                                     : MODP(m, dst, j) + t;
+    }
+}
+
+static int leading (const struct modp_matrix *m, int i)
+{
+    int j = 0;
+    while (j < m->ncols && MODP(m, i, j) == 0)
+        j++;
+    return j;
+}
+
+/* modp_echelon the plain way, choosing pivot rows as it does */
+static void plain_echelon (struct modp_matrix *m)
+{
+    int last_leading = -1;
+    for (int i = 0; i < m->nrows; i++) {
+        int current = leading(m, i);
+        for (int k = i + 1; k < m->nrows && current != last_leading + 1; k++) {
+            int lead = leading(m, k);
+            if (lead < current) {
+                uint64_t *temp = m->rows[i];
+                m->rows[i] = m->rows[k];
+                m->rows[k] = temp;
+                current = lead;
+            }
+        }
+        if (current == m->ncols)
+            break;
+        uint64_t s = inverse(MODP(m, i, current), m->p);
+        for (int j = current; j < m->ncols; j++)
+            MODP(m, i, j) = mul(MODP(m, i, j), s, m->p);
+        for (int k = i + 1; k < m->nrows; k++) {
+            if (MODP(m, k, current) != 0)
+                add_scaled_mod(m, k, i, m->p - MODP(m, k, current), current);
+        }
+        last_leading = current;
+    }
+}
+
+/* modp_reduced_echelon the plain way */
+static void plain_reduce (struct modp_matrix *m)
+{
+    for (int i = m->nrows - 1; i >= 0; i--) {
+        int lead = leading(m, i);
+        if (lead == m->ncols)
+            continue;
+        for (int k = 0; k < i; k++) {
+            if (MODP(m, k, lead) != 0)
+                add_scaled_mod(m, k, i, m->p - MODP(m, k, lead), lead);
+        }
+    }
+}
+
+static struct modp_matrix *copy (const struct modp_matrix *m)
+{
+    struct modp_matrix *c = modp_create(m->nrows, m->ncols, m->p);
+    for (int i = 0; i < m->nrows && c != NULL; i++)
+        memcpy(c->rows[i], m->rows[i], m->ncols * sizeof(uint64_t));
+    return c;
+}
+
+static bool same (const struct modp_matrix *a, const struct modp_matrix *b)
+{
+    for (int i = 0; i < a->nrows; i++)
+        if (memcmp(a->rows[i], b->rows[i], a->ncols * sizeof(uint64_t)) != 0)
+            return false;
+    return true;
+}
+
+/* A random matrix mod p whose rows from the rank-th on are combinations of
+ * the ones before them, against the plain steps */
+static void check_random_mod (int n, int c, int rank, uint64_t p, uint64_t *state)
+{
+    struct modp_matrix *m = modp_create(n, c, p);
+    struct modp_matrix *plain = NULL;
+    int *pivots = malloc(n * sizeof(int));
+    int *plain_pivots = malloc(n * sizeof(int));
+    if (m == NULL || pivots == NULL || plain_pivots == NULL) {
+        CHECK(false, "could not allocate a %d x %d matrix mod %llu", n, c,
+              (unsigned long long) p);
+        goto out;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < c && i < rank; j++)
+            MODP(m, i, j) = check_random(state) % p;
+        for (int k = 0; k < rank && i >= rank; k++)
+            add_scaled_mod(m, i, k, check_random(state) % p, 0);
+    }
+    plain = copy(m);
+    if (plain == NULL) {
+        CHECK(false, "could not copy a %d x %d matrix", n, c);
+        goto out;
+    }
+
+    CHECK(modp_echelon(m, TRACE_QUIET), "%d x %d mod %llu: echelon failed", n, c,
+          (unsigned long long) p);
+    plain_echelon(plain);
+    CHECK(same(m, plain), "%d x %d mod %llu: echelon forms differ", n, c,
+          (unsigned long long) p);
+    int found = modp_pivot_columns(m, pivots);
+    int expected = rank < c ? rank : c;
+    CHECK(found <= expected && found == modp_pivot_columns(plain, plain_pivots)
+          && memcmp(pivots, plain_pivots, found * sizeof(int)) == 0,
+          "%d x %d mod %llu: rank %d", n, c, (unsigned long long) p, found);
+
+    modp_reduced_echelon(m, TRACE_QUIET);
+    plain_reduce(plain);
+    CHECK(same(m, plain), "%d x %d mod %llu: reduced forms differ", n, c,
+          (unsigned long long) p);
+out:
+    modp_free(m);
+    modp_free(plain);
+    free(pivots);
+    free(plain_pivots);
+}
+
+/* Check that a token parses mod p to value, or not at all if fails */
+static void check_token (const char *tok, uint64_t p, uint64_t value, bool fails)
+{
+    uint64_t got = 0;
+    bool parsed = parse_modular(tok, p, &got);
+    if (fails)
+        CHECK(!parsed, "\"%s\" parsed mod %llu", tok, (unsigned long long) p);
+    else
+        CHECK(parsed && got == value, "\"%s\" mod %llu is %llu, not %llu", tok,
+              (unsigned long long) p, (unsigned long long) got,
+              (unsigned long long) value);
+}
+
+static void check_parsing (void)
+{
+    uint64_t big = primes[4];
+    uint64_t p;
+    CHECK(parse_modulus("9223372036854775783", &p) && p == big, "largest prime refused");
+    CHECK(!parse_modulus("9223372036854775837", &p), "a prime over 2^63 taken");
+    CHECK(!parse_modulus("1", &p) && !parse_modulus("4", &p) && !parse_modulus("x", &p),
+          "a modulus that isn't prime taken");
+
+    check_token("10", 7, 3, false);
+    check_token("-1", 7, 6, false);
+    check_token("1/3", 7, 5, false);
+    check_token("-2/3", 7, 4, false);
+    check_token("0.5", 7, 4, false);
+    check_token("1e2", 7, 2, false);
+    check_token("2.5e-1", 7, 2, false);
+    check_token("1/7", 7, 0, true);
+    check_token("x", 7, 0, true);
+
+    // Inverses at the ends of the range, where Euclid's steps are longest
+    check_token("1/1", big, 1, false);
+    check_token("1/2", big, (big + 1) / 2, false);
+    check_token("1/9223372036854775782", big, big - 1, false);
+    check_token("1/2147483646", 2147483647, 2147483646, false);
+    check_token("-1", big, big - 1, false);
+    check_token("9223372036854775783", big, 0, false);
+    check_token("18446744073709551616", big, 50, false); // 2^64 - 2p
+    check_token("1/18446744073709551566", big, 0, true); // 2p
+}
+
+int main (void)
+{
+    uint64_t state = 0xda942042e4dd58b5ull;
+    check_quiet();
+    kernels_init();
+    check_parsing();
+    for (size_t q = 0; q < sizeof(primes) / sizeof(primes[0]); q++) {
+        for (int t = 0; t < TRIES; t++) {
+            int n = check_int(&state, 1, MAXN), c = check_int(&state, 1, MAXN);
+            check_random_mod(n, c, t % 2 == 0 ? n : check_int(&state, 0, n),
+                             primes[q], &state);
+        }
+    }
+    return check_done("modp");
+}
@@ -0,0 +1,118 @@
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "automatic.h"
+#include "check.h"
+#include "matrix_file.h"
+#include "matrix_proc.h"
+#include "outcore.h"
+
+/* Out-of-core reduction of a matrix file against auto_gauss_jordan in
+ * memory: the same rank and rows, to rounding error, whatever the number
+ * of slabs. */
+
+#define TRIES 12
+#define MAXN 90
+
+static char path[] = "/tmp/test_outcore_XXXXXX";
+
+/* The biggest difference between two matrices' entries, relative to the
+ * biggest entry of either */
+static double difference (const struct matrix *a, const struct matrix *b)
+{
+    double diff = 0, size = 1;
+    for (int i = 0; i < a->nrows; i++) {
+        for (int j = 0; j < a->ncols; j++) {
+            diff = fmax(diff, fabs(MAT(a, i, j) - MAT(b, i, j)));
+            size = fmax(size, fmax(fabs(MAT(a, i, j)), fabs(MAT(b, i, j))));
+        }
+    }
+    return diff / size;
+}
+
+/* Reduce a matrix through the file in slabs of slab_rows rows, and in
+ * memory, and compare them */
+static void check_slabs (struct matrix *m, int slab_rows, int rank)
+{
+    int n = m->nrows, c = m->ncols;
+    CHECK(matrix_file_write(path, m, NULL), "%d x %d: could not write: %s",
+          n, c, check_error);
+    size_t memory = (size_t) OUTCORE_SLABS * slab_rows * m->stride * sizeof(double);
+    int found = -1;
+    CHECK(outcore_reduce(path, memory, &found), "%d x %d in slabs of %d: %s",
+          n, c, slab_rows, check_error);
+    CHECK(found == rank, "%d x %d in slabs of %d: rank %d, not %d",
+          n, c, slab_rows, found, rank);
+
+    struct matrix *reduced = matrix_file_read(path);
+    CHECK(reduced != NULL, "%d x %d: could not read back: %s", n, c, check_error);
+    CHECK(auto_gauss_jordan(m, TRACE_QUIET), "%d x %d: gauss jordan failed", n, c);
+    if (reduced != NULL) {
+        CHECK(reduced->nrows == n && reduced->ncols == c, "%d x %d came back %d x %d",
+              n, c, reduced->nrows, reduced->ncols);
+        if (reduced->nrows == n && reduced->ncols == c)
+            CHECK(difference(reduced, m) < 1e-9, "%d x %d in slabs of %d: off by %g",
+                  n, c, slab_rows, difference(reduced, m));
+        matrix_free(reduced);
+    }
+}
+
+/* Too little memory for a row is reported, and the file left alone */
+static void check_refused (void)
+{
+    const double v[] = { 1, 2,
+                         3, 4 };
+    struct matrix *m = check_matrix(2, 2, v);
+    int rank;
+    CHECK(m != NULL && matrix_file_write(path, m, NULL), "could not write");
+    CHECK(!outcore_reduce(path, 1, &rank), "reduced in 1 byte");
+    CHECK(strstr(check_error, "Need at least") != NULL, "reported \"%s\"", check_error);
+    struct matrix *same = matrix_file_read(path);
+    CHECK(same != NULL && check_same(same, m), "the file changed");
+    matrix_free(same);
+    matrix_free(m);
+}
+
+int main (void)
+{
+    uint64_t state = 3935559000370003845ull;
+    check_quiet();
+    kernels_init();
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    close(fd);
+
+    for (int t = 0; t < TRIES; t++) {
+        /* Independent rows, kept so by a big diagonal since doubles
+         * round, and a few rows of zeroes that have to end up at the
+         * bottom */
+        int n = check_int(&state, 1, MAXN), c = check_int(&state, n, MAXN + 5);
+        struct matrix *m = matrix_create(n, c);
+        if (m == NULL) {
+            CHECK(false, "could not allocate a %d x %d matrix", n, c);
+            continue;
+        }
+        check_fill(m, n, &state);
+        for (int i = 0; i < n; i++)
+            MAT(m, i, i) += 100;
+        int rank = n;
+        for (int k = 0; k < n / 8; k++) {
+            int i = check_int(&state, 0, n - 1);
+            if (leading_pos(i, m) != -1) {
+                memset(matrix_row(m, i), 0, c * sizeof(double));
+                rank--;
+            }
+        }
+        // One slab, two, and slabs of a row or a few
+        int slabs[] = { n, (n + 1) / 2, 1, check_int(&state, 1, 7) };
+        int s = t % 4;
+        check_slabs(m, slabs[s], rank);
+        matrix_free(m);
+    }
+    check_refused();
+    unlink(path);
+    return check_done("outcore");
+}
@@ -0,0 +1,206 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "check.h"
+#include "reader.h"
+
+/* The reader against strtod: every number parsed the same, bit for bit,
+ * whether it takes the fast path or not, whether it is a fraction, and
+ * wherever the READER_CHUNK pieces of a file cut it off. Also the row,
+ * column and line that a bad value is reported at. */
+
+#define TOKENS 20000
+
+static char path[] = "/tmp/test_reader_XXXXXX";
+
+/* Write text to the test's file */
+static bool write_file (const char *text, size_t len)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return false;
+    bool written = fwrite(text, 1, len, f) == len;
+    return fclose(f) == 0 && written;
+}
+
+/* A random number as text: an integer, a decimal with up to 25 digits, an
+ * exponent, or a fraction of those */
+static int random_token (char *buf, uint64_t *state)
+{
+    int len = 0;
+    int parts = check_int(state, 0, 4) == 0 ? 2 : 1;
+    for (int part = 0; part < parts; part++) {
+        if (part == 1)
+            buf[len++] = '/';
+        if (check_int(state, 0, 2) == 0)
+            buf[len++] = check_int(state, 0, 1) ? '-' : '+';
+        int ndigits = check_int(state, 1, 25);
+        int point = check_int(state, -1, ndigits);
+        for (int k = 0; k < ndigits; k++) {
+            if (k == point)
+                buf[len++] = '.';
+            // Fractions need a denominator that isn't all zeroes
+            buf[len++] = '0' + (part == 1 && k == 0 ? check_int(state, 1, 9)
+                                                   : check_int(state, 0, 9));
+        }
+        if (check_int(state, 0, 2) == 0)
+            len += sprintf(buf + len, "e%d", check_int(state, -30, 30));
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/* The value of a token, by strtod */
+static double expected (const char *tok)
+{
+    char *end;
+    double num = strtod(tok, &end);
+    if (*end == '/')
+        num /= strtod(end + 1, NULL);
+    return num;
+}
+
+static bool same_double (double a, double b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+/* parse_double on one token */
+static void check_token (const char *tok)
+{
+    double value;
+    CHECK(parse_double(tok, &value), "\"%s\" not parsed", tok);
+    CHECK(same_double(value, expected(tok)), "\"%s\" is %.17g, not %.17g", tok,
+          value, expected(tok));
+}
+
+static void check_tokens (uint64_t *state)
+{
+    const char *edges[] = {
+        "0", "-0", "1e22", "1e23", "1e-22", "1e-23", "0.1", "9007199254740993",
+        "9007199254740992.5", "18446744073709551615", "18446744073709551616",
+        "000000000000000000000000123.5", "3.14159265358979323846264338327950288",
+        "1e308", "1e309", "-1e-320", "4.9e-324", "123456789012345678e-18",
+        "1/3", "-2/3", "1e2/4e1", "0.5/0.25", ".5", "5.", "+7",
+    };
+    for (size_t k = 0; k < sizeof(edges) / sizeof(edges[0]); k++)
+        check_token(edges[k]);
+
+    char buf[128];
+    for (int t = 0; t < TOKENS; t++) {
+        random_token(buf, state);
+        check_token(buf);
+    }
+
+    const char *bad[] = { "", "-", ".", "e5", "1e", "1e+", "1/", "/3", "1/0",
+                          "1/-0", "1x", "1/2/3", "--1", "1..2" };
+    double value;
+    for (size_t k = 0; k < sizeof(bad) / sizeof(bad[0]); k++)
+        CHECK(!parse_double(bad[k], &value), "\"%s\" parsed as %g", bad[k], value);
+}
+
+/* A file of numbers more than twice READER_CHUNK long, starting with pad
+ * spaces so that the ends of the pieces fall somewhere else in it each
+ * time, read back as a matrix */
+static void check_chunks (int pad, uint64_t *state)
+{
+    int ncols = 7;
+    size_t room = 3 * READER_CHUNK;
+    char *text = malloc(room);
+    double *values = malloc(room / 2 * sizeof(double));
+    struct matrix *m = NULL;
+    if (text == NULL || values == NULL) {
+        CHECK(false, "could not allocate the text");
+        goto out;
+    }
+
+    /* The size goes last, once the number of rows is known */
+    size_t len = 32 + pad;
+    int count = 0;
+    while (len < 2 * READER_CHUNK + 4096 || count % ncols != 0) {
+        char tok[128];
+        int n = random_token(tok, state);
+        values[count++] = expected(tok);
+        memcpy(text + len, tok, n);
+        len += n;
+        text[len++] = count % ncols == 0 ? '\n' : " ,\t"[check_int(state, 0, 2)];
+    }
+    int nrows = count / ncols;
+    int header = snprintf(text, 32, "%d %d", nrows, ncols);
+    memset(text + header, ' ', 32 + pad - header);
+    text[31 + pad] = '\n';
+
+    struct reader in;
+    int r, c;
+    CHECK(write_file(text, len) && reader_open(&in, path), "could not write %s", path);
+    CHECK(read_size(&in, &r, &c) && r == nrows && c == ncols, "size read as %d x %d", r, c);
+    m = matrix_create(nrows, ncols);
+    CHECK(m != NULL && read_matrix(&in, m), "pad %d: could not read the matrix", pad);
+    reader_close(&in);
+    for (int k = 0; k < count && m != NULL; k++) {
+        double v = MAT(m, k / ncols, k % ncols);
+        if (!same_double(v, values[k])) {
+            CHECK(false, "pad %d: value %d is %.17g, not %.17g", pad, k, v, values[k]);
+            break;
+        }
+    }
+out:
+    matrix_free(m);
+    free(text);
+    free(values);
+}
+
+/* Read a matrix from text that has a bad value, and check that the
+ * message on stderr names where it is */
+static void check_error_at (const char *text, const char *message)
+{
+    char log[] = "/tmp/test_reader_log_XXXXXX";
+    int fd = mkstemp(log);
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    dup2(fd, STDERR_FILENO);
+
+    struct reader in;
+    int nrows, ncols;
+    bool read = write_file(text, strlen(text)) && reader_open(&in, path)
+                && read_size(&in, &nrows, &ncols);
+    struct matrix *m = read ? matrix_create(nrows, ncols) : NULL;
+    read = m != NULL && read_matrix(&in, m);
+    reader_close(&in);
+    matrix_free(m);
+
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    char got[256] = "";
+    ssize_t n = pread(fd, got, sizeof(got) - 1, 0);
+    got[n > 0 ? n : 0] = '\0';
+    close(fd);
+    unlink(log);
+    CHECK(!read && strstr(got, message) != NULL, "reported \"%s\", not \"%s\"",
+          got, message);
+}
+
+int main (void)
+{
+    uint64_t state = 0xb5ad4eceda1ce2a9ull;
+    check_quiet();
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    close(fd);
+
+    check_tokens(&state);
+    for (int pad = 0; pad < 24; pad++)
+        check_chunks(pad, &state);
+
+    check_error_at("2 3\n1 2 3\n4 x 6\n", "row 2, column 2 on line 3");
+    check_error_at("2 2\n1\n\n2\n3 1/0\n", "row 2, column 2 on line 5");
+    check_error_at("2 3\n1 2 3\n4 5\n", "Input ended before row 2, column 3");
+    check_error_at("1 3\n1,2;three\n", "row 1, column 3 on line 2");
+    unlink(path);
+    return check_done("reader");
+}
@@ -0,0 +1,207 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "automatic.h"
+#include "check.h"
+#include "matrix_proc.h"
+#include "server.h"
+
+/* A server on a pair of pipes against the engines called directly: the
+ * same rows and pivots for every operation, requests over the limit
+ * refused without ending the connection, and sizes past 64 bits refused. */
+
+#define TRIES 30
+#define LIMIT_MB 1
+
+static int to_server, from_server;
+
+/* Start a server in a child process, reading and writing the pipes, and
+ * writing its errors nowhere if hushed */
+static pid_t start_server (bool hushed)
+{
+    int requests[2], responses[2];
+    if (pipe(requests) != 0 || pipe(responses) != 0)
+        return -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(requests[0], STDIN_FILENO);
+        dup2(responses[1], STDOUT_FILENO);
+        close(requests[1]);
+        close(responses[0]);
+        if (hushed)
+            dup2(open("/dev/null", O_WRONLY), STDERR_FILENO);
+        _exit(serve(NULL, LIMIT_MB) ? 0 : 1);
+    }
+    close(requests[0]);
+    close(responses[1]);
+    to_server = requests[1];
+    from_server = responses[0];
+    return pid;
+}
+
+static bool put (const void *p, size_t n)
+{
+    for (const char *c = p; n > 0; ) {
+        ssize_t w = write(to_server, c, n);
+        if (w <= 0)
+            return false;
+        c += w;
+        n -= w;
+    }
+    return true;
+}
+
+static bool get (void *p, size_t n)
+{
+    for (char *c = p; n > 0; ) {
+        ssize_t r = read(from_server, c, n);
+        if (r <= 0)
+            return false;
+        c += r;
+        n -= r;
+    }
+    return true;
+}
+
+/* Send a request for a matrix, whose entries are sent only if send_rows */
+static bool request (enum server_op op, const struct matrix *m, bool send_rows)
+{
+    struct server_request req = {
+        .magic = SERVER_REQUEST_MAGIC, .version = SERVER_VERSION, .op = op,
+        .byte_order = SERVER_BYTE_ORDER, .nrows = m->nrows, .ncols = m->ncols,
+    };
+    bool sent = put(&req, sizeof(req));
+    for (int i = 0; i < m->nrows && sent && send_rows; i++)
+        sent = put(matrix_row(m, i), m->ncols * sizeof(double));
+    return sent;
+}
+
+/* Read a response into a matrix of the expected size and its pivots */
+static bool response (struct server_response *r, struct matrix *m, int *pivots)
+{
+    if (!get(r, sizeof(*r)))
+        return false;
+    bool got = true;
+    for (uint32_t i = 0; i < r->nrows && got; i++)
+        got = (int) r->ncols == m->ncols && get(matrix_row(m, i), m->ncols * sizeof(double));
+    for (int k = 0; k < r->rank && got; k++) {
+        int64_t pivot;
+        got = get(&pivot, sizeof(pivot));
+        pivots[k] = (int) pivot;
+    }
+    char error[1024];
+    return got && r->length < sizeof(error) && get(error, r->length);
+}
+
+/* A random matrix through each operation, against the engines */
+static void check_ops (uint64_t *state)
+{
+    for (int t = 0; t < TRIES; t++) {
+        int nrows = check_int(state, 1, 40), ncols = check_int(state, 1, 40);
+        enum server_op op = SERVER_ECHELON + t % 4;
+        struct matrix *m = matrix_create(nrows, ncols);
+        struct matrix *expected = matrix_create(nrows, ncols);
+        struct matrix *got = matrix_create(nrows, ncols);
+        int *pivots = malloc(nrows * sizeof(int));
+        int *expected_pivots = malloc(nrows * sizeof(int));
+        check_fill(m, check_int(state, 1, nrows), state);
+        for (int i = 0; i < nrows; i++)
+            memcpy(matrix_row(expected, i), matrix_row(m, i), ncols * sizeof(double));
+
+        bool solved = op == SERVER_GAUSS_JORDAN ? auto_gauss_jordan(expected, TRACE_QUIET)
+                      : auto_echelon(expected, TRACE_QUIET);
+        if (op == SERVER_REDUCE)
+            solved = solved && auto_reduced_echelon(expected, TRACE_QUIET);
+        int rank = pivot_columns(expected, expected_pivots);
+
+        struct server_response r;
+        CHECK(solved && request(op, m, true) && response(&r, got, pivots),
+              "%d x %d op %d: no response", nrows, ncols, op);
+        CHECK(r.status == SERVER_OK && r.rank == rank,
+              "%d x %d op %d: status %d rank %d, not %d", nrows, ncols, op,
+              r.status, r.rank, rank);
+        CHECK(r.nrows == (op == SERVER_RANK ? 0 : (uint32_t) nrows),
+              "%d x %d op %d: %u rows", nrows, ncols, op, r.nrows);
+        CHECK(op == SERVER_RANK || check_same(got, expected),
+              "%d x %d op %d: rows differ", nrows, ncols, op);
+        CHECK(memcmp(pivots, expected_pivots, rank * sizeof(int)) == 0,
+              "%d x %d op %d: pivots differ", nrows, ncols, op);
+        free(pivots);
+        free(expected_pivots);
+        matrix_free(m);
+        matrix_free(expected);
+        matrix_free(got);
+    }
+}
+
+/* A request over the limit is refused, its entries skipped, and the next
+ * one served */
+static void check_limit (void)
+{
+    int n = 400; // 400 * 400 doubles are over 1 MB
+    struct matrix *big = matrix_create(n, n);
+    struct matrix *small = matrix_create(2, 2);
+    int pivots[2];
+    MAT(small, 0, 0) = 2;
+    MAT(small, 1, 1) = 3;
+    struct server_response r;
+    CHECK(big != NULL && request(SERVER_RANK, big, true) && response(&r, small, pivots),
+          "no response to a big request");
+    CHECK(r.status == SERVER_BAD_REQUEST, "big request got status %d", r.status);
+    CHECK(request(SERVER_RANK, small, true) && response(&r, small, pivots),
+          "no response after a big request");
+    CHECK(r.status == SERVER_OK && r.rank == 2, "after a big request: status %d rank %d",
+          r.status, r.rank);
+    matrix_free(big);
+    matrix_free(small);
+}
+
+/* A request whose size in bytes doesn't fit in 64 bits, and used to wrap
+ * around to below the limit, is refused and ends the connection, since
+ * its entries can't be skipped */
+static void check_overflow (void)
+{
+    pid_t pid = start_server(true);
+    CHECK(pid > 0, "could not start a server");
+    if (pid <= 0)
+        return;
+    struct server_request req = {
+        .magic = SERVER_REQUEST_MAGIC, .version = SERVER_VERSION, .op = SERVER_RANK,
+        .byte_order = SERVER_BYTE_ORDER, .nrows = 1073774337, .ncols = 2147418624,
+    };
+    struct matrix *none = matrix_create(1, 1);
+    int pivots[1];
+    struct server_response r;
+    CHECK(none != NULL && put(&req, sizeof(req)) && response(&r, none, pivots),
+          "no response to a request past 64 bits");
+    CHECK(r.status == SERVER_BAD_REQUEST, "request past 64 bits got status %d", r.status);
+    char c;
+    CHECK(read(from_server, &c, 1) == 0, "the connection went on");
+    close(to_server);
+    close(from_server);
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status),
+          "server did not end");
+    matrix_free(none);
+}
+
+int main (void)
+{
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    kernels_init();
+    signal(SIGPIPE, SIG_IGN);
+    pid_t pid = start_server(false);
+    CHECK(pid > 0, "could not start the server");
+    if (pid > 0) {
+        check_ops(&state);
+        check_limit();
+        close(to_server);
+        int status;
+        CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status)
+              && WEXITSTATUS(status) == 0, "server did not end cleanly");
+    }
+    check_overflow();
+    return check_done("server");
+}
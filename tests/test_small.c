@@ -0,0 +1,100 @@
+#include <math.h>
+#include "automatic.h"
+#include "check.h"
+#include "small.h"
+#include "stats.h"
+
+/* The elimination written out for each small size against the general
+ * engines, which take over whenever stats are being counted. */
+
+#define TRIES 200
+
+enum kind { INTEGERS, SPARSE, REALS, SPECIAL, BITS, KINDS };
+
+/* An entry of the given kind: small integers, mostly zeroes, reals,
+ * some infinities and NaNs, or zeroes and ones */
+static double pick (enum kind kind, uint64_t *state)
+{
+    int r = check_int(state, 0, 99);
+    switch (kind) {
+    case INTEGERS:
+        return check_int(state, -9, 9);
+    case SPARSE:
+        return r < 40 ? 0 : check_int(state, -3, 3);
+    case REALS:
+        return check_double(state);
+    case SPECIAL:
+        return r < 2 ? INFINITY : r < 4 ? NAN : r < 40 ? 0 : check_int(state, -2, 2);
+    default:
+        return r < 70 ? 0 : 1;
+    }
+}
+
+/* Bring a matrix to a form with the engine stats_enabled picks */
+static bool solve (struct matrix *m, enum small_form form, bool general)
+{
+    stats_enabled = general;
+    bool success;
+    if (form == SMALL_ECHELON)
+        success = auto_echelon(m, TRACE_QUIET);
+    else if (form == SMALL_REDUCED)
+        success = auto_echelon(m, TRACE_QUIET) && auto_reduced_echelon(m, TRACE_QUIET);
+    else
+        success = auto_gauss_jordan(m, TRACE_QUIET);
+    stats_enabled = false;
+    return success;
+}
+
+/* Check whether two entries are the same bits, or both NaN */
+static bool same_entry (double x, double y)
+{
+    return (isnan(x) && isnan(y)) || memcmp(&x, &y, sizeof(double)) == 0;
+}
+
+static void check_size (int rows, int cols, uint64_t *state)
+{
+    for (int t = 0; t < TRIES; t++) {
+        enum kind kind = t % KINDS;
+        enum small_form form = t / KINDS % 3;
+        struct matrix *small = matrix_create(rows, cols);
+        struct matrix *general = matrix_create(rows, cols);
+        if (small == NULL || general == NULL) {
+            CHECK(false, "could not allocate a %d x %d matrix", rows, cols);
+            matrix_free(small);
+            matrix_free(general);
+            return;
+        }
+
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < cols; j++)
+                MAT(small, i, j) = pick(kind, state);
+        // Make some of them singular
+        if (kind == SPARSE)
+            memcpy(matrix_row(small, rows - 1), matrix_row(small, 0), cols * sizeof(double));
+        for (int i = 0; i < rows; i++)
+            memcpy(matrix_row(general, i), matrix_row(small, i), cols * sizeof(double));
+
+        bool small_ok = solve(small, form, false);
+        bool general_ok = solve(general, form, true);
+        bool same = small_ok == general_ok;
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < cols; j++)
+                same = same && same_entry(MAT(small, i, j), MAT(general, i, j));
+        CHECK(same, "%d x %d, kind %d, form %d", rows, cols, kind, form);
+
+        matrix_free(small);
+        matrix_free(general);
+    }
+}
+
+int main (void)
+{
+    uint64_t state = 2463534242ull;
+    check_quiet();
+    kernels_init();
+    for (int rows = SMALL_MIN_ROWS; rows <= SMALL_MAX_ROWS; rows++) {
+        check_size(rows, rows, &state);
+        check_size(rows, rows + 1, &state);
+    }
+    return check_done("small");
+}